@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "annexb.h"
+#include "rbsp.h"
+#include "common.h"
+#include "nal.h"
+#include "output.h"
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+mp4tree_es_t
+mp4tree_annexb_detect(const char * filename)
+{
+    static const struct
+    {
+        const char * ext;
+        mp4tree_es_t codec;
+    } exts[] =
+    {
+        { ".264",  MP4TREE_ES_H264 },
+        { ".h264", MP4TREE_ES_H264 },
+        { ".avc",  MP4TREE_ES_H264 },
+        { ".265",  MP4TREE_ES_HEVC },
+        { ".h265", MP4TREE_ES_HEVC },
+        { ".hevc", MP4TREE_ES_HEVC },
+    };
+    const char * ext = strrchr(filename, '.');
+    size_t       i;
+
+    if (ext == NULL)
+        return MP4TREE_ES_NONE;
+
+    for (i = 0; i < sizeof(exts) / sizeof(exts[0]); i++)
+    {
+        if (strcasecmp(ext, exts[i].ext) == 0)
+            return exts[i].codec;
+    }
+
+    return MP4TREE_ES_NONE;
+}
+
+
+int
+mp4tree_annexb_print(
+    const uint8_t * p,
+    size_t          len,
+    mp4tree_es_t    codec,
+    int             depth)
+{
+    const char * name  = codec == MP4TREE_ES_HEVC ? "HEVC" : "H264";
+    size_t       start = rbsp_start_code_find(p, len);
+    size_t       skip;
+
+    if (start == len)
+    {
+        out_printf("No start code found\n");
+        return -1;
+    }
+
+    /* leading_zero_8bits are part of the byte stream, anything else is not */
+    for (skip = start; skip > 0 && p[skip - 1] == 0; skip--)
+        ;
+    if (skip > 0)
+        out_printf("Skipped %zu bytes before the first start code\n", skip);
+
+    start += 3;
+
+    while (start < len)
+    {
+        size_t next = start + rbsp_start_code_find(p + start, len - start);
+        size_t end  = next;
+
+        /* Zero bytes before the next start code belong to the byte stream */
+        while (end > start && p[end - 1] == 0)
+            end--;
+
+        out_nal_start(name, p + start, end - start, depth);
+        out_printf("%s--- Offset %zu Length %zu Type: %s NAL\n",
+                   indent(depth, 1), start, end - start, name);
+
+        if (codec == MP4TREE_ES_HEVC)
+        {
+            if (end - start >= 2)
+                mp4tree_box_mdat_hevc_nal_print(p + start, end - start, depth + 1);
+        }
+        else if (end > start)
+        {
+            mp4tree_sei_h264_nal_print(p + start, end - start, depth + 1);
+        }
+        out_nal_end(name, depth);
+
+        if (depth == 0)
+            out_box_done();
+
+        start = next + 3;
+    }
+
+    return 0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              Annex B elementary streams                    *
+ ******************************************************************************
+ *
+ * Raw H.264 and HEVC elementary streams (ITU-T H.264 / H.265 Annex B), as
+ * written to .264 and .265 files, are NAL units each preceded by a 00 00 01
+ * or 00 00 00 01 start code.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "options.h"
+
+
+/* Codec of a file name's extension, MP4TREE_ES_NONE if not an elementary stream */
+mp4tree_es_t
+mp4tree_annexb_detect(const char * filename);
+
+/*
+ * Print every NAL unit of an elementary stream with the NAL unit printer
+ * of the codec. Returns -1 if there is no start code at all.
+ */
+int
+mp4tree_annexb_print(const uint8_t * p, size_t len, mp4tree_es_t codec, int depth);
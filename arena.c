@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+#define ARENA_ALIGN 8
+
+struct arena_block_struct
+{
+    arena_block_t * next;
+    size_t          used;
+    size_t          size;
+    uint64_t        data[];
+};
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+void
+arena_init(arena_t * arena, size_t block_size)
+{
+    arena->head       = NULL;
+    arena->block_size = block_size ? block_size : ARENA_BLOCK_SIZE;
+}
+
+
+void *
+arena_alloc(arena_t * arena, size_t size)
+{
+    arena_block_t * block = arena->head;
+    void *          p;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+    if (block == NULL || block->size - block->used < size)
+    {
+        size_t block_size = arena->block_size;
+
+        /* Oversized allocations get a block of their own */
+        if (size > block_size)
+            block_size = size;
+
+        block = malloc(sizeof(*block) + block_size);
+        if (block == NULL)
+            return NULL;
+
+        block->used = 0;
+        block->size = block_size;
+        block->next = arena->head;
+        arena->head = block;
+    }
+
+    p = (uint8_t *)block->data + block->used;
+    block->used += size;
+
+    memset(p, 0, size);
+    return p;
+}
+
+
+void
+arena_free(arena_t * arena)
+{
+    arena_block_t * block = arena->head;
+
+    while (block != NULL)
+    {
+        arena_block_t * next = block->next;
+        free(block);
+        block = next;
+    }
+
+    arena->head = NULL;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              Arena allocator                               *
+ ******************************************************************************
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+
+/* Default size of each arena block */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct arena_block_struct arena_block_t;
+
+typedef struct arena_struct
+{
+    arena_block_t * head;
+    size_t          block_size;
+} arena_t;
+
+
+/* Initialise an empty arena, block_size 0 selects ARENA_BLOCK_SIZE */
+void
+arena_init(arena_t * arena, size_t block_size);
+
+/* Allocate size bytes, 8 byte aligned and zeroed. NULL on failure */
+void *
+arena_alloc(arena_t * arena, size_t size);
+
+/* Release everything allocated from the arena in one go */
+void
+arena_free(arena_t * arena);
@@ -1,13 +1,17 @@
 #include <string.h>
 #include "atom-desc.h"
+#include "common.h"
 
 struct atom_desc {
-    const char *name;
+    char name[4];
     const char *desc;
     const char *source;
 };
 
+/* Sorted by fourcc byte order for fourcc_lookup() */
 static const struct atom_desc atoms[] = {
+	{ "ID32", "ID3 version 2 container", "id3v2" },
+	{ "UITS", "Unique Identifier Technology Solution", "Universal Music Group" },
 	{ "ainf", "Asset information to identify, license and play", "DECE" },
 	{ "avcn", "AVC NAL Unit Storage Box", "DECE" },
 	{ "bloc", "Base location and purchase location for license acquisition", "DECE" },
@@ -49,7 +53,6 @@ static const struct atom_desc atoms[] = {
 	{ "hmhd", "hint media header, overall information (hint track only)", "ISO" },
 	{ "hpix", "Hipix Rich Picture (user-data or meta-data)", "Hipix" },
 	{ "icnu", "OMA DRM Icon URI", "OMA DRM 2.0" },
-	{ "ID32", "ID3 version 2 container", "id3v2" },
 	{ "idat", "Item data", "ISO" },
 	{ "ihdr", "Image Header", "JPEG2000" },
 	{ "iinf", "item information", "ISO" },
@@ -130,13 +133,13 @@ static const struct atom_desc atoms[] = {
 	{ "sgpd", "Sample group definition box", "ISO" },
 	{ "sidx", "Segment Index Box", "3GPP" },
 	{ "sinf", "protection scheme information box", "ISO" },
+	{ "size", "Edgeware specific box containing segment sizes", "Edgeware" },
 	{ "skip", "free space", "ISO" },
 	{ "smhd", "sound media header, overall information (sound track only)", "ISO" },
 	{ "srmb", "System Renewability Message", "DVB" },
 	{ "srmc", "System Renewability Message container", "DVB" },
 	{ "srpp", "STRP Process", "ISO" },
 	{ "ssix", "Sub-sample index", "ISO" },
-	{ "size", "Edgeware specific box containing segment sizes", "Edgeware" },
 	{ "stbl", "sample table box, container for the time/space map", "ISO" },
 	{ "stco", "chunk offset, partial data-offset information", "ISO" },
 	{ "stdp", "sample degradation priority", "ISO" },
@@ -172,7 +175,6 @@ static const struct atom_desc atoms[] = {
 	{ "trun", "track fragment run", "ISO" },
 	{ "udta", "user-data", "ISO" },
 	{ "uinf", "a tool by which a vendor may provide access to additional information associated with a UUID", "JPEG2000" },
-	{ "UITS", "Unique Identifier Technology Solution", "Universal Music Group" },
 	{ "ulst", "a list of UUID’s", "JPEG2000" },
 	{ "url ", "a URL", "JPEG2000" },
 	{ "uuid", "user-extension box", "ISO" },
@@ -183,11 +185,16 @@ static const struct atom_desc atoms[] = {
 
 const char *get_box_desc(const uint8_t *name)
 {
-    int i;
+    const struct atom_desc *atom;
+
+    atom = fourcc_lookup(atoms, sizeof(atoms) / sizeof(*atoms),
+                         sizeof(*atoms), name);
 
-    for (i = 0; i < sizeof(atoms) / sizeof(*atoms); i++)
-        if (!memcmp(name, atoms[i].name, 4))
-            return atoms[i].desc;
+    return atom ? atom->desc : NULL;
+}
 
-    return NULL;
+bool atom_desc_table_valid(void)
+{
+    return fourcc_table_sorted(atoms, sizeof(atoms) / sizeof(*atoms),
+                               sizeof(*atoms));
 }
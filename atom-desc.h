@@ -1,6 +1,10 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 
 const char *get_box_desc(const uint8_t *type);
 
+/* Check that the description table is sorted for lookup */
+bool atom_desc_table_valid(void);
+
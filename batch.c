@@ -0,0 +1,486 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "common.h"
+#include "mp4tree.h"
+#include "options.h"
+#include "output.h"
+#include "pool.h"
+#include "process.h"
+#include "json.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+/* Files at least this large are split into fragment jobs */
+#define MP4TREE_BATCH_SPLIT_SIZE (64 * 1024 * 1024)
+
+/* Fragment jobs take whole fragments until they hold at least this much */
+#define MP4TREE_BATCH_CHUNK_SIZE (1024 * 1024)
+
+/* Jobs started ahead of the one being written, per thread */
+#define MP4TREE_BATCH_AHEAD 4
+
+typedef struct batch_struct batch_t;
+
+/* A file split into fragment jobs, shared by them */
+typedef struct batch_file_struct
+{
+    mp4tree_input_t input;
+    mp4tree_state_t state;   /* Parser state after the boxes before the fragments */
+    int             refs;    /* Fragment jobs not yet done */
+} batch_file_t;
+
+typedef struct batch_job_struct batch_job_t;
+
+struct batch_job_struct
+{
+    batch_job_t *   next;       /* Next job in output order */
+    batch_t *       batch;
+    char *          filename;   /* File to print, NULL for fragment jobs */
+
+    /* Fragment jobs print the top-level boxes [p, p + len) of file */
+    batch_file_t *  file;
+    const uint8_t * p;
+    size_t          len;
+    bool            first;      /* No box of the file printed before p */
+    bool            last;       /* p + len is the end of the file */
+
+    bool            submitted;  /* Handed to the pool */
+
+    /* Result, valid once done is set */
+    bool            done;
+    int             status;
+    char *          out;
+    size_t          out_len;
+};
+
+struct batch_struct
+{
+    pthread_mutex_t lock;        /* Protects the job list, done flags and refs */
+    pthread_cond_t  cond;        /* Signalled when a job is done */
+    batch_job_t *   tail;
+    pool_t *        pool;
+    mp4tree_state_t init_state;  /* Parser state left by --initseg */
+    off_t           split_size;  /* Smallest file split into fragment jobs */
+    bool            array;       /* The JSON documents of the files form one array */
+    const char *    initseg;     /* Printed before the files, NULL if none */
+};
+
+
+/* Start of the top-level box after the one at p, end if it is the last */
+static const uint8_t *
+batch_box_next(const uint8_t * p, const uint8_t * end)
+{
+    const uint8_t * type;
+    const uint8_t * payload;
+    const uint8_t * next = box_next(p, end, &type, &payload);
+
+    /* Broken and open-ended boxes stay with everything after them */
+    return next != NULL ? next : end;
+}
+
+
+static bool
+batch_box_is_moof(const uint8_t * p, const uint8_t * end)
+{
+    return end - p >= 8 && memcmp(p + 4, "moof", 4) == 0;
+}
+
+
+/* Print the top-level boxes of a fragment job */
+static void
+batch_fragment_print(batch_job_t * job)
+{
+    batch_t *      batch = job->batch;
+    batch_file_t * file  = job->file;
+    bool           release;
+
+    mp4tree_state_set(&file->state);
+    mp4tree_format_resume(job->first);
+
+    out_set_origin(file->input.buf, 0);
+    mp4tree_print(job->p, job->len, 0);
+
+    if (job->last)
+        mp4tree_format_end();
+    else
+        out_set_callbacks(NULL, NULL);
+
+    job->status = EXIT_SUCCESS;
+
+    pthread_mutex_lock(&batch->lock);
+    release = --file->refs == 0;
+    pthread_mutex_unlock(&batch->lock);
+
+    if (release)
+    {
+        mp4tree_input_close(&file->input);
+        free(file);
+    }
+}
+
+
+/*
+ * Print the start of a large file and add its fragments as jobs of their
+ * own, following this one. Only the top-level box headers are read here,
+ * the fragments are printed by the jobs. Returns -1 if the file is not split.
+ */
+static int
+batch_file_split(batch_job_t * job)
+{
+    batch_t *       batch = job->batch;
+    batch_file_t *  file;
+    batch_job_t *   first = NULL;
+    batch_job_t **  link  = &first;
+    batch_job_t *   last  = NULL;
+    const uint8_t * buf;
+    const uint8_t * end;
+    const uint8_t * p;
+    struct stat     st;
+
+    /* Only plain printing of whole mapped files can be split */
+    if (g_options.stream || g_options.path || g_options.index ||
+        mp4tree_process_selects() ||
+        mp4tree_process_es(job->filename) != MP4TREE_ES_NONE ||
+        strcmp(job->filename, "-") == 0 || stat(job->filename, &st) < 0 ||
+        !S_ISREG(st.st_mode) || st.st_size < batch->split_size)
+        return -1;
+
+    file = calloc(1, sizeof(*file));
+    if (file == NULL)
+        return -1;
+
+    if (mp4tree_input_open(job->filename, &file->input) < 0)
+    {
+        free(file);
+        return -1;
+    }
+
+    if (!file->input.mapped)
+    {
+        mp4tree_input_close(&file->input);
+        free(file);
+        return -1;
+    }
+
+    buf = file->input.buf;
+    end = buf + file->input.len;
+
+    /* Everything before the first fragment sets up the state for the rest */
+    for (p = buf; p < end && !batch_box_is_moof(p, end); )
+        p = batch_box_next(p, end);
+
+    mp4tree_format_begin(job->filename);
+    mp4tree_process_prologue(job->filename, &file->input);
+    out_set_origin(buf, 0);
+    mp4tree_print(buf, p - buf, 0);
+
+    /* Shared by the fragment jobs, which only read it */
+    mp4tree_state_get(&file->state);
+
+    if (p == end)
+    {
+        mp4tree_format_end();
+        mp4tree_input_close(&file->input);
+        free(file);
+        return EXIT_SUCCESS;
+    }
+
+    out_set_callbacks(NULL, NULL);
+
+    while (p < end)
+    {
+        const uint8_t * chunk = p;
+
+        /* Small fragments share a job, a fragment is never split */
+        do
+        {
+            p = batch_box_next(p, end);
+        } while (p < end && ((size_t)(p - chunk) < MP4TREE_BATCH_CHUNK_SIZE ||
+                             !batch_box_is_moof(p, end)));
+
+        batch_job_t *   frag  = calloc(1, sizeof(*frag));
+        if (frag == NULL)
+            break;
+
+        frag->batch = batch;
+        frag->file  = file;
+        frag->p     = chunk;
+        frag->len   = p - chunk;
+        frag->first = chunk == buf;
+
+        *link = frag;
+        link  = &frag->next;
+        last  = frag;
+        file->refs++;
+    }
+
+    if (last == NULL)
+    {
+        /* Out of memory, end the output where it is */
+        mp4tree_format_resume(false);
+        mp4tree_format_end();
+        mp4tree_input_close(&file->input);
+        free(file);
+        return EXIT_FAILURE;
+    }
+
+    last->last = true;
+
+    pthread_mutex_lock(&batch->lock);
+    last->next = job->next;
+    job->next  = first;
+    if (batch->tail == job)
+        batch->tail = last;
+    pthread_mutex_unlock(&batch->lock);
+
+    return p == end ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+static void
+batch_job_run(void * arg)
+{
+    batch_job_t * job   = arg;
+    batch_t *     batch = job->batch;
+
+    if (out_capture_begin() < 0)
+    {
+        job->status = EXIT_FAILURE;
+    }
+    else
+    {
+        if (job->file != NULL)
+        {
+            batch_fragment_print(job);
+        }
+        else
+        {
+            mp4tree_state_set(&batch->init_state);
+
+            job->status = batch_file_split(job);
+            if (job->status < 0)
+                job->status = mp4tree_process(job->filename);
+        }
+
+        job->out = out_capture_end(&job->out_len);
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    job->done = true;
+    pthread_cond_broadcast(&batch->cond);
+    pthread_mutex_unlock(&batch->lock);
+}
+
+
+/*
+ * First job in the window of jobs ahead of the writer that still has to be
+ * started. *room is set if the window is not full.
+ */
+static batch_job_t *
+batch_job_next(batch_job_t * head, int window, bool * room)
+{
+    batch_job_t * job;
+    int           n = 0;
+
+    for (job = head; job != NULL && n < window; job = job->next, n++)
+    {
+        if (!job->submitted)
+            return job;
+    }
+
+    *room = n < window;
+    return NULL;
+}
+
+
+static int
+batch_run(batch_t * batch, char ** files, int num_files, int jobs)
+{
+    batch_job_t * head   = NULL;
+    int           next   = 0;
+    bool          more   = true;
+    bool          first  = true;
+    int           status = EXIT_SUCCESS;
+    int           window;
+
+    if (batch->array)
+        mp4tree_json_array_begin();
+
+    /* The init segment is the first item when it is printed */
+    if (batch->initseg != NULL)
+    {
+        if (batch->array && !mp4tree_process_selects())
+        {
+            mp4tree_json_array_next(first);
+            first = false;
+        }
+
+        status = mp4tree_process_initseg(batch->initseg);
+        if (status != EXIT_SUCCESS)
+        {
+            if (batch->array)
+                mp4tree_json_array_end();
+            return status;
+        }
+    }
+
+    batch->pool = pool_create(jobs);
+    if (batch->pool == NULL)
+    {
+        fprintf(stderr, "Failed to start threads\n");
+        if (batch->array)
+            mp4tree_json_array_end();
+        return EXIT_FAILURE;
+    }
+
+    pthread_mutex_init(&batch->lock, NULL);
+    pthread_cond_init(&batch->cond, NULL);
+    mp4tree_state_get(&batch->init_state);
+
+    /* Bounds the output held in memory while waiting for the next job */
+    window = MP4TREE_BATCH_AHEAD * pool_size(batch->pool);
+
+    while (1)
+    {
+        batch_job_t * job;
+
+        /* Start jobs in output order, adding files while there is room */
+        while (1)
+        {
+            bool   room = false;
+            char * filename;
+
+            pthread_mutex_lock(&batch->lock);
+            job = batch_job_next(head, window, &room);
+            if (job != NULL)
+                job->submitted = true;
+            pthread_mutex_unlock(&batch->lock);
+
+            if (job != NULL)
+            {
+                /* Without a worker to take it, the job is run right away */
+                if (pool_submit(batch->pool, batch_job_run, job) < 0)
+                    batch_job_run(job);
+                continue;
+            }
+
+            if (!room || !more)
+                break;
+
+            filename = mp4tree_filename_next(files, num_files, &next);
+            if (filename == NULL)
+            {
+                more = false;
+                break;
+            }
+
+            job = calloc(1, sizeof(*job));
+            if (job == NULL)
+            {
+                fprintf(stderr, "Failed to allocate memory\n");
+                free(filename);
+                more   = false;
+                status = EXIT_FAILURE;
+                break;
+            }
+
+            job->batch    = batch;
+            job->filename = filename;
+
+            pthread_mutex_lock(&batch->lock);
+            if (head == NULL)
+                head = job;
+            else
+                batch->tail->next = job;
+            batch->tail = job;
+            pthread_mutex_unlock(&batch->lock);
+        }
+
+        if (head == NULL)
+            break;
+
+        pthread_mutex_lock(&batch->lock);
+        while (!head->done)
+            pthread_cond_wait(&batch->cond, &batch->lock);
+        job  = head;
+        head = job->next;
+        if (head == NULL)
+            batch->tail = NULL;
+        pthread_mutex_unlock(&batch->lock);
+
+        /* The first job of a file starts its document */
+        if (batch->array && job->filename != NULL && job->out_len > 0)
+        {
+            mp4tree_json_array_next(first);
+            first = false;
+        }
+
+        out_raw_write(job->out, job->out_len);
+        out_box_done();
+
+        if (job->status != EXIT_SUCCESS)
+        {
+            if (job->filename != NULL)
+                fprintf(stderr, "Error parsing %s\n", job->filename);
+            status = EXIT_FAILURE;
+        }
+
+        free(job->out);
+        free(job->filename);
+        free(job);
+    }
+
+    if (batch->array)
+        mp4tree_json_array_end();
+
+    pool_destroy(batch->pool);
+    pthread_cond_destroy(&batch->cond);
+    pthread_mutex_destroy(&batch->lock);
+
+    return status;
+}
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+int
+mp4tree_batch(char ** files, int num_files, int jobs)
+{
+    batch_t batch = {0};
+
+    batch.split_size = MP4TREE_BATCH_SPLIT_SIZE;
+    batch.array      = g_options.format == MP4TREE_FORMAT_JSON;
+    batch.initseg    = g_options.initseg;
+
+    return batch_run(&batch, files, num_files, jobs);
+}
+
+
+int
+mp4tree_parallel(const char * filename, int jobs)
+{
+    batch_t batch = {0};
+    char *  files[1];
+
+    /* Asked for explicitly, so any fragmented file is split */
+    batch.split_size = 0;
+    files[0]         = (char *)filename;
+
+    return batch_run(&batch, files, 1, jobs);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              Batch mode                                    *
+ ******************************************************************************
+ *
+ * Prints many files on a pool of threads. The output of every file is
+ * written as one block, in the order the files were given, as if they had
+ * been printed one after the other.
+ *
+ * Large fragmented files are split: the boxes before the first moof are
+ * printed first, then the fragments are printed in parallel with a copy of
+ * the parser state those boxes left, and written in file order.
+ */
+
+
+/*
+ * Print num_files files, or the files named on the lines of stdin if files
+ * is NULL, on jobs threads (0 for one per online CPU). --initseg is printed
+ * first and the files with the parser state it left. With --format=json the
+ * documents are the items of one array. Returns EXIT_SUCCESS if every file
+ * could be printed.
+ */
+int
+mp4tree_batch(char ** files, int num_files, int jobs);
+
+/* Print a single file, splitting it into fragments printed on jobs threads */
+int
+mp4tree_parallel(const char * filename, int jobs);
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "binary.h"
+#include "common.h"
+#include "output.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+/* Values collected before a samples record is written */
+#define MP4TREE_BIN_SAMPLE_BATCH 8192
+
+#define MP4TREE_BIN_ALIGN(_n) (((_n) + 7) & ~(size_t)7)
+
+static _Thread_local struct
+{
+    const char * table;        /* Table of the pending rows, NULL if none */
+    uint32_t     first_index;
+    uint32_t     rows;
+    uint32_t     columns;
+    int          depth;
+    uint64_t     values[MP4TREE_BIN_SAMPLE_BATCH];
+} bin;
+
+static const uint8_t bin_zero[8];
+
+
+/* Write a record header for payload_len bytes, returns the padding needed */
+static size_t
+bin_record(mp4tree_bin_kind_t kind, int depth, size_t payload_len)
+{
+    uint8_t hdr[MP4TREE_BIN_RECORD_LEN];
+    size_t  len = MP4TREE_BIN_RECORD_LEN + MP4TREE_BIN_ALIGN(payload_len);
+
+    put_le32(hdr, len);
+    put_le16(hdr + 4, kind);
+    put_le16(hdr + 6, depth < 0 ? 0 : depth);
+    out_raw_write((const char *)hdr, sizeof(hdr));
+
+    return MP4TREE_BIN_ALIGN(payload_len) - payload_len;
+}
+
+
+static void
+bin_samples_flush(void)
+{
+    uint8_t  hdr[16];
+    size_t   name_len;
+    size_t   num;
+    size_t   pad;
+
+    if (bin.table == NULL)
+        return;
+
+    name_len = strlen(bin.table);
+    num      = (size_t)bin.rows * bin.columns;
+
+    bin_record(MP4TREE_BIN_SAMPLES, bin.depth,
+               sizeof(hdr) + MP4TREE_BIN_ALIGN(name_len) + num * 8);
+
+    put_le32(hdr,      bin.first_index);
+    put_le32(hdr + 4,  bin.rows);
+    put_le32(hdr + 8,  bin.columns);
+    put_le32(hdr + 12, name_len);
+    out_raw_write((const char *)hdr, sizeof(hdr));
+
+    pad = MP4TREE_BIN_ALIGN(name_len) - name_len;
+    out_raw_write(bin.table, name_len);
+    out_raw_write((const char *)bin_zero, pad);
+
+    /* Already in the right byte order on little-endian hosts */
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    for (size_t i = 0; i < num; i++)
+        put_le64((uint8_t *)&bin.values[i], bin.values[i]);
+#endif
+    out_raw_write((const char *)bin.values, num * 8);
+
+    bin.table = NULL;
+    bin.rows  = 0;
+}
+
+
+/*
+ ******************************************************************************
+ *                            Callbacks                                       *
+ ******************************************************************************
+ */
+
+static void
+bin_box_start(
+    void *          opaque,
+    const uint8_t * type,
+    uint64_t        offset,
+    uint64_t        size,
+    int             depth)
+{
+    uint8_t payload[24] = {0};
+
+    bin_samples_flush();
+
+    put_le64(payload, offset);
+    put_le64(payload + 8, size);
+    memcpy(payload + 16, type, 4);
+
+    bin_record(MP4TREE_BIN_BOX_START, depth, sizeof(payload));
+    out_raw_write((const char *)payload, sizeof(payload));
+}
+
+
+static void
+bin_box_end(
+    void *          opaque,
+    const uint8_t * type,
+    int             depth)
+{
+    uint8_t payload[8] = {0};
+
+    bin_samples_flush();
+
+    memcpy(payload, type, 4);
+
+    bin_record(MP4TREE_BIN_BOX_END, depth, sizeof(payload));
+    out_raw_write((const char *)payload, sizeof(payload));
+}
+
+
+static void
+bin_field(
+    void *       opaque,
+    const char * name,
+    const char * value,
+    int          depth)
+{
+    uint8_t hdr[8];
+    size_t  name_len  = strlen(name);
+    size_t  value_len = strlen(value);
+    size_t  pad;
+
+    bin_samples_flush();
+
+    pad = bin_record(MP4TREE_BIN_FIELD, depth, sizeof(hdr) + name_len + value_len);
+
+    put_le32(hdr, name_len);
+    put_le32(hdr + 4, value_len);
+    out_raw_write((const char *)hdr, sizeof(hdr));
+    out_raw_write(name, name_len);
+    out_raw_write(value, value_len);
+    out_raw_write((const char *)bin_zero, pad);
+}
+
+
+static void
+bin_sample(
+    void *           opaque,
+    const char *     table,
+    uint32_t         index,
+    const uint64_t * values,
+    int              num,
+    int              depth)
+{
+    /* Consecutive rows of one table are packed into a single record */
+    if (bin.table == NULL ||
+        (bin.table != table && strcmp(bin.table, table) != 0) ||
+        bin.columns != (uint32_t)num ||
+        bin.depth != depth ||
+        bin.first_index + bin.rows != index ||
+        (size_t)(bin.rows + 1) * num > MP4TREE_BIN_SAMPLE_BATCH)
+    {
+        bin_samples_flush();
+
+        bin.table       = table;
+        bin.first_index = index;
+        bin.columns     = num;
+        bin.depth       = depth;
+    }
+
+    memcpy(bin.values + (size_t)bin.rows * num, values, num * sizeof(values[0]));
+    bin.rows++;
+}
+
+
+static const mp4tree_callbacks_t bin_callbacks =
+{
+    .box_start = bin_box_start,
+    .box_end   = bin_box_end,
+    .field     = bin_field,
+    .sample    = bin_sample,
+};
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+const mp4tree_callbacks_t *
+mp4tree_bin_callbacks(void)
+{
+    return &bin_callbacks;
+}
+
+
+void
+mp4tree_bin_begin(const char * filename, uint64_t file_size)
+{
+    uint8_t header[MP4TREE_BIN_HEADER_LEN] = MP4TREE_BIN_MAGIC;
+    uint8_t payload[16] = {0};
+    size_t  name_len    = strlen(filename);
+    size_t  pad;
+
+    bin.table = NULL;
+    bin.rows  = 0;
+
+    put_le32(header + 8, MP4TREE_BIN_VERSION);
+    out_raw_write((const char *)header, sizeof(header));
+
+    pad = bin_record(MP4TREE_BIN_FILE, 0, sizeof(payload) + name_len);
+    put_le64(payload, file_size);
+    put_le32(payload + 8, name_len);
+    out_raw_write((const char *)payload, sizeof(payload));
+    out_raw_write(filename, name_len);
+    out_raw_write((const char *)bin_zero, pad);
+}
+
+
+void
+mp4tree_bin_resume(void)
+{
+    bin.table = NULL;
+    bin.rows  = 0;
+}
+
+
+void
+mp4tree_bin_end(void)
+{
+    bin_samples_flush();
+    bin_record(MP4TREE_BIN_END, 0, 0);
+}
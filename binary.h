@@ -0,0 +1,77 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              Binary output                                 *
+ ******************************************************************************
+ *
+ * A stream of length-prefixed records meant to be mapped and walked without
+ * any text parsing. All integers are little-endian and every record starts
+ * on an 8 byte boundary.
+ *
+ * Each file starts with a 16 byte stream header:
+ *
+ *     char     magic[8]       "MP4TBIN\0"
+ *     uint32_t version        MP4TREE_BIN_VERSION
+ *     uint32_t reserved
+ *
+ * followed by records, each starting with an 8 byte record header:
+ *
+ *     uint32_t length         Size of the record including this header,
+ *                             always a multiple of 8
+ *     uint16_t kind           One of mp4tree_bin_kind_t
+ *     uint16_t depth          Tree depth, as passed to the printers
+ *
+ * Records of unknown kind can be skipped using their length. Strings are not
+ * NUL terminated, padding bytes are zero.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "libmp4tree.h"
+
+
+#define MP4TREE_BIN_MAGIC      "MP4TBIN"
+#define MP4TREE_BIN_VERSION    1
+#define MP4TREE_BIN_HEADER_LEN 16
+#define MP4TREE_BIN_RECORD_LEN 8
+
+typedef enum
+{
+    /* uint64_t file_size, uint32_t name_len, uint32_t reserved, name */
+    MP4TREE_BIN_FILE      = 1,
+
+    /* uint64_t offset, uint64_t size, char type[4], uint32_t reserved */
+    MP4TREE_BIN_BOX_START = 2,
+
+    /* char type[4], uint32_t reserved */
+    MP4TREE_BIN_BOX_END   = 3,
+
+    /* uint32_t name_len, uint32_t value_len, name, value */
+    MP4TREE_BIN_FIELD     = 4,
+
+    /* uint32_t first_index, uint32_t rows, uint32_t columns,
+       uint32_t name_len, name padded to 8 bytes, uint64_t values[rows][columns] */
+    MP4TREE_BIN_SAMPLES   = 5,
+
+    /* No payload, ends the records of a file */
+    MP4TREE_BIN_END       = 6
+} mp4tree_bin_kind_t;
+
+
+/* Callbacks writing binary records into the output buffer */
+const mp4tree_callbacks_t *
+mp4tree_bin_callbacks(void);
+
+/* Write the stream header and the file record */
+void
+mp4tree_bin_begin(const char * filename, uint64_t file_size);
+
+/* Continue the records of a file started elsewhere, at a top-level box */
+void
+mp4tree_bin_resume(void);
+
+/* Write any pending samples and the end record */
+void
+mp4tree_bin_end(void);
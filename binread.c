@@ -0,0 +1,340 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "binary.h"
+#include "common.h"
+#include "mp4tree.h"
+#include "options.h"
+#include "output.h"
+
+/*
+ * mp4tree-read, prints the records written by mp4tree --format=binary as the
+ * text tree. Field labels are rebuilt from the field names, so alignment and
+ * the table headers of the text tree are approximated.
+ */
+
+/*
+ ******************************************************************************
+ *                            Record printing                                 *
+ ******************************************************************************
+ */
+
+typedef struct
+{
+    const uint8_t * p;
+    uint32_t        len;
+    uint16_t        kind;
+    uint16_t        depth;
+} bin_record_t;
+
+
+/* Smallest record of a kind that holds its fixed fields */
+static uint32_t
+bin_record_min_len(uint16_t kind)
+{
+    switch (kind)
+    {
+    case MP4TREE_BIN_FILE:
+        return 24;
+    case MP4TREE_BIN_BOX_START:
+        return 32;
+    case MP4TREE_BIN_BOX_END:
+        return 16;
+    case MP4TREE_BIN_FIELD:
+        return 16;
+    case MP4TREE_BIN_SAMPLES:
+        return 24;
+    default:
+        return MP4TREE_BIN_RECORD_LEN;
+    }
+}
+
+
+/*
+ * Fetch the record at pos, returns false if it does not fit the buffer or is
+ * too short for its kind
+ */
+static bool
+bin_record_get(const uint8_t * buf, size_t len, size_t pos, bin_record_t * rec)
+{
+    if (len - pos < MP4TREE_BIN_RECORD_LEN)
+        return false;
+
+    rec->p     = buf + pos;
+    rec->len   = get_le32(rec->p);
+    rec->kind  = get_le16(rec->p + 4);
+    rec->depth = get_le16(rec->p + 6);
+
+    return rec->len >= bin_record_min_len(rec->kind) &&
+           (rec->len & 7) == 0 &&
+           rec->len <= len - pos;
+}
+
+
+/* Width of the widest "name:" in the run of fields starting at pos */
+static int
+bin_field_width(const uint8_t * buf, size_t len, size_t pos, int depth)
+{
+    bin_record_t rec;
+    int          width = 0;
+
+    while (bin_record_get(buf, len, pos, &rec) &&
+           rec.kind == MP4TREE_BIN_FIELD && rec.depth == depth)
+    {
+        int name_len = get_le32(rec.p + 8) + 1;
+
+        if (name_len > width)
+            width = name_len;
+        pos += rec.len;
+    }
+
+    return width + 1;
+}
+
+
+static int
+bin_hex_decode(const char * hex, size_t len, uint8_t * out)
+{
+    size_t i;
+
+    for (i = 0; i + 1 < len; i += 2)
+    {
+        char byte[3] = { hex[i], hex[i + 1], 0 };
+
+        out[i / 2] = strtoul(byte, NULL, 16);
+    }
+
+    return len / 2;
+}
+
+
+static void
+bin_field_print(const bin_record_t * rec, int width)
+{
+    uint32_t     name_len  = get_le32(rec->p + 8);
+    uint32_t     value_len = get_le32(rec->p + 12);
+    const char * name      = (const char *)rec->p + 16;
+    const char * value     = name + name_len;
+
+    if (16 + (uint64_t)name_len + value_len > rec->len)
+        return;
+
+    /* Hexdumps are reported as a Data field */
+    if (name_len == 4 && memcmp(name, "Data", 4) == 0)
+    {
+        uint8_t * data = malloc(value_len / 2 + 1);
+
+        if (data != NULL)
+        {
+            mp4tree_hexdump(data, bin_hex_decode(value, value_len, data), rec->depth);
+            free(data);
+        }
+        return;
+    }
+
+    out_printf("%s  %.*s:%*s%.*s\n", indent(rec->depth, 0),
+               (int)name_len, name, (int)(width - name_len - 1), "",
+               (int)value_len, value);
+}
+
+
+static void
+bin_samples_print(const bin_record_t * rec)
+{
+    uint32_t        first    = get_le32(rec->p + 8);
+    uint32_t        rows     = get_le32(rec->p + 12);
+    uint32_t        columns  = get_le32(rec->p + 16);
+    uint32_t        name_len = get_le32(rec->p + 20);
+    uint64_t        name_end = 24 + (((uint64_t)name_len + 7) & ~7ull);
+    const uint8_t * values;
+    const char *    prefix   = indent(rec->depth, 0);
+    uint32_t        i;
+    uint32_t        j;
+
+    if (name_end > rec->len || (uint64_t)rows * columns > (rec->len - name_end) / 8)
+        return;
+
+    values = rec->p + name_end;
+
+    if (first == 0)
+        out_printf("%s  %.*s:\n", prefix, (int)name_len, (const char *)rec->p + 24);
+
+    for (i = 0; i < rows; i++)
+    {
+        out_write(prefix, strlen(prefix));
+        out_write("      ", 6);
+        out_uint(first + i + 1, 3);
+        out_write(":", 1);
+        for (j = 0; j < columns; j++)
+        {
+            out_write("   ", 3);
+            out_uint(get_le64(values), 6);
+            values += 8;
+        }
+        out_write("\n", 1);
+    }
+}
+
+
+/* Print the records of one file starting at pos, returns the end position */
+static size_t
+bin_file_print(const uint8_t * buf, size_t len, size_t pos)
+{
+    bin_record_t rec;
+    int          width       = 0;
+    int          width_depth = 0;
+
+    while (bin_record_get(buf, len, pos, &rec))
+    {
+        switch (rec.kind)
+        {
+        case MP4TREE_BIN_FILE:
+        {
+            uint64_t size     = get_le64(rec.p + 8);
+            uint32_t name_len = get_le32(rec.p + 16);
+
+            if (24 + (uint64_t)name_len > rec.len)
+                break;
+
+            if (name_len == 1 && rec.p[24] == '-')
+            {
+                out_printf("Reading stream\n");
+            }
+            else
+            {
+                out_printf("Reading file %.*s\n", (int)name_len, (const char *)rec.p + 24);
+                out_printf("Read %llu bytes \n", (unsigned long long)size);
+            }
+            out_printf("File Content:\n");
+            break;
+        }
+        case MP4TREE_BIN_BOX_START:
+            mp4tree_box_print(rec.p + 24, get_le64(rec.p + 16), rec.depth);
+            width = 0;
+            break;
+        case MP4TREE_BIN_FIELD:
+            if (width == 0 || width_depth != rec.depth)
+            {
+                width       = bin_field_width(buf, len, pos, rec.depth);
+                width_depth = rec.depth;
+            }
+            bin_field_print(&rec, width);
+            break;
+        case MP4TREE_BIN_SAMPLES:
+            bin_samples_print(&rec);
+            break;
+        case MP4TREE_BIN_BOX_END:
+            if (rec.depth == 0)
+                out_box_done();
+            break;
+        case MP4TREE_BIN_END:
+            return pos + rec.len;
+        default:
+            /* Newer record kinds are skipped */
+            break;
+        }
+
+        if (rec.kind != MP4TREE_BIN_FIELD)
+            width = 0;
+
+        pos += rec.len;
+    }
+
+    if (pos != len)
+    {
+        fprintf(stderr, "Corrupt record at offset %zu\n", pos);
+        return 0;
+    }
+
+    return pos;
+}
+
+
+static int
+bin_print(const uint8_t * buf, size_t len)
+{
+    size_t pos = 0;
+
+    while (pos < len)
+    {
+        uint32_t version;
+
+        if (len - pos < MP4TREE_BIN_HEADER_LEN ||
+            memcmp(buf + pos, MP4TREE_BIN_MAGIC, sizeof(MP4TREE_BIN_MAGIC)) != 0)
+        {
+            fprintf(stderr, "Not an mp4tree binary stream at offset %zu\n", pos);
+            return -1;
+        }
+
+        version = get_le32(buf + pos + 8);
+        if (version != MP4TREE_BIN_VERSION)
+        {
+            fprintf(stderr, "Unsupported binary stream version %u\n", version);
+            return -1;
+        }
+
+        pos = bin_file_print(buf, len, pos + MP4TREE_BIN_HEADER_LEN);
+        if (pos == 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ ******************************************************************************
+ *                           Main functionality                               *
+ ******************************************************************************
+ */
+
+int
+main(int argc, char **argv)
+{
+    struct stat st;
+    void *      buf;
+    int         fd;
+    int         status;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s FILE\n", argv[0]);
+        fprintf(stderr, " Print the output of mp4tree --format=binary as text.\n");
+        return EXIT_FAILURE;
+    }
+
+    fd = open(argv[1], O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        fprintf(stderr, "Failed to open %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    if (st.st_size == 0)
+        return EXIT_SUCCESS;
+
+    buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (buf == MAP_FAILED)
+    {
+        fprintf(stderr, "Failed to map %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    atexit(out_flush);
+
+    /* Dumps were already truncated when the stream was written */
+    g_options.truncate = INT32_MAX;
+
+    status = bin_print(buf, st.st_size);
+    munmap(buf, st.st_size);
+
+    return status < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              Bit reader                                    *
+ ******************************************************************************
+ *
+ * MSB-first reader for NAL unit payloads. Up to 64 bits are cached in a
+ * register and refilled with a single unaligned load, Exp-Golomb codes are
+ * decoded with a count leading zeros instruction. Reads never go past the
+ * end of the buffer: they return zero bits and set the error flag instead,
+ * so a decoder only needs to check the flag once when it is done.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+
+typedef struct bits_struct
+{
+    const uint8_t * p;       /* Next byte to load into the cache */
+    const uint8_t * end;
+    uint64_t        cache;   /* Unread bits, MSB first */
+    int             num;     /* Number of valid bits in the cache */
+    bool            error;   /* Read past the end or invalid code */
+} bits_t;
+
+
+static inline uint64_t
+bits_load_be64(const uint8_t * p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+
+static inline void
+bits_refill(bits_t * b)
+{
+    if (b->end - b->p >= 8)
+    {
+        /* Partly loaded bytes are loaded again next time, at the same bits */
+        int n = (63 - b->num) >> 3;
+
+        b->cache |= bits_load_be64(b->p) >> b->num;
+        b->p     += n;
+        b->num   += n * 8;
+    }
+    else
+    {
+        while (b->num <= 56 && b->p < b->end)
+        {
+            b->cache |= (uint64_t)*b->p++ << (56 - b->num);
+            b->num   += 8;
+        }
+    }
+}
+
+
+static inline void
+bits_init(bits_t * b, const uint8_t * p, size_t len)
+{
+    b->p     = p;
+    b->end   = p + len;
+    b->cache = 0;
+    b->num   = 0;
+    b->error = false;
+}
+
+
+/* Read n bits, 0 <= n <= 32 */
+static inline uint32_t
+bits_read(bits_t * b, int n)
+{
+    uint32_t v;
+
+    if (n == 0)
+        return 0;
+
+    if (b->num < n)
+    {
+        bits_refill(b);
+
+        /* Out of data, the cache is zero past the last byte */
+        if (b->num < n)
+        {
+            b->error = true;
+            b->num   = n;
+        }
+    }
+
+    v = b->cache >> (64 - n);
+    b->cache <<= n;
+    b->num    -= n;
+    return v;
+}
+
+
+static inline bool
+bits_read_flag(bits_t * b)
+{
+    return bits_read(b, 1);
+}
+
+
+static inline void
+bits_skip(bits_t * b, size_t n)
+{
+    while (n > 32)
+    {
+        bits_read(b, 32);
+        n -= 32;
+    }
+    bits_read(b, n);
+}
+
+
+/* Unsigned Exp-Golomb code, ue(v) */
+static inline uint32_t
+bits_read_ue(bits_t * b)
+{
+    int zeros;
+
+    if (b->num < 32)
+        bits_refill(b);
+
+    zeros = b->cache ? __builtin_clzll(b->cache) : 64;
+
+    /* Codes are at most 32 zeros long, a 1 must follow within the data */
+    if (zeros > 31 || zeros >= b->num)
+    {
+        b->error = true;
+        b->cache = 0;
+        b->num   = 0;
+        b->p     = b->end;
+        return 0;
+    }
+
+    b->cache <<= zeros + 1;
+    b->num    -= zeros + 1;
+
+    return ((1u << zeros) - 1) + bits_read(b, zeros);
+}
+
+
+/* Signed Exp-Golomb code, se(v) */
+static inline int32_t
+bits_read_se(bits_t * b)
+{
+    uint32_t k = bits_read_ue(b);
+
+    return (k & 1) ? (int32_t)((k >> 1) + 1) : -(int32_t)(k >> 1);
+}
+
+
+/* Number of bits read so far, from p of bits_init() */
+static inline size_t
+bits_pos(const bits_t * b, const uint8_t * start)
+{
+    return (size_t)(b->p - start) * 8 - b->num;
+}
+
+
+/* Number of bits left to read */
+static inline size_t
+bits_left(const bits_t * b)
+{
+    return (size_t)(b->end - b->p) * 8 + b->num;
+}
+
+
+static inline bool
+bits_byte_aligned(const bits_t * b)
+{
+    return (b->num & 7) == 0;
+}
@@ -2,26 +2,31 @@
 #include <string.h>
 
 #include "common.h"
+#include "output.h"
+
+/* Deepest indentation level, deeper boxes are printed at this level */
+#define INDENT_MAX 32
+
+#define INDENT_4   "|  |  |  |  "
+#define INDENT_32  INDENT_4 INDENT_4 INDENT_4 INDENT_4 \
+                   INDENT_4 INDENT_4 INDENT_4 INDENT_4
+
+/* Every indentation is a suffix of one of these */
+static const char indent_body[]   = INDENT_32;
+static const char indent_header[] = INDENT_32 "+";
 
 const char *
 indent(int depth, int header)
 {
-    static char buf[64];
-    int i = 0;
-
-    memset(buf, 0 , sizeof buf);
-
-    for (i = 0; i < depth; i++)
-    {
-        strcat(buf, "|  ");
-    }
+    if (depth < 0)
+        depth = 0;
+    else if (depth > INDENT_MAX)
+        depth = INDENT_MAX;
 
     if (header)
-        strcat(buf, "+");
-    else
-        strcat(buf, "");
+        return indent_header + 3 * (INDENT_MAX - depth);
 
-    return buf;
+    return indent_body + 3 * (INDENT_MAX - depth);
 }
 
 inline uint16_t
@@ -56,6 +61,45 @@ get_u64(const uint8_t * p)
             (uint64_t) p[7];
 }
 
+inline uint16_t
+get_le16(const uint8_t * p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+inline uint32_t
+get_le32(const uint8_t * p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline uint64_t
+get_le64(const uint8_t * p)
+{
+    return get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+inline void
+put_le16(uint8_t * p, uint16_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+}
+
+inline void
+put_le32(uint8_t * p, uint32_t value)
+{
+    put_le16(p, value);
+    put_le16(p + 2, value >> 16);
+}
+
+inline void
+put_le64(uint8_t * p, uint64_t value)
+{
+    put_le32(p, value);
+    put_le32(p + 4, value >> 32);
+}
+
 const char *
 get_pascal_string(const uint8_t * p)
 {
@@ -64,46 +108,105 @@ get_pascal_string(const uint8_t * p)
     return (char *)p + 1;
 }
 
-uint8_t
-get_bit(const uint8_t * p, int n)
+void
+print_hex(const uint8_t * buf, uint32_t num)
 {
-
-    return (p[n/8] & (1 << (7-(n % 8)))) ? 1 : 0;
+    uint32_t pos = 0;
+    while (pos < num)
+    {
+        out_printf("%.2x", buf[pos++]);
+    }
 }
 
-uint32_t
-get_exp_golomb(const uint8_t *p, uint32_t * bit)
+const void *
+fourcc_lookup(const void * table, size_t num, size_t size, const uint8_t * type)
 {
-    int      leading_zero_bits = 0;
-    int      i;
-    int      j;
-    uint32_t v = 0;
+    const uint8_t * base = table;
+    const uint32_t  key  = get_u32(type);
 
-    for (i = *bit; 1; i++)
+    if (num == 0)
+        return NULL;
+
+    /* Branchless lower bound, the ternary compiles to a conditional move */
+    while (num > 1)
     {
+        const size_t half = num / 2;
 
-        if (get_bit(p, i) == 0)
-            leading_zero_bits++;
-        else
-            break;
+        base = get_u32(base + half * size) <= key ? base + half * size : base;
+        num -= half;
     }
 
-    for (j = 0; j < leading_zero_bits; j++)
+    return get_u32(base) == key ? base : NULL;
+}
+
+bool
+fourcc_table_sorted(const void * table, size_t num, size_t size)
+{
+    const uint8_t * p = table;
+    size_t          i;
+
+    for (i = 1; i < num; i++)
     {
-        v |= get_bit(p, i + j + 1) << (leading_zero_bits -j -1);
+        if (get_u32(p + (i - 1) * size) >= get_u32(p + i * size))
+            return false;
     }
 
-    *bit += 2 * leading_zero_bits + 1;
-    return (1 << leading_zero_bits) - 1 + v;
+    return true;
 }
 
-void
-print_hex(const uint8_t * buf, uint32_t num)
+const uint8_t *
+box_next(
+    const uint8_t *  p,
+    const uint8_t *  end,
+    const uint8_t ** type,
+    const uint8_t ** payload)
 {
-    uint32_t pos = 0;
-    while (pos < num)
+    uint64_t len;
+    size_t   hdr_len = 8;
+
+    if (p == NULL || end - p < 8)
+        return NULL;
+
+    len = get_u32(p);
+    if (len == 1)
     {
-        printf("%.2x", buf[pos++]);
+        if (end - p < 16)
+            return NULL;
+        len     = get_u64(p + 8);
+        hdr_len = 16;
     }
+    else if (len == 0)
+    {
+        len = end - p;
+    }
+
+    if (len < hdr_len || len > (uint64_t)(end - p))
+        return NULL;
+
+    *type    = p + 4;
+    *payload = p + hdr_len;
+    return p + len;
 }
 
+const uint8_t *
+box_find(
+    const uint8_t *  p,
+    const uint8_t *  end,
+    const char *     type,
+    const uint8_t ** payload,
+    const uint8_t ** box_end)
+{
+    const uint8_t * box_type;
+    const uint8_t * next;
+
+    for (; (next = box_next(p, end, &box_type, payload)) != NULL; p = next)
+    {
+        if (memcmp(box_type, type, 4) == 0)
+        {
+            *box_end = next;
+            return p;
+        }
+    }
+
+    return NULL;
+}
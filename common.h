@@ -2,6 +2,7 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 const char *
 indent(int depth, int header);
@@ -18,14 +19,55 @@ get_u32(const uint8_t * p);
 uint64_t
 get_u64(const uint8_t * p);
 
-const char *
-get_pascal_string(const uint8_t * p);
+/* Little-endian accessors, used by the binary output format */
+uint16_t
+get_le16(const uint8_t * p);
 
 uint32_t
-get_exp_golomb(const uint8_t *p, uint32_t * bit);
+get_le32(const uint8_t * p);
+
+uint64_t
+get_le64(const uint8_t * p);
+
+void
+put_le16(uint8_t * p, uint16_t value);
+
+void
+put_le32(uint8_t * p, uint32_t value);
+
+void
+put_le64(uint8_t * p, uint64_t value);
+
+const char *
+get_pascal_string(const uint8_t * p);
 
 void
 print_hex(const uint8_t * buf, uint32_t num);
 
-uint8_t
-get_bit(const uint8_t * p, int n);
+/*
+ * Find the entry for a box type in a table whose entries start with a
+ * char[4] fourcc and are sorted in fourcc byte order. NULL if not found.
+ */
+const void *
+fourcc_lookup(const void * table, size_t num, size_t size, const uint8_t * type);
+
+/* Check that a fourcc table is strictly sorted */
+bool
+fourcc_table_sorted(const void * table, size_t num, size_t size);
+
+/*
+ * Type and payload of the box at p, which ends before end. Returns the end
+ * of the box, NULL if there is no complete box at p. A box of size 0 runs
+ * to end.
+ */
+const uint8_t *
+box_next(const uint8_t * p, const uint8_t * end, const uint8_t ** type,
+         const uint8_t ** payload);
+
+/*
+ * First box of a type among the boxes from p to end, NULL if there is none
+ * before a broken box or end. Its payload and end are returned.
+ */
+const uint8_t *
+box_find(const uint8_t * p, const uint8_t * end, const char * type,
+         const uint8_t ** payload, const uint8_t ** box_end);
@@ -0,0 +1,688 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "h264.h"
+#include "bits.h"
+#include "rbsp.h"
+#include "common.h"
+#include "nal.h"
+#include "mp4tree.h"
+#include "output.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+/* Per thread like the rest of the parser state */
+static _Thread_local mp4tree_h264_state_t h264;
+
+
+static mp4tree_h264_track_t *
+h264_track_current(void)
+{
+    if (h264.current < h264.num_tracks)
+        return &h264.tracks[h264.current];
+
+    return NULL;
+}
+
+
+/* Find the cache of a track, creating it if asked to */
+static mp4tree_h264_track_t *
+h264_track_find(uint32_t track_id, bool create)
+{
+    mp4tree_h264_track_t * track;
+    int                    i;
+
+    for (i = 0; i < h264.num_tracks; i++)
+    {
+        if (h264.tracks[i].track_id == track_id)
+        {
+            h264.current = i;
+            return &h264.tracks[i];
+        }
+    }
+
+    if (!create)
+        return NULL;
+
+    if (h264.num_tracks < MP4TREE_H264_TRACKS)
+    {
+        i = h264.num_tracks++;
+    }
+    else
+    {
+        i = h264.oldest;
+        h264.oldest = (h264.oldest + 1) % MP4TREE_H264_TRACKS;
+    }
+
+    track = &h264.tracks[i];
+    memset(track, 0, sizeof(*track));
+    track->track_id        = track_id;
+    track->nal_length_size = 4;
+
+    h264.current = i;
+    return track;
+}
+
+
+static const char *
+h264_profile_name(uint8_t profile_idc)
+{
+    switch (profile_idc)
+    {
+    case 66:  return "Baseline";
+    case 77:  return "Main";
+    case 88:  return "Extended";
+    case 100: return "High";
+    case 110: return "High 10";
+    case 122: return "High 4:2:2";
+    case 244: return "High 4:4:4 Predictive";
+    case 44:  return "CAVLC 4:4:4 Intra";
+    case 83:  return "Scalable Baseline";
+    case 86:  return "Scalable High";
+    case 118: return "Multiview High";
+    case 128: return "Stereo High";
+    default:  return "Unknown";
+    }
+}
+
+
+static const char *
+h264_chroma_name(uint8_t chroma_format_idc)
+{
+    static const char * names[] = { "4:0:0", "4:2:0", "4:2:2", "4:4:4" };
+
+    return chroma_format_idc < 4 ? names[chroma_format_idc] : "Unknown";
+}
+
+
+/* Profiles whose SPS carries chroma format and bit depths */
+static bool
+h264_profile_has_chroma_info(uint8_t profile_idc)
+{
+    switch (profile_idc)
+    {
+    case 100: case 110: case 122: case 244: case 44:
+    case 83:  case 86:  case 118: case 128: case 138:
+    case 139: case 134: case 135:
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+static void
+h264_scaling_list_skip(bits_t * b, int size)
+{
+    int last = 8;
+    int next = 8;
+    int j;
+
+    for (j = 0; j < size; j++)
+    {
+        if (next != 0)
+            next = (last + bits_read_se(b) + 256) % 256;
+        if (next != 0)
+            last = next;
+    }
+}
+
+
+/* True if there is more data before the rbsp_trailing_bits() */
+static bool
+h264_more_rbsp_data(const bits_t * b, const uint8_t * p, size_t len)
+{
+    size_t stop;
+
+    /* The stop bit is the last bit set in the RBSP */
+    while (len > 0 && p[len - 1] == 0)
+        len--;
+    if (len == 0)
+        return false;
+
+    stop = len * 8 - 1 - __builtin_ctz(p[len - 1]);
+    return bits_pos(b, p) < stop;
+}
+
+
+/* Get the RBSP after the one byte NAL unit header */
+static const uint8_t *
+h264_rbsp(rbsp_t * rbsp, const uint8_t * p, size_t len, size_t * rbsp_len)
+{
+    if (len < 2)
+        return NULL;
+
+    rbsp_set(rbsp, p + 1, len - 1);
+    return rbsp_data(rbsp, rbsp_len);
+}
+
+
+static bool
+h264_sps_parse(const uint8_t * p, size_t len, mp4tree_h264_sps_t * sps, unsigned int * id)
+{
+    bits_t   b;
+    uint32_t width_mbs;
+    uint32_t height_units;
+    uint32_t crop[4] = {0};
+    uint32_t crop_x  = 1;
+    uint32_t crop_y;
+    int      i;
+
+    memset(sps, 0, sizeof(*sps));
+    bits_init(&b, p, len);
+
+    sps->profile_idc       = bits_read(&b, 8);
+    sps->constraint_flags  = bits_read(&b, 8);
+    sps->level_idc         = bits_read(&b, 8);
+    *id                    = bits_read_ue(&b);
+    sps->chroma_format_idc = 1;
+    sps->bit_depth_luma    = 8;
+    sps->bit_depth_chroma  = 8;
+
+    if (*id >= MP4TREE_H264_SPS_MAX)
+        return false;
+
+    if (h264_profile_has_chroma_info(sps->profile_idc))
+    {
+        sps->chroma_format_idc = bits_read_ue(&b);
+        if (sps->chroma_format_idc == 3)
+            sps->separate_colour_plane = bits_read_flag(&b);
+        sps->bit_depth_luma   = 8 + bits_read_ue(&b);
+        sps->bit_depth_chroma = 8 + bits_read_ue(&b);
+        bits_read_flag(&b);    /* qpprime_y_zero_transform_bypass_flag */
+
+        if (bits_read_flag(&b))
+        {
+            for (i = 0; i < (sps->chroma_format_idc != 3 ? 8 : 12); i++)
+            {
+                if (bits_read_flag(&b))
+                    h264_scaling_list_skip(&b, i < 6 ? 16 : 64);
+            }
+        }
+    }
+
+    sps->log2_max_frame_num = 4 + bits_read_ue(&b);
+    sps->pic_order_cnt_type = bits_read_ue(&b);
+
+    if (sps->pic_order_cnt_type == 0)
+    {
+        sps->log2_max_poc_lsb = 4 + bits_read_ue(&b);
+    }
+    else if (sps->pic_order_cnt_type == 1)
+    {
+        uint32_t cycle;
+
+        sps->delta_pic_order_always_zero = bits_read_flag(&b);
+        bits_read_se(&b);      /* offset_for_non_ref_pic */
+        bits_read_se(&b);      /* offset_for_top_to_bottom_field */
+        cycle = bits_read_ue(&b);
+        if (cycle > 255)
+            return false;
+        while (cycle--)
+            bits_read_se(&b);
+    }
+
+    sps->max_num_ref_frames = bits_read_ue(&b);
+    bits_read_flag(&b);        /* gaps_in_frame_num_value_allowed_flag */
+    width_mbs    = bits_read_ue(&b) + 1;
+    height_units = bits_read_ue(&b) + 1;
+
+    sps->frame_mbs_only = bits_read_flag(&b);
+    if (!sps->frame_mbs_only)
+        bits_read_flag(&b);    /* mb_adaptive_frame_field_flag */
+    bits_read_flag(&b);        /* direct_8x8_inference_flag */
+
+    if (bits_read_flag(&b))
+    {
+        for (i = 0; i < 4; i++)
+            crop[i] = bits_read_ue(&b);
+    }
+
+    /* Crop units depend on the chroma subsampling, 7.4.2.1.1 */
+    crop_y = 2 - sps->frame_mbs_only;
+    if (!sps->separate_colour_plane && sps->chroma_format_idc != 0)
+    {
+        crop_x  = sps->chroma_format_idc == 3 ? 1 : 2;
+        crop_y *= sps->chroma_format_idc == 1 ? 2 : 1;
+    }
+
+    sps->width  = width_mbs * 16 - crop_x * (crop[0] + crop[1]);
+    sps->height = (2 - sps->frame_mbs_only) * height_units * 16 -
+                  crop_y * (crop[2] + crop[3]);
+
+    /* VUI up to the timing info, HRD parameters are not needed */
+    if (bits_read_flag(&b))
+    {
+        if (bits_read_flag(&b))
+        {
+            static const uint8_t sar[17][2] =
+            {
+                {0, 0}, {1, 1}, {12, 11}, {10, 11}, {16, 11}, {40, 33},
+                {24, 11}, {20, 11}, {32, 11}, {80, 33}, {18, 11}, {15, 11},
+                {64, 33}, {160, 99}, {4, 3}, {3, 2}, {2, 1}
+            };
+            uint8_t idc = bits_read(&b, 8);
+
+            if (idc == 255)
+            {
+                sps->sar_width  = bits_read(&b, 16);
+                sps->sar_height = bits_read(&b, 16);
+            }
+            else if (idc < 17)
+            {
+                sps->sar_width  = sar[idc][0];
+                sps->sar_height = sar[idc][1];
+            }
+        }
+
+        if (bits_read_flag(&b))
+            bits_read_flag(&b);    /* overscan_appropriate_flag */
+
+        if (bits_read_flag(&b))
+        {
+            bits_read(&b, 3);      /* video_format */
+            sps->full_range = bits_read_flag(&b);
+            if (bits_read_flag(&b))
+            {
+                sps->colour_primaries         = bits_read(&b, 8);
+                sps->transfer_characteristics = bits_read(&b, 8);
+                sps->matrix_coefficients      = bits_read(&b, 8);
+            }
+        }
+
+        if (bits_read_flag(&b))
+        {
+            bits_read_ue(&b);      /* chroma_sample_loc_type_top_field */
+            bits_read_ue(&b);      /* chroma_sample_loc_type_bottom_field */
+        }
+
+        if (bits_read_flag(&b))
+        {
+            sps->num_units_in_tick = bits_read(&b, 32);
+            sps->time_scale        = bits_read(&b, 32);
+        }
+    }
+
+    return !b.error;
+}
+
+
+static bool
+h264_pps_parse(const uint8_t * p, size_t len, mp4tree_h264_pps_t * pps, unsigned int * id)
+{
+    const mp4tree_h264_sps_t * sps;
+    bits_t                     b;
+    uint32_t                   groups;
+    uint32_t                   i;
+
+    memset(pps, 0, sizeof(*pps));
+    bits_init(&b, p, len);
+
+    *id = bits_read_ue(&b);
+    i   = bits_read_ue(&b);
+    if (*id >= MP4TREE_H264_PPS_MAX || i >= MP4TREE_H264_SPS_MAX)
+        return false;
+
+    pps->sps_id                                  = i;
+    pps->entropy_coding_mode                     = bits_read_flag(&b);
+    pps->bottom_field_pic_order_in_frame_present = bits_read_flag(&b);
+
+    groups = bits_read_ue(&b) + 1;
+    if (groups > 8)
+        return false;
+    pps->num_slice_groups = groups;
+
+    if (groups > 1)
+    {
+        uint32_t map_type = bits_read_ue(&b);
+
+        if (map_type == 0)
+        {
+            for (i = 0; i < groups; i++)
+                bits_read_ue(&b);          /* run_length_minus1 */
+        }
+        else if (map_type == 2)
+        {
+            for (i = 0; i + 1 < groups; i++)
+            {
+                bits_read_ue(&b);          /* top_left */
+                bits_read_ue(&b);          /* bottom_right */
+            }
+        }
+        else if (map_type >= 3 && map_type <= 5)
+        {
+            bits_read_flag(&b);            /* slice_group_change_direction_flag */
+            bits_read_ue(&b);              /* slice_group_change_rate_minus1 */
+        }
+        else if (map_type == 6)
+        {
+            uint32_t units = bits_read_ue(&b) + 1;
+            int      bits  = 32 - __builtin_clz(groups - 1);
+
+            if (units > bits_left(&b))
+                return false;
+            bits_skip(&b, (size_t)units * bits);
+        }
+    }
+
+    pps->num_ref_idx_l0_default_active     = bits_read_ue(&b) + 1;
+    pps->num_ref_idx_l1_default_active     = bits_read_ue(&b) + 1;
+    pps->weighted_pred                     = bits_read_flag(&b);
+    pps->weighted_bipred_idc               = bits_read(&b, 2);
+    pps->pic_init_qp                       = 26 + bits_read_se(&b);
+    bits_read_se(&b);                      /* pic_init_qs_minus26 */
+    pps->chroma_qp_index_offset            = bits_read_se(&b);
+    pps->deblocking_filter_control_present = bits_read_flag(&b);
+    pps->constrained_intra_pred            = bits_read_flag(&b);
+    pps->redundant_pic_cnt_present         = bits_read_flag(&b);
+
+    if (h264_more_rbsp_data(&b, p, len))
+    {
+        int lists;
+
+        pps->transform_8x8_mode = bits_read_flag(&b);
+
+        /* The number of lists depends on the chroma format of the SPS */
+        sps   = mp4tree_h264_sps_get(pps->sps_id);
+        lists = 6 + ((sps && sps->chroma_format_idc == 3) ? 6 : 2) * pps->transform_8x8_mode;
+
+        if (bits_read_flag(&b))
+        {
+            for (i = 0; i < lists; i++)
+            {
+                if (bits_read_flag(&b))
+                    h264_scaling_list_skip(&b, i < 6 ? 16 : 64);
+            }
+        }
+        bits_read_se(&b);                  /* second_chroma_qp_index_offset */
+    }
+
+    return !b.error;
+}
+
+
+static void
+h264_sps_fields_print(const mp4tree_h264_sps_t * sps, unsigned int id, int depth)
+{
+    out_field(depth, "Profile:              ", "%u (%s)", sps->profile_idc,
+              h264_profile_name(sps->profile_idc));
+    out_field(depth, "Constraint flags:     ", "0x%.2x", sps->constraint_flags);
+    out_field(depth, "Level:                ", "%u.%u", sps->level_idc / 10, sps->level_idc % 10);
+    out_field(depth, "SPS ID:               ", "%u", id);
+    out_field(depth, "Chroma format:        ", "%u (%s)", sps->chroma_format_idc,
+              h264_chroma_name(sps->chroma_format_idc));
+    out_field(depth, "Bit depth:            ", "%u/%u", sps->bit_depth_luma, sps->bit_depth_chroma);
+    out_field(depth, "Max frame num:        ", "2^%u", sps->log2_max_frame_num);
+    out_field(depth, "POC type:             ", "%u", sps->pic_order_cnt_type);
+    if (sps->pic_order_cnt_type == 0)
+        out_field(depth, "Max POC LSB:          ", "2^%u", sps->log2_max_poc_lsb);
+    out_field(depth, "Max ref frames:       ", "%u", sps->max_num_ref_frames);
+    out_field(depth, "Frame MBs only:       ", "%u", sps->frame_mbs_only);
+    out_field(depth, "Resolution:           ", "%ux%u", sps->width, sps->height);
+
+    if (sps->sar_width)
+        out_field(depth, "Sample aspect ratio:  ", "%u:%u", sps->sar_width, sps->sar_height);
+    if (sps->colour_primaries)
+        out_field(depth, "Colour:               ", "primaries %u transfer %u matrix %u%s",
+                  sps->colour_primaries, sps->transfer_characteristics,
+                  sps->matrix_coefficients, sps->full_range ? " full range" : "");
+    if (sps->time_scale && sps->num_units_in_tick)
+        out_field(depth, "Timing:               ", "%u/%u (%.3f fps)",
+                  sps->num_units_in_tick, sps->time_scale,
+                  sps->time_scale / (2.0 * sps->num_units_in_tick));
+}
+
+
+static void
+h264_pps_fields_print(const mp4tree_h264_pps_t * pps, unsigned int id, int depth)
+{
+    out_field(depth, "PPS ID:               ", "%u", id);
+    out_field(depth, "SPS ID:               ", "%u", pps->sps_id);
+    out_field(depth, "Entropy coding:       ", "%s", pps->entropy_coding_mode ? "CABAC" : "CAVLC");
+    out_field(depth, "Slice groups:         ", "%u", pps->num_slice_groups);
+    out_field(depth, "Ref idx default:      ", "%u/%u", pps->num_ref_idx_l0_default_active,
+              pps->num_ref_idx_l1_default_active);
+    out_field(depth, "Weighted pred:        ", "%u/%u", pps->weighted_pred, pps->weighted_bipred_idc);
+    out_field(depth, "Init QP:              ", "%d", pps->pic_init_qp);
+    out_field(depth, "Chroma QP offset:     ", "%d", pps->chroma_qp_index_offset);
+    out_field(depth, "Deblocking control:   ", "%u", pps->deblocking_filter_control_present);
+    out_field(depth, "Constrained intra:    ", "%u", pps->constrained_intra_pred);
+    out_field(depth, "Transform 8x8:        ", "%u", pps->transform_8x8_mode);
+}
+
+
+/* Print the parameter set NAL units of avcC, returns the bytes used or 0 */
+static size_t
+h264_avcc_nals_print(const uint8_t * p, const uint8_t * end, unsigned int num, int depth)
+{
+    const uint8_t * start = p;
+
+    while (num--)
+    {
+        uint16_t nal_len;
+
+        if (end - p < 2)
+            return 0;
+
+        nal_len = get_u16(p);
+        p += 2;
+        if (nal_len == 0 || nal_len > end - p)
+            return 0;
+
+        out_nal_start("H264", p, nal_len, depth);
+        out_printf("%s--- Length %u Type: H264 NAL\n", indent(depth, 1), nal_len);
+        mp4tree_sei_h264_nal_print(p, nal_len, depth + 1);
+        out_nal_end("H264", depth);
+        p += nal_len;
+    }
+
+    return p - start;
+}
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+void
+mp4tree_h264_avcc_print(
+    const uint8_t * p,
+    size_t          len,
+    int             depth,
+    uint32_t        track_id)
+{
+    const uint8_t *        end = p + len;
+    mp4tree_h264_track_t * track;
+    uint8_t                profile;
+    size_t                 n;
+
+    /*
+     * aligned(8) class AVCDecoderConfigurationRecord {
+     *     unsigned int(8) configurationVersion = 1;
+     *     unsigned int(8) AVCProfileIndication;
+     *     unsigned int(8) profile_compatibility;
+     *     unsigned int(8) AVCLevelIndication;
+     *     bit(6) reserved = '111111'b;
+     *     unsigned int(2) lengthSizeMinusOne;
+     *     bit(3) reserved = '111'b;
+     *     unsigned int(5) numOfSequenceParameterSets;
+     *     ...
+     */
+    if (len < 7)
+    {
+        mp4tree_hexdump(p, len, depth);
+        return;
+    }
+
+    track = h264_track_find(track_id, true);
+    track->nal_length_size = (p[4] & 0x03) + 1;
+    profile = p[1];
+
+    out_field(depth, "Version:              ", "%u", p[0]);
+    out_field(depth, "Profile:              ", "%u (%s)", p[1], h264_profile_name(p[1]));
+    out_field(depth, "Compatibility:        ", "0x%.2x", p[2]);
+    out_field(depth, "Level:                ", "%u.%u", p[3] / 10, p[3] % 10);
+    out_field(depth, "NAL length size:      ", "%u", track->nal_length_size);
+
+    out_field(depth, "Num SPS:              ", "%u", p[5] & 0x1f);
+    n = h264_avcc_nals_print(p + 6, end, p[5] & 0x1f, depth);
+    if (n == 0 && (p[5] & 0x1f))
+        return;
+    p += 6 + n;
+
+    if (p >= end)
+        return;
+
+    out_field(depth, "Num PPS:              ", "%u", p[0]);
+    n = h264_avcc_nals_print(p + 1, end, p[0], depth);
+    if (n == 0 && p[0])
+        return;
+    p += 1 + n;
+
+    /* High profiles repeat the chroma format and bit depths */
+    if (end - p >= 4 && h264_profile_has_chroma_info(profile))
+    {
+        out_field(depth, "Chroma format:        ", "%u (%s)", p[0] & 0x03,
+                  h264_chroma_name(p[0] & 0x03));
+        out_field(depth, "Bit depth:            ", "%u/%u", (p[1] & 0x07) + 8, (p[2] & 0x07) + 8);
+        out_field(depth, "Num SPS Ext:          ", "%u", p[3]);
+        h264_avcc_nals_print(p + 4, end, p[3], depth);
+    }
+}
+
+
+void
+mp4tree_h264_track_select(uint32_t track_id)
+{
+    /* Parameter sets of the track before this one must not apply to it */
+    if (h264_track_find(track_id, false) == NULL)
+        h264.current = MP4TREE_H264_TRACKS;
+    h264.selected = track_id;
+}
+
+
+int
+mp4tree_h264_nal_length_size(void)
+{
+    const mp4tree_h264_track_t * track = h264_track_current();
+
+    return track ? track->nal_length_size : 4;
+}
+
+
+void
+mp4tree_h264_sps_print(const uint8_t * p, size_t len, int depth)
+{
+    mp4tree_h264_track_t * track = h264_track_current();
+    mp4tree_h264_sps_t     sps;
+    rbsp_t                 rbsp;
+    const uint8_t *        data;
+    size_t                 data_len;
+    unsigned int           id;
+    bool                   ok;
+
+    rbsp_init(&rbsp);
+    data = h264_rbsp(&rbsp, p, len, &data_len);
+    ok   = data != NULL && h264_sps_parse(data, data_len, &sps, &id);
+    rbsp_free(&rbsp);
+
+    if (!ok)
+    {
+        mp4tree_hexdump(p, len, depth);
+        return;
+    }
+
+    h264_sps_fields_print(&sps, id, depth);
+
+    /* SPS before any avcC, e.g. in an elementary stream, go to the selected track */
+    if (track == NULL)
+        track = h264_track_find(h264.selected, true);
+
+    track->sps[id]    = sps;
+    track->sps_valid |= 1u << id;
+}
+
+
+void
+mp4tree_h264_pps_print(const uint8_t * p, size_t len, int depth)
+{
+    mp4tree_h264_track_t * track = h264_track_current();
+    mp4tree_h264_pps_t     pps;
+    rbsp_t                 rbsp;
+    const uint8_t *        data;
+    size_t                 data_len;
+    unsigned int           id;
+    bool                   ok;
+
+    rbsp_init(&rbsp);
+    data = h264_rbsp(&rbsp, p, len, &data_len);
+    ok   = data != NULL && h264_pps_parse(data, data_len, &pps, &id);
+    rbsp_free(&rbsp);
+
+    if (!ok)
+    {
+        mp4tree_hexdump(p, len, depth);
+        return;
+    }
+
+    h264_pps_fields_print(&pps, id, depth);
+
+    if (track == NULL)
+        track = h264_track_find(h264.selected, true);
+
+    track->pps[id]             = pps;
+    track->pps_valid[id / 64] |= 1ull << (id % 64);
+}
+
+
+const mp4tree_h264_sps_t *
+mp4tree_h264_sps_get(unsigned int id)
+{
+    const mp4tree_h264_track_t * track = h264_track_current();
+
+    if (track == NULL || id >= MP4TREE_H264_SPS_MAX || !(track->sps_valid & (1u << id)))
+        return NULL;
+
+    return &track->sps[id];
+}
+
+
+const mp4tree_h264_pps_t *
+mp4tree_h264_pps_get(unsigned int id)
+{
+    const mp4tree_h264_track_t * track = h264_track_current();
+
+    if (track == NULL || id >= MP4TREE_H264_PPS_MAX ||
+        !(track->pps_valid[id / 64] & (1ull << (id % 64))))
+        return NULL;
+
+    return &track->pps[id];
+}
+
+
+void
+mp4tree_h264_state_get(mp4tree_h264_state_t * state)
+{
+    *state = h264;
+}
+
+
+void
+mp4tree_h264_state_set(const mp4tree_h264_state_t * state)
+{
+    h264 = *state;
+}
+
+
+void
+mp4tree_h264_reset(void)
+{
+    memset(&h264, 0, sizeof(h264));
+}
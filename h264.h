@@ -0,0 +1,132 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              H.264 parameter sets                          *
+ ******************************************************************************
+ *
+ * Decoding of the avcC configuration and of SPS/PPS NAL units (ISO/IEC
+ * 14496-15 5.3.3, ITU-T H.264 7.3.2). Decoded parameter sets are cached per
+ * track, keyed by their id, together with the NAL unit length size the
+ * samples of the track are written with.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* Tracks with cached parameter sets, further tracks replace the oldest */
+#define MP4TREE_H264_TRACKS 4
+
+#define MP4TREE_H264_SPS_MAX 32
+#define MP4TREE_H264_PPS_MAX 256
+
+typedef struct mp4tree_h264_sps_struct
+{
+    uint8_t  profile_idc;
+    uint8_t  constraint_flags;
+    uint8_t  level_idc;
+    uint8_t  chroma_format_idc;
+    uint8_t  bit_depth_luma;
+    uint8_t  bit_depth_chroma;
+    uint8_t  log2_max_frame_num;
+    uint8_t  pic_order_cnt_type;
+    uint8_t  log2_max_poc_lsb;
+    uint8_t  max_num_ref_frames;
+    bool     separate_colour_plane;
+    bool     frame_mbs_only;
+    bool     delta_pic_order_always_zero;
+    uint32_t width;                  /* Cropped picture size in pixels */
+    uint32_t height;
+
+    /* VUI, zero when absent */
+    uint16_t sar_width;
+    uint16_t sar_height;
+    bool     full_range;
+    uint8_t  colour_primaries;
+    uint8_t  transfer_characteristics;
+    uint8_t  matrix_coefficients;
+    uint32_t num_units_in_tick;
+    uint32_t time_scale;
+} mp4tree_h264_sps_t;
+
+typedef struct mp4tree_h264_pps_struct
+{
+    uint8_t  sps_id;
+    bool     entropy_coding_mode;    /* CABAC */
+    bool     bottom_field_pic_order_in_frame_present;
+    bool     weighted_pred;
+    uint8_t  weighted_bipred_idc;
+    uint8_t  num_slice_groups;
+    uint8_t  num_ref_idx_l0_default_active;
+    uint8_t  num_ref_idx_l1_default_active;
+    int8_t   pic_init_qp;
+    int8_t   chroma_qp_index_offset;
+    bool     deblocking_filter_control_present;
+    bool     constrained_intra_pred;
+    bool     redundant_pic_cnt_present;
+    bool     transform_8x8_mode;
+} mp4tree_h264_pps_t;
+
+/* Parameter sets of one track */
+typedef struct mp4tree_h264_track_struct
+{
+    uint32_t           track_id;
+    uint8_t            nal_length_size;
+    uint32_t           sps_valid;    /* Bit per seq_parameter_set_id */
+    uint64_t           pps_valid[MP4TREE_H264_PPS_MAX / 64];
+    mp4tree_h264_sps_t sps[MP4TREE_H264_SPS_MAX];
+    mp4tree_h264_pps_t pps[MP4TREE_H264_PPS_MAX];
+} mp4tree_h264_track_t;
+
+/* The cache, part of the parser state, see mp4tree_state_get() */
+typedef struct mp4tree_h264_state_struct
+{
+    int                  num_tracks;
+    int                  current;    /* Track NAL units are printed for, if < num_tracks */
+    uint32_t             selected;   /* Its track_ID, also when it has no cache yet */
+    int                  oldest;
+    mp4tree_h264_track_t tracks[MP4TREE_H264_TRACKS];
+} mp4tree_h264_state_t;
+
+
+/* Print avcC and cache its parameter sets for track_id */
+void
+mp4tree_h264_avcc_print(const uint8_t * p, size_t len, int depth, uint32_t track_id);
+
+/*
+ * Make track_id the track NAL units are printed for. Without an avcC it has
+ * no cache until parameter sets are printed for it.
+ */
+void
+mp4tree_h264_track_select(uint32_t track_id);
+
+/* NAL unit length size of the current track, 4 if unknown */
+int
+mp4tree_h264_nal_length_size(void);
+
+/* Print an SPS NAL unit, including its header, and cache it */
+void
+mp4tree_h264_sps_print(const uint8_t * p, size_t len, int depth);
+
+/* Print a PPS NAL unit, including its header, and cache it */
+void
+mp4tree_h264_pps_print(const uint8_t * p, size_t len, int depth);
+
+/* Cached parameter sets of the current track, NULL if not seen */
+const mp4tree_h264_sps_t *
+mp4tree_h264_sps_get(unsigned int id);
+
+const mp4tree_h264_pps_t *
+mp4tree_h264_pps_get(unsigned int id);
+
+void
+mp4tree_h264_state_get(mp4tree_h264_state_t * state);
+
+void
+mp4tree_h264_state_set(const mp4tree_h264_state_t * state);
+
+/* Forget the parameter sets of every track */
+void
+mp4tree_h264_reset(void);
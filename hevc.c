@@ -0,0 +1,1020 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "hevc.h"
+#include "bits.h"
+#include "rbsp.h"
+#include "common.h"
+#include "nal.h"
+#include "mp4tree.h"
+#include "output.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+/* Per thread like the rest of the parser state */
+static _Thread_local mp4tree_hevc_state_t hevc;
+
+
+static mp4tree_hevc_track_t *
+hevc_track_current(void)
+{
+    if (hevc.current < hevc.num_tracks)
+        return &hevc.tracks[hevc.current];
+
+    return NULL;
+}
+
+
+/* Find the cache of a track, creating it if asked to */
+static mp4tree_hevc_track_t *
+hevc_track_find(uint32_t track_id, bool create)
+{
+    mp4tree_hevc_track_t * track;
+    int                    i;
+
+    for (i = 0; i < hevc.num_tracks; i++)
+    {
+        if (hevc.tracks[i].track_id == track_id)
+        {
+            hevc.current = i;
+            return &hevc.tracks[i];
+        }
+    }
+
+    if (!create)
+        return NULL;
+
+    if (hevc.num_tracks < MP4TREE_HEVC_TRACKS)
+    {
+        i = hevc.num_tracks++;
+    }
+    else
+    {
+        i = hevc.oldest;
+        hevc.oldest = (hevc.oldest + 1) % MP4TREE_HEVC_TRACKS;
+    }
+
+    track = &hevc.tracks[i];
+    memset(track, 0, sizeof(*track));
+    track->track_id        = track_id;
+    track->nal_length_size = 4;
+
+    hevc.current = i;
+    return track;
+}
+
+
+/*
+ * Parameter sets seen before any hvcC, e.g. in an elementary stream, go to
+ * the selected track
+ */
+static mp4tree_hevc_track_t *
+hevc_track_for_nal(void)
+{
+    mp4tree_hevc_track_t * track = hevc_track_current();
+
+    return track ? track : hevc_track_find(hevc.selected, true);
+}
+
+
+/* FNV-1a of the escaped NAL unit, cheaper than unescaping and decoding it */
+static uint64_t
+hevc_hash(const uint8_t * p, size_t len)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+    size_t   i;
+
+    for (i = 0; i < len; i++)
+        hash = (hash ^ p[i]) * 0x100000001b3ull;
+
+    return hash;
+}
+
+
+/* Remember the bytes a parameter set was decoded from, if short enough */
+static void
+hevc_key_set(mp4tree_hevc_key_t * key, const uint8_t * p, size_t len, uint64_t hash)
+{
+    key->hash = hash;
+    key->len  = len;
+    if (len <= MP4TREE_HEVC_KEY_MAX)
+        memcpy(key->bytes, p, len);
+}
+
+
+/* Id of the cached parameter set decoded from the same bytes, or -1 */
+static int
+hevc_key_find(const mp4tree_hevc_key_t * keys, uint64_t valid,
+              const uint8_t * p, size_t len, uint64_t hash)
+{
+    if (len > MP4TREE_HEVC_KEY_MAX)
+        return -1;
+
+    while (valid)
+    {
+        int id = __builtin_ctzll(valid);
+
+        /* The hash rejects most, the bytes confirm a hit */
+        if (keys[id].hash == hash && keys[id].len == len &&
+            memcmp(keys[id].bytes, p, len) == 0)
+            return id;
+        valid &= valid - 1;
+    }
+
+    return -1;
+}
+
+
+static const char *
+hevc_profile_name(uint8_t profile_idc)
+{
+    switch (profile_idc)
+    {
+    case 1:  return "Main";
+    case 2:  return "Main 10";
+    case 3:  return "Main Still Picture";
+    case 4:  return "Range Extensions";
+    case 5:  return "High Throughput";
+    case 6:  return "Multiview Main";
+    case 7:  return "Scalable Main";
+    case 8:  return "3D Main";
+    case 9:  return "Screen Content";
+    case 10: return "Scalable Range Extensions";
+    case 11: return "High Throughput Screen Content";
+    default: return "Unknown";
+    }
+}
+
+
+static const char *
+hevc_chroma_name(uint8_t chroma_format_idc)
+{
+    static const char * names[] = { "4:0:0", "4:2:0", "4:2:2", "4:4:4" };
+
+    return chroma_format_idc < 4 ? names[chroma_format_idc] : "Unknown";
+}
+
+
+static const char *
+hevc_nal_type_name(uint8_t type)
+{
+    switch (type)
+    {
+    case 32: return "VPS";
+    case 33: return "SPS";
+    case 34: return "PPS";
+    case 39: return "PREFIX SEI";
+    case 40: return "SUFFIX SEI";
+    default: return "Other";
+    }
+}
+
+
+/* profile_tier_level(1, max_sub_layers_minus1), 7.3.3 */
+static void
+hevc_ptl_parse(bits_t * b, mp4tree_hevc_ptl_t * ptl, int max_sub_layers_minus1)
+{
+    bool sub_profile[8];
+    bool sub_level[8];
+    int  i;
+
+    ptl->profile_space       = bits_read(b, 2);
+    ptl->tier                = bits_read_flag(b);
+    ptl->profile_idc         = bits_read(b, 5);
+    ptl->compatibility_flags = bits_read(b, 32);
+    ptl->constraint_flags    = (uint64_t)bits_read(b, 16) << 32;
+    ptl->constraint_flags   |= bits_read(b, 32);
+    ptl->level_idc           = bits_read(b, 8);
+
+    for (i = 0; i < max_sub_layers_minus1; i++)
+    {
+        sub_profile[i] = bits_read_flag(b);
+        sub_level[i]   = bits_read_flag(b);
+    }
+
+    if (max_sub_layers_minus1 > 0)
+        bits_skip(b, 2 * (8 - max_sub_layers_minus1));
+
+    for (i = 0; i < max_sub_layers_minus1; i++)
+    {
+        if (sub_profile[i])
+            bits_skip(b, 88);
+        if (sub_level[i])
+            bits_skip(b, 8);
+    }
+}
+
+
+/* Skip scaling_list_data(), 7.3.4 */
+static void
+hevc_scaling_list_skip(bits_t * b)
+{
+    int size_id;
+    int matrix_id;
+    int i;
+
+    for (size_id = 0; size_id < 4; size_id++)
+    {
+        for (matrix_id = 0; matrix_id < 6; matrix_id += (size_id == 3) ? 3 : 1)
+        {
+            int coefs = 1 << (4 + (size_id << 1));
+
+            if (!bits_read_flag(b))
+            {
+                bits_read_ue(b);           /* scaling_list_pred_matrix_id_delta */
+                continue;
+            }
+
+            if (coefs > 64)
+                coefs = 64;
+            if (size_id > 1)
+                bits_read_se(b);           /* scaling_list_dc_coef_minus8 */
+            for (i = 0; i < coefs && !b->error; i++)
+                bits_read_se(b);
+        }
+    }
+}
+
+
+/* Skip st_ref_pic_set(idx), 7.3.7, keeping NumDeltaPocs of each set */
+static bool
+hevc_st_ref_pic_set_skip(bits_t * b, int idx, uint8_t * num_delta_pocs)
+{
+    uint32_t num_negative;
+    uint32_t num_positive;
+    uint32_t i;
+
+    if (idx != 0 && bits_read_flag(b))
+    {
+        /* inter_ref_pic_set_prediction_flag, delta_idx_minus1 is only in slice headers */
+        int ref  = idx - 1;
+        int used = 0;
+
+        bits_read_flag(b);                 /* delta_rps_sign */
+        bits_read_ue(b);                   /* abs_delta_rps_minus1 */
+
+        for (i = 0; i <= num_delta_pocs[ref]; i++)
+        {
+            /* use_delta_flag is inferred to be 1 for pictures used by the current one */
+            if (bits_read_flag(b) || bits_read_flag(b))
+                used++;
+        }
+
+        if (used > 16)
+            return false;
+
+        num_delta_pocs[idx] = used;
+        return !b->error;
+    }
+
+    num_negative = bits_read_ue(b);
+    num_positive = bits_read_ue(b);
+    if (num_negative > 16 || num_positive > 16 - num_negative)
+        return false;
+
+    for (i = 0; i < num_negative + num_positive; i++)
+    {
+        bits_read_ue(b);                   /* delta_poc_sX_minus1 */
+        bits_read_flag(b);                 /* used_by_curr_pic_sX_flag */
+    }
+
+    num_delta_pocs[idx] = num_negative + num_positive;
+    return !b->error;
+}
+
+
+/* vui_parameters() up to the timing info, E.2.1 */
+static void
+hevc_vui_parse(bits_t * b, mp4tree_hevc_sps_t * sps)
+{
+    if (bits_read_flag(b))
+    {
+        static const uint8_t sar[17][2] =
+        {
+            {0, 0}, {1, 1}, {12, 11}, {10, 11}, {16, 11}, {40, 33},
+            {24, 11}, {20, 11}, {32, 11}, {80, 33}, {18, 11}, {15, 11},
+            {64, 33}, {160, 99}, {4, 3}, {3, 2}, {2, 1}
+        };
+        uint8_t idc = bits_read(b, 8);
+
+        if (idc == 255)
+        {
+            sps->sar_width  = bits_read(b, 16);
+            sps->sar_height = bits_read(b, 16);
+        }
+        else if (idc < 17)
+        {
+            sps->sar_width  = sar[idc][0];
+            sps->sar_height = sar[idc][1];
+        }
+    }
+
+    if (bits_read_flag(b))
+        bits_read_flag(b);                 /* overscan_appropriate_flag */
+
+    if (bits_read_flag(b))
+    {
+        bits_read(b, 3);                   /* video_format */
+        sps->full_range = bits_read_flag(b);
+        if (bits_read_flag(b))
+        {
+            sps->colour_primaries         = bits_read(b, 8);
+            sps->transfer_characteristics = bits_read(b, 8);
+            sps->matrix_coefficients      = bits_read(b, 8);
+        }
+    }
+
+    if (bits_read_flag(b))
+    {
+        bits_read_ue(b);                   /* chroma_sample_loc_type_top_field */
+        bits_read_ue(b);                   /* chroma_sample_loc_type_bottom_field */
+    }
+
+    bits_read_flag(b);                     /* neutral_chroma_indication_flag */
+    bits_read_flag(b);                     /* field_seq_flag */
+    bits_read_flag(b);                     /* frame_field_info_present_flag */
+
+    if (bits_read_flag(b))
+    {
+        bits_read_ue(b);                   /* default_display_window offsets */
+        bits_read_ue(b);
+        bits_read_ue(b);
+        bits_read_ue(b);
+    }
+
+    if (bits_read_flag(b))
+    {
+        sps->num_units_in_tick = bits_read(b, 32);
+        sps->time_scale        = bits_read(b, 32);
+    }
+}
+
+
+static bool
+hevc_vps_parse(const uint8_t * p, size_t len, mp4tree_hevc_vps_t * vps, unsigned int * id)
+{
+    bits_t b;
+
+    memset(vps, 0, sizeof(*vps));
+    bits_init(&b, p, len);
+
+    *id                      = bits_read(&b, 4);
+    bits_read(&b, 2);                      /* base_layer_internal/available */
+    vps->max_layers          = bits_read(&b, 6) + 1;
+    vps->max_sub_layers      = bits_read(&b, 3) + 1;
+    vps->temporal_id_nesting = bits_read_flag(&b);
+    bits_read(&b, 16);                     /* vps_reserved_0xffff_16bits */
+
+    if (vps->max_sub_layers > 7)
+        return false;
+
+    hevc_ptl_parse(&b, &vps->ptl, vps->max_sub_layers - 1);
+
+    /* Timing info is after the layer sets, which are just flags */
+    {
+        uint32_t first = bits_read_flag(&b) ? 0 : vps->max_sub_layers - 1;
+        uint32_t max_layer_id;
+        uint32_t num_layer_sets;
+        uint32_t i;
+
+        for (i = first; i < vps->max_sub_layers; i++)
+        {
+            bits_read_ue(&b);              /* vps_max_dec_pic_buffering_minus1 */
+            bits_read_ue(&b);              /* vps_max_num_reorder_pics */
+            bits_read_ue(&b);              /* vps_max_latency_increase_plus1 */
+        }
+
+        max_layer_id   = bits_read(&b, 6);
+        num_layer_sets = bits_read_ue(&b) + 1;
+        if (num_layer_sets > 1024)
+            return false;
+        bits_skip(&b, (size_t)(num_layer_sets - 1) * (max_layer_id + 1));
+
+        if (bits_read_flag(&b))
+        {
+            vps->num_units_in_tick = bits_read(&b, 32);
+            vps->time_scale        = bits_read(&b, 32);
+        }
+    }
+
+    return !b.error;
+}
+
+
+static bool
+hevc_sps_parse(const uint8_t * p, size_t len, mp4tree_hevc_sps_t * sps, unsigned int * id)
+{
+    uint8_t  num_delta_pocs[64];
+    bits_t   b;
+    uint32_t width;
+    uint32_t height;
+    uint32_t crop[4] = {0};
+    uint32_t sub_width  = 1;
+    uint32_t sub_height = 1;
+    uint32_t i;
+
+    memset(sps, 0, sizeof(*sps));
+    bits_init(&b, p, len);
+
+    sps->vps_id         = bits_read(&b, 4);
+    sps->max_sub_layers = bits_read(&b, 3) + 1;
+    bits_read_flag(&b);                    /* sps_temporal_id_nesting_flag */
+
+    if (sps->max_sub_layers > 7)
+        return false;
+
+    hevc_ptl_parse(&b, &sps->ptl, sps->max_sub_layers - 1);
+
+    *id = bits_read_ue(&b);
+    sps->chroma_format_idc = bits_read_ue(&b);
+    if (*id >= MP4TREE_HEVC_SPS_MAX || sps->chroma_format_idc > 3)
+        return false;
+
+    if (sps->chroma_format_idc == 3)
+        sps->separate_colour_plane = bits_read_flag(&b);
+
+    width  = bits_read_ue(&b);
+    height = bits_read_ue(&b);
+
+    if (bits_read_flag(&b))
+    {
+        for (i = 0; i < 4; i++)
+            crop[i] = bits_read_ue(&b);
+    }
+
+    /* Conformance window units depend on the chroma subsampling, Table 6-1 */
+    if (!sps->separate_colour_plane)
+    {
+        sub_width  = (sps->chroma_format_idc == 1 || sps->chroma_format_idc == 2) ? 2 : 1;
+        sub_height = sps->chroma_format_idc == 1 ? 2 : 1;
+    }
+
+    sps->width            = width  - sub_width  * (crop[0] + crop[1]);
+    sps->height           = height - sub_height * (crop[2] + crop[3]);
+    sps->bit_depth_luma   = 8 + bits_read_ue(&b);
+    sps->bit_depth_chroma = 8 + bits_read_ue(&b);
+    sps->log2_max_poc_lsb = 4 + bits_read_ue(&b);
+
+    for (i = bits_read_flag(&b) ? 0 : sps->max_sub_layers - 1; i < sps->max_sub_layers; i++)
+    {
+        bits_read_ue(&b);                  /* sps_max_dec_pic_buffering_minus1 */
+        bits_read_ue(&b);                  /* sps_max_num_reorder_pics */
+        bits_read_ue(&b);                  /* sps_max_latency_increase_plus1 */
+    }
+
+    sps->log2_min_cb_size = 3 + bits_read_ue(&b);
+    sps->log2_ctb_size    = sps->log2_min_cb_size + bits_read_ue(&b);
+    if (sps->log2_min_cb_size > 6 || sps->log2_ctb_size > 6)
+        return false;
+    bits_read_ue(&b);                      /* log2_min_luma_transform_block_size_minus2 */
+    bits_read_ue(&b);                      /* log2_diff_max_min_luma_transform_block_size */
+    bits_read_ue(&b);                      /* max_transform_hierarchy_depth_inter */
+    bits_read_ue(&b);                      /* max_transform_hierarchy_depth_intra */
+
+    sps->scaling_list_enabled = bits_read_flag(&b);
+    if (sps->scaling_list_enabled && bits_read_flag(&b))
+        hevc_scaling_list_skip(&b);
+
+    sps->amp = bits_read_flag(&b);
+    sps->sao = bits_read_flag(&b);
+    sps->pcm = bits_read_flag(&b);
+    if (sps->pcm)
+    {
+        bits_read(&b, 8);                  /* pcm sample bit depths */
+        bits_read_ue(&b);                  /* log2_min_pcm_luma_coding_block_size_minus3 */
+        bits_read_ue(&b);                  /* log2_diff_max_min_pcm_luma_coding_block_size */
+        bits_read_flag(&b);                /* pcm_loop_filter_disabled_flag */
+    }
+
+    i = bits_read_ue(&b);
+    if (i > 64)
+        return false;
+    sps->num_short_term_ref_pic_sets = i;
+
+    for (i = 0; i < sps->num_short_term_ref_pic_sets; i++)
+    {
+        if (!hevc_st_ref_pic_set_skip(&b, i, num_delta_pocs))
+            return false;
+    }
+
+    sps->long_term_ref_pics = bits_read_flag(&b);
+    if (sps->long_term_ref_pics)
+    {
+        uint32_t num = bits_read_ue(&b);
+
+        if (num > 32)
+            return false;
+        bits_skip(&b, (size_t)num * (sps->log2_max_poc_lsb + 1));
+    }
+
+    sps->temporal_mvp           = bits_read_flag(&b);
+    sps->strong_intra_smoothing = bits_read_flag(&b);
+
+    if (bits_read_flag(&b))
+        hevc_vui_parse(&b, sps);
+
+    return !b.error;
+}
+
+
+static bool
+hevc_pps_parse(const uint8_t * p, size_t len, mp4tree_hevc_pps_t * pps, unsigned int * id)
+{
+    bits_t   b;
+    uint32_t i;
+
+    memset(pps, 0, sizeof(*pps));
+    bits_init(&b, p, len);
+
+    *id = bits_read_ue(&b);
+    i   = bits_read_ue(&b);
+    if (*id >= MP4TREE_HEVC_PPS_MAX || i >= MP4TREE_HEVC_SPS_MAX)
+        return false;
+
+    pps->sps_id                        = i;
+    pps->dependent_slice_segments      = bits_read_flag(&b);
+    bits_read_flag(&b);                    /* output_flag_present_flag */
+    bits_read(&b, 3);                      /* num_extra_slice_header_bits */
+    pps->sign_data_hiding              = bits_read_flag(&b);
+    pps->cabac_init_present            = bits_read_flag(&b);
+    pps->num_ref_idx_l0_default_active = bits_read_ue(&b) + 1;
+    pps->num_ref_idx_l1_default_active = bits_read_ue(&b) + 1;
+    pps->init_qp                       = 26 + bits_read_se(&b);
+    bits_read_flag(&b);                    /* constrained_intra_pred_flag */
+    bits_read_flag(&b);                    /* transform_skip_enabled_flag */
+
+    pps->cu_qp_delta = bits_read_flag(&b);
+    if (pps->cu_qp_delta)
+        pps->diff_cu_qp_delta_depth = bits_read_ue(&b);
+
+    pps->cb_qp_offset        = bits_read_se(&b);
+    pps->cr_qp_offset        = bits_read_se(&b);
+    bits_read_flag(&b);                    /* pps_slice_chroma_qp_offsets_present_flag */
+    pps->weighted_pred       = bits_read_flag(&b);
+    pps->weighted_bipred     = bits_read_flag(&b);
+    pps->transquant_bypass   = bits_read_flag(&b);
+    pps->tile_columns        = 1;
+    pps->tile_rows           = 1;
+
+    if (bits_read_flag(&b))
+    {
+        uint32_t columns;
+        uint32_t rows;
+
+        pps->entropy_coding_sync = bits_read_flag(&b);
+        columns = bits_read_ue(&b) + 1;
+        rows    = bits_read_ue(&b) + 1;
+        if (columns > 64 || rows > 64)
+            return false;
+        pps->tile_columns = columns;
+        pps->tile_rows    = rows;
+
+        if (!bits_read_flag(&b))
+        {
+            /* Explicit sizes of all but the last column and row */
+            for (i = 0; i + 2 < columns + rows; i++)
+                bits_read_ue(&b);
+        }
+        bits_read_flag(&b);                /* loop_filter_across_tiles_enabled_flag */
+    }
+    else
+    {
+        pps->entropy_coding_sync = bits_read_flag(&b);
+    }
+
+    pps->loop_filter_across_slices         = bits_read_flag(&b);
+    pps->deblocking_filter_control_present = bits_read_flag(&b);
+    if (pps->deblocking_filter_control_present)
+    {
+        bits_read_flag(&b);                /* deblocking_filter_override_enabled_flag */
+        pps->deblocking_filter_disabled = bits_read_flag(&b);
+        if (!pps->deblocking_filter_disabled)
+        {
+            bits_read_se(&b);              /* pps_beta_offset_div2 */
+            bits_read_se(&b);              /* pps_tc_offset_div2 */
+        }
+    }
+
+    if (bits_read_flag(&b))
+        hevc_scaling_list_skip(&b);
+
+    bits_read_flag(&b);                    /* lists_modification_present_flag */
+    pps->log2_parallel_merge_level = 2 + bits_read_ue(&b);
+
+    return !b.error;
+}
+
+
+static void
+hevc_ptl_print(const mp4tree_hevc_ptl_t * ptl, int depth)
+{
+    out_field(depth, "Profile:              ", "%u (%s)", ptl->profile_idc,
+              hevc_profile_name(ptl->profile_idc));
+    if (ptl->profile_space)
+        out_field(depth, "Profile space:        ", "%u", ptl->profile_space);
+    out_field(depth, "Tier:                 ", "%s", ptl->tier ? "High" : "Main");
+    out_field(depth, "Level:                ", "%u.%u", ptl->level_idc / 30, ptl->level_idc % 30 / 3);
+    out_field(depth, "Compatibility:        ", "0x%.8x", ptl->compatibility_flags);
+    out_field(depth, "Constraint flags:     ", "0x%.12llx", (unsigned long long)ptl->constraint_flags);
+}
+
+
+static void
+hevc_timing_print(uint32_t num_units_in_tick, uint32_t time_scale, int depth)
+{
+    if (time_scale && num_units_in_tick)
+        out_field(depth, "Timing:               ", "%u/%u (%.3f fps)",
+                  num_units_in_tick, time_scale, (double)time_scale / num_units_in_tick);
+}
+
+
+static void
+hevc_vps_fields_print(const mp4tree_hevc_vps_t * vps, unsigned int id, int depth)
+{
+    out_field(depth, "VPS ID:               ", "%u", id);
+    hevc_ptl_print(&vps->ptl, depth);
+    out_field(depth, "Max layers:           ", "%u", vps->max_layers);
+    out_field(depth, "Max sub layers:       ", "%u", vps->max_sub_layers);
+    out_field(depth, "Temporal ID nesting:  ", "%u", vps->temporal_id_nesting);
+    hevc_timing_print(vps->num_units_in_tick, vps->time_scale, depth);
+}
+
+
+static void
+hevc_sps_fields_print(const mp4tree_hevc_sps_t * sps, unsigned int id, int depth)
+{
+    out_field(depth, "SPS ID:               ", "%u", id);
+    out_field(depth, "VPS ID:               ", "%u", sps->vps_id);
+    hevc_ptl_print(&sps->ptl, depth);
+    out_field(depth, "Max sub layers:       ", "%u", sps->max_sub_layers);
+    out_field(depth, "Chroma format:        ", "%u (%s)", sps->chroma_format_idc,
+              hevc_chroma_name(sps->chroma_format_idc));
+    out_field(depth, "Resolution:           ", "%ux%u", sps->width, sps->height);
+    out_field(depth, "Bit depth:            ", "%u/%u", sps->bit_depth_luma, sps->bit_depth_chroma);
+    out_field(depth, "Max POC LSB:          ", "2^%u", sps->log2_max_poc_lsb);
+    out_field(depth, "CTB size:             ", "%u", 1u << sps->log2_ctb_size);
+    out_field(depth, "Min CB size:          ", "%u", 1u << sps->log2_min_cb_size);
+    out_field(depth, "Scaling lists:        ", "%u", sps->scaling_list_enabled);
+    out_field(depth, "AMP:                  ", "%u", sps->amp);
+    out_field(depth, "SAO:                  ", "%u", sps->sao);
+    out_field(depth, "PCM:                  ", "%u", sps->pcm);
+    out_field(depth, "Short term RPS:       ", "%u", sps->num_short_term_ref_pic_sets);
+    out_field(depth, "Long term refs:       ", "%u", sps->long_term_ref_pics);
+    out_field(depth, "Temporal MVP:         ", "%u", sps->temporal_mvp);
+    out_field(depth, "Strong intra smooth:  ", "%u", sps->strong_intra_smoothing);
+
+    if (sps->sar_width)
+        out_field(depth, "Sample aspect ratio:  ", "%u:%u", sps->sar_width, sps->sar_height);
+    if (sps->colour_primaries)
+        out_field(depth, "Colour:               ", "primaries %u transfer %u matrix %u%s",
+                  sps->colour_primaries, sps->transfer_characteristics,
+                  sps->matrix_coefficients, sps->full_range ? " full range" : "");
+    hevc_timing_print(sps->num_units_in_tick, sps->time_scale, depth);
+}
+
+
+static void
+hevc_pps_fields_print(const mp4tree_hevc_pps_t * pps, unsigned int id, int depth)
+{
+    out_field(depth, "PPS ID:               ", "%u", id);
+    out_field(depth, "SPS ID:               ", "%u", pps->sps_id);
+    out_field(depth, "Dependent slices:     ", "%u", pps->dependent_slice_segments);
+    out_field(depth, "Sign data hiding:     ", "%u", pps->sign_data_hiding);
+    out_field(depth, "CABAC init present:   ", "%u", pps->cabac_init_present);
+    out_field(depth, "Ref idx default:      ", "%u/%u", pps->num_ref_idx_l0_default_active,
+              pps->num_ref_idx_l1_default_active);
+    out_field(depth, "Init QP:              ", "%d", pps->init_qp);
+    if (pps->cu_qp_delta)
+        out_field(depth, "CU QP delta depth:    ", "%u", pps->diff_cu_qp_delta_depth);
+    out_field(depth, "Chroma QP offsets:    ", "%d/%d", pps->cb_qp_offset, pps->cr_qp_offset);
+    out_field(depth, "Weighted pred:        ", "%u/%u", pps->weighted_pred, pps->weighted_bipred);
+    out_field(depth, "Transquant bypass:    ", "%u", pps->transquant_bypass);
+    out_field(depth, "Tiles:                ", "%ux%u", pps->tile_columns, pps->tile_rows);
+    out_field(depth, "Entropy coding sync:  ", "%u", pps->entropy_coding_sync);
+    out_field(depth, "Loop filter slices:   ", "%u", pps->loop_filter_across_slices);
+    out_field(depth, "Deblocking control:   ", "%u%s", pps->deblocking_filter_control_present,
+              pps->deblocking_filter_disabled ? " (disabled)" : "");
+    out_field(depth, "Parallel merge level: ", "%u", pps->log2_parallel_merge_level);
+}
+
+
+/* Get the RBSP after the two byte NAL unit header */
+static const uint8_t *
+hevc_rbsp(rbsp_t * rbsp, const uint8_t * p, size_t len, size_t * rbsp_len)
+{
+    if (len < 3)
+        return NULL;
+
+    rbsp_set(rbsp, p + 2, len - 2);
+    return rbsp_data(rbsp, rbsp_len);
+}
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+void
+mp4tree_hevc_hvcc_print(
+    const uint8_t * p,
+    size_t          len,
+    int             depth,
+    uint32_t        track_id)
+{
+    const uint8_t *        end = p + len;
+    mp4tree_hevc_track_t * track;
+    mp4tree_hevc_ptl_t     ptl;
+    unsigned int           num_arrays;
+    unsigned int           i;
+
+    /*
+     * aligned(8) class HEVCDecoderConfigurationRecord {
+     *     unsigned int(8) configurationVersion = 1;
+     *     unsigned int(2) general_profile_space;
+     *     unsigned int(1) general_tier_flag;
+     *     unsigned int(5) general_profile_idc;
+     *     unsigned int(32) general_profile_compatibility_flags;
+     *     unsigned int(48) general_constraint_indicator_flags;
+     *     unsigned int(8) general_level_idc;
+     *     bit(4) reserved = '1111'b;
+     *     unsigned int(12) min_spatial_segmentation_idc;
+     *     bit(6) reserved = '111111'b;
+     *     unsigned int(2) parallelismType;
+     *     bit(6) reserved = '111111'b;
+     *     unsigned int(2) chromaFormat;
+     *     bit(5) reserved = '11111'b;
+     *     unsigned int(3) bitDepthLumaMinus8;
+     *     bit(5) reserved = '11111'b;
+     *     unsigned int(3) bitDepthChromaMinus8;
+     *     bit(16) avgFrameRate;
+     *     bit(2) constantFrameRate;
+     *     bit(3) numTemporalLayers;
+     *     bit(1) temporalIdNested;
+     *     unsigned int(2) lengthSizeMinusOne;
+     *     unsigned int(8) numOfArrays;
+     *     ...
+     */
+    if (len < 23)
+    {
+        mp4tree_hexdump(p, len, depth);
+        return;
+    }
+
+    track = hevc_track_find(track_id, true);
+    track->nal_length_size = (p[21] & 0x03) + 1;
+
+    ptl.profile_space       = p[1] >> 6;
+    ptl.tier                = (p[1] >> 5) & 0x01;
+    ptl.profile_idc         = p[1] & 0x1f;
+    ptl.compatibility_flags = get_u32(p + 2);
+    ptl.constraint_flags    = ((uint64_t)get_u16(p + 6) << 32) | get_u32(p + 8);
+    ptl.level_idc           = p[12];
+
+    out_field(depth, "Version:              ", "%u", p[0]);
+    hevc_ptl_print(&ptl, depth);
+    out_field(depth, "Min segmentation:     ", "%u", get_u16(p + 13) & 0x0fff);
+    out_field(depth, "Parallelism:          ", "%u", p[15] & 0x03);
+    out_field(depth, "Chroma format:        ", "%u (%s)", p[16] & 0x03, hevc_chroma_name(p[16] & 0x03));
+    out_field(depth, "Bit depth:            ", "%u/%u", (p[17] & 0x07) + 8, (p[18] & 0x07) + 8);
+    out_field(depth, "Avg frame rate:       ", "%.2f", get_u16(p + 19) / 256.0);
+    out_field(depth, "Constant frame rate:  ", "%u", p[21] >> 6);
+    out_field(depth, "Temporal layers:      ", "%u", (p[21] >> 3) & 0x07);
+    out_field(depth, "Temporal ID nested:   ", "%u", (p[21] >> 2) & 0x01);
+    out_field(depth, "NAL length size:      ", "%u", track->nal_length_size);
+
+    num_arrays = p[22];
+    out_field(depth, "Num arrays:           ", "%u", num_arrays);
+    p += 23;
+
+    for (i = 0; i < num_arrays; i++)
+    {
+        unsigned int num_nalus;
+
+        if (end - p < 3)
+            return;
+
+        num_nalus = get_u16(p + 1);
+        out_field(depth, "Array:                ", "%u (%s) complete %u, %u NAL units",
+                  p[0] & 0x3f, hevc_nal_type_name(p[0] & 0x3f), p[0] >> 7, num_nalus);
+        p += 3;
+
+        while (num_nalus--)
+        {
+            uint16_t nal_len;
+
+            if (end - p < 2)
+                return;
+
+            nal_len = get_u16(p);
+            p += 2;
+            if (nal_len < 2 || nal_len > end - p)
+                return;
+
+            out_nal_start("HEVC", p, nal_len, depth);
+            out_printf("%s--- Length %u Type: HEVC NAL\n", indent(depth, 1), nal_len);
+            mp4tree_box_mdat_hevc_nal_print(p, nal_len, depth + 1);
+            out_nal_end("HEVC", depth);
+            p += nal_len;
+        }
+    }
+}
+
+
+void
+mp4tree_hevc_track_select(uint32_t track_id)
+{
+    /* Parameter sets of the track before this one must not apply to it */
+    if (hevc_track_find(track_id, false) == NULL)
+        hevc.current = MP4TREE_HEVC_TRACKS;
+    hevc.selected = track_id;
+}
+
+
+int
+mp4tree_hevc_nal_length_size(void)
+{
+    const mp4tree_hevc_track_t * track = hevc_track_current();
+
+    return track ? track->nal_length_size : 4;
+}
+
+
+void
+mp4tree_hevc_vps_print(const uint8_t * p, size_t len, int depth)
+{
+    mp4tree_hevc_track_t * track = hevc_track_for_nal();
+    uint64_t               hash  = hevc_hash(p, len);
+    mp4tree_hevc_vps_t     vps;
+    rbsp_t                 rbsp;
+    const uint8_t *        data;
+    size_t                 data_len;
+    unsigned int           id;
+    int                    cached;
+    bool                   ok;
+
+    cached = hevc_key_find(track->vps_key, track->vps_valid, p, len, hash);
+    if (cached >= 0)
+    {
+        hevc_vps_fields_print(&track->vps[cached], cached, depth);
+        return;
+    }
+
+    rbsp_init(&rbsp);
+    data = hevc_rbsp(&rbsp, p, len, &data_len);
+    ok   = data != NULL && hevc_vps_parse(data, data_len, &vps, &id);
+    rbsp_free(&rbsp);
+
+    if (!ok)
+    {
+        mp4tree_hexdump(p, len, depth);
+        return;
+    }
+
+    hevc_vps_fields_print(&vps, id, depth);
+
+    track->vps[id]     = vps;
+    hevc_key_set(&track->vps_key[id], p, len, hash);
+    track->vps_valid  |= 1u << id;
+}
+
+
+void
+mp4tree_hevc_sps_print(const uint8_t * p, size_t len, int depth)
+{
+    mp4tree_hevc_track_t * track = hevc_track_for_nal();
+    uint64_t               hash  = hevc_hash(p, len);
+    mp4tree_hevc_sps_t     sps;
+    rbsp_t                 rbsp;
+    const uint8_t *        data;
+    size_t                 data_len;
+    unsigned int           id;
+    int                    cached;
+    bool                   ok;
+
+    cached = hevc_key_find(track->sps_key, track->sps_valid, p, len, hash);
+    if (cached >= 0)
+    {
+        hevc_sps_fields_print(&track->sps[cached], cached, depth);
+        return;
+    }
+
+    rbsp_init(&rbsp);
+    data = hevc_rbsp(&rbsp, p, len, &data_len);
+    ok   = data != NULL && hevc_sps_parse(data, data_len, &sps, &id);
+    rbsp_free(&rbsp);
+
+    if (!ok)
+    {
+        mp4tree_hexdump(p, len, depth);
+        return;
+    }
+
+    hevc_sps_fields_print(&sps, id, depth);
+
+    track->sps[id]     = sps;
+    hevc_key_set(&track->sps_key[id], p, len, hash);
+    track->sps_valid  |= 1u << id;
+}
+
+
+void
+mp4tree_hevc_pps_print(const uint8_t * p, size_t len, int depth)
+{
+    mp4tree_hevc_track_t * track = hevc_track_for_nal();
+    uint64_t               hash  = hevc_hash(p, len);
+    mp4tree_hevc_pps_t     pps;
+    rbsp_t                 rbsp;
+    const uint8_t *        data;
+    size_t                 data_len;
+    unsigned int           id;
+    int                    cached;
+    bool                   ok;
+
+    cached = hevc_key_find(track->pps_key, track->pps_valid, p, len, hash);
+    if (cached >= 0)
+    {
+        hevc_pps_fields_print(&track->pps[cached], cached, depth);
+        return;
+    }
+
+    rbsp_init(&rbsp);
+    data = hevc_rbsp(&rbsp, p, len, &data_len);
+    ok   = data != NULL && hevc_pps_parse(data, data_len, &pps, &id);
+    rbsp_free(&rbsp);
+
+    if (!ok)
+    {
+        mp4tree_hexdump(p, len, depth);
+        return;
+    }
+
+    hevc_pps_fields_print(&pps, id, depth);
+
+    track->pps[id]     = pps;
+    hevc_key_set(&track->pps_key[id], p, len, hash);
+    track->pps_valid  |= 1ull << id;
+}
+
+
+const mp4tree_hevc_vps_t *
+mp4tree_hevc_vps_get(unsigned int id)
+{
+    const mp4tree_hevc_track_t * track = hevc_track_current();
+
+    if (track == NULL || id >= MP4TREE_HEVC_VPS_MAX || !(track->vps_valid & (1u << id)))
+        return NULL;
+
+    return &track->vps[id];
+}
+
+
+const mp4tree_hevc_sps_t *
+mp4tree_hevc_sps_get(unsigned int id)
+{
+    const mp4tree_hevc_track_t * track = hevc_track_current();
+
+    if (track == NULL || id >= MP4TREE_HEVC_SPS_MAX || !(track->sps_valid & (1u << id)))
+        return NULL;
+
+    return &track->sps[id];
+}
+
+
+const mp4tree_hevc_pps_t *
+mp4tree_hevc_pps_get(unsigned int id)
+{
+    const mp4tree_hevc_track_t * track = hevc_track_current();
+
+    if (track == NULL || id >= MP4TREE_HEVC_PPS_MAX || !(track->pps_valid & (1ull << id)))
+        return NULL;
+
+    return &track->pps[id];
+}
+
+
+void
+mp4tree_hevc_state_get(mp4tree_hevc_state_t * state)
+{
+    *state = hevc;
+}
+
+
+void
+mp4tree_hevc_state_set(const mp4tree_hevc_state_t * state)
+{
+    hevc = *state;
+}
+
+
+void
+mp4tree_hevc_reset(void)
+{
+    memset(&hevc, 0, sizeof(hevc));
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              HEVC parameter sets                           *
+ ******************************************************************************
+ *
+ * Decoding of the hvcC configuration and of VPS/SPS/PPS NAL units (ISO/IEC
+ * 14496-15 8.3.3, ITU-T H.265 7.3.2). Decoded parameter sets are cached per
+ * track by their id. A parameter set repeated with the same bytes, as they
+ * usually are before every IRAP picture, is printed from the cache instead
+ * of being decoded again. Longer ones than MP4TREE_HEVC_KEY_MAX are always
+ * decoded.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* Tracks with cached parameter sets, further tracks replace the oldest */
+#define MP4TREE_HEVC_TRACKS 4
+
+#define MP4TREE_HEVC_VPS_MAX 16
+#define MP4TREE_HEVC_SPS_MAX 16
+#define MP4TREE_HEVC_PPS_MAX 64
+
+/* Longest parameter set NAL unit printed from the cache when repeated */
+#define MP4TREE_HEVC_KEY_MAX 128
+
+/* General profile_tier_level() */
+typedef struct mp4tree_hevc_ptl_struct
+{
+    uint8_t  profile_space;
+    bool     tier;                   /* High tier */
+    uint8_t  profile_idc;
+    uint32_t compatibility_flags;
+    uint64_t constraint_flags;       /* 48 bits from progressive_source_flag */
+    uint8_t  level_idc;              /* 30 times the level */
+} mp4tree_hevc_ptl_t;
+
+typedef struct mp4tree_hevc_vps_struct
+{
+    mp4tree_hevc_ptl_t ptl;
+    uint8_t            max_layers;
+    uint8_t            max_sub_layers;
+    bool               temporal_id_nesting;
+    uint32_t           num_units_in_tick;    /* Zero when absent */
+    uint32_t           time_scale;
+} mp4tree_hevc_vps_t;
+
+typedef struct mp4tree_hevc_sps_struct
+{
+    mp4tree_hevc_ptl_t ptl;
+    uint8_t            vps_id;
+    uint8_t            max_sub_layers;
+    uint8_t            chroma_format_idc;
+    bool               separate_colour_plane;
+    uint32_t           width;                /* Cropped picture size in pixels */
+    uint32_t           height;
+    uint8_t            bit_depth_luma;
+    uint8_t            bit_depth_chroma;
+    uint8_t            log2_max_poc_lsb;
+    uint8_t            log2_min_cb_size;
+    uint8_t            log2_ctb_size;
+    bool               scaling_list_enabled;
+    bool               amp;
+    bool               sao;
+    bool               pcm;
+    uint8_t            num_short_term_ref_pic_sets;
+    bool               long_term_ref_pics;
+    bool               temporal_mvp;
+    bool               strong_intra_smoothing;
+
+    /* VUI, zero when absent */
+    uint16_t           sar_width;
+    uint16_t           sar_height;
+    bool               full_range;
+    uint8_t            colour_primaries;
+    uint8_t            transfer_characteristics;
+    uint8_t            matrix_coefficients;
+    uint32_t           num_units_in_tick;
+    uint32_t           time_scale;
+} mp4tree_hevc_sps_t;
+
+typedef struct mp4tree_hevc_pps_struct
+{
+    uint8_t  sps_id;
+    bool     dependent_slice_segments;
+    bool     sign_data_hiding;
+    bool     cabac_init_present;
+    uint8_t  num_ref_idx_l0_default_active;
+    uint8_t  num_ref_idx_l1_default_active;
+    int8_t   init_qp;
+    bool     cu_qp_delta;
+    uint8_t  diff_cu_qp_delta_depth;
+    int8_t   cb_qp_offset;
+    int8_t   cr_qp_offset;
+    bool     weighted_pred;
+    bool     weighted_bipred;
+    bool     transquant_bypass;
+    bool     entropy_coding_sync;    /* Wavefront parallel processing */
+    uint8_t  tile_columns;           /* 1 when tiles are not enabled */
+    uint8_t  tile_rows;
+    bool     loop_filter_across_slices;
+    bool     deblocking_filter_control_present;
+    bool     deblocking_filter_disabled;
+    uint8_t  log2_parallel_merge_level;
+} mp4tree_hevc_pps_t;
+
+/* What a cached parameter set was decoded from */
+typedef struct mp4tree_hevc_key_struct
+{
+    uint64_t hash;
+    size_t   len;
+    uint8_t  bytes[MP4TREE_HEVC_KEY_MAX];   /* Only kept up to MP4TREE_HEVC_KEY_MAX */
+} mp4tree_hevc_key_t;
+
+/* Parameter sets of one track */
+typedef struct mp4tree_hevc_track_struct
+{
+    uint32_t           track_id;
+    uint8_t            nal_length_size;
+    uint16_t           vps_valid;    /* Bit per parameter set id */
+    uint16_t           sps_valid;
+    uint64_t           pps_valid;
+    mp4tree_hevc_key_t vps_key[MP4TREE_HEVC_VPS_MAX];
+    mp4tree_hevc_key_t sps_key[MP4TREE_HEVC_SPS_MAX];
+    mp4tree_hevc_key_t pps_key[MP4TREE_HEVC_PPS_MAX];
+    mp4tree_hevc_vps_t vps[MP4TREE_HEVC_VPS_MAX];
+    mp4tree_hevc_sps_t sps[MP4TREE_HEVC_SPS_MAX];
+    mp4tree_hevc_pps_t pps[MP4TREE_HEVC_PPS_MAX];
+} mp4tree_hevc_track_t;
+
+/* The cache, part of the parser state, see mp4tree_state_get() */
+typedef struct mp4tree_hevc_state_struct
+{
+    int                  num_tracks;
+    int                  current;    /* Track NAL units are printed for, if < num_tracks */
+    uint32_t             selected;   /* Its track_ID, also when it has no cache yet */
+    int                  oldest;
+    mp4tree_hevc_track_t tracks[MP4TREE_HEVC_TRACKS];
+} mp4tree_hevc_state_t;
+
+
+/* Print hvcC and cache its parameter sets for track_id */
+void
+mp4tree_hevc_hvcc_print(const uint8_t * p, size_t len, int depth, uint32_t track_id);
+
+/*
+ * Make track_id the track NAL units are printed for. Without an hvcC it has
+ * no cache until parameter sets are printed for it.
+ */
+void
+mp4tree_hevc_track_select(uint32_t track_id);
+
+/* NAL unit length size of the current track, 4 if unknown */
+int
+mp4tree_hevc_nal_length_size(void);
+
+/* Print a VPS, SPS or PPS NAL unit, including its header, and cache it */
+void
+mp4tree_hevc_vps_print(const uint8_t * p, size_t len, int depth);
+
+void
+mp4tree_hevc_sps_print(const uint8_t * p, size_t len, int depth);
+
+void
+mp4tree_hevc_pps_print(const uint8_t * p, size_t len, int depth);
+
+/* Cached parameter sets of the current track, NULL if not seen */
+const mp4tree_hevc_vps_t *
+mp4tree_hevc_vps_get(unsigned int id);
+
+const mp4tree_hevc_sps_t *
+mp4tree_hevc_sps_get(unsigned int id);
+
+const mp4tree_hevc_pps_t *
+mp4tree_hevc_pps_get(unsigned int id);
+
+void
+mp4tree_hevc_state_get(mp4tree_hevc_state_t * state);
+
+void
+mp4tree_hevc_state_set(const mp4tree_hevc_state_t * state);
+
+/* Forget the parameter sets of every track */
+void
+mp4tree_hevc_reset(void);
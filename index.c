@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "index.h"
+#include "common.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+#define MP4TREE_INDEX_MAGIC      "MP4TIDX"
+#define MP4TREE_INDEX_HEADER_LEN 56
+#define MP4TREE_INDEX_ENTRY_LEN  24
+
+/* Deepest nesting accepted from an index file */
+#define MP4TREE_INDEX_DEPTH_MAX  256
+
+/* Modification time of a struct stat, macOS names it st_mtimespec */
+#ifdef __APPLE__
+#define MP4TREE_INDEX_MTIME(_st) ((_st)->st_mtimespec)
+#else
+#define MP4TREE_INDEX_MTIME(_st) ((_st)->st_mtim)
+#endif
+
+
+static int
+mp4tree_index_path(const char * filename, char * path, size_t size)
+{
+    int n = snprintf(path, size, "%s" MP4TREE_INDEX_SUFFIX, filename);
+
+    return (n < 0 || (size_t)n >= size) ? -1 : 0;
+}
+
+
+static void
+mp4tree_index_header(uint8_t * hdr, const struct stat * st, uint32_t num_boxes)
+{
+    memset(hdr, 0, MP4TREE_INDEX_HEADER_LEN);
+    memcpy(hdr, MP4TREE_INDEX_MAGIC, sizeof(MP4TREE_INDEX_MAGIC));
+    put_le32(hdr + 8,  MP4TREE_INDEX_VERSION);
+    put_le32(hdr + 12, num_boxes);
+    put_le64(hdr + 16, st->st_size);
+    put_le64(hdr + 24, MP4TREE_INDEX_MTIME(st).tv_sec);
+    put_le64(hdr + 32, MP4TREE_INDEX_MTIME(st).tv_nsec);
+    put_le64(hdr + 40, st->st_ino);
+    put_le64(hdr + 48, st->st_dev);
+}
+
+
+/* Rebuild the boxes from the entries, returns false if they are inconsistent */
+static bool
+mp4tree_index_build(mp4tree_tree_t * tree, const uint8_t * p, uint32_t num_boxes)
+{
+    mp4tree_box_t ** link[MP4TREE_INDEX_DEPTH_MAX + 1];
+    mp4tree_box_t *  parent[MP4TREE_INDEX_DEPTH_MAX];
+    int              prev_depth = -1;
+    uint32_t         i;
+
+    link[0] = &tree->boxes;
+
+    for (i = 0; i < num_boxes; i++, p += MP4TREE_INDEX_ENTRY_LEN)
+    {
+        int             depth    = get_le16(p + 4);
+        uint8_t         hdr_len  = p[6];
+        bool            complete = p[7];
+        uint64_t        offset   = get_le64(p + 8);
+        uint64_t        size     = get_le64(p + 16);
+        mp4tree_box_t * box;
+
+        if (depth > prev_depth + 1 || depth >= MP4TREE_INDEX_DEPTH_MAX ||
+            (hdr_len != 8 && hdr_len != 16) || size < hdr_len ||
+            offset > tree->len || tree->len - offset < hdr_len ||
+            (complete && tree->len - offset < size))
+            return false;
+
+        box = arena_alloc(&tree->arena, sizeof(*box));
+        if (box == NULL)
+            return false;
+
+        memcpy(box->type, p, 4);
+        box->hdr_len  = hdr_len;
+        box->complete = complete;
+        box->depth    = depth;
+        box->offset   = offset;
+        box->size     = size;
+        box->data     = tree->buf + offset + hdr_len;
+        box->func     = mp4tree_box_printer_get(box->type);
+        box->parent   = depth ? parent[depth - 1] : NULL;
+
+        *link[depth]    = box;
+        link[depth]     = &box->next;
+        link[depth + 1] = &box->children;
+        parent[depth]   = box;
+        prev_depth      = depth;
+
+        tree->num_boxes++;
+    }
+
+    return true;
+}
+
+
+static int
+mp4tree_index_write_boxes(FILE * f, const mp4tree_box_t * box)
+{
+    uint8_t entry[MP4TREE_INDEX_ENTRY_LEN];
+
+    for ( ; box != NULL; box = box->next)
+    {
+        memcpy(entry, box->type, 4);
+        put_le16(entry + 4, box->depth);
+        entry[6] = box->hdr_len;
+        entry[7] = box->complete;
+        put_le64(entry + 8, box->offset);
+        put_le64(entry + 16, box->size);
+
+        if (fwrite(entry, sizeof(entry), 1, f) != 1 ||
+            mp4tree_index_write_boxes(f, box->children) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+mp4tree_tree_t *
+mp4tree_index_load(
+    const char *        filename,
+    const struct stat * st,
+    const uint8_t *     buf,
+    size_t              len)
+{
+    char             path[PATH_MAX];
+    uint8_t          expect[MP4TREE_INDEX_HEADER_LEN];
+    struct stat      sb;
+    uint8_t *        map;
+    uint32_t         num_boxes;
+    mp4tree_tree_t * tree = NULL;
+    int              fd;
+
+    if (mp4tree_index_path(filename, path, sizeof(path)) < 0)
+        return NULL;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+
+    if (fstat(fd, &sb) < 0 || sb.st_size < MP4TREE_INDEX_HEADER_LEN)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    /* Only trust an index written for this very file */
+    num_boxes = get_le32(map + 12);
+    mp4tree_index_header(expect, st, num_boxes);
+
+    if (memcmp(map, expect, sizeof(expect)) == 0 &&
+        (uint64_t)sb.st_size == MP4TREE_INDEX_HEADER_LEN +
+                                (uint64_t)num_boxes * MP4TREE_INDEX_ENTRY_LEN)
+    {
+        tree = mp4tree_tree_create(buf, len);
+
+        if (tree != NULL &&
+            !mp4tree_index_build(tree, map + MP4TREE_INDEX_HEADER_LEN, num_boxes))
+        {
+            mp4tree_tree_free(tree);
+            tree = NULL;
+        }
+    }
+
+    munmap(map, sb.st_size);
+    return tree;
+}
+
+
+int
+mp4tree_index_save(
+    const char *           filename,
+    const struct stat *    st,
+    const mp4tree_tree_t * tree)
+{
+    char    path[PATH_MAX];
+    char    tmp[PATH_MAX + 4];
+    uint8_t hdr[MP4TREE_INDEX_HEADER_LEN];
+    FILE *  f;
+    int     ret;
+
+    if (mp4tree_index_path(filename, path, sizeof(path)) < 0 ||
+        tree->num_boxes > UINT32_MAX)
+        return -1;
+
+    /* Write next to the final name and rename, readers never see half an index */
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    f = fopen(tmp, "wb");
+    if (f == NULL)
+        return -1;
+
+    mp4tree_index_header(hdr, st, tree->num_boxes);
+
+    ret = fwrite(hdr, sizeof(hdr), 1, f) == 1 &&
+          mp4tree_index_write_boxes(f, tree->boxes) == 0 ? 0 : -1;
+
+    if (fclose(f) != 0)
+        ret = -1;
+
+    if (ret == 0 && rename(tmp, path) == 0)
+        return 0;
+
+    unlink(tmp);
+    return -1;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              Sidecar box index                             *
+ ******************************************************************************
+ *
+ * FILE.mp4idx holds the box structure of FILE so later runs can rebuild the
+ * tree without walking the file. All integers are little-endian:
+ *
+ *     char     magic[8]       "MP4TIDX\0"
+ *     uint32_t version        MP4TREE_INDEX_VERSION
+ *     uint32_t num_boxes
+ *     uint64_t file_size      Key of the indexed file, the index is only
+ *     uint64_t mtime_sec      trusted when all of these still match
+ *     uint64_t mtime_nsec
+ *     uint64_t inode
+ *     uint64_t device
+ *
+ * followed by num_boxes entries of 24 bytes in tree order (depth first):
+ *
+ *     char     type[4]
+ *     uint16_t depth
+ *     uint8_t  hdr_len
+ *     uint8_t  complete       Whole box is inside the file
+ *     uint64_t offset         Absolute offset of the box header
+ *     uint64_t size           Box size including the header
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "tree.h"
+
+
+#define MP4TREE_INDEX_SUFFIX  ".mp4idx"
+#define MP4TREE_INDEX_VERSION 1
+
+
+/*
+ * Rebuild the tree of buf from the index of filename. Returns NULL if there
+ * is no index or it does not match st, the file is then parsed instead.
+ */
+mp4tree_tree_t *
+mp4tree_index_load(const char * filename, const struct stat * st,
+                   const uint8_t * buf, size_t len);
+
+/* Write the index of filename, returns 0 on success */
+int
+mp4tree_index_save(const char * filename, const struct stat * st,
+                   const mp4tree_tree_t * tree);
@@ -0,0 +1,359 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "iter.h"
+#include "common.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+static mp4tree_iter_track_t *
+iter_track(mp4tree_iter_t * iter, uint32_t track_id)
+{
+    mp4tree_iter_track_t * track;
+    int                    i;
+
+    for (i = 0; i < iter->num_tracks; i++)
+    {
+        if (iter->tracks[i].track_id == track_id)
+            return &iter->tracks[i];
+    }
+
+    if (iter->num_tracks == MP4TREE_TRACKS_MAX)
+        return NULL;
+
+    track = &iter->tracks[iter->num_tracks++];
+    memset(track, 0, sizeof(*track));
+    track->track_id = track_id;
+    return track;
+}
+
+
+/* track_ID of a tkhd payload, following the creation and modification times */
+static uint32_t
+iter_tkhd(const uint8_t * p, size_t len)
+{
+    if (len >= 24 && p[0] == 1)
+        return get_u32(p + 20);
+    if (len >= 16)
+        return get_u32(p + 12);
+    return 0;
+}
+
+
+/* Find the tkhd and stbl of a trak, returns the stbl payload or NULL */
+static const uint8_t *
+iter_trak(mp4tree_iter_t * iter, const uint8_t * p, const uint8_t * end, size_t * stbl_len)
+{
+    const uint8_t * type;
+    const uint8_t * payload;
+    const uint8_t * next;
+    const uint8_t * stbl = NULL;
+
+    for (; (next = box_next(p, end, &type, &payload)) != NULL; p = next)
+    {
+        if (memcmp(type, "tkhd", 4) == 0)
+            iter->track_id = iter_tkhd(payload, next - payload);
+        else if (memcmp(type, "mdia", 4) == 0 || memcmp(type, "minf", 4) == 0)
+            stbl = iter_trak(iter, payload, next, stbl_len);
+        else if (memcmp(type, "stbl", 4) == 0)
+        {
+            *stbl_len = next - payload;
+            return payload;
+        }
+
+        if (stbl != NULL)
+            return stbl;
+    }
+
+    return NULL;
+}
+
+
+/* Record the trex boxes of an mvex */
+static void
+iter_mvex(mp4tree_iter_t * iter, const uint8_t * p, const uint8_t * end)
+{
+    const uint8_t * type;
+    const uint8_t * payload;
+    const uint8_t * next;
+
+    for (; (next = box_next(p, end, &type, &payload)) != NULL; p = next)
+    {
+        mp4tree_iter_track_t * track;
+        mp4tree_trex_t         trex;
+
+        if (memcmp(type, "trex", 4) != 0 || !mp4tree_trex_parse(payload, next - payload, &trex))
+            continue;
+
+        track = iter_track(iter, trex.track_id);
+        if (track == NULL)
+            continue;
+
+        track->has_trex = true;
+        track->trex     = trex;
+    }
+}
+
+
+/* Set up the defaults and data base of a traf from its tfhd payload */
+static void
+iter_tfhd(mp4tree_iter_t * iter, const uint8_t * p, size_t len)
+{
+    mp4tree_iter_track_t * track;
+
+    if (len < 8)
+        return;
+
+    track = iter_track(iter, mp4tree_tfhd_track_id(p, len));
+    mp4tree_frag_tfhd(&iter->frag, p, len, track && track->has_trex ? &track->trex : NULL);
+
+    iter->traf_track = track;
+    iter->dts        = track ? track->next_dts : 0;
+}
+
+
+static void
+iter_tfdt(mp4tree_iter_t * iter, const uint8_t * p, size_t len)
+{
+    if (len >= 12 && p[0] == 1)
+        iter->dts = get_u64(p + 4);
+    else if (len >= 8)
+        iter->dts = get_u32(p + 4);
+}
+
+
+/* Start on the samples of a trun payload */
+static void
+iter_trun(mp4tree_iter_t * iter, const uint8_t * p, size_t len)
+{
+    mp4tree_frag_trun(&iter->frag, p, len, &iter->trun);
+    iter->trun_pos = 0;
+    iter->offset   = iter->trun.offset;
+}
+
+
+/* The next sample of the current trun */
+static void
+iter_trun_sample(mp4tree_iter_t * iter, mp4tree_sample_t * sample)
+{
+    mp4tree_trun_sample_t s;
+
+    mp4tree_trun_sample(&iter->trun, iter->trun_pos++, &s);
+
+    sample->track_id = iter->frag.track_id;
+    sample->offset   = iter->offset;
+    sample->size     = s.size;
+    sample->flags    = s.flags;
+    sample->dts      = iter->dts;
+    sample->pts      = iter->dts + s.cts_offset;
+    sample->sync     = !(s.flags & MP4TREE_SAMPLE_NON_SYNC);
+
+    iter->offset += s.size;
+    iter->dts    += s.duration;
+}
+
+
+/* The next sample of the current stbl, false at its end */
+static bool
+iter_stbl_sample(mp4tree_iter_t * iter, mp4tree_sample_t * sample)
+{
+    const mp4tree_stbl_samples_t * block = &iter->block;
+    uint32_t                       j;
+
+    if (iter->block_pos == block->count)
+    {
+        if (mp4tree_stbl_expand(&iter->stbl, block->first + block->count, &iter->block) == 0)
+            return false;
+        iter->block_pos = 0;
+    }
+
+    j = iter->block_pos++;
+
+    sample->track_id = iter->track_id;
+    sample->offset   = block->offset[j];
+    sample->size     = block->size[j];
+    sample->dts      = block->dts[j];
+    sample->pts      = block->dts[j] + block->cts_offset[j];
+    sample->sync     = block->sync[j];
+    sample->flags    = block->sync[j] ? 0 : MP4TREE_SAMPLE_NON_SYNC;
+
+    return true;
+}
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+void
+mp4tree_iter_init(mp4tree_iter_t * iter, const uint8_t * buf, size_t len)
+{
+    memset(iter, 0, sizeof(*iter));
+    iter->buf  = buf;
+    iter->end  = buf + len;
+    iter->next = buf;
+}
+
+
+void
+mp4tree_iter_defaults(mp4tree_iter_t * iter, const uint8_t * buf, size_t len)
+{
+    const uint8_t * end = buf + len;
+    const uint8_t * type;
+    const uint8_t * payload;
+    const uint8_t * next;
+    const uint8_t * p;
+
+    for (p = buf; (next = box_next(p, end, &type, &payload)) != NULL; p = next)
+    {
+        const uint8_t * q;
+        const uint8_t * moov_next;
+
+        if (memcmp(type, "moov", 4) != 0)
+            continue;
+
+        for (q = payload; (moov_next = box_next(q, next, &type, &payload)) != NULL; q = moov_next)
+        {
+            if (memcmp(type, "mvex", 4) == 0)
+                iter_mvex(iter, payload, moov_next);
+        }
+    }
+}
+
+
+bool
+mp4tree_iter_next(mp4tree_iter_t * iter, mp4tree_sample_t * sample)
+{
+    const uint8_t * type;
+    const uint8_t * payload;
+    const uint8_t * next;
+
+    while (1)
+    {
+        if (iter->in_stbl)
+        {
+            if (iter_stbl_sample(iter, sample))
+                return true;
+
+            mp4tree_stbl_free(&iter->stbl);
+            iter->in_stbl = false;
+        }
+
+        if (iter->trun_pos < iter->trun.samples)
+        {
+            iter_trun_sample(iter, sample);
+            return true;
+        }
+
+        /* The next box of the traf */
+        if ((next = box_next(iter->traf_next, iter->traf_end, &type, &payload)) != NULL)
+        {
+            if (memcmp(type, "tfhd", 4) == 0)
+                iter_tfhd(iter, payload, next - payload);
+            else if (memcmp(type, "tfdt", 4) == 0)
+                iter_tfdt(iter, payload, next - payload);
+            else if (memcmp(type, "trun", 4) == 0)
+                iter_trun(iter, payload, next - payload);
+
+            iter->traf_next = next;
+            continue;
+        }
+
+        /* The traf has ended, the next one of the track continues from it */
+        if (iter->traf_next != NULL)
+        {
+            if (iter->traf_track != NULL)
+                iter->traf_track->next_dts = iter->dts;
+            iter->traf_next  = NULL;
+            iter->traf_track = NULL;
+        }
+
+        /* The next traf of the moof */
+        if ((next = box_next(iter->moof_next, iter->moof_end, &type, &payload)) != NULL)
+        {
+            if (memcmp(type, "traf", 4) == 0)
+            {
+                iter->traf_next = payload;
+                iter->traf_end  = next;
+            }
+
+            iter->moof_next = next;
+            continue;
+        }
+
+        /* The next trak of the moov */
+        if ((next = box_next(iter->moov_next, iter->moov_end, &type, &payload)) != NULL)
+        {
+            const uint8_t * stbl;
+            size_t          stbl_len;
+            int             err;
+
+            iter->moov_next = next;
+
+            if (memcmp(type, "mvex", 4) == 0)
+            {
+                iter_mvex(iter, payload, next);
+                continue;
+            }
+
+            if (memcmp(type, "trak", 4) != 0)
+                continue;
+
+            iter->track_id = 0;
+            stbl = iter_trak(iter, payload, next, &stbl_len);
+            if (stbl == NULL)
+                continue;
+
+            /* The stbl of a fragmented track has no samples */
+            err = mp4tree_stbl_build(stbl, stbl_len, &iter->stbl);
+            if (err < 0)
+            {
+                iter->stbl_error       = err;
+                iter->stbl_error_track = iter->track_id;
+                continue;
+            }
+
+            iter->in_stbl     = true;
+            iter->block.first = 0;
+            iter->block.count = 0;
+            iter->block_pos   = 0;
+            continue;
+        }
+
+        /* The next top-level box */
+        next = box_next(iter->next, iter->end, &type, &payload);
+        if (next == NULL)
+            return false;
+
+        if (memcmp(type, "moov", 4) == 0)
+        {
+            iter->moov_next = payload;
+            iter->moov_end  = next;
+        }
+        else if (memcmp(type, "moof", 4) == 0)
+        {
+            mp4tree_frag_moof(&iter->frag, iter->next - iter->buf);
+            iter->moof_next = payload;
+            iter->moof_end  = next;
+        }
+
+        iter->next = next;
+    }
+}
+
+
+void
+mp4tree_iter_free(mp4tree_iter_t * iter)
+{
+    if (iter->in_stbl)
+        mp4tree_stbl_free(&iter->stbl);
+    iter->in_stbl = false;
+}
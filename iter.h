@@ -0,0 +1,107 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              Sample iterator                               *
+ ******************************************************************************
+ *
+ * Yields every sample of a file the same way whether it is described by the
+ * truns of its moofs, with the tfhd and trex defaults applied, or by the
+ * stbl of its traks, see stbl.h. Samples are read in place from the buffer
+ * and nothing is allocated per sample, only the sample index of a trak is
+ * allocated when the iterator enters it.
+ *
+ * Samples come in the order they are described in the file: the traks of a
+ * moov one after the other, then the trafs of each moof in turn. Within a
+ * track this is decode order.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "track.h"
+#include "stbl.h"
+
+
+/* trun sample_is_non_sync_sample, also set for non-sync stbl samples */
+#define MP4TREE_SAMPLE_NON_SYNC 0x00010000
+
+typedef struct mp4tree_sample_struct
+{
+    uint32_t track_id;
+    uint64_t offset;                /* In the buffer iterated over */
+    uint32_t size;
+    uint64_t dts;
+    int64_t  pts;
+    bool     sync;
+    uint32_t flags;                 /* trun sample_flags */
+} mp4tree_sample_t;
+
+/* trex defaults of a track, and where its next traf continues */
+typedef struct mp4tree_iter_track_struct
+{
+    uint32_t       track_id;
+    bool           has_trex;
+    mp4tree_trex_t trex;
+    uint64_t       next_dts;
+} mp4tree_iter_track_t;
+
+typedef struct mp4tree_iter_struct
+{
+    const uint8_t *        buf;
+    const uint8_t *        end;
+    const uint8_t *        next;            /* Next top-level box */
+
+    int                    num_tracks;
+    mp4tree_iter_track_t   tracks[MP4TREE_TRACKS_MAX];
+
+    /* The moov and the sample index of its current trak */
+    const uint8_t *        moov_next;
+    const uint8_t *        moov_end;
+    bool                   in_stbl;
+    uint32_t               track_id;
+    mp4tree_stbl_t         stbl;
+    mp4tree_stbl_samples_t block;
+    uint32_t               block_pos;
+
+    /*
+     * Error of mp4tree_stbl_build() for the last trak skipped because its
+     * stbl could not be indexed, and its track, 0 if none. Left for the
+     * caller to report and clear.
+     */
+    int                    stbl_error;
+    uint32_t               stbl_error_track;
+
+    /* The moof, its current traf and trun */
+    mp4tree_frag_t         frag;
+    const uint8_t *        moof_next;
+    const uint8_t *        moof_end;
+    const uint8_t *        traf_next;
+    const uint8_t *        traf_end;
+    mp4tree_iter_track_t * traf_track;
+    uint64_t               dts;
+    mp4tree_trun_t         trun;
+    uint32_t               trun_pos;
+    uint64_t               offset;          /* Of the next sample of the trun */
+} mp4tree_iter_t;
+
+
+/* Start iterating over the len bytes of boxes at buf */
+void
+mp4tree_iter_init(mp4tree_iter_t * iter, const uint8_t * buf, size_t len);
+
+/*
+ * Take the trex defaults of the tracks from the moov of the len bytes at
+ * buf, typically an init segment, for media segments iterated after it
+ */
+void
+mp4tree_iter_defaults(mp4tree_iter_t * iter, const uint8_t * buf, size_t len);
+
+/* The next sample, false when there are no more */
+bool
+mp4tree_iter_next(mp4tree_iter_t * iter, mp4tree_sample_t * sample);
+
+/* Release the sample index of a trak the iteration stopped in */
+void
+mp4tree_iter_free(mp4tree_iter_t * iter);
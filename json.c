@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "json.h"
+#include "output.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+static _Thread_local struct
+{
+    int          open;     /* Number of box objects not yet closed */
+    bool         first;    /* Next item is the first of the open array */
+    const char * table;    /* Name of the open sample table, NULL if none */
+} json;
+
+
+/* Non-zero for bytes that need escaping inside a JSON string */
+static const uint8_t json_escape[256] =
+{
+    [0x00 ... 0x1f] = 1,
+    ['"']           = 1,
+    ['\\']          = 1,
+    [0x7f ... 0xff] = 1,
+};
+
+
+static void
+json_string(const char * s, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    const uint8_t *   p     = (const uint8_t *)s;
+    size_t            run   = 0;
+    size_t            i;
+
+    out_raw_write("\"", 1);
+
+    for (i = 0; i < len; i++)
+    {
+        char esc[6] = { '\\', 'u', '0', '0' };
+
+        if (!json_escape[p[i]])
+            continue;
+
+        out_raw_write(s + run, i - run);
+        run = i + 1;
+
+        if (p[i] == '"' || p[i] == '\\')
+        {
+            esc[1] = p[i];
+            out_raw_write(esc, 2);
+            continue;
+        }
+
+        /* Control characters and bytes that are not ASCII, as Latin-1 */
+        esc[4] = hex[p[i] >> 4];
+        esc[5] = hex[p[i] & 0x0f];
+        out_raw_write(esc, 6);
+    }
+
+    out_raw_write(s + run, len - run);
+    out_raw_write("\"", 1);
+}
+
+
+static void
+json_uint(uint64_t value)
+{
+    char   digits[20];
+    int    num   = 0;
+    char * start = out_reserve(sizeof(digits));
+    char * p     = start;
+
+    if (start == NULL)
+        return;
+
+    do
+    {
+        digits[num++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    while (num)
+        *p++ = digits[--num];
+
+    out_raw_commit(p - start);
+}
+
+
+/* Separate a new item from the previous one in the open array */
+static void
+json_item(void)
+{
+    if (json.table != NULL)
+    {
+        out_raw_write("]}", 2);
+        json.table = NULL;
+    }
+
+    if (!json.first)
+        out_raw_write(",", 1);
+    json.first = false;
+}
+
+
+/*
+ ******************************************************************************
+ *                            Callbacks                                       *
+ ******************************************************************************
+ */
+
+static void
+json_box_start(
+    void *          opaque,
+    const uint8_t * type,
+    uint64_t        offset,
+    uint64_t        size,
+    int             depth)
+{
+    json_item();
+
+    out_raw_write("{\"type\":", 8);
+    json_string((const char *)type, 4);
+    out_raw_write(",\"offset\":", 10);
+    json_uint(offset);
+    out_raw_write(",\"size\":", 8);
+    json_uint(size);
+    out_raw_write(",\"children\":[", 13);
+
+    json.first = true;
+    json.open++;
+}
+
+
+static void
+json_box_end(
+    void *          opaque,
+    const uint8_t * type,
+    int             depth)
+{
+    if (json.open == 0)
+        return;
+
+    if (json.table != NULL)
+    {
+        out_raw_write("]}", 2);
+        json.table = NULL;
+    }
+
+    out_raw_write("]}", 2);
+    json.first = false;
+    json.open--;
+
+    if (json.open == 0)
+        out_raw_write("\n", 1);
+}
+
+
+static void
+json_field(
+    void *       opaque,
+    const char * name,
+    const char * value,
+    int          depth)
+{
+    json_item();
+
+    out_raw_write("{\"name\":", 8);
+    json_string(name, strlen(name));
+    out_raw_write(",\"value\":", 9);
+    json_string(value, strlen(value));
+    out_raw_write("}", 1);
+}
+
+
+static void
+json_sample(
+    void *           opaque,
+    const char *     table,
+    uint32_t         index,
+    const uint64_t * values,
+    int              num,
+    int              depth)
+{
+    int i;
+
+    /* Consecutive rows of the same table share one array */
+    if (json.table != NULL && (json.table == table || strcmp(json.table, table) == 0))
+    {
+        out_raw_write(",[", 2);
+    }
+    else
+    {
+        json_item();
+        out_raw_write("{\"table\":", 9);
+        json_string(table, strlen(table));
+        out_raw_write(",\"rows\":[[", 10);
+        json.table = table;
+    }
+
+    for (i = 0; i < num; i++)
+    {
+        if (i)
+            out_raw_write(",", 1);
+        json_uint(values[i]);
+    }
+    out_raw_write("]", 1);
+}
+
+
+static const mp4tree_callbacks_t json_callbacks =
+{
+    .box_start = json_box_start,
+    .box_end   = json_box_end,
+    .field     = json_field,
+    .sample    = json_sample,
+};
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+const mp4tree_callbacks_t *
+mp4tree_json_callbacks(void)
+{
+    return &json_callbacks;
+}
+
+
+void
+mp4tree_json_begin(const char * filename)
+{
+    json.open  = 0;
+    json.first = true;
+    json.table = NULL;
+
+    out_raw_write("{\"file\":", 8);
+    json_string(filename, strlen(filename));
+    out_raw_write(",\"boxes\":[\n", 11);
+}
+
+
+void
+mp4tree_json_resume(bool first)
+{
+    json.open  = 0;
+    json.first = first;
+    json.table = NULL;
+}
+
+
+void
+mp4tree_json_end(void)
+{
+    /* Boxes left open by a read error are closed to keep the document valid */
+    while (json.open > 0)
+        json_box_end(NULL, NULL, 0);
+
+    if (json.table != NULL)
+        out_raw_write("]}", 2);
+    json.table = NULL;
+
+    out_raw_write("]}\n", 3);
+}
+
+
+void
+mp4tree_json_array_begin(void)
+{
+    out_raw_write("[\n", 2);
+}
+
+
+void
+mp4tree_json_array_next(bool first)
+{
+    if (!first)
+        out_raw_write(",", 1);
+}
+
+
+void
+mp4tree_json_array_end(void)
+{
+    out_raw_write("]\n", 2);
+}
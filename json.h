@@ -0,0 +1,48 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              JSON output                                   *
+ ******************************************************************************
+ */
+
+#include <stdbool.h>
+
+#include "libmp4tree.h"
+
+
+/*
+ * Callbacks writing one streaming JSON document per file into the output
+ * buffer. Boxes are objects with their fields, sample tables and child boxes
+ * in a "children" array, in the same order as the text tree.
+ */
+const mp4tree_callbacks_t *
+mp4tree_json_callbacks(void);
+
+/* Start the document for a file */
+void
+mp4tree_json_begin(const char * filename);
+
+/*
+ * Continue a document started elsewhere, e.g. by another thread, at a
+ * top-level box. first is true if no box has been written yet.
+ */
+void
+mp4tree_json_resume(bool first);
+
+/* Close any open boxes and end the document */
+void
+mp4tree_json_end(void);
+
+/*
+ * The documents of several files as the items of one array. Call
+ * mp4tree_json_array_next() before each document, first for the first one.
+ */
+void
+mp4tree_json_array_begin(void);
+
+void
+mp4tree_json_array_next(bool first);
+
+void
+mp4tree_json_array_end(void);
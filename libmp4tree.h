@@ -0,0 +1,51 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              libmp4tree                                    *
+ ******************************************************************************
+ *
+ * Event interface to the mp4tree box parser. The parser walks a caller owned
+ * buffer and reports what the mp4tree tool would print as events, without
+ * copying or allocating per box. Any callback may be NULL.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+
+/* The library is built with hidden visibility, only these are exported */
+#define MP4TREE_API __attribute__((visibility("default")))
+
+
+typedef struct mp4tree_callbacks
+{
+    /*
+     * A box starts, offset is relative to the start of the buffer. NAL units
+     * of mdat, avcC, hvcC and elementary streams are reported the same way,
+     * with type "H264" or "HEVC" and the offset and size of the NAL unit
+     * without its length field or start code.
+     */
+    void (*box_start)(void * opaque, const uint8_t * type,
+                      uint64_t offset, uint64_t size, int depth);
+
+    /* The box started with the same type and depth ends */
+    void (*box_end)(void * opaque, const uint8_t * type, int depth);
+
+    /* A named field of the current box, value formatted as in the text tree */
+    void (*field)(void * opaque, const char * name, const char * value,
+                  int depth);
+
+    /* Row of a sample or entry table of the current box, index from 0 */
+    void (*sample)(void * opaque, const char * table, uint32_t index,
+                   const uint64_t * values, int num, int depth);
+} mp4tree_callbacks_t;
+
+
+/*
+ * Parse len bytes of boxes at buf, returns 0 on success. Every call starts
+ * afresh, tracks and parameter sets of buffers parsed before are forgotten.
+ */
+MP4TREE_API int
+mp4tree_parse(const uint8_t * buf, size_t len,
+              const mp4tree_callbacks_t * cb, void * opaque);
@@ -1,14 +1,18 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
-#include <fcntl.h>
 #include <getopt.h>
 #include <string.h>
 #include <unistd.h>
-#include <sys/stat.h>
 
 #include "mp4tree.h"
+#include "stream.h"
 #include "options.h"
+#include "output.h"
+#include "process.h"
+#include "batch.h"
+#include "timeline.h"
+#include "samples.h"
 
 /*
  ******************************************************************************
@@ -16,63 +20,6 @@
  ******************************************************************************
  */
 
-int
-process_file(const char * filename)
-{
-    uint8_t *   buf     = NULL;
-    struct stat sb      = {0};
-    int         fd      = -1;
-    ssize_t     len     = 0;
-
-    printf("Reading file %s\n", filename);
-    if (stat(filename, &sb) < 0)
-    {
-        perror("stat");
-        exit(EXIT_FAILURE);
-    }
-
-    buf = malloc(sb.st_size);
-
-    if (buf == NULL)
-    {
-        printf("Failed to allocate memory\n");
-        exit(EXIT_FAILURE);
-    }
-
-    fd = open(filename, 0);
-
-    if (fd < 0)
-    {
-        perror("open");
-        goto errout;
-    }
-
-    len = read(fd, buf, sb.st_size);
-
-    printf("Read %zd bytes \n", len);
-    if (len < 0)
-    {
-        perror("read");
-        goto errout;
-    }
-
-    printf("File Content:\n");
-    mp4tree_print(buf, len, 0);
-
-    if (buf != NULL)
-        free(buf);
-
-    return EXIT_SUCCESS;
-
-errout:
-
-    if (buf != NULL)
-        free(buf);
-
-    return EXIT_FAILURE;
-}
-
-
 static int
 mp4tree_parse_options(
     int         argc,
@@ -86,16 +33,33 @@ mp4tree_parse_options(
             {"filter",   required_argument, 0, 'f'},
             {"help",     0,                 0, 'h'},
             {"selftest", 0,                 0, 's'},
+            {"stream",   0,                 0, 'S'},
+            {"window",   required_argument, 0, 'w'},
+            {"format",   required_argument, 0, 'F'},
+            {"index",    0,                 0, 'x'},
+            {"path",     required_argument, 0, 'p'},
+            {"batch",    0,                 0, 'b'},
+            {"jobs",     required_argument, 0, 'j'},
+            {"es",       required_argument, 0, 'e'},
+            {"check-timeline", 0,           0, 'T'},
+            {"subsegment", required_argument, 0, 'n'},
+            {"subsegment-time", required_argument, 0, 'm'},
+            {"at",       required_argument, 0, 'a'},
+            {"track",    required_argument, 0, 'k'},
+            {"samples",  0,                 0, 'l'},
             {0,          0,                 0,  0}
         };
 
     /* Set default options */
     memset(&g_options, 0, sizeof(g_options));
     g_options.truncate = 256;
+    g_options.window   = MP4TREE_STREAM_WINDOW_DEFAULT;
+    g_options.subsegment_time = -1;
+    g_options.at              = -1;
 
     while (1)
     {
-        c = getopt_long(argc, argv, "t:f:i:hs",
+        c = getopt_long(argc, argv, "t:f:i:hsSw:F:xp:bj:e:Tn:m:a:k:l",
                         options, &optix);
 
         if (c == -1)
@@ -115,16 +79,90 @@ mp4tree_parse_options(
         case 'i':
             g_options.initseg = optarg;
             break;
+        case 'S':
+            g_options.stream = true;
+            break;
+        case 'w':
+            g_options.window = strtoull(optarg, NULL, 0);
+            if (g_options.window < 16)
+                return -1;
+            break;
+        case 'p':
+            g_options.path = optarg;
+            break;
+        case 'x':
+            g_options.index = true;
+            break;
+        case 'b':
+            g_options.batch = true;
+            break;
+        case 'j':
+            g_options.jobs = atoi(optarg);
+            if (g_options.jobs < 1)
+                return -1;
+            break;
+        case 'e':
+            if (strcmp(optarg, "h264") == 0)
+                g_options.es = MP4TREE_ES_H264;
+            else if (strcmp(optarg, "hevc") == 0)
+                g_options.es = MP4TREE_ES_HEVC;
+            else
+                return -1;
+            break;
+        case 'T':
+            g_options.timeline = true;
+            break;
+        case 'n':
+            g_options.subsegment = strtoull(optarg, NULL, 0);
+            if (g_options.subsegment == 0)
+                return -1;
+            break;
+        case 'm':
+            g_options.subsegment_time = strtod(optarg, NULL);
+            if (g_options.subsegment_time < 0)
+                return -1;
+            break;
+        case 'l':
+            g_options.samples = true;
+            break;
+        case 'a':
+            g_options.at = strtod(optarg, NULL);
+            if (g_options.at < 0)
+                return -1;
+            break;
+        case 'k':
+            g_options.track = strtoul(optarg, NULL, 0);
+            if (g_options.track == 0)
+                return -1;
+            break;
+        case 'F':
+            if (strcmp(optarg, "text") == 0)
+                g_options.format = MP4TREE_FORMAT_TEXT;
+            else if (strcmp(optarg, "json") == 0)
+                g_options.format = MP4TREE_FORMAT_JSON;
+            else if (strcmp(optarg, "binary") == 0)
+                g_options.format = MP4TREE_FORMAT_BINARY;
+            else
+                return -1;
+            break;
         case 'h':
         default:
             return -1;
         }
     }
 
-    /* File name */
+    /* The timeline check prints a report, not boxes */
+    if (g_options.timeline && g_options.format != MP4TREE_FORMAT_TEXT)
+    {
+        fprintf(stderr, "--check-timeline only prints text, not --format=%s\n",
+                g_options.format == MP4TREE_FORMAT_JSON ? "json" : "binary");
+        return -1;
+    }
+
+    /* File name, batch mode and the timeline check read a list from stdin without any */
     if (optind < argc)
         g_options.filename = argv[optind];
-    else
+    else if (!g_options.batch && !g_options.timeline)
         return -1;
 
     return 0;
@@ -134,14 +172,35 @@ mp4tree_parse_options(
 static void
 mp4tree_usage_print(const char * binary)
 {
-    printf("Description:\n");
-    printf(" This program parses and prints the content of an mp4 file.\n");
-    printf("Usage: %s [OPTION]... [FILE]\n", binary);
-    printf("  Available OPTIONs:\n");
-    printf("  -t, --truncate=N          Truncate boxes larger N bytes (default N=256)\n");
-    printf("  -s, --selftest            Run self test\n");
-    printf("  -i, --initseg=<path>      Also parse init segment at <path>\n");
-    printf("\n");
+    out_printf("Description:\n");
+    out_printf(" This program parses and prints the content of an mp4 file.\n");
+    out_printf("Usage: %s [OPTION]... [FILE]\n", binary);
+    out_printf("       %s --batch [OPTION]... [FILE]...\n", binary);
+    out_printf("  With FILE -, boxes are read from stdin and printed as they complete.\n");
+    out_printf("  Available OPTIONs:\n");
+    out_printf("  -t, --truncate=N          Truncate boxes larger N bytes (default N=256)\n");
+    out_printf("  -s, --selftest            Run self test\n");
+    out_printf("  -i, --initseg=<path>      Also parse init segment at <path>\n");
+    out_printf("  -S, --stream              Read boxes on demand instead of loading the file\n");
+    out_printf("  -w, --window=N            Max bytes held in memory in stream mode (default 16 MiB)\n");
+    out_printf("  -p, --path=PATH           Only print the box at PATH, e.g. moov/trak[2]/mdia/mdhd\n");
+    out_printf("  -x, --index               Use and maintain a FILE.mp4idx box index\n");
+    out_printf("  -F, --format=FMT          Output format, text (default), json or binary\n");
+    out_printf("  -b, --batch               Print all FILEs, or those listed on stdin, in parallel\n");
+    out_printf("  -j, --jobs=N              Print the fragments of FILE on N threads, or\n");
+    out_printf("                            the files of a batch (default one per CPU)\n");
+    out_printf("  -e, --es=CODEC            FILE is an Annex B h264 or hevc elementary stream,\n");
+    out_printf("                            the default for .264 and .265 files\n");
+    out_printf("  -T, --check-timeline      Check that the fragments of all FILEs, or those\n");
+    out_printf("                            listed on stdin, have no decode time gaps or overlaps\n");
+    out_printf("  -n, --subsegment=N        Only print subsegment N (from 1) of the sidx of FILE\n");
+    out_printf("  -m, --subsegment-time=T   Only print the subsegment of the sidx covering T seconds\n");
+    out_printf("  -a, --at=T                Only print the fragment at T seconds, found through\n");
+    out_printf("                            the mfra at the end of FILE\n");
+    out_printf("  -k, --track=ID            Track whose tfra --at uses (default the first\n");
+    out_printf("                            video track, else the first tfra)\n");
+    out_printf("  -l, --samples             List the samples of FILE, from its moofs or stbls\n");
+    out_printf("\n");
 }
 
 
@@ -150,6 +209,11 @@ main(int argc, char **argv)
 {
     int status;
 
+    /* Output is buffered, make sure it is written on every exit path */
+    atexit(out_flush);
+    if (isatty(STDOUT_FILENO))
+        out_set_flush_policy(OUT_FLUSH_BOX);
+
     if (mp4tree_parse_options(argc, argv) < 0)
     {
         mp4tree_usage_print(argv[0]);
@@ -161,16 +225,38 @@ main(int argc, char **argv)
         return mp4tree_selftest();
     }
 
+    /* Nothing is printed, the init segment only provides defaults */
+    if (g_options.timeline)
+    {
+        if (optind < argc)
+            return mp4tree_timeline_check(g_options.initseg, argv + optind, argc - optind);
+        return mp4tree_timeline_check(g_options.initseg, NULL, 0);
+    }
+
+    /* Only the moov and moof boxes of the files are read */
+    if (g_options.samples)
+        return mp4tree_samples_print(g_options.initseg, g_options.filename);
+
+    if (g_options.batch)
+    {
+        /* Files are listed on stdin when none are given */
+        if (optind < argc)
+            status = mp4tree_batch(argv + optind, argc - optind, g_options.jobs);
+        else
+            status = mp4tree_batch(NULL, 0, g_options.jobs);
+        return status;
+    }
+
     if (g_options.initseg)
     {
-        status = process_file(g_options.initseg);
+        status = mp4tree_process_initseg(g_options.initseg);
         if (status != EXIT_SUCCESS)
-        {
-            fprintf(stderr, "Error parsing init segment %s\n", g_options.initseg);
             return status;
-        }
     }
 
-    status = process_file(g_options.filename);
+    if (g_options.jobs > 0)
+        return mp4tree_parallel(g_options.filename, g_options.jobs);
+
+    status = mp4tree_process(g_options.filename);
     return status;
 }
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "mfra.h"
+#include "common.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+/* Big endian number of 1 to 4 bytes */
+static uint32_t
+tfra_get_uint(const uint8_t * p, int size)
+{
+    uint32_t v = 0;
+    int      i;
+
+    for (i = 0; i < size; i++)
+        v = (v << 8) | p[i];
+
+    return v;
+}
+
+
+/* Time of entry i, which is all a lookup compares */
+static uint64_t
+tfra_time(const mp4tree_tfra_t * tfra, uint32_t i)
+{
+    const uint8_t * p = tfra->entries + tfra->entry_size * i;
+
+    return tfra->version == 1 ? get_u64(p) : get_u32(p);
+}
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+bool
+mp4tree_tfra_parse(const uint8_t * p, size_t len, mp4tree_tfra_t * tfra)
+{
+    uint32_t sizes;
+
+    memset(tfra, 0, sizeof(*tfra));
+    if (len < 16)
+        return false;
+
+    sizes = get_u32(p + 8);
+
+    tfra->version         = p[0];
+    tfra->track_id        = get_u32(p + 4);
+    tfra->traf_num_size   = ((sizes >> 4) & 0x3) + 1;
+    tfra->trun_num_size   = ((sizes >> 2) & 0x3) + 1;
+    tfra->sample_num_size = (sizes & 0x3) + 1;
+    tfra->entry_count     = get_u32(p + 12);
+    tfra->entries         = p + 16;
+    tfra->entry_size      = (tfra->version == 1 ? 16 : 8) + tfra->traf_num_size +
+                            tfra->trun_num_size + tfra->sample_num_size;
+
+    if (tfra->entry_count > (len - 16) / tfra->entry_size)
+        tfra->entry_count = (len - 16) / tfra->entry_size;
+
+    return true;
+}
+
+
+void
+mp4tree_tfra_entry_get(const mp4tree_tfra_t * tfra, uint32_t i, mp4tree_tfra_entry_t * entry)
+{
+    const uint8_t * p = tfra->entries + tfra->entry_size * i;
+
+    if (tfra->version == 1)
+    {
+        entry->time        = get_u64(p);
+        entry->moof_offset = get_u64(p + 8);
+        p += 16;
+    }
+    else
+    {
+        entry->time        = get_u32(p);
+        entry->moof_offset = get_u32(p + 4);
+        p += 8;
+    }
+
+    entry->traf_number = tfra_get_uint(p, tfra->traf_num_size);
+    p += tfra->traf_num_size;
+    entry->trun_number = tfra_get_uint(p, tfra->trun_num_size);
+    p += tfra->trun_num_size;
+    entry->sample_number = tfra_get_uint(p, tfra->sample_num_size);
+}
+
+
+int64_t
+mp4tree_tfra_lookup(const mp4tree_tfra_t * tfra, uint64_t time)
+{
+    uint32_t lo = 0;
+    uint32_t hi = tfra->entry_count;
+
+    if (tfra->entry_count == 0)
+        return -1;
+
+    /* First entry after time, the one before it is the answer */
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (tfra_time(tfra, mid) <= time)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo > 0 ? lo - 1 : 0;
+}
+
+
+const uint8_t *
+mp4tree_mfra_find(const uint8_t * buf, size_t len, size_t * mfra_len)
+{
+    const uint8_t * mfro;
+    uint32_t        size;
+
+    /* mfro is a 16 byte full box holding the size of the mfra */
+    if (len < 16)
+        return NULL;
+
+    mfro = buf + len - 16;
+    if (get_u32(mfro) != 16 || memcmp(mfro + 4, "mfro", 4) != 0)
+        return NULL;
+
+    size = get_u32(mfro + 12);
+    if (size < 16 || size > len)
+        return NULL;
+
+    if (get_u32(buf + len - size) != size || memcmp(buf + len - size + 4, "mfra", 4) != 0)
+        return NULL;
+
+    *mfra_len = size;
+    return buf + len - size;
+}
+
+
+int
+mp4tree_mfra_tfras(const uint8_t * p, size_t len, mp4tree_tfra_t * tfras, int max)
+{
+    const uint8_t * end = p + len;
+    const uint8_t * type;
+    const uint8_t * payload;
+    const uint8_t * next;
+    int             num = 0;
+
+    if (len < 8)
+        return 0;
+
+    for (p += 8; num < max && (next = box_next(p, end, &type, &payload)) != NULL; p = next)
+    {
+        if (memcmp(type, "tfra", 4) == 0 && mp4tree_tfra_parse(payload, next - payload, &tfras[num]))
+            num++;
+    }
+
+    return num;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                         Movie fragment random access                       *
+ ******************************************************************************
+ *
+ * Decoding of mfra, tfra and mfro (ISO/IEC 14496-12 8.8.9 - 8.8.11) and
+ * lookups of fragments by time through them. The mfra at the end of a file
+ * is found through the mfro closing it. The entries of a tfra are sorted by
+ * time and read in place, so a lookup only touches the entries it compares.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+
+typedef struct mp4tree_tfra_struct
+{
+    uint8_t         version;
+    uint32_t        track_id;
+    uint8_t         traf_num_size;      /* Bytes of traf_number, 1 to 4 */
+    uint8_t         trun_num_size;
+    uint8_t         sample_num_size;
+    uint32_t        entry_count;        /* Only those inside the box */
+    size_t          entry_size;
+    const uint8_t * entries;
+} mp4tree_tfra_t;
+
+typedef struct mp4tree_tfra_entry_struct
+{
+    uint64_t time;
+    uint64_t moof_offset;
+    uint32_t traf_number;
+    uint32_t trun_number;
+    uint32_t sample_number;
+} mp4tree_tfra_entry_t;
+
+
+/* Parse a tfra payload, returns false if it is too short for its header */
+bool
+mp4tree_tfra_parse(const uint8_t * p, size_t len, mp4tree_tfra_t * tfra);
+
+/* Entry i of a parsed tfra, i < entry_count */
+void
+mp4tree_tfra_entry_get(const mp4tree_tfra_t * tfra, uint32_t i, mp4tree_tfra_entry_t * entry);
+
+/*
+ * Index of the last entry at or before time, or of the first entry if time
+ * is before it. Returns -1 if the tfra has no entries.
+ */
+int64_t
+mp4tree_tfra_lookup(const mp4tree_tfra_t * tfra, uint64_t time);
+
+/*
+ * The mfra box at the end of buf, found through its mfro. Returns the start
+ * of the box and sets *mfra_len, or NULL if the file does not end with one.
+ */
+const uint8_t *
+mp4tree_mfra_find(const uint8_t * buf, size_t len, size_t * mfra_len);
+
+/*
+ * Parse the tfra boxes, one per track, of the mfra box at p into tfras, up
+ * to max of them. Invalid ones are skipped. Returns the number parsed.
+ */
+int
+mp4tree_mfra_tfras(const uint8_t * p, size_t len, mp4tree_tfra_t * tfras, int max);
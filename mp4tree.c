@@ -4,14 +4,28 @@
 #include <stdbool.h>
 #include <string.h>
 #include <sys/types.h>
-#include <ctype.h>
 #include <inttypes.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "common.h"
+#include "bits.h"
+#include "rbsp.h"
 #include "mp4tree.h"
 #include "atom-desc.h"
 #include "nal.h"
+#include "h264.h"
+#include "hevc.h"
+#include "track.h"
+#include "sidx.h"
+#include "mfra.h"
+#include "stbl.h"
+#include "iter.h"
 #include "options.h"
+#include "output.h"
+#include "libmp4tree.h"
 
 /*
  ******************************************************************************
@@ -32,24 +46,11 @@ typedef struct mp4tree_box_map_struct
     mp4tree_parse_func func;
 } mp4tree_box_map_t;
 
-static struct mp4_data
+/* Runtime options, the defaults are also what library users get */
+struct options_struct g_options =
 {
-    // Simplified - could differ per track
-    int per_sample_iv_size;
-    int constant_iv_size;
-} g_mp4_data;
-
-static mp4tree_parse_func mdat_printer = NULL;
-
-/*
- ******************************************************************************
- *                           Function declarations                            *
- ******************************************************************************
- */
-
-static mp4tree_parse_func
-mp4tree_box_printer_get(const uint8_t *p);
-
+    .truncate = 256,
+};
 
 /*
  ******************************************************************************
@@ -63,22 +64,127 @@ mp4tree_get_box_type(const uint8_t * p)
     return p + 4;
 }
 
+/* Hex and ASCII part of a hexdump row: 16 * "xx " + " |" + 16 chars + "|\n" */
+#define HEXDUMP_ROW_LEN (16 * 3 + 2 + 16 + 2)
+
+/* Offset column: two spaces, up to 16 hex digits and four spaces */
+#define HEXDUMP_OFFSET_MAX (2 + 16 + 4)
+
+static const char hex_nibbles[] = "0123456789abcdef";
+
+
+/* Format the hex and ASCII columns of a full 16 byte row */
+static inline void
+mp4tree_hexdump_row16(char * out, const uint8_t * p)
+{
+#ifdef __SSE2__
+    const __m128i v      = _mm_loadu_si128((const __m128i *)p);
+    const __m128i mask   = _mm_set1_epi8(0x0f);
+    const __m128i hi     = _mm_and_si128(_mm_srli_epi16(v, 4), mask);
+    const __m128i lo     = _mm_and_si128(v, mask);
+    const __m128i nine   = _mm_set1_epi8(9);
+    const __m128i zero   = _mm_set1_epi8('0');
+    const __m128i alpha  = _mm_set1_epi8('a' - '0' - 10);
+    uint8_t       pairs[32];
+    int           k;
+
+    /* Nibble to digit: '0' + n, plus the gap to 'a' for n > 9 */
+    __m128i hi_c = _mm_add_epi8(_mm_add_epi8(hi, zero),
+                                _mm_and_si128(_mm_cmpgt_epi8(hi, nine), alpha));
+    __m128i lo_c = _mm_add_epi8(_mm_add_epi8(lo, zero),
+                                _mm_and_si128(_mm_cmpgt_epi8(lo, nine), alpha));
+
+    _mm_storeu_si128((__m128i *)pairs, _mm_unpacklo_epi8(hi_c, lo_c));
+    _mm_storeu_si128((__m128i *)(pairs + 16), _mm_unpackhi_epi8(hi_c, lo_c));
+
+    for (k = 0; k < 16; k++)
+    {
+        out[k * 3]     = pairs[k * 2];
+        out[k * 3 + 1] = pairs[k * 2 + 1];
+        out[k * 3 + 2] = ' ';
+    }
+
+    /* Printable is 0x20..0x7e, bytes >= 0x80 are negative as signed chars */
+    __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x1f)),
+                                      _mm_cmplt_epi8(v, _mm_set1_epi8(0x7f)));
+    __m128i txt = _mm_or_si128(_mm_and_si128(printable, v),
+                               _mm_andnot_si128(printable, _mm_set1_epi8('.')));
+
+    out[48] = ' ';
+    out[49] = '|';
+    _mm_storeu_si128((__m128i *)(out + 50), txt);
+    out[66] = '|';
+    out[67] = '\n';
+#else
+    int k;
+
+    for (k = 0; k < 16; k++)
+    {
+        out[k * 3]     = hex_nibbles[p[k] >> 4];
+        out[k * 3 + 1] = hex_nibbles[p[k] & 0x0f];
+        out[k * 3 + 2] = ' ';
+        out[50 + k]    = (p[k] >= 0x20 && p[k] < 0x7f) ? p[k] : '.';
+    }
+
+    out[48] = ' ';
+    out[49] = '|';
+    out[66] = '|';
+    out[67] = '\n';
+#endif
+}
+
+
+/* Format the hex and ASCII columns of a row of n < 16 bytes, space padded */
+static void
+mp4tree_hexdump_row_partial(char * out, const uint8_t * p, size_t n)
+{
+    size_t k;
+
+    memset(out, ' ', HEXDUMP_ROW_LEN);
+
+    for (k = 0; k < n; k++)
+    {
+        out[k * 3]     = hex_nibbles[p[k] >> 4];
+        out[k * 3 + 1] = hex_nibbles[p[k] & 0x0f];
+        out[50 + k]    = (p[k] >= 0x20 && p[k] < 0x7f) ? p[k] : '.';
+    }
+
+    out[49] = '|';
+    out[66] = '|';
+    out[67] = '\n';
+}
+
+
+/* Format "  %.4zx    " and return the number of chars written */
+static inline size_t
+mp4tree_hexdump_offset(char * out, size_t offset)
+{
+    int digits = 4;
+    int k;
+
+    while (digits < 16 && (offset >> (digits * 4)) != 0)
+        digits++;
+
+    out[0] = ' ';
+    out[1] = ' ';
+    for (k = 0; k < digits; k++)
+        out[2 + k] = hex_nibbles[(offset >> ((digits - 1 - k) * 4)) & 0x0f];
+    memset(out + 2 + digits, ' ', 4);
+
+    return 2 + digits + 4;
+}
+
+
 void
 mp4tree_hexdump(
     const uint8_t * p,
     size_t          len,
     int             depth)
 {
-    size_t i;
-    size_t truncated_len = 0;
-
-    // String templates to keep pretty alignment
-    const char * empty_hex = "                                                ";
-    const char * empty_txt = "                ";
-    char hex_buf[1024];
-    char txt_buf[1024];
-    sprintf(hex_buf, "%s", empty_hex);
-    sprintf(txt_buf, "%s", empty_txt);
+    size_t       i;
+    size_t       truncated_len = 0;
+    const char * prefix        = indent(depth, 0);
+    size_t       prefix_len    = strlen(prefix);
 
     if (len > g_options.truncate)
     {
@@ -86,50 +192,40 @@ mp4tree_hexdump(
         len = g_options.truncate;
     }
 
-    size_t line_pos = 0;
-    for (i = 0; i < len; i++)
+    if (!out_is_text())
     {
-        line_pos = i & 0x0f;
+        out_field_hex(depth, "Data", p, len);
+        return;
+    }
 
-        // Print hex output to temporary buffer...
-        char hex[4];
-        sprintf(hex, "%02x ", p[i]);
-        // ...and use strncpy to avoid null-termination
-        strncpy(&hex_buf[line_pos*3], hex, 3);
+    if (len == 0)
+    {
+        // An empty dump has always printed one blank row without offset
+        char * out = out_reserve(HEXDUMP_ROW_LEN);
+        mp4tree_hexdump_row_partial(out, p, 0);
+        out_commit(HEXDUMP_ROW_LEN);
+    }
 
-        if (isprint(p[i]))
-        {
-            // A printable character
-            txt_buf[line_pos] = p[i];
-        }
-        else
-        {
-            // Replace non-printable characters with a dot.
-            txt_buf[line_pos] = '.';
-        }
+    for (i = 0; i < len; i += 16)
+    {
+        char * out = out_reserve(prefix_len + HEXDUMP_OFFSET_MAX + HEXDUMP_ROW_LEN);
+        size_t pos = prefix_len;
 
-        if (i % 16 == 0)
-        {
-            printf("%s  %.4zx    ", indent(depth, 0), i);
-        }
+        memcpy(out, prefix, prefix_len);
+        pos += mp4tree_hexdump_offset(out + pos, i);
 
-        if (line_pos == 15)
-        {
-            printf("%s |%s|\n", hex_buf, txt_buf);
-            sprintf(hex_buf, "%s", empty_hex);
-            sprintf(txt_buf, "%s", empty_txt);
-        }
-    }
+        if (len - i >= 16)
+            mp4tree_hexdump_row16(out + pos, p + i);
+        else
+            mp4tree_hexdump_row_partial(out + pos, p + i, len - i);
 
-    if (line_pos != 15)
-    {
-        printf("%s |%s|\n", hex_buf, txt_buf);
+        out_commit(pos + HEXDUMP_ROW_LEN);
     }
 
     if (truncated_len)
     {
-        printf("%s   ... %zu bytes truncated\n",
-               indent(depth, 0), truncated_len);
+        out_printf("%s   ... %zu bytes truncated\n",
+                   prefix, truncated_len);
     }
 }
 
@@ -149,21 +245,44 @@ mp4tree_table_print(
     int             num,
     int             depth)
 {
-    int i;
-    int j;
-    int offset = 0;
+    int          i;
+    int          j;
+    int          offset     = 0;
+    const char * prefix     = indent(depth, 0);
+    size_t       prefix_len = strlen(prefix);
+
+    if (!out_is_text())
+    {
+        uint64_t values[8];
+
+        if (width > 8)
+            width = 8;
 
-    printf("%s  %s:\n", indent(depth, 0), name);
-    printf("%s             %s\n", indent(depth, 0), header);
+        for (i = 0; i < num; i++)
+        {
+            for (j = 0; j < width; j++)
+                values[j] = get_u32(p + offset + j * esize);
+            offset += width * esize;
+            out_sample(name, i, values, width, depth);
+        }
+        return;
+    }
+
+    out_printf("%s  %s:\n", prefix, name);
+    out_printf("%s             %s\n", prefix, header);
     for (i = 0; i < num; i++)
     {
-        printf("%s      %3d:", indent(depth, 0), i+1);
+        out_write(prefix, prefix_len);
+        out_write("      ", 6);
+        out_uint(i + 1, 3);
+        out_write(":", 1);
         for (j = 0; j < width; j++)
         {
-            printf("   %6u", get_u32(p + offset));
+            out_write("   ", 3);
+            out_uint(get_u32(p + offset), 6);
             offset += esize;
         }
-        printf("\n");
+        out_write("\n", 1);
     }
 }
 
@@ -172,8 +291,8 @@ mp4tree_hexstr(
     const uint8_t * p,
     size_t          len)
 {
-    static char buffer[128];
-    int         n = 0;
+    static _Thread_local char buffer[128];
+    int                       n = 0;
     size_t      i;
 
     if (len > g_options.truncate)
@@ -187,8 +306,26 @@ mp4tree_hexstr(
     return buffer;
 }
 
+static const char *
+mp4tree_hexstr_packed(
+    const uint8_t * p,
+    size_t          len)
+{
+    static _Thread_local char buffer[65];
+    size_t                    i;
 
-static void
+    if (len > 32)
+        len = 32;
+
+    for (i = 0; i < len; i++)
+        snprintf(buffer + 2 * i, sizeof(buffer) - 2 * i, "%.2x", p[i]);
+    buffer[2 * len] = '\0';
+
+    return buffer;
+}
+
+
+void
 mp4tree_box_print(
     const uint8_t * type,
     size_t          len,
@@ -196,13 +333,18 @@ mp4tree_box_print(
 {
     const char *desc;
 
-    printf("%s--- Length: %zu Type: %c%c%c%c\n",
-            indent(depth, 1), len,
-           type[0], type[1], type[2], type[3]);
+    out_box_start(type, len, depth);
+
+    /* trun data offsets are relative to the moof */
+    if (memcmp(type, "moof", 4) == 0)
+        mp4tree_track_moof(out_offset(type - 4));
+    out_printf("%s--- Length: %zu Type: %c%c%c%c\n",
+                indent(depth, 1), len,
+               type[0], type[1], type[2], type[3]);
 
     desc = get_box_desc(type);
     if (desc)
-        printf("%s  Description: %s\n", indent(depth + 1, 0), desc);
+        out_printf("%s  Description: %s\n", indent(depth + 1, 0), desc);
 }
 
 
@@ -213,13 +355,28 @@ mp4tree_box_mdat_h264_print(
     int             depth)
 {
     const uint8_t * p_end = p + len;
-    while (p < p_end)
+
+    /* avcC gives the size of the NAL unit length fields */
+    const int       size  = mp4tree_h264_nal_length_size();
+
+    while (p_end - p >= size)
     {
-        uint32_t nal_length = get_u32(p);
+        uint32_t nal_length = 0;
+        int      i;
+
+        for (i = 0; i < size; i++)
+            nal_length = (nal_length << 8) | p[i];
 
-        printf("%s--- Length %u Type: H264 NAL\n", indent(depth, 1), nal_length);
-        mp4tree_sei_h264_nal_print(p+4, nal_length, depth+1);
-        p += nal_length + 4;
+        p += size;
+
+        out_nal_start("H264", p, nal_length, depth);
+        out_printf("%s--- Length %u Type: H264 NAL\n", indent(depth, 1), nal_length);
+        if (nal_length > p_end - p)
+            nal_length = p_end - p;
+        if (nal_length > 0)
+            mp4tree_sei_h264_nal_print(p, nal_length, depth+1);
+        out_nal_end("H264", depth);
+        p += nal_length;
     }
 }
 
@@ -234,13 +391,25 @@ mp4tree_box_mdat_hevc_print(
 
     const uint8_t * p_end = p + len;
 
-    while (p < p_end)
-    {
-        uint32_t nal_length = get_u32(p);
-        p += 4;
+    /* hvcC gives the size of the NAL unit length fields */
+    const int       size  = mp4tree_hevc_nal_length_size();
 
-        printf("%s--- Length %u Type: HEVC NAL\n", indent(depth, 1), nal_length);
-        mp4tree_box_mdat_hevc_nal_print(p, nal_length, depth + 1);
+    while (p_end - p >= size)
+    {
+        uint32_t nal_length = 0;
+        int      i;
+
+        for (i = 0; i < size; i++)
+            nal_length = (nal_length << 8) | p[i];
+        p += size;
+
+        out_nal_start("HEVC", p, nal_length, depth);
+        out_printf("%s--- Length %u Type: HEVC NAL\n", indent(depth, 1), nal_length);
+        if (nal_length > p_end - p)
+            nal_length = p_end - p;
+        if (nal_length > 0)
+            mp4tree_box_mdat_hevc_nal_print(p, nal_length, depth + 1);
+        out_nal_end("HEVC", depth);
         p += nal_length;
     }
 }
@@ -273,34 +442,36 @@ mp4tree_box_senc_print(
     //     }[ sample_count ]
     // }
 
-    printf("%s  Version:      %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:        0x%.6x\n", indent(depth, 0), flags);
-    printf("%s  Sample Count: %u\n", indent(depth, 0), sample_count);
+    out_field(depth, "Version:      ", "%u", p[0]);
+    out_field(depth, "Flags:        ", "0x%.6x", flags);
+    out_field(depth, "Sample Count: ", "%u", sample_count);
 
     p += 8;
     //    printf("%s  Sample\n", indent(depth, 0), j);
     for (i = 0; i < sample_count; i++)
     {
-        printf("%s Sample: %3u\n", indent(depth, 1), i);
+        out_printf("%s Sample: %3u\n", indent(depth, 1), i);
 
-        uint32_t iv_len = g_mp4_data.per_sample_iv_size;
+        uint32_t iv_len = mp4tree_track_current()->per_sample_iv_size;
         if (iv_len)
         {
-            printf("%s  IV:     %s\n",
-                   indent(depth+1, 0), mp4tree_hexstr(p, iv_len));
+            out_field(depth+1, "IV:     ", "%s", mp4tree_hexstr(p, iv_len));
             p += iv_len;
         }
 
         if (flags & 0x000002)
         {
             uint32_t sub_sample_count = get_u16(p);
-            printf("%s  Subsample Count: %u\n", indent(depth+1, 1), sub_sample_count);
+            out_printf("%s  Subsample Count: %u\n", indent(depth+1, 1), sub_sample_count);
             p += 2;
-            printf("%s  Subsample  BytesOfClear  BytesOfProtectedData\n", indent(depth+2, 0));
+            out_printf("%s  Subsample  BytesOfClear  BytesOfProtectedData\n", indent(depth+2, 0));
             for (j = 0; j < sub_sample_count; j++)
             {
-                printf("%s  %9d  %12u  %20u\n",
-                       indent(depth+2, 0), j, get_u16(p), get_u32(p+2));
+                uint64_t row[2] = { get_u16(p), get_u32(p+2) };
+
+                out_sample("Subsamples", j, row, 2, depth+2);
+                out_printf("%s  %9d  %12u  %20u\n",
+                           indent(depth+2, 0), j, get_u16(p), get_u32(p+2));
                 p +=6;
             }
         }
@@ -319,18 +490,17 @@ mp4tree_box_uuid_sample_encryption(
     uint32_t       i           = 0;
     uint8_t        iv_size     = 8;
 
-    printf("%s  Name:        Sample Encryption Box\n", indent(depth, 0));
-    printf("%s  Version:     %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:       0x%.6x\n", indent(depth, 0), flags);
+    out_field(depth, "Name:        ", "Sample Encryption Box");
+    out_field(depth, "Version:     ", "%u", p[0]);
+    out_field(depth, "Flags:       ", "0x%.6x", flags);
 
     p += 4;
     if (flags & 1)
     {
-        printf("%s  AlgorithmID: 0x%.2x%.2x%.2x\n",indent(depth, 0),
-                 p[0], p[1], p[2]);
-        printf("%s  IV Sizes:       %u\n", indent(depth, 0), p[3]);
+        out_field(depth, "AlgorithmID: ", "0x%.2x%.2x%.2x", p[0], p[1], p[2]);
+        out_field(depth, "IV Sizes:       ", "%u", p[3]);
 
-        printf("%s  Key ID:\n", indent(depth, 0));
+        out_printf("%s  Key ID:\n", indent(depth, 0));
         mp4tree_hexdump(p+4, 16, depth);
         p += 20;
     }
@@ -338,19 +508,18 @@ mp4tree_box_uuid_sample_encryption(
     num_entries = get_u32(p);
     p  += 4;
 
-    printf("%s  Num Entries: %u\n", indent(depth, 0), num_entries);
+    out_field(depth, "Num Entries: ", "%u", num_entries);
 
-    printf("%s  Entry           IV             Entries\n",
-            indent(depth, 0));
+    out_printf("%s  Entry           IV             Entries\n",
+                indent(depth, 0));
 
     for (i = 0; i < num_entries; i++)
     {
         if (iv_size)
         {
-            printf("%s Entry: %3u\n",
-                   indent(depth, 1), i);
-            printf("%s  IV:     %s\n",
-               indent(depth+1, 0), mp4tree_hexstr(p, 8));
+            out_printf("%s Entry: %3u\n",
+                       indent(depth, 1), i);
+            out_field(depth+1, "IV:     ", "%s", mp4tree_hexstr(p, 8));
             p += iv_size;
         }
 
@@ -360,14 +529,17 @@ mp4tree_box_uuid_sample_encryption(
             uint16_t num_sub_samples;
 
             num_sub_samples = get_u16(p);
-            printf("%s  Sub-Entries Count: %u\n", indent(depth+1, 1), num_sub_samples);
+            out_printf("%s  Sub-Entries Count: %u\n", indent(depth+1, 1), num_sub_samples);
             p += 2;
 
-            printf("%s  Sub-Entry  BytesOfClear  BytesOfProtectedData\n", indent(depth+2, 0));
+            out_printf("%s  Sub-Entry  BytesOfClear  BytesOfProtectedData\n", indent(depth+2, 0));
             for (j = 0; j < num_sub_samples; j++)
             {
-                printf("%s  %9d  %12u  %20u\n",
-                       indent(depth+2, 0), j, get_u16(p), get_u32(p+2));
+                uint64_t row[2] = { get_u16(p), get_u32(p+2) };
+
+                out_sample("Subsamples", j, row, 2, depth+2);
+                out_printf("%s  %9d  %12u  %20u\n",
+                           indent(depth+2, 0), j, get_u16(p), get_u32(p+2));
                 p +=6;
             }
         }
@@ -389,23 +561,30 @@ mp4tree_box_uuid_tfrf(
     const uint8_t  fragment_count = p[4];
     unsigned int i = 0;
 
-    printf("%s  Name:           tfrf\n", indent(depth, 0));
-    printf("%s  Version:        %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:          0x%.6x\n", indent(depth, 0), flags);
-    printf("%s  Fragment Count: %u\n", indent(depth, 0), fragment_count);
-    printf("%s    Fragment    Time              Duration\n", indent(depth, 0));
+    out_field(depth, "Name:           ", "tfrf");
+    out_field(depth, "Version:        ", "%u", p[0]);
+    out_field(depth, "Flags:          ", "0x%.6x", flags);
+    out_field(depth, "Fragment Count: ", "%u", fragment_count);
+    out_printf("%s    Fragment    Time              Duration\n", indent(depth, 0));
     for (i = 0; i < fragment_count; i++)
     {
+        uint64_t row[2];
+
         if (flags & 1)
         {
-            printf("%s    %u           %16u  %u\n",
-                   indent(depth, 0), i, get_u32(p+5), get_u32(p+9));
+            out_printf("%s    %u           %16u  %u\n",
+                       indent(depth, 0), i, get_u32(p+5), get_u32(p+9));
+            row[0] = get_u32(p+5);
+            row[1] = get_u32(p+9);
         }
         else
         {
-            printf("%s    %u           %16"PRIu64"  %"PRIu64"\n",
-                   indent(depth, 0), i, get_u64(p+5), get_u64(p+13));
+            out_printf("%s    %u           %16"PRIu64"  %"PRIu64"\n",
+                       indent(depth, 0), i, get_u64(p+5), get_u64(p+13));
+            row[0] = get_u64(p+5);
+            row[1] = get_u64(p+13);
         }
+        out_sample("Fragments", i, row, 2, depth);
     }
 }
 
@@ -460,58 +639,58 @@ mp4tree_box_stsd_avc1_print(
     /* Version
        A 16-bit integer indicating the version number of the compressed data.
        This is set to 0, unless a compressor has changed its data format.*/
-    printf("%s  Version:          %u\n", indent(depth, 0), get_u16(p));
+    out_field(depth, "Version:          ", "%u", get_u16(p));
 
     /* Revision level
        A 16-bit integer that must be set to 0. */
-    printf("%s  Revision level:   %u\n", indent(depth, 0), get_u16(p+2));
+    out_field(depth, "Revision level:   ", "%u", get_u16(p+2));
 
     /* Vendor
        A 32-bit integer that specifies the developer of the compressor that
        generated the compressed data. Often this field contains 'appl' to
        indicate Apple, Inc. */
-    printf("%s  Vendor:           %x\n", indent(depth, 0), get_u32(p+4));
+    out_field(depth, "Vendor:           ", "%x", get_u32(p+4));
 
     /* Temporal quality
        A 32-bit integer containing a value from 0 to 1023 indicating the degree
        of temporal compression. */
-    printf("%s  Temporal Quality: %u\n", indent(depth, 0), get_u32(p+8));
+    out_field(depth, "Temporal Quality: ", "%u", get_u32(p+8));
 
     /* Spatial quality
        A 32-bit integer containing a value from 0 to 1024 indicating the degree
        of spatial compression.*/
-    printf("%s  Spatial Quality:  %u\n", indent(depth, 0), get_u32(p+12));
+    out_field(depth, "Spatial Quality:  ", "%u", get_u32(p+12));
 
     /* Width
        A 16-bit integer that specifies the width of the source image in pixels.*/
-    printf("%s  Width:            %u\n", indent(depth, 0), get_u16(p+16));
+    out_field(depth, "Width:            ", "%u", get_u16(p+16));
 
     /* Height
        A 16-bit integer that specifies the height of the source image in pixels. */
-    printf("%s  Heigth:           %u\n", indent(depth, 0), get_u16(p+18));
+    out_field(depth, "Heigth:           ", "%u", get_u16(p+18));
 
     /* Horizontal resolution
        A 32-bit fixed-point number containing the horizontal resolution of the
        image in pixels per inch. */
-    printf("%s  Horizontal PPI:   %u\n", indent(depth, 0), get_u32(p+20));
+    out_field(depth, "Horizontal PPI:   ", "%u", get_u32(p+20));
 
     /* Vertical resolution
        A 32-bit fixed-point number containing the vertical resolution of the
        image in pixels per inch. */
-    printf("%s  Vertical PPI:     %u\n", indent(depth, 0), get_u32(p+24));
+    out_field(depth, "Vertical PPI:     ", "%u", get_u32(p+24));
 
     /* Data size
        A 32-bit integer that must be set to 0. */
-    printf("%s  Data Size:        %u\n", indent(depth, 0), get_u32(p+28));
+    out_field(depth, "Data Size:        ", "%u", get_u32(p+28));
     /* Frame count
        A 16-bit integer that indicates how many frames of compressed data are
        stored in each sample. Usually set to 1. */
-    printf("%s  Frame Count:      %u\n", indent(depth, 0), get_u16(p+32));
+    out_field(depth, "Frame Count:      ", "%u", get_u16(p+32));
 
     /* Compressor name
        A 32-byte Pascal string containing the name of the compressor that
        created the image, such as "jpeg". */
-    printf("%s  Compressor:       %x\n", indent(depth, 0), get_u32(p+34));
+    out_field(depth, "Compressor:       ", "%x", get_u32(p+34));
 
     /* Depth
        A 16-bit integer that indicates the pixel depth of the compressed image.
@@ -519,7 +698,7 @@ mp4tree_box_stsd_avc1_print(
        The value 32 should be used only if the image contains an alpha channel.
        Values of 34, 36, and 40 indicate 2-, 4-, and 8-bit grayscale,
        respectively, for grayscale images. */
-    printf("%s  Depth:            %x\n", indent(depth, 0), get_u16(p+36));
+    out_field(depth, "Depth:            ", "%x", get_u16(p+36));
 
     /* Color table ID
        A 16-bit integer that identifies which color table to use. If this
@@ -532,8 +711,8 @@ mp4tree_box_stsd_avc1_print(
        sample description. See Color Table Atoms for a complete description of
        a color table. */
 
-    printf("%s  Color Table ID:   %x\n", indent(depth, 0), get_u16(p+38));
-    mdat_printer = mp4tree_box_mdat_h264_print;
+    out_field(depth, "Color Table ID:   ", "%x", get_u16(p+38));
+    mp4tree_track_current()->mdat_printer = mp4tree_box_mdat_h264_print;
     mp4tree_box_print((uint8_t *)"avc1", len, depth-1);
     mp4tree_hexdump(p, len, depth);
 }
@@ -546,8 +725,10 @@ mp4tree_box_stsd_avcC_print(
     size_t          len,
     int             depth)
 {
-    mp4tree_hexdump(p, len, depth);
-    mdat_printer = mp4tree_box_mdat_h264_print;
+    mp4tree_track_t * track = mp4tree_track_current();
+
+    mp4tree_h264_avcc_print(p, len, depth, track->track_id);
+    track->mdat_printer = mp4tree_box_mdat_h264_print;
 }
 
 
@@ -557,26 +738,28 @@ mp4tree_box_stsd_hvcC_print(
     size_t          len,
     int             depth)
 {
-    mp4tree_hexdump(p, len, depth);
-    mdat_printer = mp4tree_box_mdat_hevc_print;
+    mp4tree_track_t * track = mp4tree_track_current();
+
+    mp4tree_hevc_hvcc_print(p, len, depth, track->track_id);
+    track->mdat_printer = mp4tree_box_mdat_hevc_print;
 }
 
 
+#if 0
+
+/* Shadowed by the ctab container entry in box_map, only used below */
 static void
 mp4tree_box_ctab_print(
     const uint8_t * p,
     size_t          len,
     int             depth)
 {
-    printf("%s  Color Table Seed   %x\n", indent(depth, 0), get_u32(p));
-    printf("%s  Color Table Flags  %u\n", indent(depth, 0), get_u16(p+4));
-    printf("%s  Color Table Size   %u\n", indent(depth, 0), get_u16(p+6));
+    out_field(depth, "Color Table Seed   ", "%x", get_u32(p));
+    out_field(depth, "Color Table Flags  ", "%u", get_u16(p+4));
+    out_field(depth, "Color Table Size   ", "%u", get_u16(p+6));
 }
 
 
-
-#if 0
-
 static void
 mp4tree_box_stsd_hev1_print(
     const uint8_t * p,
@@ -586,64 +769,64 @@ mp4tree_box_stsd_hev1_print(
     // 6 bytes reserved to
     p += 6;
 
-    printf("%s  Data reference index:          %u\n", indent(depth, 0), get_u16(p));
+    out_field(depth, "Data reference index:          ", "%u", get_u16(p));
 
     p += 2;
     /* Version
        A 16-bit integer indicating the version number of the compressed data.
        This is set to 0, unless a compressor has changed its data format.*/
-    printf("%s  Version:          %u\n", indent(depth, 0), get_u16(p));
+    out_field(depth, "Version:          ", "%u", get_u16(p));
 
     /* Revision level
        A 16-bit integer that must be set to 0. */
-    printf("%s  Revision level:   %u\n", indent(depth, 0), get_u16(p+2));
+    out_field(depth, "Revision level:   ", "%u", get_u16(p+2));
 
     /* Vendor
        A 32-bit integer that specifies the developer of the compressor that
        generated the compressed data. Often this field contains 'appl' to
        indicate Apple, Inc. */
-    printf("%s  Vendor:           %x\n", indent(depth, 0), get_u32(p+4));
+    out_field(depth, "Vendor:           ", "%x", get_u32(p+4));
 
     /* Temporal quality
        A 32-bit integer containing a value from 0 to 1023 indicating the degree
        of temporal compression. */
-    printf("%s  Temporal Quality: %u\n", indent(depth, 0), get_u32(p+8));
+    out_field(depth, "Temporal Quality: ", "%u", get_u32(p+8));
 
     /* Spatial quality
        A 32-bit integer containing a value from 0 to 1024 indicating the degree
        of spatial compression.*/
-    printf("%s  Spatial Quality:  %u\n", indent(depth, 0), get_u32(p+12));
+    out_field(depth, "Spatial Quality:  ", "%u", get_u32(p+12));
 
     /* Width
        A 16-bit integer that specifies the width of the source image in pixels.*/
-    printf("%s  Width:            %u\n", indent(depth, 0), get_u16(p+16));
+    out_field(depth, "Width:            ", "%u", get_u16(p+16));
 
     /* Height
        A 16-bit integer that specifies the height of the source image in pixels. */
-    printf("%s  Heigth:           %u\n", indent(depth, 0), get_u16(p+18));
+    out_field(depth, "Heigth:           ", "%u", get_u16(p+18));
 
     /* Horizontal resolution
        A 32-bit fixed-point number containing the horizontal resolution of the
        image in pixels per inch. */
-    printf("%s  Horizontal PPI:   %u\n", indent(depth, 0), get_u32(p+20));
+    out_field(depth, "Horizontal PPI:   ", "%u", get_u32(p+20));
 
     /* Vertical resolution
        A 32-bit fixed-point number containing the vertical resolution of the
        image in pixels per inch. */
-    printf("%s  Vertical PPI:     %u\n", indent(depth, 0), get_u32(p+24));
+    out_field(depth, "Vertical PPI:     ", "%u", get_u32(p+24));
 
     /* Data size
        A 32-bit integer that must be set to 0. */
-    printf("%s  Data Size:        %u\n", indent(depth, 0), get_u32(p+28));
+    out_field(depth, "Data Size:        ", "%u", get_u32(p+28));
     /* Frame count
        A 16-bit integer that indicates how many frames of compressed data are
        stored in each sample. Usually set to 1. */
-    printf("%s  Frame Count:      %u\n", indent(depth, 0), get_u16(p+32));
+    out_field(depth, "Frame Count:      ", "%u", get_u16(p+32));
 
     /* Compressor name
        A 32-byte Pascal string containing the name of the compressor that
        created the image, such as "jpeg". */
-    printf("%s  Compressor:       %x\n", indent(depth, 0), get_u32(p+34));
+    out_field(depth, "Compressor:       ", "%x", get_u32(p+34));
 
     /* Depth
        A 16-bit integer that indicates the pixel depth of the compressed image.
@@ -651,7 +834,7 @@ mp4tree_box_stsd_hev1_print(
        The value 32 should be used only if the image contains an alpha channel.
        Values of 34, 36, and 40 indicate 2-, 4-, and 8-bit grayscale,
        respectively, for grayscale images. */
-    printf("%s  Depth:            %x\n", indent(depth, 0), get_u16(p+36));
+    out_field(depth, "Depth:            ", "%x", get_u16(p+36));
 
     /* Color table ID
        A 16-bit integer that identifies which color table to use. If this
@@ -664,13 +847,13 @@ mp4tree_box_stsd_hev1_print(
        sample description. See Color Table Atoms for a complete description of
        a color table. */
 
-    printf("%s  Color Table ID:   %x\n", indent(depth, 0), get_u16(p+38));
+    out_field(depth, "Color Table ID:   ", "%x", get_u16(p+38));
     mp4tree_box_ctab_print(p + 40, len, depth);
 //    mp4tree_print(p + 40, len - 40, depth + 1);
 //    mp4tree_box_print((uint8_t *)"hvc1", len, depth-1);
     mp4tree_hexdump(p + 48, len, depth);
 
-    mdat_printer = mp4tree_box_mdat_hevc_print;
+    mp4tree_track_current()->mdat_printer = mp4tree_box_mdat_hevc_print;
 }
 #endif
 
@@ -702,14 +885,14 @@ mp4tree_box_saio_print(
     uint32_t flags = get_u24(p+1);
     uint8_t entry_count = 0;
 
-    printf("%s  Version:                  %u\n",indent(depth, 0), version);
-    printf("%s  Flags:                    0x%.6x\n", indent(depth, 0), flags);
+    out_field(depth, "Version:                  ", "%u", version);
+    out_field(depth, "Flags:                    ", "0x%.6x", flags);
     p += 4;
 
     if (flags & 1)
     {
-        printf("%s  Aux Info Type:            %c%c%c%c\n",indent(depth, 0), p[0], p[1], p[2], p[3]);
-        printf("%s  Aux Info Type Parameter:  %u\n",indent(depth, 0), get_u32(p+4));
+        out_field(depth, "Aux Info Type:            ", "%c%c%c%c", p[0], p[1], p[2], p[3]);
+        out_field(depth, "Aux Info Type Parameter:  ", "%u", get_u32(p+4));
         p += 8;
     }
 
@@ -719,10 +902,13 @@ mp4tree_box_saio_print(
     {
         int i = 0;
 
-        printf("%s  Entry     Offset\n", indent(depth, 0));
+        out_printf("%s  Entry     Offset\n", indent(depth, 0));
         for (i = 0; i < entry_count; i++)
         {
-            printf("%s  %3d:       %u\n", indent(depth, 0), i, get_u32(p));
+            uint64_t offset = get_u32(p);
+
+            out_sample("Offsets", i, &offset, 1, depth);
+            out_printf("%s  %3d:       %u\n", indent(depth, 0), i, get_u32(p));
             p += 4;
         }
     }
@@ -730,10 +916,13 @@ mp4tree_box_saio_print(
     {
         int i = 0;
 
-        printf("%s  Entry     Offset\n", indent(depth, 0));
+        out_printf("%s  Entry     Offset\n", indent(depth, 0));
         for (i = 0; i < entry_count; i++)
         {
-            printf("%s  %3d:       %llu\n", indent(depth, 0), i, (long long unsigned) get_u64(p));
+            uint64_t offset = get_u64(p);
+
+            out_sample("Offsets", i, &offset, 1, depth);
+            out_printf("%s  %3d:       %llu\n", indent(depth, 0), i, (long long unsigned) get_u64(p));
             p += 8;
         }
     }
@@ -764,29 +953,32 @@ mp4tree_box_saiz_print(
      **/
     uint32_t flags = get_u24(p+1);
 
-    printf("%s  Version:                  %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:                    0x%.6x\n", indent(depth, 0), flags);
+    out_field(depth, "Version:                  ", "%u", p[0]);
+    out_field(depth, "Flags:                    ", "0x%.6x", flags);
     p += 4;
     if (flags & 1)
     {
-        printf("%s  Aux Info Type:            %c%c%c%c\n",indent(depth, 0), p[0], p[1], p[2], p[3]);
-        printf("%s  Aux Info Type Parameter:  %u\n",indent(depth, 0), get_u32(p+4));
+        out_field(depth, "Aux Info Type:            ", "%c%c%c%c", p[0], p[1], p[2], p[3]);
+        out_field(depth, "Aux Info Type Parameter:  ", "%u", get_u32(p+4));
         p += 8;
     }
     uint8_t default_sample_info_size = p[0];
     uint8_t sample_count = get_u32(p + 1);
-    printf("%s  Default Sample Info Size: %u\n",indent(depth, 0), default_sample_info_size);
-    printf("%s  Sample Count:             %u\n",indent(depth, 0), sample_count);
+    out_field(depth, "Default Sample Info Size: ", "%u", default_sample_info_size);
+    out_field(depth, "Sample Count:             ", "%u", sample_count);
 
     p += 5;
     if (default_sample_info_size == 0)
     {
         int i = 0;
 
-        printf("%s  Sample     Sample Info Size\n", indent(depth, 0));
+        out_printf("%s  Sample     Sample Info Size\n", indent(depth, 0));
         for (i = 0; i < sample_count; i++)
         {
-            printf("%s  %3d:           %.2u\n", indent(depth, 0), i, p[i]);
+            uint64_t size = p[i];
+
+            out_sample("Sample Info Sizes", i, &size, 1, depth);
+            out_printf("%s  %3d:           %.2u\n", indent(depth, 0), i, p[i]);
         }
     }
 }
@@ -798,7 +990,7 @@ mp4tree_box_btrt_print(
     size_t          len,
     int             depth)
 {
-    printf("%s  Version:                 %u\n",indent(depth, 0), p[0]);
+    out_field(depth, "Version:                 ", "%u", p[0]);
     mp4tree_hexdump(p, len, depth);
 
 }
@@ -809,7 +1001,7 @@ mp4tree_box_frma_print(
     size_t          len,
     int             depth)
 {
-    printf("%s  Data Format: %c%c%c%c\n",indent(depth, 0), p[0], p[1], p[2], p[3]);
+    out_field(depth, "Data Format: ", "%c%c%c%c", p[0], p[1], p[2], p[3]);
 }
 
 static void
@@ -823,8 +1015,8 @@ mp4tree_box_tenc_print(
     uint32_t flags = get_u24(p + pos);
     pos += 3;
 
-    printf("%s  Version:                    %u\n",indent(depth, 0), version);
-    printf("%s  Flags:                      0x%.6x\n", indent(depth, 0), flags);
+    out_field(depth, "Version:                    ", "%u", version);
+    out_field(depth, "Flags:                      ", "0x%.6x", flags);
 
     // One byte reserved
     pos++;
@@ -833,39 +1025,29 @@ mp4tree_box_tenc_print(
     {
         uint32_t crypt_byte_block = (p[pos] & 0xf0) >> 4;
         uint32_t skip_byte_block = p[pos] & 0x0f;
-        printf("%s  default_crypt_byte_block:   %u\n", indent(depth, 0), crypt_byte_block);
-        printf("%s  default_skip_byte_block:    %u\n", indent(depth, 0), skip_byte_block);
+        out_field(depth, "default_crypt_byte_block:   ", "%u", crypt_byte_block);
+        out_field(depth, "default_skip_byte_block:    ", "%u", skip_byte_block);
     }
     pos++;
 
     uint32_t is_protected = p[pos++];
     uint32_t per_sample_iv_size = p[pos++];
-    g_mp4_data.per_sample_iv_size = per_sample_iv_size;
+    mp4tree_track_current()->per_sample_iv_size = per_sample_iv_size;
 
-    printf("%s  default_isProtected:        %u\n", indent(depth, 0), is_protected);
-    printf("%s  default_Per_Sample_IV_Size: %u\n", indent(depth, 0), per_sample_iv_size);
+    out_field(depth, "default_isProtected:        ", "%u", is_protected);
+    out_field(depth, "default_Per_Sample_IV_Size: ", "%u", per_sample_iv_size);
 
-    printf("%s  default_KID:                ", indent(depth, 0));
-    print_hex(p + pos, 16);
-    printf("\n");
+    out_field(depth, "default_KID:                ", "%s", mp4tree_hexstr_packed(p + pos, 16));
     pos += 16;
 
     if (per_sample_iv_size == 0)
     {
         uint32_t constant_iv_size = p[pos++];
-        g_mp4_data.constant_iv_size = constant_iv_size;
+        mp4tree_track_current()->constant_iv_size = constant_iv_size;
 
-        printf("%s  default_constant_IV_size:   %u\n", indent(depth, 0), constant_iv_size);
-        printf("%s  default_constant_IV:        ", indent(depth, 0));
-        if (constant_iv_size <= 32)
-        {
-            print_hex(p + pos, constant_iv_size);
-        }
-        else
-        {
-            printf("?");
-        }
-        printf("\n");
+        out_field(depth, "default_constant_IV_size:   ", "%u", constant_iv_size);
+        out_field(depth, "default_constant_IV:        ", "%s",
+                  constant_iv_size <= 32 ? mp4tree_hexstr_packed(p + pos, constant_iv_size) : "?");
     }
 }
 
@@ -877,15 +1059,15 @@ mp4tree_box_schm_print(
 {
     uint32_t        flags       = get_u24(p+1);
 
-    printf("%s  Version:       %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:         0x%.6x\n", indent(depth, 0), flags);
+    out_field(depth, "Version:       ", "%u", p[0]);
+    out_field(depth, "Flags:         ", "0x%.6x", flags);
 
-    printf("%s  Scheme Type:    %c%c%c%c\n",indent(depth, 0), p[4], p[5], p[6], p[7]);
-    printf("%s  Scheme Version: %u\n", indent(depth, 0), get_u32(p+8));
+    out_field(depth, "Scheme Type:    ", "%c%c%c%c", p[4], p[5], p[6], p[7]);
+    out_field(depth, "Scheme Version: ", "%u", get_u32(p+8));
 
     if (flags & 0x1)
     {
-        printf("%s  Scheme URI: TODO\n", indent(depth, 0));
+        out_field(depth, "Scheme URI: ", "TODO");
     }
 }
 
@@ -896,10 +1078,9 @@ mp4tree_box_stsd_sample_audio_print(
     int             depth)
 {
     /* General sample decription */
-    printf("%s  Reserved:             %.2x%.2x%.2x%.2x%.2x%.2x\n",
-               indent(depth, 0), p[0], p[1], p[2], p[3], p[4], p[5]);
+    out_field(depth, "Reserved:             ", "%.2x%.2x%.2x%.2x%.2x%.2x", p[0], p[1], p[2], p[3], p[4], p[5]);
 
-    printf("%s  Data reference index: %u\n", indent(depth, 0), get_u16(p+6));
+    out_field(depth, "Data reference index: ", "%u", get_u16(p+6));
 
     p += 8;
 
@@ -942,14 +1123,14 @@ mp4tree_box_stsd_sample_audio_print(
 *
 */
     uint16_t version = get_u16(p);
-    printf("%s  Version:              %u\n", indent(depth, 0), version);
-    printf("%s  Revision level:       %u\n", indent(depth, 0), get_u16(p+2));
-    printf("%s  Vendor:               %x\n", indent(depth, 0), get_u32(p+4));
-    printf("%s  Number of Channels:   %u\n", indent(depth, 0), get_u16(p+8));
-    printf("%s  Sample Size:          %u\n", indent(depth, 0), get_u16(p+10));
-    printf("%s  Compression ID:       %u\n", indent(depth, 0), get_u16(p+12));
-    printf("%s  Packet Size:          %u\n", indent(depth, 0), get_u16(p+14));
-    printf("%s  Sample Rate:          %u\n", indent(depth, 0), get_u32(p+16));
+    out_field(depth, "Version:              ", "%u", version);
+    out_field(depth, "Revision level:       ", "%u", get_u16(p+2));
+    out_field(depth, "Vendor:               ", "%x", get_u32(p+4));
+    out_field(depth, "Number of Channels:   ", "%u", get_u16(p+8));
+    out_field(depth, "Sample Size:          ", "%u", get_u16(p+10));
+    out_field(depth, "Compression ID:       ", "%u", get_u16(p+12));
+    out_field(depth, "Packet Size:          ", "%u", get_u16(p+14));
+    out_field(depth, "Sample Rate:          ", "%u", get_u32(p+16));
 
     if (version == 0)
     {
@@ -965,10 +1146,9 @@ mp4tree_box_stsd_sample_video_print(
     int             depth)
 {
     /* General sample decription */
-    printf("%s  Reserved:             %.2x%.2x%.2x%.2x%.2x%.2x\n",
-               indent(depth, 0), p[0], p[1], p[2], p[3], p[4], p[5]);
+    out_field(depth, "Reserved:             ", "%.2x%.2x%.2x%.2x%.2x%.2x", p[0], p[1], p[2], p[3], p[4], p[5]);
 
-    printf("%s  Data reference index: %u\n", indent(depth, 0), get_u16(p+6));
+    out_field(depth, "Data reference index: ", "%u", get_u16(p+6));
 
     p += 8;
 
@@ -976,58 +1156,58 @@ mp4tree_box_stsd_sample_video_print(
     /* Version
        A 16-bit integer indicating the version number of the compressed data.
        This is set to 0, unless a compressor has changed its data format.*/
-    printf("%s  Version:          %u\n", indent(depth, 0), get_u16(p));
+    out_field(depth, "Version:          ", "%u", get_u16(p));
 
     /* Revision level
        A 16-bit integer that must be set to 0. */
-    printf("%s  Revision level:   %u\n", indent(depth, 0), get_u16(p+2));
+    out_field(depth, "Revision level:   ", "%u", get_u16(p+2));
 
     /* Vendor
        A 32-bit integer that specifies the developer of the compressor that
        generated the compressed data. Often this field contains 'appl' to
        indicate Apple, Inc. */
-    printf("%s  Vendor:           %x\n", indent(depth, 0), get_u32(p+4));
+    out_field(depth, "Vendor:           ", "%x", get_u32(p+4));
 
     /* Temporal quality
        A 32-bit integer containing a value from 0 to 1023 indicating the degree
        of temporal compression. */
-    printf("%s  Temporal Quality: %u\n", indent(depth, 0), get_u32(p+8));
+    out_field(depth, "Temporal Quality: ", "%u", get_u32(p+8));
 
     /* Spatial quality
        A 32-bit integer containing a value from 0 to 1024 indicating the degree
        of spatial compression.*/
-    printf("%s  Spatial Quality:  %u\n", indent(depth, 0), get_u32(p+12));
+    out_field(depth, "Spatial Quality:  ", "%u", get_u32(p+12));
 
     /* Width
        A 16-bit integer that specifies the width of the source image in pixels.*/
-    printf("%s  Width:            %u\n", indent(depth, 0), get_u16(p+16));
+    out_field(depth, "Width:            ", "%u", get_u16(p+16));
 
     /* Height
        A 16-bit integer that specifies the height of the source image in pixels. */
-    printf("%s  Heigth:           %u\n", indent(depth, 0), get_u16(p+18));
+    out_field(depth, "Heigth:           ", "%u", get_u16(p+18));
 
     /* Horizontal resolution
        A 32-bit fixed-point number containing the horizontal resolution of the
        image in pixels per inch. */
-    printf("%s  Horizontal PPI:   %u\n", indent(depth, 0), get_u32(p+20));
+    out_field(depth, "Horizontal PPI:   ", "%u", get_u32(p+20));
 
     /* Vertical resolution
        A 32-bit fixed-point number containing the vertical resolution of the
        image in pixels per inch. */
-    printf("%s  Vertical PPI:     %u\n", indent(depth, 0), get_u32(p+24));
+    out_field(depth, "Vertical PPI:     ", "%u", get_u32(p+24));
 
     /* Data size
        A 32-bit integer that must be set to 0. */
-    printf("%s  Data Size:        %u\n", indent(depth, 0), get_u32(p+28));
+    out_field(depth, "Data Size:        ", "%u", get_u32(p+28));
     /* Frame count
        A 16-bit integer that indicates how many frames of compressed data are
        stored in each sample. Usually set to 1. */
-    printf("%s  Frame Count:      %u\n", indent(depth, 0), get_u16(p+32));
+    out_field(depth, "Frame Count:      ", "%u", get_u16(p+32));
 
     /* Compressor name
        A 32-byte Pascal string containing the name of the compressor that
        created the image, such as "jpeg". */
-    printf("%s  Compressor:       %s\n", indent(depth, 0), get_pascal_string(p+34));
+    out_field(depth, "Compressor:       ", "%s", get_pascal_string(p+34));
 
     /* Depth
        A 16-bit integer that indicates the pixel depth of the compressed image.
@@ -1035,7 +1215,7 @@ mp4tree_box_stsd_sample_video_print(
        The value 32 should be used only if the image contains an alpha channel.
        Values of 34, 36, and 40 indicate 2-, 4-, and 8-bit grayscale,
        respectively, for grayscale images. */
-    printf("%s  Depth:            %x\n", indent(depth, 0), get_u16(p+68));
+    out_field(depth, "Depth:            ", "%x", get_u16(p+68));
 
     /* Color table ID
        A 16-bit integer that identifies which color table to use. If this
@@ -1048,7 +1228,7 @@ mp4tree_box_stsd_sample_video_print(
        sample description. See Color Table Atoms for a complete description of
        a color table. */
 
-    printf("%s  Color Table ID:   %x\n", indent(depth, 0), get_u16(p+70));
+    out_field(depth, "Color Table ID:   ", "%x", get_u16(p+70));
 
     mp4tree_print(p+70, len - 78, depth);
 //    mp4tree_hexdump(p+72, len - 78, depth);
@@ -1066,9 +1246,12 @@ mp4tree_box_stsd_print(
     uint32_t        flags       = get_u24(p+1);
     const uint32_t  num_entries = get_u32(p+4);
 
-    printf("%s  Version:     %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:       0x%.6x\n", indent(depth, 0), flags);
-    printf("%s  Num Entries: %u\n", indent(depth, 0), num_entries);
+    out_field(depth, "Version:     ", "%u", p[0]);
+    out_field(depth, "Flags:       ", "0x%.6x", flags);
+    out_field(depth, "Num Entries: ", "%u", num_entries);
+
+    if (len >= 16)
+        memcpy(mp4tree_track_current()->format, p + 12, 4);
 
     /* Print recursive boxes */
     mp4tree_print(p + 8, len - 8, depth);
@@ -1081,9 +1264,8 @@ mp4tree_box_mime_print(
     size_t          len,
     int             depth)
 {
-    printf("%s  Version and Flags: %u\n", indent(depth, 0), get_u32(p));
-    printf("%s  Content Type: %.*s\n", indent(depth, 0),
-           (int)(len - 4), (const char *)p + 4);
+    out_field(depth, "Version and Flags: ", "%u", get_u32(p));
+    out_field(depth, "Content Type: ", "%.*s", (int)(len - 4), (const char *)p + 4);
 }
 
 /* 14496-12:2015 12.6.3.2 */
@@ -1093,22 +1275,22 @@ mp4tree_box_stpp_print(
     size_t          len,
     int             depth)
 {
-    printf("%s  Reference Index: %u\n", indent(depth, 0), get_u16(p + 6));
+    out_field(depth, "Reference Index: ", "%u", get_u16(p + 6));
 
     do {
         const uint8_t *pp = p;
         const uint8_t *end = p + len;
 
         pp += 8;
-        printf("%s  Namespace:       %s\n", indent(depth, 0), (const char *)pp);
+        out_field(depth, "Namespace:       ", "%s", (const char *)pp);
         pp += strlen((const char *)pp) + 1;
         if (pp >= end)
             break;
-        printf("%s  Scheme Location: %s\n", indent(depth, 0), (const char *)pp);
+        out_field(depth, "Scheme Location: ", "%s", (const char *)pp);
         pp += strlen((const char *)pp) + 1;
         if (pp >= end)
             break;
-        printf("%s  Aux Mime Type:   %s\n", indent(depth, 0), (const char *)pp);
+        out_field(depth, "Aux Mime Type:   ", "%s", (const char *)pp);
         pp += strlen((const char *)pp) + 1;
         if (pp >= end)
             break;
@@ -1126,14 +1308,12 @@ mp4tree_box_ftyp_print(
 {
     const uint8_t  * pp;
 
-    printf("%s  Major brand:   %c%c%c%c\n",
-               indent(depth, 0), p[0], p[1], p[2], p[3]);
-    printf("%s  Minor version: %u\n",indent(depth, 0), get_u32(p + 4));
+    out_field(depth, "Major brand:   ", "%c%c%c%c", p[0], p[1], p[2], p[3]);
+    out_field(depth, "Minor version: ", "%u", get_u32(p + 4));
 
     for (pp = p + 8; pp < p + len; pp += 4)
     {
-        printf("%s  Compability brand: %c%c%c%c\n",
-               indent(depth, 0), pp[0], pp[1], pp[2], pp[3]);
+        out_field(depth, "Compability brand: ", "%c%c%c%c", pp[0], pp[1], pp[2], pp[3]);
     }
 }
 
@@ -1143,7 +1323,7 @@ mp4tree_box_mfhd_print(
     size_t          len,
     int             depth)
 {
-    printf("%s  Sequence Number: %u\n", indent(depth, 0), get_u32(p+4));
+    out_field(depth, "Sequence Number: ", "%u", get_u32(p+4));
 }
 
 static void
@@ -1154,22 +1334,22 @@ mp4tree_box_mvhd_print(
 {
     mp4tree_hexdump(p, 128, depth);
 
-    printf("%s  Version:            %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:              0x%.2x%.2x%.2x\n", indent(depth, 0), p[1], p[2], p[3]);
-    printf("%s  Creation time:      %u\n",indent(depth, 0), get_u32(p+4));
-    printf("%s  Modification time:  %u\n",indent(depth, 0), get_u32(p+8));
-    printf("%s  Time scale:         %u\n",indent(depth, 0), get_u32(p+12));
-    printf("%s  Duration:           %u\n",indent(depth, 0), get_u32(p+16));
-    printf("%s  Preferred rate:     %u\n",indent(depth, 0), get_u32(p+20));
-    printf("%s  Preferred volume:   %u\n",indent(depth, 0), get_u16(p+24));
+    out_field(depth, "Version:            ", "%u", p[0]);
+    out_field(depth, "Flags:              ", "0x%.2x%.2x%.2x", p[1], p[2], p[3]);
+    out_field(depth, "Creation time:      ", "%u", get_u32(p+4));
+    out_field(depth, "Modification time:  ", "%u", get_u32(p+8));
+    out_field(depth, "Time scale:         ", "%u", get_u32(p+12));
+    out_field(depth, "Duration:           ", "%u", get_u32(p+16));
+    out_field(depth, "Preferred rate:     ", "%u", get_u32(p+20));
+    out_field(depth, "Preferred volume:   ", "%u", get_u16(p+24));
 //    printf("%s  Matrix structure:   %u\n",indent(depth, 0), get_u32(p+2));
-    printf("%s  Preview time:       %u\n",indent(depth, 0), get_u32(p+72));
-    printf("%s  Preview duration:   %u\n",indent(depth, 0), get_u32(p+76));
-    printf("%s  Poster time:        %u\n",indent(depth, 0), get_u32(p+80));
-    printf("%s  Selection time:     %u\n",indent(depth, 0), get_u32(p+84));
-    printf("%s  Selection duration: %u\n",indent(depth, 0), get_u32(p+88));
-    printf("%s  Current Time:       %u\n",indent(depth, 0), get_u32(p+92));
-    printf("%s  Next track ID       %u\n",indent(depth, 0), get_u32(p+96));
+    out_field(depth, "Preview time:       ", "%u", get_u32(p+72));
+    out_field(depth, "Preview duration:   ", "%u", get_u32(p+76));
+    out_field(depth, "Poster time:        ", "%u", get_u32(p+80));
+    out_field(depth, "Selection time:     ", "%u", get_u32(p+84));
+    out_field(depth, "Selection duration: ", "%u", get_u32(p+88));
+    out_field(depth, "Current Time:       ", "%u", get_u32(p+92));
+    out_field(depth, "Next track ID       ", "%u", get_u32(p+96));
 }
 
 static void
@@ -1178,8 +1358,8 @@ mp4tree_box_iods_print(
     size_t          len,
     int             depth)
 {
-    printf("%s  Version:            %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:              0x%.2x%.2x%.2x\n", indent(depth, 0), p[1], p[2], p[3]);
+    out_field(depth, "Version:            ", "%u", p[0]);
+    out_field(depth, "Flags:              ", "0x%.2x%.2x%.2x", p[1], p[2], p[3]);
     mp4tree_hexdump(p, len, depth);
 }
 
@@ -1189,14 +1369,16 @@ mp4tree_box_mdhd_print(
     size_t          len,
     int             depth)
 {
-    printf("%s  Version:            %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:              0x%.2x%.2x%.2x\n", indent(depth, 0), p[1], p[2], p[3]);
-    printf("%s  Creation time:      %u\n",indent(depth, 0), get_u32(p+4));
-    printf("%s  Modification time:  %u\n",indent(depth, 0), get_u32(p+8));
-    printf("%s  Time scale:         %u\n",indent(depth, 0), get_u32(p+12));
-    printf("%s  Duration:           %u\n",indent(depth, 0), get_u32(p+16));
-    printf("%s  Language:           %u\n",indent(depth, 0), get_u16(p+20));
-    printf("%s  Quality:            %u\n",indent(depth, 0), get_u16(p+22));
+    out_field(depth, "Version:            ", "%u", p[0]);
+    out_field(depth, "Flags:              ", "0x%.2x%.2x%.2x", p[1], p[2], p[3]);
+    out_field(depth, "Creation time:      ", "%u", get_u32(p+4));
+    out_field(depth, "Modification time:  ", "%u", get_u32(p+8));
+    out_field(depth, "Time scale:         ", "%u", get_u32(p+12));
+    out_field(depth, "Duration:           ", "%u", get_u32(p+16));
+    out_field(depth, "Language:           ", "%u", get_u16(p+20));
+    out_field(depth, "Quality:            ", "%u", get_u16(p+22));
+
+    mp4tree_track_mdhd(p, len);
 }
 
 static void
@@ -1205,10 +1387,13 @@ mp4tree_box_vmhd_print(
     size_t          len,
     int             depth)
 {
-    printf("%s  Version:      %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:        0x%.2x%.2x%.2x\n", indent(depth, 0), p[1], p[2], p[3]);
-    printf("%s  Graphic mode: %u\n",indent(depth, 0), get_u16(p+4));
-    printf("%s  Opcolor       TODO\n",indent(depth, 0));
+    out_field(depth, "Version:      ", "%u", p[0]);
+    out_field(depth, "Flags:        ", "0x%.2x%.2x%.2x", p[1], p[2], p[3]);
+    out_field(depth, "Graphic mode: ", "%u", get_u16(p+4));
+    out_printf("%s  Opcolor       TODO\n",indent(depth, 0));
+
+    /* Only the minf of a video track has a vmhd */
+    mp4tree_track_current()->video = true;
 }
 
 static void
@@ -1222,7 +1407,7 @@ mp4tree_box_tfhd_optional_print(
     {
         if (p + 8 > end)
             return;
-        printf("%s  Base Data Offset:        %"PRIu64"\n", indent(depth, 0), get_u64(p));
+        out_field(depth, "Base Data Offset:        ", "%"PRIu64, get_u64(p));
         p += 8;
     }
 
@@ -1230,7 +1415,7 @@ mp4tree_box_tfhd_optional_print(
     {
         if (p + 4 > end)
             return;
-        printf("%s  Sample Desc Index:       %d\n", indent(depth, 0), get_u32(p));
+        out_field(depth, "Sample Desc Index:       ", "%d", get_u32(p));
         p += 4;
     }
 
@@ -1238,7 +1423,7 @@ mp4tree_box_tfhd_optional_print(
     {
         if (p + 4 > end)
             return;
-        printf("%s  Default Sample Duration: %d\n", indent(depth, 0), get_u32(p));
+        out_field(depth, "Default Sample Duration: ", "%d", get_u32(p));
         p += 4;
     }
 
@@ -1246,7 +1431,7 @@ mp4tree_box_tfhd_optional_print(
     {
         if (p + 4 > end)
             return;
-        printf("%s  Default Sample Size:     %d\n", indent(depth, 0), get_u32(p));
+        out_field(depth, "Default Sample Size:     ", "%d", get_u32(p));
         p += 4;
     }
 
@@ -1254,7 +1439,7 @@ mp4tree_box_tfhd_optional_print(
     {
         if (p + 4 > end)
             return;
-        printf("%s  Default Sample Flags:    0x%x\n", indent(depth, 0), get_u32(p));
+        out_field(depth, "Default Sample Flags:    ", "0x%x", get_u32(p));
         p += 4;
     }
 }
@@ -1267,10 +1452,135 @@ mp4tree_box_tfhd_print(
 {
     uint32_t        flags       = get_u24(p+1);
 
-    printf("%s  Version:     %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:       0x%.6x\n", indent(depth, 0), flags);
-    printf("%s  Track ID:   0x%d\n", indent(depth, 0), get_u32(p + 4));
+    out_field(depth, "Version:     ", "%u", p[0]);
+    out_field(depth, "Flags:       ", "0x%.6x", flags);
+    out_field(depth, "Track ID:   ", "0x%d", get_u32(p + 4));
     mp4tree_box_tfhd_optional_print(p + 8, p + len, depth, flags);
+
+    /* Selects the track the rest of the traf is printed for */
+    mp4tree_track_tfhd(p, len);
+    mp4tree_h264_track_select(get_u32(p + 4));
+    mp4tree_hevc_track_select(get_u32(p + 4));
+}
+
+static void
+mp4tree_box_tfdt_print(
+    const uint8_t * p,
+    size_t          len,
+    int             depth)
+{
+    out_field(depth, "Version:                ", "%u", p[0]);
+    out_field(depth, "Flags:                  ", "0x%.6x", get_u24(p+1));
+
+    if (p[0] == 1 && len >= 12)
+        out_field(depth, "Base Media Decode Time: ", "%"PRIu64, get_u64(p+4));
+    else if (len >= 8)
+        out_field(depth, "Base Media Decode Time: ", "%u", get_u32(p+4));
+}
+
+static void
+mp4tree_box_sidx_print(
+    const uint8_t * p,
+    size_t          len,
+    int             depth)
+{
+    const char *       prefix = indent(depth, 0);
+    mp4tree_sidx_t     sidx;
+    mp4tree_sidx_ref_t ref;
+    unsigned int       i;
+
+    if (!mp4tree_sidx_parse(p, len, &sidx))
+    {
+        mp4tree_hexdump(p, len, depth);
+        return;
+    }
+
+    out_field(depth, "Version:                    ", "%u", sidx.version);
+    out_field(depth, "Flags:                      ", "0x%.6x", get_u24(p+1));
+    out_field(depth, "Reference ID:               ", "%u", sidx.reference_id);
+    out_field(depth, "Timescale:                  ", "%u", sidx.timescale);
+    out_field(depth, "Earliest Presentation Time: ", "%"PRIu64, sidx.earliest_presentation_time);
+    out_field(depth, "First Offset:               ", "%"PRIu64, sidx.first_offset);
+    out_field(depth, "Reference Count:            ", "%u", sidx.reference_count);
+
+    out_printf("%s  References:\n", prefix);
+    out_printf("%s             Type      Size    Duration   SAP   SAP Type   SAP Delta Time\n", prefix);
+    for (i = 0; i < sidx.reference_count; i++)
+    {
+        uint64_t row[6];
+
+        mp4tree_sidx_ref_get(&sidx, i, &ref);
+        row[0] = ref.is_index;
+        row[1] = ref.size;
+        row[2] = ref.duration;
+        row[3] = ref.starts_with_sap;
+        row[4] = ref.sap_type;
+        row[5] = ref.sap_delta_time;
+        out_sample("References", i, row, 6, depth);
+
+        out_printf("%s      %3u:   %-5s %9u %11u %5u %10u %16u\n", prefix, i + 1,
+                   ref.is_index ? "sidx" : "media", ref.size, ref.duration,
+                   ref.starts_with_sap, ref.sap_type, ref.sap_delta_time);
+    }
+}
+
+static void
+mp4tree_box_tfra_print(
+    const uint8_t * p,
+    size_t          len,
+    int             depth)
+{
+    const char *         prefix = indent(depth, 0);
+    mp4tree_tfra_t       tfra;
+    mp4tree_tfra_entry_t entry;
+    uint32_t             i;
+
+    if (!mp4tree_tfra_parse(p, len, &tfra))
+    {
+        mp4tree_hexdump(p, len, depth);
+        return;
+    }
+
+    out_field(depth, "Version:     ", "%u", tfra.version);
+    out_field(depth, "Flags:       ", "0x%.6x", get_u24(p+1));
+    out_field(depth, "Track ID:    ", "%u", tfra.track_id);
+    out_field(depth, "Num Entries: ", "%u", tfra.entry_count);
+
+    out_printf("%s  Entries:\n", prefix);
+    out_printf("%s                     Time        Moof Offset   Traf   Trun   Sample\n", prefix);
+    for (i = 0; i < tfra.entry_count; i++)
+    {
+        uint64_t row[5];
+
+        mp4tree_tfra_entry_get(&tfra, i, &entry);
+        row[0] = entry.time;
+        row[1] = entry.moof_offset;
+        row[2] = entry.traf_number;
+        row[3] = entry.trun_number;
+        row[4] = entry.sample_number;
+        out_sample("Entries", i, row, 5, depth);
+
+        out_printf("%s      %3u: %16"PRIu64" %18"PRIu64" %6u %6u %8u\n", prefix, i + 1,
+                   entry.time, entry.moof_offset, entry.traf_number,
+                   entry.trun_number, entry.sample_number);
+    }
+}
+
+static void
+mp4tree_box_mfro_print(
+    const uint8_t * p,
+    size_t          len,
+    int             depth)
+{
+    if (len < 8)
+    {
+        mp4tree_hexdump(p, len, depth);
+        return;
+    }
+
+    out_field(depth, "Version: ", "%u", p[0]);
+    out_field(depth, "Flags:   ", "0x%.6x", get_u24(p+1));
+    out_field(depth, "Size:    ", "%u", get_u32(p+4));
 }
 
 static void
@@ -1295,10 +1605,10 @@ mp4tree_box_size_print(
         "MDAT"
     };
 
-    printf("%s  Version: %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:   0x%.6x\n", indent(depth, 0), flags);
-    printf("%s  Entries: %u\n", indent(depth, 0), entries);
-    printf("%s  Sizes:   \n", indent(depth, 0));
+    out_field(depth, "Version: ", "%u", p[0]);
+    out_field(depth, "Flags:   ", "0x%.6x", flags);
+    out_field(depth, "Entries: ", "%u", entries);
+    out_printf("%s  Sizes:   \n", indent(depth, 0));
 
     p += 8;
 
@@ -1311,7 +1621,10 @@ mp4tree_box_size_print(
         if (type < sizeof(typeMap)/sizeof(typeMap[0]))
             type_str = typeMap[type];
 
-        printf("%s    %s (%u): %u\n", indent(depth, 0), type_str, type, size);
+        uint64_t row[2] = { type, size };
+
+        out_sample("Sizes", i, row, 2, depth);
+        out_printf("%s    %s (%u): %u\n", indent(depth, 0), type_str, type, size);
         p += 5;
     }
 }
@@ -1326,29 +1639,32 @@ mp4tree_box_nals_print(
     const uint32_t  samples  = get_u32(p+4);
     uint32_t i = 0;
 
-    printf("%s  Version:      %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:        0x%.6x\n", indent(depth, 0), flags);
-    printf("%s  Sample Count: %u\n", indent(depth, 0), samples);
-    printf("%s  Samples:\n", indent(depth, 0));
+    out_field(depth, "Version:      ", "%u", p[0]);
+    out_field(depth, "Flags:        ", "0x%.6x", flags);
+    out_field(depth, "Sample Count: ", "%u", samples);
+    out_printf("%s  Samples:\n", indent(depth, 0));
 
     p += 8;
 
     for (i = 0; i < samples; i++)
     {
         uint8_t nal_count = p[0];
-        printf("%s    Sample:    %u\n", indent(depth, 0), i + 1);
-        printf("%s    NAL Count: %u\n", indent(depth, 0), nal_count);
-        printf("%s    NALs:\n", indent(depth, 0));
+        out_printf("%s    Sample:    %u\n", indent(depth, 0), i + 1);
+        out_printf("%s    NAL Count: %u\n", indent(depth, 0), nal_count);
+        out_printf("%s    NALs:\n", indent(depth, 0));
         p++;
 
         if (nal_count)
         {
             uint32_t j;
-            printf("%s      Type  Size\n", indent(depth, 0));
+            out_printf("%s      Type  Size\n", indent(depth, 0));
 
             for (j = 0; j < nal_count; j++)
             {
-                printf("%s      %2u %6u\n",  indent(depth, 0), p[0], get_u32(p+1));
+                uint64_t row[3] = { i, p[0], get_u32(p+1) };
+
+                out_sample("NALs", j, row, 3, depth);
+                out_printf("%s      %2u %6u\n",  indent(depth, 0), p[0], get_u32(p+1));
                 p += 5;
             }
         }
@@ -1362,22 +1678,23 @@ mp4tree_box_tkhd_print(
     size_t          len,
     int             depth)
 {
-    printf("%s  Version:            %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:              0x%.2x%.2x%.2x\n", indent(depth, 0), p[1], p[2], p[3]);
-    printf("%s  Creation time:      %u\n",indent(depth, 0), get_u32(p+4));
-    printf("%s  Modification time:  %u\n",indent(depth, 0), get_u32(p+8));
-    printf("%s  Track ID:           %u\n",indent(depth, 0), get_u32(p+12));
+    out_field(depth, "Version:            ", "%u", p[0]);
+    out_field(depth, "Flags:              ", "0x%.2x%.2x%.2x", p[1], p[2], p[3]);
+    out_field(depth, "Creation time:      ", "%u", get_u32(p+4));
+    out_field(depth, "Modification time:  ", "%u", get_u32(p+8));
+    out_field(depth, "Track ID:           ", "%u", get_u32(p+12));
+    mp4tree_track_select(p[0] == 1 ? get_u32(p + 20) : get_u32(p + 12));
     /* Reserved 4 bytes */
-    printf("%s  Duration:           %u\n",indent(depth, 0), get_u32(p+20));
+    out_field(depth, "Duration:           ", "%u", get_u32(p+20));
     /* Reserved 8 bytes */
-    printf("%s  Layer:              %u\n",indent(depth, 0), get_u16(p+32));
-    printf("%s  Alternate groupe:   %u\n",indent(depth, 0), get_u16(p+34));
-    printf("%s  Volume:             %u\n",indent(depth, 0), get_u16(p+36));
+    out_field(depth, "Layer:              ", "%u", get_u16(p+32));
+    out_field(depth, "Alternate groupe:   ", "%u", get_u16(p+34));
+    out_field(depth, "Volume:             ", "%u", get_u16(p+36));
     /* Reserved 2 bytes */
 
 //    printf("%s  Matrix structure:   %u\n",indent(depth, 0), get_u32(p+2));
-    printf("%s  Track width:        %u\n",indent(depth, 0), get_u32(p+76));
-    printf("%s  Track height:       %u\n",indent(depth, 0), get_u32(p+80));
+    out_field(depth, "Track width:        ", "%u", get_u32(p+76));
+    out_field(depth, "Track height:       ", "%u", get_u32(p+80));
 }
 
 static void
@@ -1390,16 +1707,20 @@ mp4tree_box_trun_print(
     const uint32_t  samples  = get_u32(p+4);
     char table_hdr[128] = {0};
     int  table_fields = 0;
+    mp4tree_trun_t  trun;
+
+    /* Where the samples are, for printing the mdat */
+    mp4tree_track_trun(p, len, &trun);
 
-    printf("%s  Version:     %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:       0x%.6x\n", indent(depth, 0), flags);
-    printf("%s  Samples:     %u\n", indent(depth, 0), samples);
+    out_field(depth, "Version:     ", "%u", p[0]);
+    out_field(depth, "Flags:       ", "0x%.6x", flags);
+    out_field(depth, "Samples:     ", "%u", samples);
 
     p +=8;
 
     if (flags & 1)
     {
-        printf("%s  Data Offset: %u\n", indent(depth, 0), get_u32(p));
+        out_field(depth, "Data Offset: ", "%u", get_u32(p));
         p += 4;
     }
 
@@ -1439,14 +1760,14 @@ mp4tree_box_hdlr_print(
     size_t          len,
     int             depth)
 {
-    printf("%s  Version:                %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:                  0x%.2x%.2x%.2x\n", indent(depth, 0), p[1], p[2], p[3]);
-    printf("%s  Component type:         %u\n",indent(depth, 0), get_u32(p+4));
-    printf("%s  Component subtype:      %.*s\n",indent(depth, 0), 4, p+8);
-    printf("%s  Component manufacturer: %.*s\n",indent(depth, 0), 4, p+8);
-    printf("%s  Component flags:        %u\n",indent(depth, 0), get_u32(p+12));
-    printf("%s  Component flags mask:   %u\n",indent(depth, 0), get_u32(p+16));
-    printf("%s  Component name:         %u\n",indent(depth, 0), get_u32(p+12));
+    out_field(depth, "Version:                ", "%u", p[0]);
+    out_field(depth, "Flags:                  ", "0x%.2x%.2x%.2x", p[1], p[2], p[3]);
+    out_field(depth, "Component type:         ", "%u", get_u32(p+4));
+    out_field(depth, "Component subtype:      ", "%.*s", 4, p+8);
+    out_field(depth, "Component manufacturer: ", "%.*s", 4, p+8);
+    out_field(depth, "Component flags:        ", "%u", get_u32(p+12));
+    out_field(depth, "Component flags mask:   ", "%u", get_u32(p+16));
+    out_field(depth, "Component name:         ", "%u", get_u32(p+12));
 }
 
 static void
@@ -1457,9 +1778,9 @@ mp4tree_box_stts_print(
 {
     const int num = get_u32(p+4);
 
-    printf("%s  Version:     %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:       0x%.2x%.2x%.2x\n", indent(depth, 0), p[1], p[2], p[3]);
-    printf("%s  Num Entries: %u\n", indent(depth, 0), num);
+    out_field(depth, "Version:     ", "%u", p[0]);
+    out_field(depth, "Flags:       ", "0x%.2x%.2x%.2x", p[1], p[2], p[3]);
+    out_field(depth, "Num Entries: ", "%u", num);
 
     mp4tree_table_print("Time-to-sample table",
                         "Sample count | Sample duration",
@@ -1474,11 +1795,11 @@ mp4tree_box_ctts_print(
 {
     const int num = get_u32(p+4);
 
-    printf("%s  Version:     %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:       0x%.2x%.2x%.2x\n", indent(depth, 0), p[1], p[2], p[3]);
-    printf("%s  Num Entries: %u\n", indent(depth, 0), num);
-    printf("%s  Composition-offset table:\n", indent(depth, 0));
-    printf("%s        Sample count | Composition offset\n", indent(depth, 0));
+    out_field(depth, "Version:     ", "%u", p[0]);
+    out_field(depth, "Flags:       ", "0x%.2x%.2x%.2x", p[1], p[2], p[3]);
+    out_field(depth, "Num Entries: ", "%u", num);
+    out_printf("%s  Composition-offset table:\n", indent(depth, 0));
+    out_printf("%s        Sample count | Composition offset\n", indent(depth, 0));
 
     mp4tree_table_print("Composition-offset table",
                         "Sample count | Composition offset",
@@ -1493,9 +1814,9 @@ mp4tree_box_stsc_print(
 {
     const int num = get_u32(p+4);
 
-    printf("%s  Version:     %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:       0x%.2x%.2x%.2x\n", indent(depth, 0), p[1], p[2], p[3]);
-    printf("%s  Num Entries: %u\n", indent(depth, 0), num);
+    out_field(depth, "Version:     ", "%u", p[0]);
+    out_field(depth, "Flags:       ", "0x%.2x%.2x%.2x", p[1], p[2], p[3]);
+    out_field(depth, "Num Entries: ", "%u", num);
 
     mp4tree_table_print("Composition-offset table",
                         "First chunk | Samples per chunk | Sample Description ID",
@@ -1511,10 +1832,10 @@ mp4tree_box_stsz_print(
     const int sample_size = get_u32(p+4);
     const int num         = get_u32(p+8);
 
-    printf("%s  Version:     %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:       0x%.2x%.2x%.2x\n", indent(depth, 0), p[1], p[2], p[3]);
-    printf("%s  Sample size: %u\n", indent(depth, 0), sample_size);
-    printf("%s  Num Entries: %u\n", indent(depth, 0), num);
+    out_field(depth, "Version:     ", "%u", p[0]);
+    out_field(depth, "Flags:       ", "0x%.2x%.2x%.2x", p[1], p[2], p[3]);
+    out_field(depth, "Sample size: ", "%u", sample_size);
+    out_field(depth, "Num Entries: ", "%u", num);
 
     mp4tree_table_print("Sample size table",
                         "Size",
@@ -1529,15 +1850,50 @@ mp4tree_box_stco_print(
 {
     const int num = get_u32(p+4);
 
-    printf("%s  Version:     %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:       0x%.2x%.2x%.2x\n", indent(depth, 0), p[1], p[2], p[3]);
-    printf("%s  Num Entries: %u\n", indent(depth, 0), num);
+    out_field(depth, "Version:     ", "%u", p[0]);
+    out_field(depth, "Flags:       ", "0x%.2x%.2x%.2x", p[1], p[2], p[3]);
+    out_field(depth, "Num Entries: ", "%u", num);
 
     mp4tree_table_print("Sample size table",
                         "Size",
                         p + 8, 4, 1, num, depth);
 }
 
+static void
+mp4tree_box_co64_print(
+    const uint8_t * p,
+    size_t          len,
+    int             depth)
+{
+    const char * prefix = indent(depth, 0);
+    uint32_t     num;
+    uint32_t     i;
+
+    if (len < 8)
+    {
+        mp4tree_hexdump(p, len, depth);
+        return;
+    }
+
+    num = get_u32(p+4);
+    if (num > (len - 8) / 8)
+        num = (len - 8) / 8;
+
+    out_field(depth, "Version:     ", "%u", p[0]);
+    out_field(depth, "Flags:       ", "0x%.2x%.2x%.2x", p[1], p[2], p[3]);
+    out_field(depth, "Num Entries: ", "%u", num);
+
+    out_printf("%s  Chunk offset table:\n", prefix);
+    out_printf("%s             Offset\n", prefix);
+    for (i = 0; i < num; i++)
+    {
+        uint64_t offset = get_u64(p + 8 + 8 * i);
+
+        out_sample("Chunk offset table", i, &offset, 1, depth);
+        out_printf("%s      %3u:   %6"PRIu64"\n", prefix, i + 1, offset);
+    }
+}
+
 static void
 mp4tree_box_stss_print(
     const uint8_t * p,
@@ -1546,9 +1902,9 @@ mp4tree_box_stss_print(
 {
     const int num = get_u32(p+4);
 
-    printf("%s  Version:     %u\n",indent(depth, 0), p[0]);
-    printf("%s  Flags:       0x%.2x%.2x%.2x\n", indent(depth, 0), p[1], p[2], p[3]);
-    printf("%s  Num Entries: %u\n", indent(depth, 0), num);
+    out_field(depth, "Version:     ", "%u", p[0]);
+    out_field(depth, "Flags:       ", "0x%.2x%.2x%.2x", p[1], p[2], p[3]);
+    out_field(depth, "Num Entries: ", "%u", num);
 
     mp4tree_table_print("Sync sample table",
                         "Size",
@@ -1566,9 +1922,9 @@ mp4tree_box_subs_print(
     const int version = p[0];
     int entry, sub, last_entry = 0;
 
-    printf("%s  Version:     %u\n",indent(depth, 0), version);
-    printf("%s  Flags:       0x%.2x%.2x%.2x\n", indent(depth, 0), p[1], p[2], p[3]);
-    printf("%s  Num Entries: %u\n", indent(depth, 0), num);
+    out_field(depth, "Version:     ", "%u", version);
+    out_field(depth, "Flags:       ", "0x%.2x%.2x%.2x", p[1], p[2], p[3]);
+    out_field(depth, "Num Entries: ", "%u", num);
 
     p += 8;
 
@@ -1581,25 +1937,32 @@ mp4tree_box_subs_print(
         if (sub_count)
         {
             last_entry += delta;
-            printf("%s      %3u      Size     Prio  Discardable\n",
-                   indent(depth, 0), last_entry);
+            out_printf("%s      %3u      Size     Prio  Discardable\n",
+                       indent(depth, 0), last_entry);
         }
         for (sub = 0; sub < sub_count; sub++)
         {
-            printf("%s      %3d:", indent(depth, 0), sub + 1);
+            uint64_t row[3];
+
+            out_printf("%s      %3d:", indent(depth, 0), sub + 1);
             if (version == 1)
             {
-                printf("   %6u", get_u32(p));
+                row[0] = get_u32(p);
+                out_printf("   %6u", get_u32(p));
                 p += 4;
             }
             else
             {
-                printf("   %6u", get_u16(p));
+                row[0] = get_u16(p);
+                out_printf("   %6u", get_u16(p));
                 p += 2;
             }
-            printf("   %6u", p[0]);
-            printf("   %6u", p[1]);
-            printf("\n");
+            row[1] = p[0];
+            row[2] = p[1];
+            out_sample("Subsamples", sub, row, 3, depth);
+            out_printf("   %6u", p[0]);
+            out_printf("   %6u", p[1]);
+            out_printf("\n");
             p += 6;
         }
     }
@@ -1611,9 +1974,50 @@ mp4tree_box_mdat_print(
     size_t          len,
     int             depth)
 {
-    if (mdat_printer != NULL)
+    const mp4tree_track_run_t * runs;
+    const int                   num_runs = mp4tree_track_runs(&runs);
+    const uint64_t              start    = out_offset(p);
+    const uint64_t              end      = start + len;
+    mp4tree_parse_func          printer;
+    bool                        found    = false;
+    int                         i;
+
+    /* The samples of each trun of the moof are printed for their own track */
+    for (i = 0; i < num_runs; i++)
     {
-        mdat_printer(p, len, depth);
+        const mp4tree_track_t * track = mp4tree_track_find(runs[i].track_id);
+        uint64_t                lo    = runs[i].offset;
+        uint64_t                hi    = runs[i].offset + runs[i].size;
+
+        lo = lo > start ? lo : start;
+        hi = hi < end ? hi : end;
+        if (lo >= hi)
+            continue;
+
+        found = true;
+
+        /* Tracks without a sample entry, e.g. of a segment printed without its init
+           segment, get the default printer, those with another codec nothing */
+        printer = track ? track->mdat_printer : NULL;
+        if (printer == NULL && (track == NULL || track->format[0] == 0))
+            printer = mp4tree_track_mdat_printer();
+        if (printer == NULL && (track == NULL || track->format[0] == 0))
+            printer = mp4tree_box_mdat_h264_print;
+        if (printer == NULL)
+            continue;
+
+        mp4tree_h264_track_select(runs[i].track_id);
+        mp4tree_hevc_track_select(runs[i].track_id);
+        printer(p + (lo - start), hi - lo, depth);
+    }
+
+    if (found)
+        return;
+
+    printer = mp4tree_track_mdat_printer();
+    if (printer != NULL)
+    {
+        printer(p, len, depth);
     }
     else
     {
@@ -1622,16 +2026,16 @@ mp4tree_box_mdat_print(
     }
 }
 
-/* 14496-12:2015 8.8.3 */
+/* 14496-12:2015 8.8.3, from the least significant bit up as laid out by gcc on x86 */
 struct trex_flags {
-    uint32_t reserved                    :  4;
-    uint32_t is_leading                  :  2;
-    uint32_t sample_depends_on           :  2;
-    uint32_t sample_is_depended_on       :  2;
-    uint32_t sample_has_redundancy       :  2;
-    uint32_t sample_padding_value        :  3;
-    uint32_t sample_is_non_sync_sample   :  1;
     uint32_t sample_degradation_priority : 16;
+    uint32_t sample_is_non_sync_sample   :  1;
+    uint32_t sample_padding_value        :  3;
+    uint32_t sample_has_redundancy       :  2;
+    uint32_t sample_is_depended_on       :  2;
+    uint32_t sample_depends_on           :  2;
+    uint32_t is_leading                  :  2;
+    uint32_t reserved                    :  4;
 };
 static void
 mp4tree_box_trex_print(
@@ -1639,21 +2043,23 @@ mp4tree_box_trex_print(
     size_t          len,
     int             depth)
 {
-    uint32_t flags_value = get_u32(p + 16);
+    uint32_t flags_value = get_u32(p + 20);
     const struct trex_flags *flags = (const struct trex_flags *)&flags_value;
 
-    printf("%s  Track ID:                %u\n", indent(depth, 0), get_u32(p));
-    printf("%s  Default sample description index: %u\n", indent(depth, 0), get_u32(p + 4));
-    printf("%s  Default sample duration: %u\n", indent(depth, 0), get_u32(p + 8));
-    printf("%s  Default sample size:     %u\n", indent(depth, 0), get_u32(p + 12));
-
-    printf("%s  Is Leading:              %u\n", indent(depth, 0), flags->is_leading);
-    printf("%s  Sample Depends On:       %u\n", indent(depth, 0), flags->sample_depends_on);
-    printf("%s  Sample Is Depended On:   %u\n", indent(depth, 0), flags->sample_is_depended_on);
-    printf("%s  Sample Has Redundancy:   %u\n", indent(depth, 0), flags->sample_has_redundancy);
-    printf("%s  Sample Padding Value:    %u\n", indent(depth, 0), flags->sample_padding_value);
-    printf("%s  Sample Is Non-Sync:      %u\n", indent(depth, 0), flags->sample_is_non_sync_sample);
-    printf("%s  Sample Degradation Prio: %u\n", indent(depth, 0), flags->sample_degradation_priority);
+    /* The fields follow the version and flags of the full box */
+    out_field(depth, "Track ID:                ", "%u", get_u32(p + 4));
+    out_field(depth, "Default sample description index: ", "%u", get_u32(p + 8));
+    out_field(depth, "Default sample duration: ", "%u", get_u32(p + 12));
+    out_field(depth, "Default sample size:     ", "%u", get_u32(p + 16));
+    mp4tree_track_trex(p, len);
+
+    out_field(depth, "Is Leading:              ", "%u", flags->is_leading);
+    out_field(depth, "Sample Depends On:       ", "%u", flags->sample_depends_on);
+    out_field(depth, "Sample Is Depended On:   ", "%u", flags->sample_is_depended_on);
+    out_field(depth, "Sample Has Redundancy:   ", "%u", flags->sample_has_redundancy);
+    out_field(depth, "Sample Padding Value:    ", "%u", flags->sample_padding_value);
+    out_field(depth, "Sample Is Non-Sync:      ", "%u", flags->sample_is_non_sync_sample);
+    out_field(depth, "Sample Degradation Prio: ", "%u", flags->sample_degradation_priority);
 }
 
 static void
@@ -1674,8 +2080,8 @@ mp4tree_box_emsg_print(
         // unsigned int(32)  presentation_time_delta;
         // unsigned int(32)  event_duration;
         // unsigned int(32)  id;
-        printf("%s  Version:            %u\n", indent(depth, 0), version);
-        printf("%s  Note:               Parsing of emsg v0 not implemented\n", indent(depth, 0));
+        out_field(depth, "Version:            ", "%u", version);
+        out_field(depth, "Note:               ", "Parsing of emsg v0 not implemented");
         return;
     }
     else if (version == 1)
@@ -1699,96 +2105,124 @@ mp4tree_box_emsg_print(
 
         message_ptr = data;
 
-        printf("%s  Version:            %u\n", indent(depth, 0), version);
-        printf("%s  Timescale:          %u\n", indent(depth, 0), timescale);
-        printf("%s  Presentation time:  %" PRIu64 "\n", indent(depth, 0), presentation_time);
-        printf("%s  Event duration:     %u\n", indent(depth, 0), event_duration);
-        printf("%s  ID:                 %u\n", indent(depth, 0), id);
-        printf("%s  Scheme ID URI:      %s\n", indent(depth, 0), scheme_data);
-        printf("%s  Value:              %s\n", indent(depth, 0), value_data);
+        out_field(depth, "Version:            ", "%u", version);
+        out_field(depth, "Timescale:          ", "%u", timescale);
+        out_field(depth, "Presentation time:  ", "%" PRIu64, presentation_time);
+        out_field(depth, "Event duration:     ", "%u", event_duration);
+        out_field(depth, "ID:                 ", "%u", id);
+        out_field(depth, "Scheme ID URI:      ", "%s", scheme_data);
+        out_field(depth, "Value:              ", "%s", value_data);
     }
 
     size_t msg_bytes = len - (message_ptr - p);
-    printf("%s  Message size:       %lu\n", indent(depth, 0), msg_bytes);
-    printf("%s  Message:\n", indent(depth, 0));
+    out_field(depth, "Message size:       ", "%lu", msg_bytes);
+    out_printf("%s  Message:\n", indent(depth, 0));
     mp4tree_hexdump(data, msg_bytes, depth);
 }
 
-static mp4tree_parse_func
-mp4tree_box_printer_get(const uint8_t *p)
+/* Box printers, sorted by fourcc byte order for fourcc_lookup() */
+static const mp4tree_box_map_t box_map[] =
 {
-    static mp4tree_box_map_t box_map[] =
-    {
-        /* Non-null terminated 4 byte string plus function */
-
-        { "btrt", mp4tree_box_btrt_print },
-        { "ctab", mp4tree_print },
-        { "enca", mp4tree_box_stsd_sample_audio_print },
-        { "encv", mp4tree_box_stsd_sample_video_print },
-        { "frma", mp4tree_box_frma_print },
-        { "ftyp", mp4tree_box_ftyp_print },
-        { "styp", mp4tree_box_ftyp_print },
-        { "mfhd", mp4tree_box_mfhd_print },
-        { "moof", mp4tree_print },
-        { "moov", mp4tree_print },
-        { "mp4a", mp4tree_box_stsd_sample_audio_print },
-        { "mvhd", mp4tree_box_mvhd_print },
-        { "nals", mp4tree_box_nals_print },
-        { "iods", mp4tree_box_iods_print },
-        { "mdhd", mp4tree_box_mdhd_print },
-        { "hdlr", mp4tree_box_hdlr_print },
-        { "tfhd", mp4tree_box_tfhd_print },
-        { "trak", mp4tree_print },
-        { "tkhd", mp4tree_box_tkhd_print },
-        { "trun", mp4tree_box_trun_print },
-        { "ctab", mp4tree_box_ctab_print },
-        { "mdia", mp4tree_print },
-        { "minf", mp4tree_print },
-        { "stbl", mp4tree_print },
-        { "traf", mp4tree_print },
-        { "schi", mp4tree_print },
-        { "schm", mp4tree_box_schm_print },
-        { "senc", mp4tree_box_senc_print },
-        { "stsd", mp4tree_box_stsd_print },
-        { "stpp", mp4tree_box_stpp_print },
-        { "mime", mp4tree_box_mime_print },
-        { "avc1", mp4tree_box_stsd_sample_video_print },
-        { "avcC", mp4tree_box_stsd_avcC_print },
-        { "hev1", mp4tree_box_stsd_sample_video_print },
-        { "hvcC", mp4tree_box_stsd_hvcC_print },
-        { "stts", mp4tree_box_stts_print },
-        { "ctts", mp4tree_box_ctts_print },
-        { "sinf", mp4tree_print},
-        { "size", mp4tree_box_size_print },
-        { "saio", mp4tree_box_saio_print },
-        { "saiz", mp4tree_box_saiz_print },
-        { "stsc", mp4tree_box_stsc_print },
-        { "skip", mp4tree_print },
-        { "stsz", mp4tree_box_stsz_print },
-        { "stco", mp4tree_box_stco_print },
-        { "stss", mp4tree_box_stss_print },
-        { "subs", mp4tree_box_subs_print },
-        { "tenc", mp4tree_box_tenc_print },
-        { "uuid", mp4tree_box_uuid_print },
-        { "vmhd", mp4tree_box_vmhd_print },
-        { "mdat", mp4tree_box_mdat_print },
-        { "mvex", mp4tree_print },
-        { "trex", mp4tree_box_trex_print },
-        { "emsg", mp4tree_box_emsg_print },
-    };
+    /* Non-null terminated 4 byte string plus function */
+
+    { "avc1", mp4tree_box_stsd_sample_video_print },
+    { "avcC", mp4tree_box_stsd_avcC_print },
+    { "btrt", mp4tree_box_btrt_print },
+    { "co64", mp4tree_box_co64_print },
+    { "ctab", mp4tree_print },
+    { "ctts", mp4tree_box_ctts_print },
+    { "emsg", mp4tree_box_emsg_print },
+    { "enca", mp4tree_box_stsd_sample_audio_print },
+    { "encv", mp4tree_box_stsd_sample_video_print },
+    { "frma", mp4tree_box_frma_print },
+    { "ftyp", mp4tree_box_ftyp_print },
+    { "hdlr", mp4tree_box_hdlr_print },
+    { "hev1", mp4tree_box_stsd_sample_video_print },
+    { "hvcC", mp4tree_box_stsd_hvcC_print },
+    { "iods", mp4tree_box_iods_print },
+    { "mdat", mp4tree_box_mdat_print },
+    { "mdhd", mp4tree_box_mdhd_print },
+    { "mdia", mp4tree_print },
+    { "mfhd", mp4tree_box_mfhd_print },
+    { "mfra", mp4tree_print },
+    { "mfro", mp4tree_box_mfro_print },
+    { "mime", mp4tree_box_mime_print },
+    { "minf", mp4tree_print },
+    { "moof", mp4tree_print },
+    { "moov", mp4tree_print },
+    { "mp4a", mp4tree_box_stsd_sample_audio_print },
+    { "mvex", mp4tree_print },
+    { "mvhd", mp4tree_box_mvhd_print },
+    { "nals", mp4tree_box_nals_print },
+    { "saio", mp4tree_box_saio_print },
+    { "saiz", mp4tree_box_saiz_print },
+    { "schi", mp4tree_print },
+    { "schm", mp4tree_box_schm_print },
+    { "senc", mp4tree_box_senc_print },
+    { "sidx", mp4tree_box_sidx_print },
+    { "sinf", mp4tree_print },
+    { "size", mp4tree_box_size_print },
+    { "skip", mp4tree_print },
+    { "stbl", mp4tree_print },
+    { "stco", mp4tree_box_stco_print },
+    { "stpp", mp4tree_box_stpp_print },
+    { "stsc", mp4tree_box_stsc_print },
+    { "stsd", mp4tree_box_stsd_print },
+    { "stss", mp4tree_box_stss_print },
+    { "stsz", mp4tree_box_stsz_print },
+    { "stts", mp4tree_box_stts_print },
+    { "styp", mp4tree_box_ftyp_print },
+    { "subs", mp4tree_box_subs_print },
+    { "tenc", mp4tree_box_tenc_print },
+    { "tfdt", mp4tree_box_tfdt_print },
+    { "tfhd", mp4tree_box_tfhd_print },
+    { "tfra", mp4tree_box_tfra_print },
+    { "tkhd", mp4tree_box_tkhd_print },
+    { "traf", mp4tree_print },
+    { "trak", mp4tree_print },
+    { "trex", mp4tree_box_trex_print },
+    { "trun", mp4tree_box_trun_print },
+    { "uuid", mp4tree_box_uuid_print },
+    { "vmhd", mp4tree_box_vmhd_print },
+};
 
-    int i;
+mp4tree_parse_func
+mp4tree_box_printer_get(const uint8_t *p)
+{
+    const mp4tree_box_map_t * entry;
 
-    for (i = 0; i < sizeof(box_map)/sizeof(box_map[0]); i++)
-    {
-        if (memcmp(p, box_map[i].type, 4) == 0)
-            return box_map[i].func;
-    }
+    entry = fourcc_lookup(box_map, array_len(box_map), sizeof(box_map[0]), p);
+    if (entry != NULL)
+        return entry->func;
 
     return mp4tree_hexdump;
 }
 
-static bool
+void
+mp4tree_state_get(mp4tree_state_t * state)
+{
+    mp4tree_track_state_get(&state->tracks);
+    mp4tree_h264_state_get(&state->h264);
+    mp4tree_hevc_state_get(&state->hevc);
+}
+
+void
+mp4tree_state_set(const mp4tree_state_t * state)
+{
+    mp4tree_track_state_set(&state->tracks);
+    mp4tree_h264_state_set(&state->h264);
+    mp4tree_hevc_state_set(&state->hevc);
+}
+
+void
+mp4tree_state_reset(void)
+{
+    mp4tree_track_reset();
+    mp4tree_h264_reset();
+    mp4tree_hevc_reset();
+}
+
+bool
 mp4tree_match_filter(const uint8_t * box_type)
 {
     char type[5] = {0};
@@ -1817,7 +2251,8 @@ mp4tree_print(
     const uint8_t *     end  = p + len;
     mp4tree_parse_func    func = NULL;
 
-    while (p < end)
+    /* Only complete box headers are read, as in mp4tree_tree_parse() */
+    while (end - p >= 8)
     {
         uint64_t        box_len  = get_u32(p);
         const uint8_t * box_type = mp4tree_get_box_type(p);
@@ -1826,10 +2261,20 @@ mp4tree_print(
 
         if (box_len == 1)
         {
+            if (end - p < 16)
+                break;
             box_len = get_u64(box_data);
             box_data = p + 16;
             box_hdr_len = 16;
         }
+        else if (box_len == 0)
+        {
+            /* Box extends to the end of the buffer */
+            box_len = end - p;
+        }
+
+        if (box_len < box_hdr_len)
+            break;
 
         if (mp4tree_match_filter(box_type))
         {
@@ -1837,7 +2282,7 @@ mp4tree_print(
             mp4tree_box_print(box_type, box_len, depth);
 
             /* Go deeper if possible */
-            if (box_data + box_len - box_hdr_len <= end)
+            if (box_len <= (uint64_t)(end - p))
             {
                 func = mp4tree_box_printer_get(box_type);
                 if (func)
@@ -1849,16 +2294,52 @@ mp4tree_print(
                     mp4tree_hexdump(box_data, 16, depth);
                 }
             }
+
+            out_box_end(box_type, depth);
         }
 
+        if (depth == 0)
+            out_box_done();
+
+        /* A truncated box is the last one */
+        if (box_len > (uint64_t)(end - p))
+            break;
+
         p += box_len;
     }
 }
 
+int
+mp4tree_parse(
+    const uint8_t *             buf,
+    size_t                      len,
+    const mp4tree_callbacks_t * cb,
+    void *                      opaque)
+{
+    if (buf == NULL || cb == NULL)
+        return -1;
+
+    /* Nothing is carried over from a buffer parsed before */
+    mp4tree_state_reset();
+    out_set_callbacks(cb, opaque);
+    out_set_origin(buf, 0);
+    mp4tree_print(buf, len, 0);
+    out_set_callbacks(NULL, NULL);
+
+    return 0;
+}
+
 int mp4tree_selftest()
 {
-    uint32_t t1 = 0xffffffff;
-    uint32_t bit = 0;
+    uint32_t        t1 = 0xffffffff;
+    bits_t          b;
+    uint8_t         nal[200];
+    rbsp_t          rbsp;
+    const uint8_t * rbsp_p;
+    size_t          rbsp_len;
+
+    /* Positions of the 03 bytes, on and across the 64 byte block edges */
+    static const size_t epb_at[] = { 2, 5, 64, 67, 129, 133, 199 };
 
     uint8_t v[] =
     {
@@ -1873,23 +2354,444 @@ int mp4tree_selftest()
         0x12, // 0001001 = 8
     };
 
+    /* 3 bits, ue 0x1fffe (33 bits), se -3, 0xfffff000, 7 bits of padding */
+    static const uint8_t golomb[] =
+    {
+        0xa0, 0x00, 0x1f, 0xff, 0xf3, 0xff, 0xff, 0xf8, 0x00, 0x00
+    };
+
+    /* stts 2 x 100, 3 x 200; stsc 2 then 3 samples per chunk; 5 samples of 10 bytes */
+    static const uint8_t stbl_tables[] =
+    {
+        0x00, 0x00, 0x00, 0x20, 's', 't', 't', 's', 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x64,
+        0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0xc8,
+        0x00, 0x00, 0x00, 0x28, 's', 't', 's', 'c', 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x02,
+        0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x03,
+        0x00, 0x00, 0x00, 0x01,
+        0x00, 0x00, 0x00, 0x14, 's', 't', 's', 'z', 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x00, 0x05,
+        0x00, 0x00, 0x00, 0x1c, 's', 't', 'c', 'o', 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03, 0xe8, 0x00, 0x00, 0x07, 0xd0,
+        0x00, 0x00, 0x0b, 0xb8
+    };
+    mp4tree_stbl_t         stbl;
+    mp4tree_stbl_samples_t samples;
+
+    /* Baseline 1920x1088 cropped to 1080, POC type 2, no VUI */
+    static const uint8_t h264_sps[] =
+    {
+        0x67, 0x42, 0xc0, 0x28, 0xda, 0x01, 0xe0, 0x08, 0x9f, 0x95
+    };
+    const mp4tree_h264_sps_t * sps;
+
+    /*
+     * Main 10 1920x1088 cropped to 1080, 4:2:0, CTBs of 64, with emulation
+     * prevention bytes and a VUI with the colour description and timing
+     */
+    static const uint8_t hevc_sps[] =
+    {
+        0x42, 0x01, 0x01, 0x02, 0x20, 0x00, 0x00, 0x03, 0x00, 0x90, 0x00, 0x00,
+        0x03, 0x00, 0x00, 0x03, 0x00, 0x7b, 0xa0, 0x03, 0xc0, 0x80, 0x11, 0x07,
+        0xca, 0xd9, 0x65, 0x79, 0x24, 0xda, 0xf0, 0x16, 0xa1, 0x22, 0x01, 0x20,
+        0x80, 0x00, 0x01, 0xf4, 0x80, 0x00, 0x75, 0x30, 0x04
+    };
+    uint8_t                    hevc_sps_changed[sizeof(hevc_sps)];
+
+    /* moov with an avc1 track 7 and its SPS and PPS in the avcC */
+    static const uint8_t parse_moov[] =
+    {
+        0x00, 0x00, 0x01, 0x0b, 'm', 'o', 'o', 'v', 0x00, 0x00, 0x01, 0x03,
+        't', 'r', 'a', 'k', 0x00, 0x00, 0x00, 0x5c, 't', 'k', 'h', 'd',
+        0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x9f, 'm', 'd', 'i', 'a', 0x00, 0x00, 0x00, 0x97,
+        'm', 'i', 'n', 'f', 0x00, 0x00, 0x00, 0x8f, 's', 't', 'b', 'l',
+        0x00, 0x00, 0x00, 0x87, 's', 't', 's', 'd', 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 'w', 'a', 'v', 'c', 0x31,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x07, 0x80, 0x04, 0x38, 0x00, 0x48, 0x00, 0x00, 0x00, 0x48, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x18, 0xff, 0xff, 0x00, 0x00, 0x00, 0x21, 'a', 'v',
+        'c', 0x43, 0x01, 0x42, 0xc0, 0x28, 0xff, 0xe1, 0x00, 0x0a, 'g', 0x42,
+        0xc0, 0x28, 0xda, 0x01, 0xe0, 0x08, 0x9f, 0x95, 0x01, 0x00, 0x04, 'h',
+        0xce, 0x3c, 0x80,
+    };
+    static const uint8_t             parse_free[] = { 0x00, 0x00, 0x00, 0x08, 'f', 'r', 'e', 'e' };
+    static const mp4tree_callbacks_t parse_cb     = { 0 };
+    const mp4tree_hevc_sps_t * hevc_sps_decoded;
+
+    /*
+     * sidx with an index reference to a second sidx and a media reference,
+     * the second sidx with two media references. Subsegments of 100 bytes
+     * and 1000 ticks start after the second sidx, at offset 112.
+     */
+    static const uint8_t sidx_boxes[] =
+    {
+        0x00, 0x00, 0x00, 0x38, 's', 'i', 'd', 'x', 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x03, 0xe8, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+        0x80, 0x00, 0x01, 0x00, 0x00, 0x00, 0x07, 0xd0, 0x90, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x64, 0x00, 0x00, 0x03, 0xe8, 0x90, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x38, 's', 'i', 'd', 'x', 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x03, 0xe8, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02,
+        0x00, 0x00, 0x00, 0x64, 0x00, 0x00, 0x03, 0xe8, 0x90, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x64, 0x00, 0x00, 0x03, 0xe8, 0x90, 0x00, 0x00, 0x00
+    };
+    uint8_t                   sidx_file[sizeof(sidx_boxes) + 300] = {0};
+    mp4tree_sidx_subsegment_t sub;
+
+    /* tfra payload, version 1, entries at 1000, 2000 and 3000 */
+    static const uint8_t tfra_payload[] =
+    {
+        0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x03,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0xe8,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x01, 0x01,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0xd0,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x01, 0x01, 0x01,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0b, 0xb8,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x01, 0x01, 0x01
+    };
+    mp4tree_tfra_t       tfra;
+    mp4tree_tfra_entry_t tfra_entry;
+
+    /*
+     * A moof with a traf of track 1 based on the moof, with tfhd defaults and
+     * a data offset of 160, and a traf of track 2 continuing after its data,
+     * with trex defaults, first sample flags and composition offsets
+     */
+    static const uint8_t iter_moof[] =
+    {
+        0x00, 0x00, 0x00, 0x98, 'm', 'o', 'o', 'f', 0x00, 0x00, 0x00, 0x10,
+        'm', 'f', 'h', 'd', 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+        0x00, 0x00, 0x00, 0x4c, 't', 'r', 'a', 'f', 0x00, 0x00, 0x00, 0x18,
+        't', 'f', 'h', 'd', 0x00, 0x02, 0x00, 0x28, 0x00, 0x00, 0x00, 0x01,
+        0x00, 0x00, 0x00, 0x32, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10,
+        't', 'f', 'd', 't', 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0xe8,
+        0x00, 0x00, 0x00, 0x1c, 't', 'r', 'u', 'n', 0x00, 0x00, 0x02, 0x01,
+        0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0xa0, 0x00, 0x00, 0x00, 0x0a,
+        0x00, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00, 0x34, 't', 'r', 'a', 'f',
+        0x00, 0x00, 0x00, 0x10, 't', 'f', 'h', 'd', 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x1c, 't', 'r', 'u', 'n',
+        0x00, 0x00, 0x08, 0x04, 0x00, 0x00, 0x00, 0x02, 0x02, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00, 0x03
+    };
+    static const uint8_t iter_moov[] =
+    {
+        0x00, 0x00, 0x00, 0x30, 'm', 'o', 'o', 'v', 0x00, 0x00, 0x00, 0x28,
+        'm', 'v', 'e', 'x', 0x00, 0x00, 0x00, 0x20, 't', 'r', 'e', 'x',
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x01,
+        0x00, 0x00, 0x00, 0x28, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x00
+    };
+    static const struct
+    {
+        uint32_t track_id;
+        uint64_t offset;
+        uint32_t size;
+        uint64_t dts;
+        int64_t  pts;
+        uint32_t flags;
+    } iter_expected[] =
+    {
+        { 1, 160, 10, 1000, 1000, 0x00010000 },
+        { 1, 170, 20, 1050, 1050, 0x00010000 },
+        { 2, 190,  5,    0,    7, 0x02000000 },
+        { 2, 195,  5,   40,   43, 0x00000000 },
+    };
+    mp4tree_iter_t   iter;
+    mp4tree_sample_t sample;
+
     int i;
 
+    if (!fourcc_table_sorted(box_map, array_len(box_map), sizeof(box_map[0])) ||
+        !atom_desc_table_valid())
+    {
+        out_printf("Failed fourcc table order\n");
+        return -1;
+    }
+
+    if (mp4tree_box_printer_get((const uint8_t *)"trun") != mp4tree_box_trun_print ||
+        mp4tree_box_printer_get((const uint8_t *)"zzzz") != mp4tree_hexdump ||
+        get_box_desc((const uint8_t *)"UITS") == NULL)
+    {
+        out_printf("Failed fourcc lookup\n");
+        return -1;
+    }
+
+    bits_init(&b, (const uint8_t *)&t1, sizeof(t1));
     for (i = 0; i < 32; i++)
     {
-        if (get_bit((uint8_t *)&t1, i) != 1)
+        if (bits_read(&b, 1) != 1)
         {
-            printf("Failed 1\n");
+            out_printf("Failed 1\n");
             return -1;
         }
     }
 
     for (i = 0; i < sizeof(v)/sizeof(v[0]); i++)
     {
-        printf("%x -> %u\n", i, get_exp_golomb(&v[i], &bit));
-        printf("bit = %u\n", bit);
-        bit = 0;
+        uint32_t value;
+
+        bits_init(&b, &v[i], 1);
+        value = bits_read_ue(&b);
+        out_printf("%x -> %u\n", i, value);
+        out_printf("bit = %zu\n", bits_pos(&b, &v[i]));
+
+        if (value != i || b.error)
+        {
+            out_printf("Failed Exp-Golomb\n");
+            return -1;
+        }
+    }
+
+    /* Codes crossing the cache refill, and reads past the end */
+    bits_init(&b, golomb, sizeof(golomb));
+    bits_skip(&b, 3);
+    if (bits_read_ue(&b) != 0x1fffe || bits_read_se(&b) != -3 ||
+        bits_read(&b, 32) != 0xfffff000 || b.error ||
+        bits_read(&b, 8) != 0 || !b.error)
+    {
+        out_printf("Failed bit reader\n");
+        return -1;
+    }
+
+    /* Emulation prevention bytes in and across the 64 byte blocks */
+    memset(nal, 0x11, sizeof(nal));
+    for (i = 0; i < sizeof(epb_at)/sizeof(epb_at[0]); i++)
+    {
+        nal[epb_at[i] - 2] = 0x00;
+        nal[epb_at[i] - 1] = 0x00;
+        nal[epb_at[i]]     = 0x03;
+    }
+
+    rbsp_init(&rbsp);
+    rbsp_set(&rbsp, nal, sizeof(nal));
+    rbsp_p = rbsp_data(&rbsp, &rbsp_len);
+    if (rbsp_p == NULL || rbsp_len != sizeof(nal) - sizeof(epb_at)/sizeof(epb_at[0]) ||
+        memchr(rbsp_p, 0x03, rbsp_len) != NULL ||
+        rbsp_epb_find(nal + 3, sizeof(nal) - 3) != 2)
+    {
+        out_printf("Failed RBSP\n");
+        rbsp_free(&rbsp);
+        return -1;
+    }
+    rbsp_free(&rbsp);
+
+    /* Start codes straddling a block edge, and none among the 00 00 03 */
+    nal[126] = 0x00;
+    nal[127] = 0x00;
+    nal[128] = 0x01;
+    if (rbsp_start_code_find(nal, sizeof(nal)) != 126 ||
+        rbsp_start_code_find(nal, 126) != 126)
+    {
+        out_printf("Failed start code\n");
+        return -1;
     }
 
+    /* Lookups inside, between and past the runs */
+    if (mp4tree_stbl_build(stbl_tables, sizeof(stbl_tables), &stbl) < 0)
+    {
+        out_printf("Failed sample index\n");
+        return -1;
+    }
+    if (stbl.sample_count != 5 ||
+        mp4tree_stbl_time_to_sample(&stbl, 450) != 3 ||
+        mp4tree_stbl_time_to_sample(&stbl, 799) != 4 ||
+        mp4tree_stbl_time_to_sample(&stbl, 800) != -1 ||
+        mp4tree_stbl_sample_offset(&stbl, 1) != 1010 ||
+        mp4tree_stbl_sample_offset(&stbl, 4) != 2020 ||
+        mp4tree_stbl_expand(&stbl, 1, &samples) != 4 ||
+        samples.offset[1] != 2000 || samples.offset[3] != 2020 ||
+        samples.dts[0] != 100 || samples.dts[3] != 600 || !samples.sync[2])
+    {
+        out_printf("Failed sample index\n");
+        mp4tree_stbl_free(&stbl);
+        return -1;
+    }
+    mp4tree_stbl_free(&stbl);
+
+    /* Subsegments in and after the nested sidx, by number and by time */
+    memcpy(sidx_file, sidx_boxes, sizeof(sidx_boxes));
+    if (mp4tree_sidx_find(sidx_file, sizeof(sidx_file), 1, 0, &sub) < 0 ||
+        sub.offset != 112 || sub.time != 0 ||
+        mp4tree_sidx_find(sidx_file, sizeof(sidx_file), 3, 0, &sub) < 0 ||
+        sub.offset != 312 || sub.time != 2000 ||
+        mp4tree_sidx_find(sidx_file, sizeof(sidx_file), 0, 1.5, &sub) < 0 ||
+        sub.number != 2 || sub.offset != 212 ||
+        mp4tree_sidx_find(sidx_file, sizeof(sidx_file), 0, 2.999, &sub) < 0 ||
+        sub.number != 3)
+    {
+        out_printf("Failed sidx lookup\n");
+        return -1;
+    }
+
+    /* Past the last subsegment, and an index reference without a sidx */
+    out_printf("Expecting 3 sidx errors:\n");
+    out_flush();
+    if (mp4tree_sidx_find(sidx_file, sizeof(sidx_file), 4, 0, &sub) == 0 ||
+        mp4tree_sidx_find(sidx_file, sizeof(sidx_file), 0, 3.0, &sub) == 0)
+    {
+        out_printf("Failed sidx errors\n");
+        return -1;
+    }
+
+    /* first_offset moved off the nested sidx */
+    sidx_file[27] = 4;
+    if (mp4tree_sidx_find(sidx_file, sizeof(sidx_file), 0, 0, &sub) == 0)
+    {
+        out_printf("Failed sidx errors\n");
+        return -1;
+    }
+
+    /* Before the first entry, exactly on entries, between and after them */
+    if (!mp4tree_tfra_parse(tfra_payload, sizeof(tfra_payload), &tfra) ||
+        tfra.entry_count != 3 ||
+        mp4tree_tfra_lookup(&tfra, 0) != 0 ||
+        mp4tree_tfra_lookup(&tfra, 999) != 0 ||
+        mp4tree_tfra_lookup(&tfra, 1000) != 0 ||
+        mp4tree_tfra_lookup(&tfra, 1999) != 0 ||
+        mp4tree_tfra_lookup(&tfra, 2000) != 1 ||
+        mp4tree_tfra_lookup(&tfra, 3000) != 2 ||
+        mp4tree_tfra_lookup(&tfra, UINT64_MAX) != 2)
+    {
+        out_printf("Failed tfra lookup\n");
+        return -1;
+    }
+
+    mp4tree_tfra_entry_get(&tfra, 2, &tfra_entry);
+    if (tfra_entry.time != 3000 || tfra_entry.moof_offset != 0x300 ||
+        tfra_entry.traf_number != 1 || tfra_entry.sample_number != 1)
+    {
+        out_printf("Failed tfra entry\n");
+        return -1;
+    }
+
+    /* Entries cut off by the end of the box are not looked at */
+    if (!mp4tree_tfra_parse(tfra_payload, 16 + 19, &tfra) ||
+        tfra.entry_count != 1 ||
+        mp4tree_tfra_lookup(&tfra, 5000) != 0 ||
+        !mp4tree_tfra_parse(tfra_payload, 16, &tfra) ||
+        mp4tree_tfra_lookup(&tfra, 5000) != -1)
+    {
+        out_printf("Failed tfra bounds\n");
+        return -1;
+    }
+
+    /* Samples of the truns with the tfhd, trex and data offset rules applied */
+    mp4tree_iter_init(&iter, iter_moof, sizeof(iter_moof));
+    mp4tree_iter_defaults(&iter, iter_moov, sizeof(iter_moov));
+    for (i = 0; mp4tree_iter_next(&iter, &sample); i++)
+    {
+        if (i == array_len(iter_expected) ||
+            sample.track_id != iter_expected[i].track_id ||
+            sample.offset != iter_expected[i].offset ||
+            sample.size != iter_expected[i].size ||
+            sample.dts != iter_expected[i].dts ||
+            sample.pts != iter_expected[i].pts ||
+            sample.flags != iter_expected[i].flags ||
+            sample.sync != !(iter_expected[i].flags & MP4TREE_SAMPLE_NON_SYNC))
+        {
+            out_printf("Failed sample iterator at sample %d\n", i + 1);
+            return -1;
+        }
+    }
+    mp4tree_iter_free(&iter);
+    if (i != array_len(iter_expected))
+    {
+        out_printf("Failed sample iterator, %d samples\n", i);
+        return -1;
+    }
+
+    /* In-band parameter sets stay with their track, not with the next one selected */
+    mp4tree_h264_track_select(1);
+    mp4tree_h264_sps_print(h264_sps, sizeof(h264_sps), 0);
+    sps = mp4tree_h264_sps_get(0);
+    if (sps == NULL || sps->width != 1920 || sps->height != 1080)
+    {
+        out_printf("Failed h264 SPS\n");
+        return -1;
+    }
+    mp4tree_h264_track_select(2);
+    if (mp4tree_h264_sps_get(0) != NULL)
+    {
+        out_printf("Failed h264 track select\n");
+        return -1;
+    }
+    mp4tree_h264_track_select(1);
+    if (mp4tree_h264_sps_get(0) != sps)
+    {
+        out_printf("Failed h264 track select\n");
+        return -1;
+    }
+
+
+    /* An HEVC SPS through the emulation prevention, PTL and VUI decoding */
+    mp4tree_hevc_track_select(1);
+    mp4tree_hevc_sps_print(hevc_sps, sizeof(hevc_sps), 0);
+    hevc_sps_decoded = mp4tree_hevc_sps_get(0);
+    if (hevc_sps_decoded == NULL ||
+        hevc_sps_decoded->ptl.profile_idc != 2 || hevc_sps_decoded->ptl.level_idc != 123 ||
+        hevc_sps_decoded->chroma_format_idc != 1 ||
+        hevc_sps_decoded->width != 1920 || hevc_sps_decoded->height != 1080 ||
+        hevc_sps_decoded->bit_depth_luma != 10 || hevc_sps_decoded->bit_depth_chroma != 10 ||
+        hevc_sps_decoded->log2_max_poc_lsb != 8 || hevc_sps_decoded->log2_ctb_size != 6 ||
+        !hevc_sps_decoded->amp || !hevc_sps_decoded->sao ||
+        !hevc_sps_decoded->temporal_mvp || !hevc_sps_decoded->strong_intra_smoothing ||
+        hevc_sps_decoded->sar_width != 1 || hevc_sps_decoded->sar_height != 1 ||
+        hevc_sps_decoded->colour_primaries != 9 || hevc_sps_decoded->transfer_characteristics != 16 ||
+        hevc_sps_decoded->matrix_coefficients != 9 ||
+        hevc_sps_decoded->num_units_in_tick != 1001 || hevc_sps_decoded->time_scale != 60000)
+    {
+        out_printf("Failed hevc SPS\n");
+        return -1;
+    }
+
+    /* The same SPS id with other bytes is decoded again, not printed from the cache */
+    memcpy(hevc_sps_changed, hevc_sps, sizeof(hevc_sps));
+    hevc_sps_changed[17] = 93;
+    mp4tree_hevc_sps_print(hevc_sps_changed, sizeof(hevc_sps_changed), 0);
+    hevc_sps_decoded = mp4tree_hevc_sps_get(0);
+    if (hevc_sps_decoded == NULL || hevc_sps_decoded->ptl.level_idc != 93)
+    {
+        out_printf("Failed hevc SPS cache\n");
+        return -1;
+    }
+
+    /* A buffer parsed with the library starts without the tracks of the one before */
+    if (mp4tree_parse(parse_moov, sizeof(parse_moov), &parse_cb, NULL) != 0 ||
+        mp4tree_track_find(7) == NULL)
+    {
+        out_printf("Failed library parse\n");
+        return -1;
+    }
+    mp4tree_h264_track_select(7);
+    if (mp4tree_h264_sps_get(0) == NULL)
+    {
+        out_printf("Failed library parse\n");
+        return -1;
+    }
+    if (mp4tree_parse(parse_free, sizeof(parse_free), &parse_cb, NULL) != 0 ||
+        mp4tree_track_find(7) != NULL)
+    {
+        out_printf("Failed library parse state reset\n");
+        return -1;
+    }
+    mp4tree_h264_track_select(7);
+    if (mp4tree_h264_sps_get(0) != NULL)
+    {
+        out_printf("Failed library parse state reset\n");
+        return -1;
+    }
     return 0;
 }
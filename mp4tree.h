@@ -4,6 +4,10 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "h264.h"
+#include "hevc.h"
+#include "track.h"
+
 
 /* Pointer to a buffer parsing function */
 typedef void (*mp4tree_parse_func) (const uint8_t * p, size_t len, int depth);
@@ -16,5 +20,39 @@ mp4tree_hexdump(const uint8_t * p, size_t len, int depth);
 void
 mp4tree_print(const uint8_t * p, size_t len, int depth);
 
+/* Print the header line (and description) of a box */
+void
+mp4tree_box_print(const uint8_t * type, size_t len, int depth);
+
+/* Get the payload printer for a box type, mp4tree_hexdump if unknown */
+mp4tree_parse_func
+mp4tree_box_printer_get(const uint8_t * type);
+
+/*
+ * State picked up from earlier boxes (e.g. moov) that later boxes are printed
+ * with. It is per thread, a thread printing boxes on behalf of another takes
+ * a copy with mp4tree_state_get() and installs it with mp4tree_state_set().
+ */
+typedef struct mp4tree_state_struct
+{
+    mp4tree_tracks_t     tracks;
+    mp4tree_h264_state_t h264;
+    mp4tree_hevc_state_t hevc;
+} mp4tree_state_t;
+
+void
+mp4tree_state_get(mp4tree_state_t * state);
+
+void
+mp4tree_state_set(const mp4tree_state_t * state);
+
+/* Start over with the state of a thread that has not printed any box */
+void
+mp4tree_state_reset(void);
+
+/* Check a box type against the --filter option */
+bool
+mp4tree_match_filter(const uint8_t * box_type);
+
 /* Run self-test */
 int mp4tree_selftest();
@@ -2,8 +2,11 @@
 
 #include "nal.h"
 #include "sei.h"
+#include "h264.h"
+#include "hevc.h"
 #include "common.h"
 #include "mp4tree.h"
+#include "output.h"
 
 void
 mp4tree_box_mdat_hevc_nal_print(
@@ -52,15 +55,15 @@ mp4tree_box_mdat_hevc_nal_print(
             break;
         case 32:
             typestr = "VPS";
-            print_func = mp4tree_hexdump;
+            print_func = mp4tree_hevc_vps_print;
             break;
         case 33:
             typestr = "SPS";
-            print_func = mp4tree_hexdump;
+            print_func = mp4tree_hevc_sps_print;
             break;
         case 34:
             typestr = "PPS";
-            print_func = mp4tree_hexdump;
+            print_func = mp4tree_hevc_pps_print;
             break;
         case 35:
             typestr = "AUD";
@@ -80,9 +83,9 @@ mp4tree_box_mdat_hevc_nal_print(
     }
 
 
-    printf("%s  nal_unit_type:        %u (%s)\n", indent(depth, 0), type, typestr);
-    printf("%s  nuh_layer_id:         %u\n", indent(depth, 0), layer_id);
-    printf("%s  nuh_temporal_id_plus1 %u\n", indent(depth, 0), temporal_id_plus1);
+    out_field(depth, "nal_unit_type:        ", "%u (%s)", type, typestr);
+    out_field(depth, "nuh_layer_id:         ", "%u", layer_id);
+    out_field(depth, "nuh_temporal_id_plus1 ", "%u", temporal_id_plus1);
     if (print_func)
     {
         print_func(p, len, depth);
@@ -131,11 +134,11 @@ mp4tree_sei_h264_nal_print(
             break;
         case 7:
             typestr = "SPS";
-            print_func = mp4tree_hexdump;
+            print_func = mp4tree_h264_sps_print;
             break;
         case 8:
             typestr = "PPS";
-            print_func = mp4tree_hexdump;
+            print_func = mp4tree_h264_pps_print;
             break;
         case 9:
             typestr = "AUD";
@@ -160,8 +163,8 @@ mp4tree_sei_h264_nal_print(
             break;
     }
 
-    printf("%s  nal_ref_idc:          %u\n", indent(depth, 0), nal_ref_idc);
-    printf("%s  nal_unit_type:        %u (%s)\n", indent(depth, 0), nal_unit_type, typestr);
+    out_field(depth, "nal_ref_idc:          ", "%u", nal_ref_idc);
+    out_field(depth, "nal_unit_type:        ", "%u (%s)", nal_unit_type, typestr);
     if (print_func)
     {
         print_func(p, len, depth);
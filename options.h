@@ -10,12 +10,42 @@
  ******************************************************************************
  */
 
+typedef enum
+{
+    MP4TREE_FORMAT_TEXT,
+    MP4TREE_FORMAT_JSON,
+    MP4TREE_FORMAT_BINARY
+} mp4tree_format_t;
+
+typedef enum
+{
+    MP4TREE_ES_NONE,        /* An mp4 file */
+    MP4TREE_ES_H264,
+    MP4TREE_ES_HEVC
+} mp4tree_es_t;
+
 struct options_struct
 {
     const char * filter;
     const char * filename;
     const char * initseg;
+    const char * path;
+    uint64_t     subsegment;        /* --subsegment, 0 if not given */
+    double       subsegment_time;   /* --subsegment-time, < 0 if not given */
+    double       at;                /* --at, < 0 if not given */
+    uint32_t     track;             /* --track, 0 if not given */
     int          truncate;
     bool         selftest;
-} g_options;
+    bool         stream;
+    bool         index;
+    bool         batch;
+    bool         timeline;  /* --check-timeline */
+    bool         samples;   /* --samples */
+    int          jobs;      /* Threads, 0 for one per CPU */
+    size_t       window;
+    mp4tree_format_t format;
+    mp4tree_es_t     es;        /* Annex B input, else detected from the file name */
+};
+
+extern struct options_struct g_options;
 
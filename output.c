@@ -0,0 +1,496 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "output.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+/*
+ * All state is per thread. The main thread writes through a static buffer,
+ * other threads allocate their own when they start capturing.
+ */
+static char                             out_main_buf[OUT_BUF_SIZE];
+static _Thread_local char *             out_buf    = out_main_buf;
+static _Thread_local size_t             out_len    = 0;
+static _Thread_local out_flush_policy_t out_policy = OUT_FLUSH_FULL;
+
+/* Capture state, see out_capture_begin() */
+static _Thread_local char * out_own_buf   = NULL;
+static _Thread_local bool   out_capturing = false;
+static _Thread_local char * out_cap       = NULL;
+static _Thread_local size_t out_cap_len   = 0;
+static _Thread_local size_t out_cap_size  = 0;
+
+/* Event mode state, see out_set_callbacks() */
+static _Thread_local const mp4tree_callbacks_t * out_cb        = NULL;
+static _Thread_local void *                      out_opaque    = NULL;
+static _Thread_local const uint8_t *             out_base      = NULL;
+static _Thread_local uint64_t                    out_base_offs = 0;
+
+
+static void
+out_fd_write(const char * p, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(STDOUT_FILENO, p, len);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            /* Nowhere to report to, drop the output */
+            return;
+        }
+
+        p   += n;
+        len -= n;
+    }
+}
+
+
+/* Write out to stdout, or append to the capture */
+static void
+out_sink_write(const char * p, size_t len)
+{
+    if (!out_capturing)
+    {
+        out_fd_write(p, len);
+        return;
+    }
+
+    if (out_cap_len + len > out_cap_size)
+    {
+        /* Small captures, e.g. of a single fragment, stay small */
+        size_t size = out_cap_size ? out_cap_size : len;
+        char * tmp;
+
+        while (size < out_cap_len + len)
+            size *= 2;
+
+        tmp = realloc(out_cap, size);
+        if (tmp == NULL)
+            return;
+
+        out_cap      = tmp;
+        out_cap_size = size;
+    }
+
+    memcpy(out_cap + out_cap_len, p, len);
+    out_cap_len += len;
+}
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+void
+out_set_flush_policy(out_flush_policy_t policy)
+{
+    out_policy = policy;
+}
+
+
+void
+out_flush(void)
+{
+    out_sink_write(out_buf, out_len);
+    out_len = 0;
+}
+
+
+void
+out_box_done(void)
+{
+    if (out_policy == OUT_FLUSH_BOX)
+        out_flush();
+}
+
+
+char *
+out_reserve(size_t len)
+{
+    if (len > OUT_BUF_SIZE)
+        return NULL;
+
+    if (out_len + len > OUT_BUF_SIZE)
+        out_flush();
+
+    return out_buf + out_len;
+}
+
+
+void
+out_raw_commit(size_t len)
+{
+    out_len += len;
+}
+
+
+void
+out_commit(size_t len)
+{
+    if (out_cb != NULL)
+        return;
+
+    out_len += len;
+}
+
+
+void
+out_write(const char * p, size_t len)
+{
+    if (out_cb != NULL)
+        return;
+
+    out_raw_write(p, len);
+}
+
+
+void
+out_raw_write(const char * p, size_t len)
+{
+    if (out_len + len > OUT_BUF_SIZE)
+    {
+        out_flush();
+
+        if (len > OUT_BUF_SIZE)
+        {
+            out_sink_write(p, len);
+            return;
+        }
+    }
+
+    memcpy(out_buf + out_len, p, len);
+    out_len += len;
+}
+
+
+static void
+out_vprintf(const char * fmt, va_list ap)
+{
+    va_list again;
+    size_t  avail = OUT_BUF_SIZE - out_len;
+    int     n;
+
+    va_copy(again, ap);
+    n = vsnprintf(out_buf + out_len, avail, fmt, ap);
+
+    if (n < 0 || (size_t)n < avail)
+    {
+        if (n > 0)
+            out_len += n;
+        va_end(again);
+        return;
+    }
+
+    /* Did not fit, make room and format again */
+    out_flush();
+
+    if (n < OUT_BUF_SIZE)
+    {
+        vsnprintf(out_buf, OUT_BUF_SIZE, fmt, again);
+        out_len = n;
+    }
+    else
+    {
+        char * tmp = malloc(n + 1);
+
+        if (tmp != NULL)
+        {
+            vsnprintf(tmp, n + 1, fmt, again);
+            out_sink_write(tmp, n);
+            free(tmp);
+        }
+    }
+
+    va_end(again);
+}
+
+
+void
+out_printf(const char * fmt, ...)
+{
+    va_list ap;
+
+    if (out_cb != NULL)
+        return;
+
+    va_start(ap, fmt);
+    out_vprintf(fmt, ap);
+    va_end(ap);
+}
+
+
+void
+out_uint(uint64_t value, int width)
+{
+    char   digits[20];
+    int    num = 0;
+    char * p;
+
+    if (out_cb != NULL)
+        return;
+
+    do
+    {
+        digits[num++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+
+    if (width < num)
+        width = num;
+
+    p = out_reserve(width);
+    if (p == NULL)
+        return;
+
+    memset(p, ' ', width - num);
+    p += width - num;
+    while (num)
+        *p++ = digits[--num];
+
+    out_commit(width);
+}
+
+
+/*
+ ******************************************************************************
+ *                            Capture                                         *
+ ******************************************************************************
+ */
+
+int
+out_capture_begin(void)
+{
+    out_flush();
+
+    if (out_own_buf == NULL)
+    {
+        out_own_buf = malloc(OUT_BUF_SIZE);
+        if (out_own_buf == NULL)
+            return -1;
+    }
+
+    out_buf       = out_own_buf;
+    out_capturing = true;
+    out_cap       = NULL;
+    out_cap_len   = 0;
+    out_cap_size  = 0;
+    return 0;
+}
+
+
+char *
+out_capture_end(size_t * len)
+{
+    char * cap;
+
+    out_flush();
+
+    cap  = out_cap;
+    *len = out_cap_len;
+
+    out_capturing = false;
+    out_cap       = NULL;
+    out_cap_len   = 0;
+    out_cap_size  = 0;
+    return cap;
+}
+
+
+void
+out_thread_release(void)
+{
+    if (out_buf == out_own_buf)
+        out_buf = out_main_buf;
+
+    free(out_own_buf);
+    out_own_buf = NULL;
+}
+
+
+/*
+ ******************************************************************************
+ *                            Event mode                                      *
+ ******************************************************************************
+ */
+
+void
+out_set_callbacks(const mp4tree_callbacks_t * cb, void * opaque)
+{
+    out_cb     = cb;
+    out_opaque = opaque;
+}
+
+
+void
+out_set_origin(const uint8_t * base, uint64_t offset)
+{
+    out_base      = base;
+    out_base_offs = offset;
+}
+
+
+bool
+out_is_text(void)
+{
+    return out_cb == NULL;
+}
+
+
+uint64_t
+out_offset(const uint8_t * p)
+{
+    return out_base_offs + ((uintptr_t)p - (uintptr_t)out_base);
+}
+
+
+void
+out_box_start(const uint8_t * type, uint64_t size, int depth)
+{
+    uint64_t offset = out_offset(type - 4);
+
+    if (out_cb != NULL && out_cb->box_start != NULL)
+        out_cb->box_start(out_opaque, type, offset, size, depth);
+}
+
+
+void
+out_box_end(const uint8_t * type, int depth)
+{
+    if (out_cb != NULL && out_cb->box_end != NULL)
+        out_cb->box_end(out_opaque, type, depth);
+}
+
+
+void
+out_nal_start(const char * codec, const uint8_t * p, uint64_t len, int depth)
+{
+    if (out_cb != NULL && out_cb->box_start != NULL)
+        out_cb->box_start(out_opaque, (const uint8_t *)codec, out_offset(p), len, depth);
+}
+
+
+void
+out_nal_end(const char * codec, int depth)
+{
+    if (out_cb != NULL && out_cb->box_end != NULL)
+        out_cb->box_end(out_opaque, (const uint8_t *)codec, depth);
+}
+
+
+void
+out_field(int depth, const char * label, const char * fmt, ...)
+{
+    char    name[64];
+    char    value[256];
+    char *  big = NULL;
+    size_t  name_len;
+    va_list ap;
+    int     n;
+
+    if (out_cb == NULL)
+    {
+        const char * prefix = indent(depth, 0);
+
+        out_write(prefix, strlen(prefix));
+        out_write("  ", 2);
+        out_write(label, strlen(label));
+        va_start(ap, fmt);
+        out_vprintf(fmt, ap);
+        va_end(ap);
+        out_write("\n", 1);
+        return;
+    }
+
+    if (out_cb->field == NULL)
+        return;
+
+    /* The label is padded for alignment, the event only gets the name */
+    name_len = strlen(label);
+    while (name_len > 0 && (label[name_len - 1] == ' ' || label[name_len - 1] == ':'))
+        name_len--;
+    if (name_len >= sizeof(name))
+        name_len = sizeof(name) - 1;
+    memcpy(name, label, name_len);
+    name[name_len] = '\0';
+
+    va_start(ap, fmt);
+    n = vsnprintf(value, sizeof(value), fmt, ap);
+    va_end(ap);
+
+    if (n < 0)
+        return;
+
+    if ((size_t)n >= sizeof(value))
+    {
+        big = malloc(n + 1);
+        if (big == NULL)
+            return;
+
+        va_start(ap, fmt);
+        vsnprintf(big, n + 1, fmt, ap);
+        va_end(ap);
+    }
+
+    out_cb->field(out_opaque, name, big ? big : value, depth);
+    free(big);
+}
+
+
+void
+out_sample(
+    const char *     table,
+    uint32_t         index,
+    const uint64_t * values,
+    int              num,
+    int              depth)
+{
+    if (out_cb != NULL && out_cb->sample != NULL)
+        out_cb->sample(out_opaque, table, index, values, num, depth);
+}
+
+
+void
+out_field_hex(int depth, const char * name, const uint8_t * p, size_t len)
+{
+    static const char digits[] = "0123456789abcdef";
+    char              value[512];
+    char *            hex = value;
+    size_t            i;
+
+    if (out_cb == NULL || out_cb->field == NULL)
+        return;
+
+    if (len * 2 + 1 > sizeof(value))
+    {
+        hex = malloc(len * 2 + 1);
+        if (hex == NULL)
+            return;
+    }
+
+    for (i = 0; i < len; i++)
+    {
+        hex[2 * i]     = digits[p[i] >> 4];
+        hex[2 * i + 1] = digits[p[i] & 0x0f];
+    }
+    hex[2 * len] = '\0';
+
+    out_cb->field(out_opaque, name, hex, depth);
+
+    if (hex != value)
+        free(hex);
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              Output engine                                 *
+ ******************************************************************************
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "libmp4tree.h"
+
+
+/* Size of the user-space output buffer */
+#define OUT_BUF_SIZE (1024 * 1024)
+
+typedef enum
+{
+    OUT_FLUSH_FULL,  /* Write out only when the buffer is full */
+    OUT_FLUSH_BOX    /* Also write out after every top-level box */
+} out_flush_policy_t;
+
+
+/* Select when buffered output is written to stdout */
+void
+out_set_flush_policy(out_flush_policy_t policy);
+
+/* Append formatted text to the output buffer */
+void
+out_printf(const char * fmt, ...) __attribute__((format(printf, 1, 2)));
+
+/* Append len bytes to the output buffer */
+void
+out_write(const char * p, size_t len);
+
+/* Append an unsigned integer right-aligned in a field of width chars */
+void
+out_uint(uint64_t value, int width);
+
+/* Reserve len bytes in the output buffer for direct formatting */
+char *
+out_reserve(size_t len);
+
+/* Commit len bytes written to the area returned by out_reserve() */
+void
+out_commit(size_t len);
+
+/* Like out_write() and out_commit(), but also in event mode, for writers
+   that turn events back into output */
+void
+out_raw_write(const char * p, size_t len);
+
+void
+out_raw_commit(size_t len);
+
+/* Mark the end of a top-level box, flushes if the policy says so */
+void
+out_box_done(void);
+
+/* Write all buffered output to stdout */
+void
+out_flush(void);
+
+/*
+ * Capture. Output of the calling thread is collected in memory instead of
+ * being written to stdout, so threads can produce output in parallel and
+ * have it written in order.
+ */
+
+/* Start capturing, returns 0 on success */
+int
+out_capture_begin(void);
+
+/* Stop capturing and return the output, which the caller frees */
+char *
+out_capture_end(size_t * len);
+
+/* Free the output buffer of a thread that is about to exit */
+void
+out_thread_release(void);
+
+/*
+ * Event mode. With callbacks set, the text functions above print nothing and
+ * boxes, fields and table rows are reported through the callbacks instead.
+ */
+
+/* Report events through cb instead of printing text, NULL restores text */
+void
+out_set_callbacks(const mp4tree_callbacks_t * cb, void * opaque);
+
+/* Box offsets are reported relative to the byte at base, which is at offset */
+void
+out_set_origin(const uint8_t * base, uint64_t offset);
+
+/* Offset of p in the input, given the origin set with out_set_origin() */
+uint64_t
+out_offset(const uint8_t * p);
+
+/* True unless events are being reported through callbacks */
+bool
+out_is_text(void);
+
+/* Start of a box, type points to the fourcc inside the box header */
+void
+out_box_start(const uint8_t * type, uint64_t size, int depth);
+
+/* End of a box started with out_box_start() */
+void
+out_box_end(const uint8_t * type, int depth);
+
+/*
+ * Start of a NAL unit of len bytes at p, without its length field or start
+ * code, reported like a box of type codec, "H264" or "HEVC". Its header
+ * line is printed by the caller in text mode.
+ */
+void
+out_nal_start(const char * codec, const uint8_t * p, uint64_t len, int depth);
+
+/* End of a NAL unit started with out_nal_start() */
+void
+out_nal_end(const char * codec, int depth);
+
+/* A named field, printed as "<indent>  <label><value>" in text mode */
+void
+out_field(int depth, const char * label, const char * fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+/* A table row, text mode prints the row itself so this only reports events */
+void
+out_sample(const char * table, uint32_t index,
+           const uint64_t * values, int num, int depth);
+
+/* A field holding raw bytes, only reported in event mode */
+void
+out_field_hex(int depth, const char * name, const uint8_t * p, size_t len);
@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "path.h"
+#include "common.h"
+#include "mp4tree.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+/* Deepest path accepted */
+#define MP4TREE_PATH_MAX 32
+
+typedef struct
+{
+    uint8_t      type[4];
+    unsigned int nth;       /* 1 for the first box of the type */
+} mp4tree_path_elem_t;
+
+
+/* Split path into its components, returns their number or -1 if invalid */
+static int
+mp4tree_path_parse(const char * path, mp4tree_path_elem_t * elems, int max)
+{
+    int num = 0;
+
+    while (*path != '\0')
+    {
+        const char * end;
+        size_t       n;
+
+        if (*path == '/')
+        {
+            path++;
+            continue;
+        }
+
+        end = path + strcspn(path, "/[");
+        n   = end - path;
+        if (num == max || n == 0 || n > 4)
+            return -1;
+
+        /* Short types like "url" are padded the way they are stored */
+        memset(elems[num].type, ' ', 4);
+        memcpy(elems[num].type, path, n);
+        elems[num].nth = 1;
+
+        if (*end == '[')
+        {
+            char *        stop;
+            unsigned long nth = strtoul(end + 1, &stop, 10);
+
+            if (stop == end + 1 || *stop != ']' || nth == 0 || nth > UINT32_MAX)
+                return -1;
+
+            elems[num].nth = nth;
+            end = stop + 1;
+        }
+
+        if (*end != '\0' && *end != '/')
+            return -1;
+
+        path = end;
+        num++;
+    }
+
+    return num > 0 ? num : -1;
+}
+
+
+/* Find the box matching elem among the boxes in [p, end) */
+static const uint8_t *
+mp4tree_path_child(
+    const uint8_t *             p,
+    const uint8_t *             end,
+    const mp4tree_path_elem_t * elem,
+    uint64_t *                  box_len,
+    uint8_t *                   hdr_len)
+{
+    unsigned int seen = 0;
+
+    while (end - p >= 8)
+    {
+        uint64_t len = get_u32(p);
+        uint8_t  hdr = 8;
+
+        if (len == 1)
+        {
+            if (end - p < 16)
+                break;
+            len = get_u64(p + 8);
+            hdr = 16;
+        }
+        else if (len == 0)
+        {
+            len = end - p;
+        }
+
+        if (len < hdr)
+            break;
+
+        if (memcmp(p + 4, elem->type, 4) == 0 && ++seen == elem->nth)
+        {
+            *box_len = len;
+            *hdr_len = hdr;
+            return p;
+        }
+
+        /* Siblings are skipped by their header alone */
+        if (len > (uint64_t)(end - p))
+            break;
+        p += len;
+    }
+
+    return NULL;
+}
+
+
+static void
+mp4tree_path_error(const char * path, const char * what, const mp4tree_path_elem_t * elem)
+{
+    fprintf(stderr, "Path %s: %s %.4s[%u]\n", path, what, elem->type, elem->nth);
+}
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+const uint8_t *
+mp4tree_path_find(
+    const uint8_t * buf,
+    size_t          len,
+    const char *    path,
+    size_t *        box_len)
+{
+    mp4tree_path_elem_t elems[MP4TREE_PATH_MAX];
+    const uint8_t *     p   = buf;
+    const uint8_t *     end = buf + len;
+    int                 num = mp4tree_path_parse(path, elems, MP4TREE_PATH_MAX);
+    int                 i;
+
+    if (num < 0)
+    {
+        fprintf(stderr, "Invalid path %s\n", path);
+        return NULL;
+    }
+
+    for (i = 0; i < num; i++)
+    {
+        uint64_t        size;
+        uint8_t         hdr_len;
+        const uint8_t * box = mp4tree_path_child(p, end, &elems[i], &size, &hdr_len);
+
+        if (box == NULL)
+        {
+            mp4tree_path_error(path, "no box", &elems[i]);
+            return NULL;
+        }
+
+        if (i == num - 1)
+        {
+            /* A truncated target is printed as far as it goes */
+            *box_len = size < (uint64_t)(end - box) ? size : (uint64_t)(end - box);
+            return box;
+        }
+
+        if (mp4tree_box_printer_get(box + 4) != mp4tree_print)
+        {
+            mp4tree_path_error(path, "not a container", &elems[i]);
+            return NULL;
+        }
+
+        if (size > (uint64_t)(end - box))
+        {
+            mp4tree_path_error(path, "truncated", &elems[i]);
+            return NULL;
+        }
+
+        p   = box + hdr_len;
+        end = box + size;
+    }
+
+    return NULL;
+}
+
+
+const mp4tree_box_t *
+mp4tree_path_find_tree(const mp4tree_tree_t * tree, const char * path)
+{
+    mp4tree_path_elem_t   elems[MP4TREE_PATH_MAX];
+    const mp4tree_box_t * box = tree->boxes;
+    int                   num = mp4tree_path_parse(path, elems, MP4TREE_PATH_MAX);
+    int                   i;
+
+    if (num < 0)
+    {
+        fprintf(stderr, "Invalid path %s\n", path);
+        return NULL;
+    }
+
+    for (i = 0; i < num; i++)
+    {
+        unsigned int seen = 0;
+
+        for ( ; box != NULL; box = box->next)
+        {
+            if (memcmp(box->type, elems[i].type, 4) == 0 && ++seen == elems[i].nth)
+                break;
+        }
+
+        if (box == NULL)
+        {
+            mp4tree_path_error(path, "no box", &elems[i]);
+            return NULL;
+        }
+
+        if (i == num - 1)
+            return box;
+
+        if (box->func != mp4tree_print || !box->complete)
+        {
+            mp4tree_path_error(path, box->complete ? "not a container" : "truncated",
+                               &elems[i]);
+            return NULL;
+        }
+
+        box = box->children;
+    }
+
+    return NULL;
+}
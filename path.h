@@ -0,0 +1,30 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              Box paths                                     *
+ ******************************************************************************
+ *
+ * A path selects a single box by the types of the containers leading to it,
+ * e.g. "moov/trak[2]/mdia/mdhd". [N] picks the Nth box of that type among
+ * its siblings, counting from 1, and defaults to the first one.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "tree.h"
+
+
+/*
+ * Find the box at path in buf, only reading the headers of the boxes along
+ * the way. Returns the start of the box and sets *box_len, or NULL with an
+ * error printed to stderr.
+ */
+const uint8_t *
+mp4tree_path_find(const uint8_t * buf, size_t len, const char * path,
+                  size_t * box_len);
+
+/* Like mp4tree_path_find(), using an already parsed or loaded tree */
+const mp4tree_box_t *
+mp4tree_path_find_tree(const mp4tree_tree_t * tree, const char * path);
@@ -0,0 +1,286 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "pool.h"
+#include "output.h"
+#include "track.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+/* Initial number of tasks a queue has room for */
+#define POOL_QUEUE_SIZE 64
+
+typedef struct pool_task_struct
+{
+    pool_func_t func;
+    void *      arg;
+} pool_task_t;
+
+/* Ring buffer of tasks, oldest at head */
+typedef struct pool_queue_struct
+{
+    pthread_mutex_t lock;
+    pool_task_t *   tasks;
+    size_t          head;
+    size_t          num;
+    size_t          size;
+} pool_queue_t;
+
+typedef struct pool_worker_struct
+{
+    pool_t *     pool;
+    int          index;
+    pthread_t    thread;
+    pool_queue_t queue;
+} pool_worker_t;
+
+struct pool_struct
+{
+    pthread_mutex_t lock;      /* Protects pending and stop */
+    pthread_cond_t  cond;
+    size_t          pending;   /* Queued tasks not yet claimed by a worker */
+    bool            stop;
+    unsigned int    next;      /* Queue for the next task from outside */
+    int             num_workers;   /* Initialized queues */
+    int             num_started;   /* Started threads, num_workers once created */
+    pool_worker_t * workers;
+};
+
+/* The worker running on this thread, NULL outside the pool */
+static _Thread_local pool_worker_t * pool_self = NULL;
+
+
+static int
+pool_queue_push(pool_queue_t * queue, pool_func_t func, void * arg)
+{
+    pthread_mutex_lock(&queue->lock);
+
+    if (queue->num == queue->size)
+    {
+        size_t        size  = queue->size ? queue->size * 2 : POOL_QUEUE_SIZE;
+        pool_task_t * tasks = malloc(size * sizeof(*tasks));
+        size_t        i;
+
+        if (tasks == NULL)
+        {
+            pthread_mutex_unlock(&queue->lock);
+            return -1;
+        }
+
+        for (i = 0; i < queue->num; i++)
+            tasks[i] = queue->tasks[(queue->head + i) % queue->size];
+
+        free(queue->tasks);
+        queue->tasks = tasks;
+        queue->head  = 0;
+        queue->size  = size;
+    }
+
+    queue->tasks[(queue->head + queue->num) % queue->size].func = func;
+    queue->tasks[(queue->head + queue->num) % queue->size].arg  = arg;
+    queue->num++;
+
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+
+/* Take the oldest task, or the newest one when stealing */
+static bool
+pool_queue_take(pool_queue_t * queue, bool steal, pool_task_t * task)
+{
+    bool found = false;
+
+    pthread_mutex_lock(&queue->lock);
+
+    if (queue->num > 0)
+    {
+        if (steal)
+        {
+            *task = queue->tasks[(queue->head + queue->num - 1) % queue->size];
+        }
+        else
+        {
+            *task = queue->tasks[queue->head];
+            queue->head = (queue->head + 1) % queue->size;
+        }
+        queue->num--;
+        found = true;
+    }
+
+    pthread_mutex_unlock(&queue->lock);
+    return found;
+}
+
+
+static void *
+pool_worker_main(void * arg)
+{
+    pool_worker_t * self = arg;
+    pool_t *        pool = self->pool;
+
+    pool_self = self;
+
+    while (1)
+    {
+        pool_task_t task;
+        int         i;
+
+        pthread_mutex_lock(&pool->lock);
+        while (pool->pending == 0 && !pool->stop)
+            pthread_cond_wait(&pool->cond, &pool->lock);
+
+        if (pool->pending == 0)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+
+        /* Claim a task, it is then guaranteed to be in one of the queues */
+        pool->pending--;
+        pthread_mutex_unlock(&pool->lock);
+
+        for (i = 0; ; i = (i + 1) % pool->num_workers)
+        {
+            pool_worker_t * victim = &pool->workers[(self->index + i) % pool->num_workers];
+
+            if (pool_queue_take(&victim->queue, victim != self, &task))
+                break;
+        }
+
+        task.func(task.arg);
+    }
+
+    /* Tasks may have captured output and printed fragments on this thread */
+    out_thread_release();
+    mp4tree_track_release();
+    return NULL;
+}
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+pool_t *
+pool_create(int num_threads)
+{
+    pool_t * pool;
+    int      i;
+
+    if (num_threads <= 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+        num_threads = online > 0 ? online : 1;
+    }
+
+    pool = calloc(1, sizeof(*pool));
+    if (pool == NULL)
+        return NULL;
+
+    pool->workers = calloc(num_threads, sizeof(*pool->workers));
+    if (pool->workers == NULL)
+    {
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+
+    for (i = 0; i < num_threads; i++)
+    {
+        pool->workers[i].pool  = pool;
+        pool->workers[i].index = i;
+        pthread_mutex_init(&pool->workers[i].queue.lock, NULL);
+    }
+
+    /* All queues must exist before any worker looks at them */
+    pool->num_workers = num_threads;
+
+    for (i = 0; i < num_threads; i++)
+    {
+        if (pthread_create(&pool->workers[i].thread, NULL, pool_worker_main,
+                           &pool->workers[i]) != 0)
+        {
+            /* Only join the workers that were started, but destroy every queue */
+            pool_destroy(pool);
+            return NULL;
+        }
+        pool->num_started = i + 1;
+    }
+
+    return pool;
+}
+
+
+int
+pool_size(const pool_t * pool)
+{
+    return pool->num_workers;
+}
+
+
+int
+pool_submit(pool_t * pool, pool_func_t func, void * arg)
+{
+    pool_worker_t * worker;
+
+    if (pool_self != NULL && pool_self->pool == pool)
+    {
+        worker = pool_self;
+    }
+    else
+    {
+        pthread_mutex_lock(&pool->lock);
+        worker = &pool->workers[pool->next++ % pool->num_workers];
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    if (pool_queue_push(&worker->queue, func, arg) < 0)
+        return -1;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->pending++;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    return 0;
+}
+
+
+void
+pool_destroy(pool_t * pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->num_started; i++)
+        pthread_join(pool->workers[i].thread, NULL);
+
+    for (i = 0; i < pool->num_workers; i++)
+    {
+        pthread_mutex_destroy(&pool->workers[i].queue.lock);
+        free(pool->workers[i].queue.tasks);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->cond);
+    free(pool->workers);
+    free(pool);
+}
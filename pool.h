@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              Thread pool                                   *
+ ******************************************************************************
+ *
+ * Work-stealing pool. Every worker has its own queue and runs its oldest
+ * task first, idle workers steal the newest task of another worker. Tasks
+ * submitted by a worker go to its own queue.
+ */
+
+#include <stdlib.h>
+
+
+typedef void (*pool_func_t)(void * arg);
+
+typedef struct pool_struct pool_t;
+
+
+/* Start num_threads workers, 0 for one per online CPU. NULL on failure */
+pool_t *
+pool_create(int num_threads);
+
+/* Number of workers */
+int
+pool_size(const pool_t * pool);
+
+/* Queue func(arg) to be run by a worker, returns 0 on success */
+int
+pool_submit(pool_t * pool, pool_func_t func, void * arg);
+
+/* Run all queued tasks, then stop the workers and free the pool */
+void
+pool_destroy(pool_t * pool);
@@ -0,0 +1,736 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "process.h"
+#include "mp4tree.h"
+#include "stream.h"
+#include "tree.h"
+#include "options.h"
+#include "output.h"
+#include "json.h"
+#include "binary.h"
+#include "index.h"
+#include "path.h"
+#include "annexb.h"
+#include "common.h"
+#include "sidx.h"
+#include "mfra.h"
+#include "track.h"
+
+/*
+ ******************************************************************************
+ *                           File loading                                     *
+ ******************************************************************************
+ */
+
+/* Bytes at the start of a mapping to ask the kernel to read ahead eagerly */
+#define MP4TREE_WILLNEED_SIZE (4 * 1024 * 1024)
+
+/* Initial buffer size when the input size is unknown (pipes etc) */
+#define MP4TREE_READ_CHUNK (1024 * 1024)
+
+/* Read fd until EOF into a heap buffer, growing it as needed */
+static int
+mp4tree_input_read(int fd, size_t size_hint, mp4tree_input_t * input)
+{
+    size_t    cap = size_hint ? size_hint : MP4TREE_READ_CHUNK;
+    size_t    len = 0;
+    uint8_t * buf = malloc(cap);
+
+    if (buf == NULL)
+    {
+        out_printf("Failed to allocate memory\n");
+        return -1;
+    }
+
+    while (1)
+    {
+        ssize_t n;
+
+        if (len == cap)
+        {
+            uint8_t * tmp = realloc(buf, cap * 2);
+            if (tmp == NULL)
+            {
+                out_printf("Failed to allocate memory\n");
+                free(buf);
+                return -1;
+            }
+            buf = tmp;
+            cap *= 2;
+        }
+
+        n = read(fd, buf + len, cap - len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("read");
+            free(buf);
+            return -1;
+        }
+
+        if (n == 0)
+            break;
+
+        len += n;
+    }
+
+    input->buf    = buf;
+    input->len    = len;
+    input->mapped = false;
+    return 0;
+}
+
+
+int
+mp4tree_input_open(const char * filename, mp4tree_input_t * input)
+{
+    struct stat sb  = {0};
+    int         fd  = -1;
+    int         ret = -1;
+    void *      map = MAP_FAILED;
+
+    fd = open(filename, O_RDONLY);
+
+    if (fd < 0)
+    {
+        perror("open");
+        return -1;
+    }
+
+    if (fstat(fd, &sb) < 0)
+    {
+        perror("stat");
+        close(fd);
+        return -1;
+    }
+
+    input->st = sb;
+
+    if (S_ISREG(sb.st_mode) && sb.st_size > 0)
+    {
+        map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+
+    if (map != MAP_FAILED)
+    {
+        size_t willneed = sb.st_size;
+
+        if (willneed > MP4TREE_WILLNEED_SIZE)
+            willneed = MP4TREE_WILLNEED_SIZE;
+
+        /* Hints only, failure is harmless */
+        madvise(map, sb.st_size, MADV_SEQUENTIAL);
+        madvise(map, willneed, MADV_WILLNEED);
+
+        input->buf    = map;
+        input->len    = sb.st_size;
+        input->mapped = true;
+        ret = 0;
+    }
+    else
+    {
+        ret = mp4tree_input_read(fd, S_ISREG(sb.st_mode) ? sb.st_size : 0, input);
+    }
+
+    close(fd);
+    return ret;
+}
+
+
+void
+mp4tree_input_close(mp4tree_input_t * input)
+{
+    if (input->mapped)
+        munmap(input->buf, input->len);
+    else
+        free(input->buf);
+
+    input->buf = NULL;
+    input->len = 0;
+}
+
+
+/*
+ ******************************************************************************
+ *                           File processing                                  *
+ ******************************************************************************
+ */
+
+void
+mp4tree_process_prologue(const char * filename, const mp4tree_input_t * input)
+{
+    out_printf("Reading file %s\n", filename);
+    out_printf("Read %zu bytes \n", input->len);
+    out_printf("File Content:\n");
+}
+
+
+/* Print only the box selected by --path, without walking the rest */
+static int
+process_path(const char * filename, const mp4tree_input_t * input)
+{
+    mp4tree_tree_t * tree    = NULL;
+    const uint8_t *  box     = NULL;
+    size_t           box_len = 0;
+
+    if (input->mapped)
+        madvise(input->buf, input->len, MADV_RANDOM);
+
+    if (g_options.index && input->mapped)
+        tree = mp4tree_index_load(filename, &input->st, input->buf, input->len);
+
+    if (tree != NULL)
+    {
+        const mp4tree_box_t * node = mp4tree_path_find_tree(tree, g_options.path);
+
+        if (node != NULL)
+        {
+            box     = input->buf + node->offset;
+            box_len = node->size;
+            if (box_len > input->len - node->offset)
+                box_len = input->len - node->offset;
+        }
+        mp4tree_tree_free(tree);
+    }
+    else
+    {
+        box = mp4tree_path_find(input->buf, input->len, g_options.path, &box_len);
+    }
+
+    if (box == NULL)
+        return EXIT_FAILURE;
+
+    out_set_origin(input->buf, 0);
+    mp4tree_print(box, box_len, 0);
+
+    return EXIT_SUCCESS;
+}
+
+
+/* Walk boxes for the state they leave, without printing anything */
+static void
+process_quiet(const uint8_t * p, size_t len)
+{
+    static const mp4tree_callbacks_t quiet = {0};
+
+    out_set_callbacks(&quiet, NULL);
+    mp4tree_print(p, len, 0);
+    out_set_callbacks(NULL, NULL);
+}
+
+
+/* The first top-level box of a type, NULL without an error if there is none */
+static const uint8_t *
+process_top_level_find(const uint8_t * buf, size_t len, const char * type, size_t * box_len)
+{
+    const uint8_t * payload;
+    const uint8_t * box_end;
+    const uint8_t * box = box_find(buf, buf + len, type, &payload, &box_end);
+
+    if (box != NULL)
+        *box_len = box_end - box;
+    return box;
+}
+
+
+/*
+ * Pick up the track state of the moov without printing it, unless the init
+ * segment has provided it already or there is no moov
+ */
+static void
+process_moov_state(const mp4tree_input_t * input)
+{
+    const uint8_t * moov;
+    size_t          moov_len;
+
+    out_set_origin(input->buf, 0);
+
+    if (g_options.initseg != NULL)
+        return;
+
+    /* A media segment has no moov, like the normal printer it goes without */
+    moov = process_top_level_find(input->buf, input->len, "moov", &moov_len);
+    if (moov == NULL)
+        return;
+
+    process_quiet(moov, moov_len);
+    mp4tree_format_resume(true);
+}
+
+
+/*
+ * Print only the subsegment selected by --subsegment or --subsegment-time,
+ * found through the sidx without walking the boxes before it
+ */
+static int
+process_subsegment(const mp4tree_input_t * input)
+{
+    mp4tree_sidx_subsegment_t sub;
+    size_t                    sub_len;
+
+    if (input->mapped)
+        madvise(input->buf, input->len, MADV_RANDOM);
+
+    if (mp4tree_sidx_find(input->buf, input->len, g_options.subsegment,
+                          g_options.subsegment_time, &sub) < 0)
+        return EXIT_FAILURE;
+
+    process_moov_state(input);
+
+    if (sub.timescale != 0)
+        out_printf("Subsegment %"PRIu64" at offset %"PRIu64", time %"PRIu64" (%.3f s)\n",
+                   sub.number, sub.offset, sub.time, (double)sub.time / sub.timescale);
+    else
+        out_printf("Subsegment %"PRIu64" at offset %"PRIu64", time %"PRIu64"\n",
+                   sub.number, sub.offset, sub.time);
+
+    sub_len = sub.ref.size;
+    if (sub_len > input->len - sub.offset)
+        sub_len = input->len - sub.offset;
+
+    mp4tree_print(input->buf + sub.offset, sub_len, 0);
+
+    return EXIT_SUCCESS;
+}
+
+
+/*
+ * The tfra of the track given with --track, or else that of the first video
+ * track, or else the first one. NULL with an error if --track has none.
+ */
+static const mp4tree_tfra_t *
+process_tfra_select(const mp4tree_tfra_t * tfras, int num)
+{
+    const mp4tree_track_t * track;
+    int                     i;
+
+    for (i = 0; i < num; i++)
+    {
+        if (g_options.track != 0 && tfras[i].track_id == g_options.track)
+            return &tfras[i];
+    }
+
+    if (g_options.track != 0)
+    {
+        fprintf(stderr, "No tfra for track %u, the mfra has", g_options.track);
+        for (i = 0; i < num; i++)
+            fprintf(stderr, " %u", tfras[i].track_id);
+        fprintf(stderr, "\n");
+        return NULL;
+    }
+
+    for (i = 0; i < num; i++)
+    {
+        track = mp4tree_track_find(tfras[i].track_id);
+        if (track != NULL && track->video)
+            return &tfras[i];
+    }
+
+    return &tfras[0];
+}
+
+
+/* Print only the fragment selected by --at, found through the mfra */
+static int
+process_at(const mp4tree_input_t * input)
+{
+    const uint8_t *         mfra;
+    const uint8_t *         p;
+    const uint8_t *         end;
+    size_t                  mfra_len;
+    mp4tree_tfra_t          tfras[MP4TREE_TRACKS_MAX];
+    const mp4tree_tfra_t *  tfra;
+    int                     num_tfras;
+    mp4tree_tfra_entry_t    entry;
+    const mp4tree_track_t * track;
+    uint64_t                time;
+    int64_t                 i;
+
+    if (input->mapped)
+        madvise(input->buf, input->len, MADV_RANDOM);
+
+    mfra = mp4tree_mfra_find(input->buf, input->len, &mfra_len);
+    if (mfra == NULL)
+    {
+        fprintf(stderr, "No mfra found through an mfro at the end of the file\n");
+        return EXIT_FAILURE;
+    }
+
+    num_tfras = mp4tree_mfra_tfras(mfra, mfra_len, tfras, MP4TREE_TRACKS_MAX);
+    if (num_tfras == 0)
+    {
+        fprintf(stderr, "No tfra in the mfra at offset %zu\n", (size_t)(mfra - input->buf));
+        return EXIT_FAILURE;
+    }
+
+    process_moov_state(input);
+
+    tfra = process_tfra_select(tfras, num_tfras);
+    if (tfra == NULL)
+        return EXIT_FAILURE;
+
+    if (tfra->entry_count == 0)
+    {
+        fprintf(stderr, "No entries in the tfra of track %u\n", tfra->track_id);
+        return EXIT_FAILURE;
+    }
+
+    /* tfra times are in the timescale of the track */
+    track = mp4tree_track_find(tfra->track_id);
+    if (track == NULL || track->timescale == 0)
+    {
+        fprintf(stderr, "No timescale for track %u of the tfra\n", tfra->track_id);
+        return EXIT_FAILURE;
+    }
+
+    if (g_options.at * track->timescale < 18446744073709549568.0)
+        time = g_options.at * track->timescale;
+    else
+        time = UINT64_MAX;
+
+    i = mp4tree_tfra_lookup(tfra, time);
+    mp4tree_tfra_entry_get(tfra, i, &entry);
+
+    if (entry.moof_offset >= input->len)
+    {
+        fprintf(stderr, "Fragment at offset %"PRIu64" is outside the file\n", entry.moof_offset);
+        return EXIT_FAILURE;
+    }
+
+    out_printf("Track %u entry %"PRId64" at offset %"PRIu64", time %"PRIu64" (%.3f s)\n",
+               tfra->track_id, i + 1, entry.moof_offset, entry.time,
+               (double)entry.time / track->timescale);
+
+    /* The moof and the boxes up to the next one, usually its mdat */
+    p   = input->buf + entry.moof_offset;
+    end = input->buf + input->len;
+    while (end - p >= 8)
+    {
+        uint64_t size = get_u32(p);
+
+        if (p != input->buf + entry.moof_offset &&
+            (memcmp(p + 4, "moof", 4) == 0 || memcmp(p + 4, "mfra", 4) == 0))
+            break;
+
+        if (size == 1 && end - p >= 16)
+            size = get_u64(p + 8);
+        else if (size == 0)
+            size = end - p;
+
+        if (size < 8 || size > (uint64_t)(end - p))
+            size = end - p;
+
+        mp4tree_print(p, size, 0);
+        p += size;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+static int
+process_file(const char * filename)
+{
+    mp4tree_input_t  input = {0};
+    mp4tree_tree_t * tree  = NULL;
+
+    if (mp4tree_input_open(filename, &input) < 0)
+    {
+        out_printf("Reading file %s\n", filename);
+        return EXIT_FAILURE;
+    }
+
+    mp4tree_process_prologue(filename, &input);
+
+    if (g_options.path)
+    {
+        int status = process_path(filename, &input);
+
+        mp4tree_input_close(&input);
+        return status;
+    }
+
+    if (g_options.subsegment != 0 || g_options.subsegment_time >= 0)
+    {
+        int status = process_subsegment(&input);
+
+        mp4tree_input_close(&input);
+        return status;
+    }
+
+    if (g_options.at >= 0)
+    {
+        int status = process_at(&input);
+
+        mp4tree_input_close(&input);
+        return status;
+    }
+
+    /* A valid sidecar index saves walking the file for its structure */
+    if (g_options.index && input.mapped)
+    {
+        tree = mp4tree_index_load(filename, &input.st, input.buf, input.len);
+
+        /* Only the rendered boxes will be touched, in any order */
+        if (tree != NULL)
+            madvise(input.buf, input.len, MADV_RANDOM);
+    }
+
+    /* Parse the box structure first, then render it */
+    if (tree == NULL)
+    {
+        tree = mp4tree_tree_parse(input.buf, input.len);
+
+        if (tree != NULL && g_options.index && input.mapped &&
+            mp4tree_index_save(filename, &input.st, tree) < 0)
+        {
+            fprintf(stderr, "Failed to write index for %s\n", filename);
+        }
+    }
+
+    if (tree == NULL)
+    {
+        out_printf("Failed to allocate memory\n");
+        mp4tree_input_close(&input);
+        return EXIT_FAILURE;
+    }
+
+    mp4tree_tree_render(tree);
+    mp4tree_tree_free(tree);
+
+    mp4tree_input_close(&input);
+
+    return EXIT_SUCCESS;
+}
+
+
+/* Print the NAL units of an Annex B elementary stream */
+static int
+process_es(const char * filename, mp4tree_es_t codec)
+{
+    mp4tree_input_t input = {0};
+    int             status;
+
+    if (strcmp(filename, "-") == 0)
+    {
+        if (mp4tree_input_read(STDIN_FILENO, 0, &input) < 0)
+            return EXIT_FAILURE;
+    }
+    else if (mp4tree_input_open(filename, &input) < 0)
+    {
+        out_printf("Reading file %s\n", filename);
+        return EXIT_FAILURE;
+    }
+
+    mp4tree_process_prologue(filename, &input);
+    out_set_origin(input.buf, 0);
+    status = mp4tree_annexb_print(input.buf, input.len, codec, 0) < 0 ?
+             EXIT_FAILURE : EXIT_SUCCESS;
+
+    mp4tree_input_close(&input);
+    return status;
+}
+
+
+static int
+mp4tree_process_input(const char * filename)
+{
+    mp4tree_es_t codec = mp4tree_process_es(filename);
+
+    /* There are no boxes to stream, index or select in an elementary stream */
+    if (codec != MP4TREE_ES_NONE)
+        return process_es(filename, codec);
+
+    if (strcmp(filename, "-") == 0)
+    {
+        if (g_options.path)
+        {
+            fprintf(stderr, "--path needs a FILE, not stdin\n");
+            return EXIT_FAILURE;
+        }
+        if (g_options.subsegment != 0 || g_options.subsegment_time >= 0)
+        {
+            fprintf(stderr, "--subsegment needs a FILE, not stdin\n");
+            return EXIT_FAILURE;
+        }
+        if (g_options.at >= 0)
+        {
+            fprintf(stderr, "--at needs a FILE, not stdin\n");
+            return EXIT_FAILURE;
+        }
+        return mp4tree_stream_fd(STDIN_FILENO);
+    }
+
+    /* Path, sidx and mfra lookups work on the mapping, which already only reads headers */
+    if (g_options.stream && g_options.path == NULL &&
+        g_options.subsegment == 0 && g_options.subsegment_time < 0 && g_options.at < 0)
+        return mp4tree_stream_file(filename, g_options.window);
+
+    return process_file(filename);
+}
+
+
+mp4tree_es_t
+mp4tree_process_es(const char * filename)
+{
+    if (g_options.es != MP4TREE_ES_NONE)
+        return g_options.es;
+
+    return mp4tree_annexb_detect(filename);
+}
+
+
+char *
+mp4tree_filename_next(char ** files, int num_files, int * next)
+{
+    char *  line = NULL;
+    size_t  size = 0;
+    ssize_t n;
+
+    if (files != NULL)
+        return *next < num_files ? strdup(files[(*next)++]) : NULL;
+
+    while ((n = getline(&line, &size, stdin)) >= 0)
+    {
+        while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r'))
+            line[--n] = '\0';
+
+        if (n > 0)
+            return line;
+    }
+
+    free(line);
+    return NULL;
+}
+
+
+bool
+mp4tree_process_selects(void)
+{
+    return g_options.subsegment != 0 || g_options.subsegment_time >= 0 || g_options.at >= 0;
+}
+
+
+int
+mp4tree_process_state(const char * filename)
+{
+    mp4tree_input_t input = {0};
+
+    if (mp4tree_input_open(filename, &input) < 0)
+        return EXIT_FAILURE;
+
+    out_set_origin(input.buf, 0);
+    process_quiet(input.buf, input.len);
+
+    mp4tree_input_close(&input);
+    return EXIT_SUCCESS;
+}
+
+
+int
+mp4tree_process_initseg(const char * filename)
+{
+    int status;
+
+    /* When only part of FILE is printed, none of the init segment is */
+    if (mp4tree_process_selects())
+        status = mp4tree_process_state(filename);
+    else
+        status = mp4tree_process(filename);
+
+    if (status != EXIT_SUCCESS)
+        fprintf(stderr, "Error parsing init segment %s\n", filename);
+    return status;
+}
+
+
+int
+mp4tree_process(const char * filename)
+{
+    int status;
+
+    mp4tree_format_begin(filename);
+    status = mp4tree_process_input(filename);
+    mp4tree_format_end();
+
+    return status;
+}
+
+
+/*
+ ******************************************************************************
+ *                           Output formats                                   *
+ ******************************************************************************
+ */
+
+void
+mp4tree_format_begin(const char * filename)
+{
+    struct stat st;
+
+    switch (g_options.format)
+    {
+    case MP4TREE_FORMAT_JSON:
+        /* Text output is replaced by one JSON document per file */
+        out_set_callbacks(mp4tree_json_callbacks(), NULL);
+        mp4tree_json_begin(filename);
+        break;
+    case MP4TREE_FORMAT_BINARY:
+        if (strcmp(filename, "-") == 0 || stat(filename, &st) < 0)
+            st.st_size = 0;
+
+        out_set_callbacks(mp4tree_bin_callbacks(), NULL);
+        mp4tree_bin_begin(filename, st.st_size);
+        break;
+    default:
+        break;
+    }
+}
+
+
+void
+mp4tree_format_resume(bool first)
+{
+    switch (g_options.format)
+    {
+    case MP4TREE_FORMAT_JSON:
+        out_set_callbacks(mp4tree_json_callbacks(), NULL);
+        mp4tree_json_resume(first);
+        break;
+    case MP4TREE_FORMAT_BINARY:
+        out_set_callbacks(mp4tree_bin_callbacks(), NULL);
+        mp4tree_bin_resume();
+        break;
+    default:
+        break;
+    }
+}
+
+
+void
+mp4tree_format_end(void)
+{
+    switch (g_options.format)
+    {
+    case MP4TREE_FORMAT_JSON:
+        mp4tree_json_end();
+        break;
+    case MP4TREE_FORMAT_BINARY:
+        mp4tree_bin_end();
+        break;
+    default:
+        break;
+    }
+
+    out_set_callbacks(NULL, NULL);
+}
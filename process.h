@@ -0,0 +1,81 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              File processing                               *
+ ******************************************************************************
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+#include "options.h"
+
+
+typedef struct mp4tree_input_struct
+{
+    uint8_t *   buf;
+    size_t      len;
+    bool        mapped;
+    struct stat st;
+} mp4tree_input_t;
+
+
+/* Map a regular file read-only, or fall back to reading it */
+int
+mp4tree_input_open(const char * filename, mp4tree_input_t * input);
+
+void
+mp4tree_input_close(mp4tree_input_t * input);
+
+/*
+ * Next file name, from files until num_files have been taken or from the
+ * lines of stdin if files is NULL. NULL when there are no more, otherwise
+ * the caller frees it.
+ */
+char *
+mp4tree_filename_next(char ** files, int num_files, int * next);
+
+/* Print the lines preceding the boxes of an opened file */
+void
+mp4tree_process_prologue(const char * filename, const mp4tree_input_t * input);
+
+/* Codec of FILE given with --es or by its extension, MP4TREE_ES_NONE for mp4 */
+mp4tree_es_t
+mp4tree_process_es(const char * filename);
+
+/* True if an option selects part of FILE, which the init segment has none of */
+bool
+mp4tree_process_selects(void);
+
+/* Pick up the state left by the boxes of a file, e.g. an init segment, silently */
+int
+mp4tree_process_state(const char * filename);
+
+/*
+ * Print an init segment, or only pick up its state if an option selects
+ * part of FILE. An error is printed to stderr.
+ */
+int
+mp4tree_process_initseg(const char * filename);
+
+/* Print a file, or stdin for "-", in the selected --format */
+int
+mp4tree_process(const char * filename);
+
+/* Start the output of a file in the selected --format */
+void
+mp4tree_format_begin(const char * filename);
+
+/*
+ * Continue the output of a file started by another thread, at a top-level
+ * box. first is true if no box of the file has been printed yet.
+ */
+void
+mp4tree_format_resume(bool first);
+
+/* End the output of a file, also after mp4tree_format_resume() */
+void
+mp4tree_format_end(void);
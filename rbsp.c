@@ -0,0 +1,261 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ * AVX2 is used when the build targets it, and otherwise picked at run time
+ * on x86 compilers that can build a function for it
+ */
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define RBSP_AVX2_TARGET
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RBSP_AVX2_TARGET __attribute__((target("avx2")))
+#define RBSP_AVX2_DISPATCH
+#endif
+
+#include "rbsp.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+/* Bit masks of the 00 bytes and of the bytes equal to byte among the 64 bytes at p */
+typedef void (*rbsp_masks_func)(const uint8_t * p, uint8_t byte, uint64_t * zero,
+                                uint64_t * match);
+
+
+static inline __attribute__((always_inline)) void
+rbsp_masks(const uint8_t * p, uint8_t byte, uint64_t * zero, uint64_t * match)
+{
+#if defined(__SSE2__)
+    const __m128i z = _mm_setzero_si128();
+    const __m128i t = _mm_set1_epi8(byte);
+    int           i;
+
+    *zero  = 0;
+    *match = 0;
+
+    for (i = 0; i < 4; i++)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + 16 * i));
+
+        *zero  |= (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, z)) << (16 * i);
+        *match |= (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, t)) << (16 * i);
+    }
+#else
+    int i;
+
+    *zero  = 0;
+    *match = 0;
+
+    for (i = 0; i < 64; i++)
+    {
+        *zero  |= (uint64_t)(p[i] == 0) << i;
+        *match |= (uint64_t)(p[i] == byte) << i;
+    }
+#endif
+}
+
+
+#ifdef RBSP_AVX2_TARGET
+static inline __attribute__((always_inline)) RBSP_AVX2_TARGET void
+rbsp_masks_avx2(const uint8_t * p, uint8_t byte, uint64_t * zero, uint64_t * match)
+{
+    const __m256i z = _mm256_setzero_si256();
+    const __m256i t = _mm256_set1_epi8(byte);
+    __m256i       a = _mm256_loadu_si256((const __m256i *)p);
+    __m256i       b = _mm256_loadu_si256((const __m256i *)(p + 32));
+
+    *zero  = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, z)) |
+             (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, z)) << 32;
+    *match = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, t)) |
+             (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, t)) << 32;
+}
+#endif
+
+
+/*
+ * Offset of the first 00 00 <byte> in p, or len. Takes 64 bytes at a time
+ * as bit masks of their 00 and <byte> bytes, a match starts where a bit is
+ * set in the 00 mask, the 00 mask shifted by one and the <byte> mask shifted
+ * by two. The two bytes after the block are looked at directly. Inlined
+ * with the masks of each instruction set.
+ */
+static inline __attribute__((always_inline)) size_t
+rbsp_pattern_scan(const uint8_t * p, size_t len, uint8_t byte, rbsp_masks_func masks)
+{
+    size_t i = 0;
+
+    for ( ; i + 66 <= len; i += 64)
+    {
+        uint64_t zero;
+        uint64_t last;
+        uint64_t match;
+
+        masks(p + i, byte, &zero, &last);
+
+        /* Most blocks of slice data have no zero bytes at all */
+        if (zero == 0)
+            continue;
+
+        match = zero &
+                ((zero >> 1) | ((uint64_t)(p[i + 64] == 0) << 63)) &
+                ((last >> 2) | ((uint64_t)(p[i + 64] == byte) << 62) |
+                               ((uint64_t)(p[i + 65] == byte) << 63));
+
+        if (match != 0)
+            return i + __builtin_ctzll(match);
+    }
+
+    for ( ; i + 3 <= len; i++)
+    {
+        if (p[i] == 0 && p[i + 1] == 0 && p[i + 2] == byte)
+            return i;
+    }
+
+    return len;
+}
+
+
+#ifdef RBSP_AVX2_TARGET
+static RBSP_AVX2_TARGET size_t
+rbsp_pattern_find_avx2(const uint8_t * p, size_t len, uint8_t byte)
+{
+    return rbsp_pattern_scan(p, len, byte, rbsp_masks_avx2);
+}
+#endif
+
+
+static size_t
+rbsp_pattern_find(const uint8_t * p, size_t len, uint8_t byte)
+{
+#if defined(__AVX2__)
+    return rbsp_pattern_find_avx2(p, len, byte);
+#else
+#ifdef RBSP_AVX2_DISPATCH
+    if (__builtin_cpu_supports("avx2"))
+        return rbsp_pattern_find_avx2(p, len, byte);
+#endif
+    return rbsp_pattern_scan(p, len, byte, rbsp_masks);
+#endif
+}
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+size_t
+rbsp_epb_find(const uint8_t * p, size_t len)
+{
+    size_t i = rbsp_pattern_find(p, len, 3);
+
+    return i < len ? i + 2 : len;
+}
+
+
+size_t
+rbsp_start_code_find(const uint8_t * p, size_t len)
+{
+    return rbsp_pattern_find(p, len, 1);
+}
+
+
+size_t
+rbsp_unescape(uint8_t * dst, const uint8_t * src, size_t len)
+{
+    size_t out = 0;
+    size_t pos = 0;
+
+    /* Zeros before an emulation prevention byte do not count after it */
+    while (pos < len)
+    {
+        size_t epb = pos + rbsp_epb_find(src + pos, len - pos);
+
+        memcpy(dst + out, src + pos, epb - pos);
+        out += epb - pos;
+        pos  = epb + 1;
+    }
+
+    return out;
+}
+
+
+void
+rbsp_init(rbsp_t * rbsp)
+{
+    memset(rbsp, 0, sizeof(*rbsp));
+}
+
+
+void
+rbsp_set(rbsp_t * rbsp, const uint8_t * nal, size_t len)
+{
+    rbsp->nal     = nal;
+    rbsp->nal_len = len;
+    rbsp->data    = NULL;
+    rbsp->len     = 0;
+}
+
+
+const uint8_t *
+rbsp_data(rbsp_t * rbsp, size_t * len)
+{
+    size_t epb;
+
+    if (rbsp->data != NULL)
+    {
+        *len = rbsp->len;
+        return rbsp->data;
+    }
+
+    epb = rbsp_epb_find(rbsp->nal, rbsp->nal_len);
+
+    if (epb == rbsp->nal_len)
+    {
+        /* Nothing to remove, use the NAL unit as it is */
+        rbsp->data = rbsp->nal;
+        rbsp->len  = rbsp->nal_len;
+    }
+    else
+    {
+        if (rbsp->size < rbsp->nal_len)
+        {
+            uint8_t * buf = realloc(rbsp->buf, rbsp->nal_len);
+
+            if (buf == NULL)
+                return NULL;
+
+            rbsp->buf  = buf;
+            rbsp->size = rbsp->nal_len;
+        }
+
+        /* The part before the first one is copied as is */
+        memcpy(rbsp->buf, rbsp->nal, epb);
+        rbsp->len  = epb + rbsp_unescape(rbsp->buf + epb, rbsp->nal + epb + 1,
+                                         rbsp->nal_len - epb - 1);
+        rbsp->data = rbsp->buf;
+    }
+
+    *len = rbsp->len;
+    return rbsp->data;
+}
+
+
+void
+rbsp_free(rbsp_t * rbsp)
+{
+    free(rbsp->buf);
+    rbsp_init(rbsp);
+}
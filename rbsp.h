@@ -0,0 +1,63 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              NAL unit RBSP                                 *
+ ******************************************************************************
+ *
+ * The payload of a NAL unit has an emulation prevention byte 03 inserted
+ * after every 00 00 that would otherwise be followed by 00, 01, 02 or 03.
+ * Decoders reading fields past the NAL header need the raw byte sequence
+ * payload (RBSP) with these bytes removed.
+ *
+ * Annex B byte streams put a 00 00 01 start code before every NAL unit,
+ * which is searched for the same way.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+
+/*
+ * Lazy RBSP view of a NAL unit. Nothing is done until rbsp_data() is
+ * called, and NAL units without emulation prevention bytes are used in
+ * place. One view can be reused for many NAL units, its copy buffer is
+ * kept until rbsp_free().
+ */
+typedef struct rbsp_struct
+{
+    const uint8_t * nal;      /* NAL unit as stored */
+    size_t          nal_len;
+    const uint8_t * data;     /* RBSP, NULL until rbsp_data() */
+    size_t          len;
+    uint8_t *       buf;      /* Storage for RBSPs that had to be copied */
+    size_t          size;
+} rbsp_t;
+
+
+/* Offset of the first emulation prevention byte in p, len if there is none */
+size_t
+rbsp_epb_find(const uint8_t * p, size_t len);
+
+/* Offset of the first 00 00 01 start code prefix in p, len if there is none */
+size_t
+rbsp_start_code_find(const uint8_t * p, size_t len);
+
+/* Copy len bytes from src to dst leaving out emulation prevention bytes,
+   returns the number of bytes written */
+size_t
+rbsp_unescape(uint8_t * dst, const uint8_t * src, size_t len);
+
+void
+rbsp_init(rbsp_t * rbsp);
+
+/* Point the view at a NAL unit */
+void
+rbsp_set(rbsp_t * rbsp, const uint8_t * nal, size_t len);
+
+/* Get the RBSP of the NAL unit, NULL on allocation failure */
+const uint8_t *
+rbsp_data(rbsp_t * rbsp, size_t * len);
+
+void
+rbsp_free(rbsp_t * rbsp);
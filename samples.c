@@ -0,0 +1,138 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "samples.h"
+#include "iter.h"
+#include "process.h"
+#include "output.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+/* Samples listed per track, to number them within their track */
+typedef struct
+{
+    int      num_tracks;
+    uint32_t track_id[MP4TREE_TRACKS_MAX];
+    uint64_t count[MP4TREE_TRACKS_MAX];
+} samples_count_t;
+
+
+/* Number of the sample within its track, counting from 1 */
+static uint64_t
+samples_number(samples_count_t * counts, uint32_t track_id)
+{
+    int i;
+
+    for (i = 0; i < counts->num_tracks; i++)
+    {
+        if (counts->track_id[i] == track_id)
+            return ++counts->count[i];
+    }
+
+    /* Further tracks are numbered together */
+    if (counts->num_tracks == MP4TREE_TRACKS_MAX)
+        return ++counts->count[MP4TREE_TRACKS_MAX - 1];
+
+    counts->track_id[counts->num_tracks] = track_id;
+    counts->count[counts->num_tracks]    = 1;
+    counts->num_tracks++;
+    return 1;
+}
+
+
+/* The next sample, reporting the traks skipped on the way to it */
+static bool
+samples_next(mp4tree_iter_t * iter, const char * filename, mp4tree_sample_t * sample)
+{
+    bool more = mp4tree_iter_next(iter, sample);
+
+    if (iter->stbl_error != 0)
+    {
+        fprintf(stderr, "%s: track %u has no samples listed, %s\n", filename,
+                iter->stbl_error_track, mp4tree_stbl_error(iter->stbl_error));
+        iter->stbl_error = 0;
+    }
+
+    return more;
+}
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+int
+mp4tree_samples_print(const char * initseg, const char * filename)
+{
+    mp4tree_input_t  init   = {0};
+    mp4tree_input_t  input  = {0};
+    samples_count_t  counts = {0};
+    mp4tree_iter_t   iter;
+    mp4tree_sample_t sample;
+    uint32_t         i;
+
+    if (initseg != NULL && mp4tree_input_open(initseg, &init) < 0)
+    {
+        fprintf(stderr, "Error reading %s\n", initseg);
+        return EXIT_FAILURE;
+    }
+
+    if (mp4tree_input_open(filename, &input) < 0)
+    {
+        fprintf(stderr, "Error reading %s\n", filename);
+        if (initseg != NULL)
+            mp4tree_input_close(&init);
+        return EXIT_FAILURE;
+    }
+
+    /* Only the moov and moof boxes are read, the media data is skipped */
+    if (input.mapped)
+        madvise(input.buf, input.len, MADV_RANDOM);
+
+    /* Rows are reported as a Samples table in the JSON and binary formats */
+    mp4tree_format_begin(filename);
+    out_printf("Track       Sample             Offset       Size                DTS                PTS   Sync      Flags\n");
+
+    mp4tree_iter_init(&iter, input.buf, input.len);
+    if (initseg != NULL)
+    {
+        mp4tree_iter_defaults(&iter, init.buf, init.len);
+        mp4tree_input_close(&init);
+    }
+
+    for (i = 0; samples_next(&iter, filename, &sample); i++)
+    {
+        uint64_t row[8];
+
+        row[0] = sample.track_id;
+        row[1] = samples_number(&counts, sample.track_id);
+        row[2] = sample.offset;
+        row[3] = sample.size;
+        row[4] = sample.dts;
+        row[5] = (uint64_t)sample.pts;
+        row[6] = sample.sync;
+        row[7] = sample.flags;
+        out_sample("Samples", i, row, 8, 0);
+
+        out_printf("%5u %12"PRIu64" %18"PRIu64" %10u %18"PRIu64" %18"PRId64" %6s 0x%.8x\n",
+                   sample.track_id, row[1], sample.offset, sample.size,
+                   sample.dts, sample.pts, sample.sync ? "yes" : "", sample.flags);
+    }
+    mp4tree_iter_free(&iter);
+    mp4tree_format_end();
+
+    mp4tree_input_close(&input);
+    return EXIT_SUCCESS;
+}
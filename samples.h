@@ -0,0 +1,23 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              Sample listing                                *
+ ******************************************************************************
+ *
+ * Lists every sample of a file through the sample iterator, see iter.h, so
+ * fragmented and progressive files are listed the same way. Only the moov
+ * and moof boxes are read.
+ */
+
+
+/*
+ * Print the samples of filename in the order of the iterator: track, number
+ * within the track, file offset, size, decode and presentation time, whether
+ * it is a sync sample and its sample flags. Returns EXIT_SUCCESS if the file
+ * could be read. With --format json or binary the samples are reported as
+ * the rows of a Samples table instead. The trex defaults of initseg, if not
+ * NULL, apply to the fragments of filename.
+ */
+int
+mp4tree_samples_print(const char * initseg, const char * filename);
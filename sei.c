@@ -3,6 +3,7 @@
 #include "sei.h"
 #include "common.h"
 #include "mp4tree.h"
+#include "output.h"
 
 
 /*
@@ -192,11 +193,9 @@ mp4tree_sei_print(const uint8_t * p, size_t len, int depth,
     uint32_t payload_type = mp4tree_sei_payload_type(p, is_hevc);
     const char * desc = mp4tree_sei_description(payload_type, sei_infos);
 
-    printf("%s  Payload type:         %u\n",
-           indent(depth, 0), payload_type);
+    out_field(depth, "Payload type:         ", "%u", payload_type);
 
-    printf("%s  Payload description:  %s\n",
-           indent(depth, 0), desc ? desc : "Reserved");
+    out_field(depth, "Payload description:  ", "%s", desc ? desc : "Reserved");
 }
 
 
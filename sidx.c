@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "sidx.h"
+#include "common.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+/* What is looked for, and how far the search has come */
+typedef struct
+{
+    uint64_t number;        /* Non-zero to find a subsegment by number */
+    double   seconds;
+    uint64_t count;         /* Subsegments passed so far */
+} sidx_search_t;
+
+
+/*
+ * Payload of the sidx box at p, NULL if there is none. *box_end is set to
+ * the end of the box, which is where its references are counted from.
+ */
+static const uint8_t *
+sidx_box(const uint8_t * p, const uint8_t * end, const uint8_t ** box_end)
+{
+    const uint8_t * type;
+    const uint8_t * payload;
+
+    *box_end = box_next(p, end, &type, &payload);
+    if (*box_end == NULL || memcmp(type, "sidx", 4) != 0)
+        return NULL;
+
+    return payload;
+}
+
+
+/* The first top-level sidx, which has to come before any media data */
+static const uint8_t *
+sidx_first(const uint8_t * p, const uint8_t * end, const uint8_t ** box_end)
+{
+    const uint8_t * type;
+    const uint8_t * payload;
+    const uint8_t * next;
+
+    for (; (next = box_next(p, end, &type, &payload)) != NULL; p = next)
+    {
+        if (memcmp(type, "sidx", 4) == 0)
+        {
+            *box_end = next;
+            return payload;
+        }
+
+        if (memcmp(type, "moof", 4) == 0 || memcmp(type, "mdat", 4) == 0)
+            return NULL;
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Search the sidx with payload p, ending at box_end, and the sidx boxes it
+ * refers to. Returns 1 if the subsegment was found, 0 if it is not in this
+ * sidx and -1 if the index is broken.
+ */
+static int
+sidx_search(
+    const uint8_t *             buf,
+    size_t                      len,
+    const uint8_t *             p,
+    const uint8_t *             box_end,
+    int                         depth,
+    sidx_search_t *             search,
+    mp4tree_sidx_subsegment_t * sub)
+{
+    mp4tree_sidx_t     sidx;
+    mp4tree_sidx_ref_t ref;
+    uint64_t           offset;
+    uint64_t           time;
+    uint64_t           target = 0;
+    unsigned int       i;
+
+    if (!mp4tree_sidx_parse(p, box_end - p, &sidx))
+    {
+        fprintf(stderr, "Invalid sidx at offset %zu\n", (size_t)(p - buf));
+        return -1;
+    }
+
+    if (search->number == 0)
+    {
+        if (sidx.timescale == 0)
+        {
+            fprintf(stderr, "sidx at offset %zu has no timescale\n", (size_t)(p - buf));
+            return -1;
+        }
+
+        /* Past the end of any index rather than overflowing */
+        if (search->seconds * sidx.timescale < 18446744073709549568.0)
+            target = search->seconds * sidx.timescale;
+        else
+            target = UINT64_MAX;
+    }
+
+    offset = (box_end - buf) + sidx.first_offset;
+    time   = sidx.earliest_presentation_time;
+
+    for (i = 0; i < sidx.reference_count; i++)
+    {
+        mp4tree_sidx_ref_get(&sidx, i, &ref);
+
+        /* Another sidx is entered to count its subsegments */
+        if (ref.is_index)
+        {
+            const uint8_t * nested_end;
+            const uint8_t * nested = NULL;
+            int             found;
+
+            if (offset < len)
+                nested = sidx_box(buf + offset, buf + len, &nested_end);
+
+            if (nested == NULL || depth == MP4TREE_SIDX_DEPTH_MAX)
+            {
+                fprintf(stderr, "No sidx at offset %"PRIu64" referred to by the sidx at offset %zu\n",
+                        offset, (size_t)(p - buf));
+                return -1;
+            }
+
+            found = sidx_search(buf, len, nested, nested_end, depth + 1, search, sub);
+            if (found != 0)
+                return found;
+        }
+        else
+        {
+            search->count++;
+
+            if (search->number != 0 ? search->count == search->number : target < time + ref.duration)
+            {
+                sub->number    = search->count;
+                sub->offset    = offset;
+                sub->time      = time;
+                sub->timescale = sidx.timescale;
+                sub->ref       = ref;
+                return 1;
+            }
+        }
+
+        offset += ref.size;
+        time   += ref.duration;
+    }
+
+    return 0;
+}
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+bool
+mp4tree_sidx_parse(const uint8_t * p, size_t len, mp4tree_sidx_t * sidx)
+{
+    size_t hdr_len;
+
+    memset(sidx, 0, sizeof(*sidx));
+    if (len < 4)
+        return false;
+
+    sidx->version = p[0];
+    hdr_len       = sidx->version == 0 ? 24 : 32;
+    if (len < hdr_len)
+        return false;
+
+    sidx->reference_id = get_u32(p + 4);
+    sidx->timescale    = get_u32(p + 8);
+
+    if (sidx->version == 0)
+    {
+        sidx->earliest_presentation_time = get_u32(p + 12);
+        sidx->first_offset               = get_u32(p + 16);
+    }
+    else
+    {
+        sidx->earliest_presentation_time = get_u64(p + 12);
+        sidx->first_offset               = get_u64(p + 20);
+    }
+
+    /* reference_count follows 16 reserved bits */
+    sidx->reference_count = get_u16(p + hdr_len - 2);
+    sidx->refs            = p + hdr_len;
+
+    if (sidx->reference_count > (len - hdr_len) / 12)
+        sidx->reference_count = (len - hdr_len) / 12;
+
+    return true;
+}
+
+
+void
+mp4tree_sidx_ref_get(const mp4tree_sidx_t * sidx, unsigned int i, mp4tree_sidx_ref_t * ref)
+{
+    const uint8_t * p    = sidx->refs + 12 * i;
+    uint32_t        type = get_u32(p);
+    uint32_t        sap  = get_u32(p + 8);
+
+    ref->is_index        = type >> 31;
+    ref->size            = type & 0x7fffffff;
+    ref->duration        = get_u32(p + 4);
+    ref->starts_with_sap = sap >> 31;
+    ref->sap_type        = (sap >> 28) & 0x7;
+    ref->sap_delta_time  = sap & 0x0fffffff;
+}
+
+
+int
+mp4tree_sidx_find(
+    const uint8_t *             buf,
+    size_t                      len,
+    uint64_t                    number,
+    double                      seconds,
+    mp4tree_sidx_subsegment_t * sub)
+{
+    sidx_search_t   search = {0};
+    const uint8_t * box_end;
+    const uint8_t * p;
+    int             found;
+
+    p = sidx_first(buf, buf + len, &box_end);
+    if (p == NULL)
+    {
+        fprintf(stderr, "No sidx before the first moof or mdat\n");
+        return -1;
+    }
+
+    search.number  = number;
+    search.seconds = seconds;
+
+    found = sidx_search(buf, len, p, box_end, 0, &search, sub);
+    if (found < 0)
+        return -1;
+
+    if (found == 0)
+    {
+        if (number != 0)
+            fprintf(stderr, "No subsegment %"PRIu64", the sidx has %"PRIu64"\n",
+                    number, search.count);
+        else
+            fprintf(stderr, "No subsegment at %.3f s, after the last of %"PRIu64"\n",
+                    seconds, search.count);
+        return -1;
+    }
+
+    if (sub->offset >= len)
+    {
+        fprintf(stderr, "Subsegment %"PRIu64" at offset %"PRIu64" is outside the file\n",
+                sub->number, sub->offset);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              Segment index                                 *
+ ******************************************************************************
+ *
+ * Decoding of sidx (ISO/IEC 14496-12 8.16.3) and lookups of subsegments
+ * through it. The references of a sidx are read in place from the box. A
+ * reference to another sidx, as in a hierarchical index, stands for the
+ * subsegments of that sidx.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* Nested sidx followed by a lookup */
+#define MP4TREE_SIDX_DEPTH_MAX 8
+
+typedef struct mp4tree_sidx_struct
+{
+    uint8_t         version;
+    uint32_t        reference_id;
+    uint32_t        timescale;
+    uint64_t        earliest_presentation_time;
+    uint64_t        first_offset;
+    uint16_t        reference_count;    /* Only those inside the box */
+    const uint8_t * refs;               /* 12 bytes per reference */
+} mp4tree_sidx_t;
+
+typedef struct mp4tree_sidx_ref_struct
+{
+    bool     is_index;                  /* Refers to another sidx */
+    uint32_t size;
+    uint32_t duration;
+    bool     starts_with_sap;
+    uint8_t  sap_type;
+    uint32_t sap_delta_time;
+} mp4tree_sidx_ref_t;
+
+/* A subsegment found by mp4tree_sidx_find() */
+typedef struct mp4tree_sidx_subsegment_struct
+{
+    uint64_t           number;          /* Counting from 1 */
+    uint64_t           offset;          /* In the buffer searched */
+    uint64_t           time;            /* Earliest presentation time */
+    uint32_t           timescale;
+    mp4tree_sidx_ref_t ref;
+} mp4tree_sidx_subsegment_t;
+
+
+/* Parse a sidx payload, returns false if it is too short for its header */
+bool
+mp4tree_sidx_parse(const uint8_t * p, size_t len, mp4tree_sidx_t * sidx);
+
+/* Reference i of a parsed sidx, i < reference_count */
+void
+mp4tree_sidx_ref_get(const mp4tree_sidx_t * sidx, unsigned int i, mp4tree_sidx_ref_t * ref);
+
+/*
+ * Find a subsegment through the first top-level sidx of buf, only reading
+ * the box headers before it and the sidx boxes on the way. With number
+ * non-zero the subsegment with that number is found, otherwise the one
+ * covering seconds, or the first one if seconds is before it. Returns -1
+ * with an error printed to stderr if there is no such subsegment.
+ */
+int
+mp4tree_sidx_find(const uint8_t * buf, size_t len, uint64_t number, double seconds,
+                  mp4tree_sidx_subsegment_t * sub);
@@ -0,0 +1,439 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "stbl.h"
+#include "common.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+/* Payload of the child of the stbl payload at p with type, NULL if none */
+static const uint8_t *
+stbl_child(const uint8_t * p, size_t len, const char * type, size_t * child_len)
+{
+    const uint8_t * payload;
+    const uint8_t * box_end;
+
+    if (box_find(p, p + len, type, &payload, &box_end) == NULL)
+        return NULL;
+
+    *child_len = box_end - payload;
+    return payload;
+}
+
+
+/* Number of entries of size esize in a table of len bytes claiming num */
+static uint32_t
+stbl_entries(uint32_t num, size_t len, size_t esize)
+{
+    return num > len / esize ? len / esize : num;
+}
+
+
+/*
+ * Runs of an stts or ctts payload. The decode time each run starts at is
+ * summed for stts, ctts only needs the sample numbers.
+ */
+static mp4tree_stbl_run_t *
+stbl_time_runs(arena_t * arena, const uint8_t * p, size_t len, uint32_t sample_count,
+               int * num_runs)
+{
+    mp4tree_stbl_run_t * runs;
+    uint32_t             num;
+    uint64_t             sample = 0;
+    uint64_t             time   = 0;
+    uint32_t             i;
+
+    if (len < 8)
+        return NULL;
+
+    num  = stbl_entries(get_u32(p + 4), len - 8, 8);
+    runs = arena_alloc(arena, (num ? num : 1) * sizeof(*runs));
+    if (runs == NULL)
+        return NULL;
+
+    for (i = 0; i < num; i++)
+    {
+        runs[i].first_sample = sample;
+        runs[i].count        = get_u32(p + 8 + 8 * i);
+        runs[i].value        = get_u32(p + 12 + 8 * i);
+        runs[i].first        = time;
+
+        /* Runs past the last sample all start at sample_count */
+        sample += runs[i].count;
+        if (sample > sample_count)
+            sample = sample_count;
+        time   += (uint64_t)runs[i].count * runs[i].value;
+    }
+
+    *num_runs = num;
+    return runs;
+}
+
+
+/* Runs of chunks of an stsc payload, the last one up to the last chunk */
+static mp4tree_stbl_run_t *
+stbl_chunk_runs(arena_t * arena, const uint8_t * p, size_t len, uint32_t chunk_count,
+                uint32_t sample_count, int * num_runs)
+{
+    mp4tree_stbl_run_t * runs;
+    uint32_t             num;
+    uint64_t             sample = 0;
+    uint32_t             i;
+
+    if (len < 8)
+        return NULL;
+
+    num  = stbl_entries(get_u32(p + 4), len - 8, 12);
+    runs = arena_alloc(arena, (num ? num : 1) * sizeof(*runs));
+    if (runs == NULL)
+        return NULL;
+
+    for (i = 0; i < num; i++)
+    {
+        /* first_chunk counts from 1 */
+        uint32_t first = get_u32(p + 8 + 12 * i);
+        uint32_t next  = i + 1 < num ? get_u32(p + 20 + 12 * i) : chunk_count + 1;
+
+        runs[i].first_sample = sample;
+        runs[i].first        = first ? first - 1 : 0;
+        runs[i].count        = next > first ? next - first : 0;
+        runs[i].value        = get_u32(p + 12 + 12 * i);
+
+        sample += (uint64_t)runs[i].count * runs[i].value;
+        if (sample > sample_count)
+            sample = sample_count;
+    }
+
+    *num_runs = num;
+    return runs;
+}
+
+
+/* Last run starting at or before sample, -1 if there is none */
+static int
+stbl_run_find(const mp4tree_stbl_run_t * runs, int num_runs, uint32_t sample)
+{
+    int lo = 0;
+    int hi = num_runs;
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+
+        if (runs[mid].first_sample <= sample)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo - 1;
+}
+
+
+static uint32_t
+stbl_size(const mp4tree_stbl_t * stbl, uint32_t i)
+{
+    return stbl->sizes != NULL ? get_u32(stbl->sizes + 4 * i) : stbl->sample_size;
+}
+
+
+static uint64_t
+stbl_chunk_offset(const mp4tree_stbl_t * stbl, uint32_t chunk)
+{
+    if (chunk >= stbl->chunk_count)
+        return 0;
+
+    if (stbl->chunk_offset_size == 8)
+        return get_u64(stbl->chunk_offsets + 8 * chunk);
+    return get_u32(stbl->chunk_offsets + 4 * chunk);
+}
+
+
+/* Composition offset of sample i in ctts run r */
+static int32_t
+stbl_cts_offset(const mp4tree_stbl_t * stbl, int r, uint32_t i)
+{
+    if (r < 0 || i - stbl->ctts[r].first_sample >= stbl->ctts[r].count)
+        return 0;
+
+    /* Version 0 offsets are unsigned, but in practice hold small values */
+    return (int32_t)stbl->ctts[r].value;
+}
+
+
+/* Index of the first stss entry at or after sample i */
+static uint32_t
+stbl_sync_find(const mp4tree_stbl_t * stbl, uint32_t i)
+{
+    uint32_t lo = 0;
+    uint32_t hi = stbl->sync_count;
+
+    /* Sample numbers in stss count from 1 */
+    while (lo < hi)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (get_u32(stbl->syncs + 4 * mid) < i + 1)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+int
+mp4tree_stbl_build(const uint8_t * p, size_t len, mp4tree_stbl_t * stbl)
+{
+    const uint8_t * stts;
+    const uint8_t * ctts;
+    const uint8_t * stsc;
+    const uint8_t * stsz;
+    const uint8_t * stco;
+    const uint8_t * stss;
+    size_t          stts_len;
+    size_t          ctts_len;
+    size_t          stsc_len;
+    size_t          stsz_len;
+    size_t          stco_len;
+    size_t          stss_len;
+
+    memset(stbl, 0, sizeof(*stbl));
+    arena_init(&stbl->arena, 0);
+
+    stts = stbl_child(p, len, "stts", &stts_len);
+    stsc = stbl_child(p, len, "stsc", &stsc_len);
+    stsz = stbl_child(p, len, "stsz", &stsz_len);
+    stco = stbl_child(p, len, "stco", &stco_len);
+    stbl->chunk_offset_size = 4;
+    if (stco == NULL)
+    {
+        stco = stbl_child(p, len, "co64", &stco_len);
+        stbl->chunk_offset_size = 8;
+    }
+
+    if (stts == NULL || stsc == NULL || stsz == NULL || stco == NULL ||
+        stsz_len < 12 || stco_len < 8)
+        return MP4TREE_STBL_NO_TABLES;
+
+    stbl->sample_size  = get_u32(stsz + 4);
+    stbl->sample_count = get_u32(stsz + 8);
+    if (stbl->sample_size == 0)
+    {
+        stbl->sizes        = stsz + 12;
+        stbl->sample_count = stbl_entries(stbl->sample_count, stsz_len - 12, 4);
+    }
+
+    stbl->chunk_count   = stbl_entries(get_u32(stco + 4), stco_len - 8, stbl->chunk_offset_size);
+    stbl->chunk_offsets = stco + 8;
+
+    stbl->stts = stbl_time_runs(&stbl->arena, stts, stts_len, stbl->sample_count,
+                                &stbl->num_stts);
+    stbl->stsc = stbl_chunk_runs(&stbl->arena, stsc, stsc_len, stbl->chunk_count,
+                                 stbl->sample_count, &stbl->num_stsc);
+    if (stbl->stts == NULL || stbl->stsc == NULL)
+    {
+        mp4tree_stbl_free(stbl);
+        return MP4TREE_STBL_INVALID;
+    }
+
+    ctts = stbl_child(p, len, "ctts", &ctts_len);
+    if (ctts != NULL)
+        stbl->ctts = stbl_time_runs(&stbl->arena, ctts, ctts_len, stbl->sample_count,
+                                    &stbl->num_ctts);
+
+    stss = stbl_child(p, len, "stss", &stss_len);
+    if (stss != NULL && stss_len >= 8)
+    {
+        stbl->sync_count = stbl_entries(get_u32(stss + 4), stss_len - 8, 4);
+        stbl->syncs      = stss + 8;
+    }
+
+    return 0;
+}
+
+
+const char *
+mp4tree_stbl_error(int err)
+{
+    switch (err)
+    {
+    case MP4TREE_STBL_NO_TABLES: return "stbl without stts, stsc, stsz and stco or co64";
+    case MP4TREE_STBL_INVALID:   return "Invalid stts or stsc";
+    default:                     return "Unknown stbl error";
+    }
+}
+
+
+void
+mp4tree_stbl_free(mp4tree_stbl_t * stbl)
+{
+    arena_free(&stbl->arena);
+    stbl->stts = NULL;
+    stbl->ctts = NULL;
+    stbl->stsc = NULL;
+}
+
+
+int64_t
+mp4tree_stbl_time_to_sample(const mp4tree_stbl_t * stbl, uint64_t dts)
+{
+    const mp4tree_stbl_run_t * run;
+    uint64_t                   i;
+    int                        lo = 0;
+    int                        hi = stbl->num_stts;
+
+    /* Last run starting at or before dts */
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+
+        if (stbl->stts[mid].first <= dts)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo == 0)
+        return -1;
+
+    run = &stbl->stts[lo - 1];
+    if (run->value == 0)
+        return run->first_sample;
+
+    i = (dts - run->first) / run->value;
+    if (i >= run->count || run->first_sample + i >= stbl->sample_count)
+        return -1;
+
+    return run->first_sample + i;
+}
+
+
+uint64_t
+mp4tree_stbl_sample_offset(const mp4tree_stbl_t * stbl, uint32_t i)
+{
+    const mp4tree_stbl_run_t * run;
+    uint32_t                   chunk;
+    uint32_t                   sample;
+    uint64_t                   offset;
+    int                        r;
+
+    r = stbl_run_find(stbl->stsc, stbl->num_stsc, i);
+    if (r < 0 || stbl->stsc[r].value == 0)
+        return 0;
+
+    run    = &stbl->stsc[r];
+    chunk  = run->first + (i - run->first_sample) / run->value;
+    sample = i - (i - run->first_sample) % run->value;
+    offset = stbl_chunk_offset(stbl, chunk);
+
+    /* The samples before it in its chunk */
+    for (; sample < i; sample++)
+        offset += stbl_size(stbl, sample);
+
+    return offset;
+}
+
+
+uint32_t
+mp4tree_stbl_expand(const mp4tree_stbl_t * stbl, uint32_t first,
+                    mp4tree_stbl_samples_t * samples)
+{
+    uint32_t count;
+    uint32_t in_chunk = 0;
+    uint32_t chunk    = 0;
+    uint32_t sync     = 0;
+    int      s;
+    int      t;
+    int      c;
+    uint32_t j;
+
+    if (first >= stbl->sample_count)
+        return 0;
+
+    count = stbl->sample_count - first;
+    if (count > MP4TREE_STBL_BLOCK)
+        count = MP4TREE_STBL_BLOCK;
+
+    samples->first = first;
+    samples->count = count;
+
+    /* Binary searches for the first sample, then a walk over the rest */
+    t = stbl_run_find(stbl->stts, stbl->num_stts, first);
+    c = stbl_run_find(stbl->ctts, stbl->num_ctts, first);
+    s = stbl_run_find(stbl->stsc, stbl->num_stsc, first);
+    if (s >= 0 && stbl->stsc[s].value != 0)
+    {
+        chunk    = stbl->stsc[s].first + (first - stbl->stsc[s].first_sample) / stbl->stsc[s].value;
+        in_chunk = (first - stbl->stsc[s].first_sample) % stbl->stsc[s].value;
+    }
+    if (stbl->syncs != NULL)
+        sync = stbl_sync_find(stbl, first);
+
+    for (j = 0; j < count; j++)
+    {
+        uint32_t i = first + j;
+
+        samples->size[j] = stbl_size(stbl, i);
+
+        if (j == 0)
+        {
+            /* Samples past the stts keep the last duration */
+            samples->dts[j] = t < 0 ? 0 : stbl->stts[t].first +
+                              (uint64_t)(i - stbl->stts[t].first_sample) * stbl->stts[t].value;
+            samples->offset[j] = mp4tree_stbl_sample_offset(stbl, i);
+        }
+        else
+        {
+            samples->dts[j] = samples->dts[j - 1] + (t < 0 ? 0 : stbl->stts[t].value);
+
+            if (s >= 0 && ++in_chunk >= stbl->stsc[s].value)
+            {
+                /* Next chunk, which may start the next run */
+                chunk++;
+                in_chunk = 0;
+                while (s + 1 < stbl->num_stsc && stbl->stsc[s + 1].first_sample <= i)
+                    s++;
+                samples->offset[j] = stbl_chunk_offset(stbl, chunk);
+            }
+            else
+            {
+                samples->offset[j] = samples->offset[j - 1] + samples->size[j - 1];
+            }
+        }
+
+        /* Duration of this sample, added to the next one's decode time */
+        while (t + 1 < stbl->num_stts && stbl->stts[t + 1].first_sample <= i)
+            t++;
+
+        while (c + 1 < stbl->num_ctts && stbl->ctts[c + 1].first_sample <= i)
+            c++;
+        samples->cts_offset[j] = stbl_cts_offset(stbl, c, i);
+
+        if (stbl->syncs == NULL)
+        {
+            samples->sync[j] = true;
+        }
+        else
+        {
+            while (sync < stbl->sync_count && get_u32(stbl->syncs + 4 * sync) < i + 1)
+                sync++;
+            samples->sync[j] = sync < stbl->sync_count && get_u32(stbl->syncs + 4 * sync) == i + 1;
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              Sample index                                  *
+ ******************************************************************************
+ *
+ * Per-sample information of a progressive track compiled from the tables of
+ * its stbl: stts, ctts, stsc, stsz, stco or co64 and stss. The sample size,
+ * chunk offset and sync sample tables are read in place from the input. The
+ * run-length tables are kept as runs with the sample number and decode time
+ * each starts at, so lookups are binary searches and the index stays as
+ * small as the tables. Samples are expanded on demand, a block at a time,
+ * into a structure of arrays.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "arena.h"
+
+
+/* Samples expanded by one call to mp4tree_stbl_expand() */
+#define MP4TREE_STBL_BLOCK 256
+
+/* Errors of mp4tree_stbl_build() */
+#define MP4TREE_STBL_NO_TABLES -1   /* No stts, stsc, stsz or chunk offsets */
+#define MP4TREE_STBL_INVALID   -2   /* stts or stsc too short, or out of memory */
+
+/* A run of stts or ctts, or of chunks in stsc */
+typedef struct mp4tree_stbl_run_struct
+{
+    uint32_t first_sample;      /* Counting from 0 */
+    uint32_t count;             /* Samples, or chunks for stsc */
+    uint32_t value;             /* Duration, composition offset or samples per chunk */
+    uint64_t first;             /* Decode time of the first sample, first chunk for stsc */
+} mp4tree_stbl_run_t;
+
+typedef struct mp4tree_stbl_struct
+{
+    uint32_t             sample_count;
+
+    /* stsz, sizes is NULL if all samples have sample_size */
+    uint32_t             sample_size;
+    const uint8_t *      sizes;
+
+    /* stco or co64 */
+    uint32_t             chunk_count;
+    int                  chunk_offset_size;     /* 4 or 8 */
+    const uint8_t *      chunk_offsets;
+
+    /* stss, syncs is NULL if every sample is a sync sample */
+    uint32_t             sync_count;
+    const uint8_t *      syncs;
+
+    int                  num_stts;
+    mp4tree_stbl_run_t * stts;
+    int                  num_ctts;              /* 0 without a ctts */
+    mp4tree_stbl_run_t * ctts;
+    int                  num_stsc;
+    mp4tree_stbl_run_t * stsc;
+
+    arena_t              arena;
+} mp4tree_stbl_t;
+
+/* Samples first to first + count - 1 as a structure of arrays */
+typedef struct mp4tree_stbl_samples_struct
+{
+    uint32_t first;
+    uint32_t count;
+    uint64_t offset[MP4TREE_STBL_BLOCK];
+    uint32_t size[MP4TREE_STBL_BLOCK];
+    uint64_t dts[MP4TREE_STBL_BLOCK];
+    int32_t  cts_offset[MP4TREE_STBL_BLOCK];
+    bool     sync[MP4TREE_STBL_BLOCK];
+} mp4tree_stbl_samples_t;
+
+
+/*
+ * Compile the index of the stbl payload at p. Returns 0, or one of the
+ * errors below if a table needed to place the samples is missing or the
+ * tables cannot be allocated. The index refers to p, which must outlive it.
+ */
+int
+mp4tree_stbl_build(const uint8_t * p, size_t len, mp4tree_stbl_t * stbl);
+
+/* Description of an error of mp4tree_stbl_build() */
+const char *
+mp4tree_stbl_error(int err);
+
+void
+mp4tree_stbl_free(mp4tree_stbl_t * stbl);
+
+/* Sample whose decode duration covers dts, -1 if dts is after the last one */
+int64_t
+mp4tree_stbl_time_to_sample(const mp4tree_stbl_t * stbl, uint64_t dts);
+
+/* File offset of sample i, i < sample_count */
+uint64_t
+mp4tree_stbl_sample_offset(const mp4tree_stbl_t * stbl, uint32_t i);
+
+/*
+ * Expand up to MP4TREE_STBL_BLOCK samples starting with sample first into
+ * samples. Returns the number of samples expanded, 0 past the last one.
+ */
+uint32_t
+mp4tree_stbl_expand(const mp4tree_stbl_t * stbl, uint32_t first,
+                    mp4tree_stbl_samples_t * samples);
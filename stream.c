@@ -0,0 +1,604 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "stream.h"
+#include "common.h"
+#include "mp4tree.h"
+#include "options.h"
+#include "output.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+typedef struct
+{
+    int       fd;
+    uint8_t * window;
+    size_t    window_size;
+} mp4tree_stream_t;
+
+
+/* Read exactly len bytes at offset, returns 0 on success */
+static int
+mp4tree_stream_read(
+    mp4tree_stream_t * s,
+    uint8_t *          buf,
+    size_t             len,
+    uint64_t           offset)
+{
+    while (len > 0)
+    {
+        ssize_t n = pread(s->fd, buf, len, offset);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("pread");
+            return -1;
+        }
+
+        if (n == 0)
+        {
+            fprintf(stderr, "Unexpected end of file at offset %llu\n",
+                    (unsigned long long)offset);
+            return -1;
+        }
+
+        buf    += n;
+        len    -= n;
+        offset += n;
+    }
+
+    return 0;
+}
+
+
+/* Walk the boxes in [pos, end) at the given depth */
+static int
+mp4tree_stream_boxes(
+    mp4tree_stream_t * s,
+    uint64_t           pos,
+    uint64_t           end,
+    int                depth)
+{
+    while (pos + 8 <= end)
+    {
+        uint8_t            hdr[16];
+        uint64_t           box_len     = 0;
+        uint64_t           box_hdr_len = 8;
+        uint64_t           payload_len = 0;
+        const uint8_t *    box_type    = hdr + 4;
+        mp4tree_parse_func func        = NULL;
+
+        if (mp4tree_stream_read(s, hdr, 8, pos) < 0)
+            return -1;
+
+        box_len = get_u32(hdr);
+
+        if (box_len == 1)
+        {
+            if (pos + 16 > end || mp4tree_stream_read(s, hdr + 8, 8, pos + 8) < 0)
+                return -1;
+
+            box_len     = get_u64(hdr + 8);
+            box_hdr_len = 16;
+        }
+        else if (box_len == 0)
+        {
+            /* Box extends to the end of the enclosing range */
+            box_len = end - pos;
+        }
+
+        if (box_len < box_hdr_len)
+        {
+            fprintf(stderr, "Invalid box length %llu at offset %llu\n",
+                    (unsigned long long)box_len, (unsigned long long)pos);
+            return -1;
+        }
+
+        /*
+         * Filtered boxes are skipped together with their children, a box
+         * running past the end of the range is the last one in it
+         */
+        if (!mp4tree_match_filter(box_type))
+        {
+            if (box_len > end - pos)
+                break;
+            pos += box_len;
+            continue;
+        }
+
+        out_set_origin(hdr, pos);
+        mp4tree_box_print(box_type, box_len, depth);
+
+        /* Like mp4tree_print(), only go deeper if the box is complete */
+        if (box_len > end - pos)
+        {
+            out_box_end(box_type, depth);
+            break;
+        }
+
+        payload_len = box_len - box_hdr_len;
+        func = mp4tree_box_printer_get(box_type);
+
+        if (memcmp(box_type, "mdat", 4) == 0)
+        {
+            /* Media data is never read in streaming mode */
+        }
+        else if (func == mp4tree_hexdump)
+        {
+            /* Only the bytes that will actually be printed are read */
+            size_t avail = payload_len < s->window_size ? payload_len : s->window_size;
+            size_t want  = avail;
+
+            if (want > g_options.truncate)
+                want = g_options.truncate;
+
+            if (mp4tree_stream_read(s, s->window, want, pos + box_hdr_len) < 0)
+                return -1;
+
+            if (avail == payload_len || avail >= g_options.truncate)
+            {
+                mp4tree_hexdump(s->window, payload_len, depth + 1);
+            }
+            else
+            {
+                mp4tree_hexdump(s->window, avail, depth + 1);
+                out_printf("%s   ... %llu bytes not read\n", indent(depth + 1, 0),
+                           (unsigned long long)(payload_len - avail));
+            }
+        }
+        else if (payload_len <= s->window_size)
+        {
+            if (mp4tree_stream_read(s, s->window, payload_len, pos + box_hdr_len) < 0)
+                return -1;
+
+            out_set_origin(s->window, pos + box_hdr_len);
+            func(s->window, payload_len, depth + 1);
+        }
+        else if (func == mp4tree_print)
+        {
+            /* Container larger than the window, descend box by box */
+            if (mp4tree_stream_boxes(s, pos + box_hdr_len, pos + box_len, depth + 1) < 0)
+                return -1;
+        }
+        else
+        {
+            out_printf("%s  Payload of %llu bytes exceeds stream window, skipped\n",
+                       indent(depth + 1, 0), (unsigned long long)payload_len);
+        }
+
+        out_box_end(box_type, depth);
+        pos += box_len;
+
+        if (depth == 0)
+            out_box_done();
+    }
+
+    return 0;
+}
+
+
+/* Chunk size used when reading a pipe */
+#define MP4TREE_PUSH_CHUNK (64 * 1024)
+
+/* Box length used for size 0 boxes which extend to the end of stream */
+#define MP4TREE_PUSH_TO_EOF UINT64_MAX
+
+typedef enum
+{
+    MP4TREE_PUSH_HEADER,  /* Collecting a box header */
+    MP4TREE_PUSH_BOX,     /* Collecting the rest of a box */
+    MP4TREE_PUSH_SKIP     /* Discarding the rest of a box */
+} mp4tree_push_state_t;
+
+struct mp4tree_push_struct
+{
+    mp4tree_push_state_t state;
+    uint8_t *            buf;
+    size_t               cap;
+    size_t               fill;
+    uint64_t             box_len;
+    uint64_t             skip;
+    uint64_t             offset;
+};
+
+
+/* Size of the header starting at p, 0 if more bytes are needed */
+static size_t
+mp4tree_push_header_len(const uint8_t * p, size_t avail)
+{
+    if (avail < 8)
+        return 0;
+
+    if (get_u32(p) == 1)
+        return avail < 16 ? 0 : 16;
+
+    return 8;
+}
+
+
+static uint64_t
+mp4tree_push_box_len(const uint8_t * p)
+{
+    uint64_t box_len = get_u32(p);
+
+    if (box_len == 1)
+        box_len = get_u64(p + 8);
+    else if (box_len == 0)
+        box_len = MP4TREE_PUSH_TO_EOF;
+
+    return box_len;
+}
+
+
+/* Whether the payload of a box should be dropped instead of buffered */
+static bool
+mp4tree_push_discard(const uint8_t * type, uint64_t box_len, size_t hdr_len)
+{
+    if (!mp4tree_match_filter(type))
+        return true;
+
+    if (!g_options.stream)
+        return false;
+
+    /* Honour the stream window so a pipe can't exhaust memory either */
+    return memcmp(type, "mdat", 4) == 0 ||
+           box_len - hdr_len > g_options.window;
+}
+
+
+/* Print a complete top-level box */
+static void
+mp4tree_push_emit(mp4tree_push_t * push, const uint8_t * p, size_t len)
+{
+    out_set_origin(p, push->offset);
+    mp4tree_print(p, len, 0);
+    out_flush();
+}
+
+
+/* Finish the current box once all of its bytes are in */
+static void
+mp4tree_push_complete(mp4tree_push_t * push)
+{
+    if (push->state == MP4TREE_PUSH_BOX && push->fill == push->box_len)
+    {
+        mp4tree_push_emit(push, push->buf, push->fill);
+        push->offset += push->fill;
+        push->fill    = 0;
+        push->state   = MP4TREE_PUSH_HEADER;
+    }
+    else if (push->state == MP4TREE_PUSH_SKIP && push->skip == 0)
+    {
+        push->offset += push->box_len;
+        push->state   = MP4TREE_PUSH_HEADER;
+    }
+}
+
+
+static int
+mp4tree_push_reserve(mp4tree_push_t * push, uint64_t size)
+{
+    uint8_t * buf;
+    size_t    cap = push->cap ? push->cap : MP4TREE_PUSH_CHUNK;
+
+    if (size <= push->cap)
+        return 0;
+
+    /* A corrupt size would overflow the doubling below */
+    if (size > SIZE_MAX / 2)
+    {
+        fprintf(stderr, "Box of %llu bytes at offset %llu is too large to buffer\n",
+                (unsigned long long)size, (unsigned long long)push->offset);
+        return -1;
+    }
+
+    while (cap < size)
+        cap *= 2;
+
+    buf = realloc(push->buf, cap);
+    if (buf == NULL)
+    {
+        out_printf("Failed to allocate memory\n");
+        return -1;
+    }
+
+    push->buf = buf;
+    push->cap = cap;
+    return 0;
+}
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+int
+mp4tree_stream_file(const char * filename, size_t window_size)
+{
+    mp4tree_stream_t s   = {0};
+    struct stat      sb  = {0};
+    int              ret = EXIT_FAILURE;
+
+    out_printf("Reading file %s\n", filename);
+
+    s.fd = open(filename, O_RDONLY);
+    if (s.fd < 0)
+    {
+        perror("open");
+        return EXIT_FAILURE;
+    }
+
+    if (fstat(s.fd, &sb) < 0)
+    {
+        perror("stat");
+        goto out;
+    }
+
+    if (!S_ISREG(sb.st_mode))
+    {
+        fprintf(stderr, "Streaming mode requires a seekable regular file\n");
+        goto out;
+    }
+
+    s.window_size = window_size;
+    s.window = malloc(window_size);
+    if (s.window == NULL)
+    {
+        out_printf("Failed to allocate memory\n");
+        goto out;
+    }
+
+    out_printf("Streaming %lld bytes with a %zu byte window\n",
+               (long long)sb.st_size, window_size);
+    out_printf("File Content:\n");
+
+    if (mp4tree_stream_boxes(&s, 0, sb.st_size, 0) == 0)
+        ret = EXIT_SUCCESS;
+
+out:
+    free(s.window);
+    close(s.fd);
+    return ret;
+}
+
+
+mp4tree_push_t *
+mp4tree_push_create(void)
+{
+    mp4tree_push_t * push = calloc(1, sizeof(*push));
+
+    if (push && mp4tree_push_reserve(push, 16) < 0)
+    {
+        free(push);
+        return NULL;
+    }
+
+    return push;
+}
+
+
+int
+mp4tree_push_feed(mp4tree_push_t * push, const uint8_t * data, size_t len)
+{
+    while (len > 0)
+    {
+        size_t n;
+
+        switch (push->state)
+        {
+        case MP4TREE_PUSH_HEADER:
+        {
+            size_t   hdr_len;
+            uint64_t box_len;
+
+            /* Fast path, complete boxes are printed straight from the chunk */
+            if (push->fill == 0 && (hdr_len = mp4tree_push_header_len(data, len)))
+            {
+                box_len = mp4tree_push_box_len(data);
+                if (box_len >= hdr_len && box_len <= len &&
+                    !mp4tree_push_discard(data + 4, box_len, hdr_len))
+                {
+                    mp4tree_push_emit(push, data, box_len);
+                    data         += box_len;
+                    len          -= box_len;
+                    push->offset += box_len;
+                    continue;
+                }
+            }
+
+            /* Collect 8 bytes, or 16 for a large size box */
+            n = (push->fill < 8 ? 8 : 16) - push->fill;
+            n = n < len ? n : len;
+            memcpy(push->buf + push->fill, data, n);
+            push->fill += n;
+            data       += n;
+            len        -= n;
+
+            hdr_len = mp4tree_push_header_len(push->buf, push->fill);
+            if (hdr_len == 0)
+                break;
+
+            box_len = mp4tree_push_box_len(push->buf);
+            if (box_len < hdr_len)
+            {
+                fprintf(stderr, "Invalid box length %llu at offset %llu\n",
+                        (unsigned long long)box_len,
+                        (unsigned long long)push->offset);
+                return -1;
+            }
+
+            push->box_len = box_len;
+
+            if (mp4tree_push_discard(push->buf + 4, box_len, hdr_len))
+            {
+                if (mp4tree_match_filter(push->buf + 4))
+                {
+                    out_set_origin(push->buf, push->offset);
+                    mp4tree_box_print(push->buf + 4, box_len, 0);
+                    out_box_end(push->buf + 4, 0);
+                    out_flush();
+                }
+                push->skip  = box_len - push->fill;
+                push->state = MP4TREE_PUSH_SKIP;
+                push->fill  = 0;
+            }
+            else
+            {
+                if (box_len != MP4TREE_PUSH_TO_EOF &&
+                    mp4tree_push_reserve(push, box_len) < 0)
+                    return -1;
+                push->state = MP4TREE_PUSH_BOX;
+            }
+
+            mp4tree_push_complete(push);
+            break;
+        }
+
+        case MP4TREE_PUSH_BOX:
+            if (push->box_len == MP4TREE_PUSH_TO_EOF)
+            {
+                if (mp4tree_push_reserve(push, push->fill + len) < 0)
+                    return -1;
+                n = len;
+            }
+            else
+            {
+                n = push->box_len - push->fill;
+                n = n < len ? n : len;
+            }
+
+            memcpy(push->buf + push->fill, data, n);
+            push->fill += n;
+            data       += n;
+            len        -= n;
+
+            mp4tree_push_complete(push);
+            break;
+
+        case MP4TREE_PUSH_SKIP:
+            n = push->skip < len ? push->skip : len;
+            data       += n;
+            len        -= n;
+            push->skip -= n;
+
+            mp4tree_push_complete(push);
+            break;
+        }
+    }
+
+    return 0;
+}
+
+
+int
+mp4tree_push_finish(mp4tree_push_t * push)
+{
+    int ret = 0;
+
+    switch (push->state)
+    {
+    case MP4TREE_PUSH_HEADER:
+        if (push->fill)
+        {
+            fprintf(stderr, "Incomplete box header at end of stream\n");
+            ret = -1;
+        }
+        break;
+
+    case MP4TREE_PUSH_BOX:
+        /* A size 0 box ends here, anything else is truncated */
+        if (push->box_len != MP4TREE_PUSH_TO_EOF)
+        {
+            fprintf(stderr, "Truncated box at end of stream, got %zu of %llu bytes\n",
+                    push->fill, (unsigned long long)push->box_len);
+            ret = -1;
+        }
+        mp4tree_push_emit(push, push->buf, push->fill);
+        break;
+
+    case MP4TREE_PUSH_SKIP:
+        if (push->box_len != MP4TREE_PUSH_TO_EOF)
+        {
+            fprintf(stderr, "Truncated box at end of stream\n");
+            ret = -1;
+        }
+        break;
+    }
+
+    push->state = MP4TREE_PUSH_HEADER;
+    push->fill  = 0;
+    return ret;
+}
+
+
+void
+mp4tree_push_destroy(mp4tree_push_t * push)
+{
+    if (push == NULL)
+        return;
+
+    free(push->buf);
+    free(push);
+}
+
+
+int
+mp4tree_stream_fd(int fd)
+{
+    mp4tree_push_t * push = mp4tree_push_create();
+    uint8_t *        chunk = malloc(MP4TREE_PUSH_CHUNK);
+    int              ret   = EXIT_FAILURE;
+
+    if (push == NULL || chunk == NULL)
+    {
+        out_printf("Failed to allocate memory\n");
+        goto out;
+    }
+
+    out_printf("Reading stream\n");
+    out_printf("File Content:\n");
+    out_flush();
+
+    while (1)
+    {
+        ssize_t n = read(fd, chunk, MP4TREE_PUSH_CHUNK);
+
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("read");
+            goto out;
+        }
+
+        if (n == 0)
+            break;
+
+        if (mp4tree_push_feed(push, chunk, n) < 0)
+            goto out;
+    }
+
+    if (mp4tree_push_finish(push) == 0)
+        ret = EXIT_SUCCESS;
+
+out:
+    free(chunk);
+    mp4tree_push_destroy(push);
+    return ret;
+}
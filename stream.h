@@ -0,0 +1,46 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                           Streaming file parsing                           *
+ ******************************************************************************
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+
+/* Default size of the payload window used in streaming mode */
+#define MP4TREE_STREAM_WINDOW_DEFAULT (16 * 1024 * 1024)
+
+
+/*
+ * Print the boxes of a file without loading it. Only box headers and the
+ * payloads of boxes that fit in a window of window_size bytes are read,
+ * mdat payloads and filtered boxes are seeked over.
+ */
+int
+mp4tree_stream_file(const char * filename, size_t window_size);
+
+
+/* Resumable push parser for non-seekable input */
+typedef struct mp4tree_push_struct mp4tree_push_t;
+
+/* Create a push parser printing top-level boxes as they complete */
+mp4tree_push_t *
+mp4tree_push_create(void);
+
+/* Feed an arbitrary chunk of the byte stream, returns 0 on success */
+int
+mp4tree_push_feed(mp4tree_push_t * push, const uint8_t * data, size_t len);
+
+/* Signal end of stream, prints any pending box. Returns 0 on success */
+int
+mp4tree_push_finish(mp4tree_push_t * push);
+
+void
+mp4tree_push_destroy(mp4tree_push_t * push);
+
+/* Read fd (e.g. stdin) until EOF and print boxes as they arrive */
+int
+mp4tree_stream_fd(int fd);
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""
+Time printing a moof with one large trun, the case the output engine was
+tuned for. Each binary prints the generated file to /dev/null and the best
+of a few runs is reported.
+
+    $ python3 tests/bench_trun.py ./mp4tree [./mp4tree.old ...]
+    $ python3 tests/bench_trun.py --samples 500000 --runs 5 ./mp4tree
+"""
+
+import argparse
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+
+def box(fourcc, *payload):
+    data = b''.join(payload)
+    return struct.pack('>I', 8 + len(data)) + fourcc.encode() + data
+
+
+def full(fourcc, version, flags, *payload):
+    return box(fourcc, struct.pack('>I', (version << 24) | flags), *payload)
+
+
+def moof(samples):
+    """trun with duration, size, flags and composition offset per sample"""
+    entry = struct.Struct('>IIII')
+    rows  = b''.join(entry.pack(100, 1000 + i % 500, 0x10000 if i % 30 else 0x2000000, i % 3 * 100)
+                     for i in range(samples))
+    trun  = full('trun', 0, 0xf01, struct.pack('>Ii', samples, 0), rows)
+    traf  = box('traf', full('tfhd', 0, 0x20000, struct.pack('>I', 1)),
+                full('tfdt', 1, 0, struct.pack('>Q', 0)), trun)
+    return box('moof', full('mfhd', 0, 0, struct.pack('>I', 1)), traf)
+
+
+def best(binary, path, runs):
+    times = []
+    with open(os.devnull, 'wb') as null:
+        for _ in range(runs):
+            start = time.perf_counter()
+            subprocess.run([binary, path], stdout=null, check=True)
+            times.append(time.perf_counter() - start)
+    return min(times)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('--samples', type=int, default=2000000)
+    parser.add_argument('--runs', type=int, default=3)
+    parser.add_argument('binaries', nargs='*', default=['./mp4tree'])
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, 'trun.mp4')
+        with open(path, 'wb') as f:
+            f.write(moof(args.samples))
+
+        size = os.path.getsize(path)
+        print('%d samples, %.1f MB moof, best of %d' % (args.samples, size / 1e6, args.runs))
+        for binary in args.binaries:
+            print('%-20s %.2f s' % (binary, best(os.path.abspath(binary), path, args.runs)))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,363 @@
+#!/usr/bin/env python3
+"""
+Command line tests of mp4tree on small generated files.
+
+    $ python3 tests/test_cli.py ./mp4tree
+"""
+
+import json
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+
+
+# ---------------------------------------------------------------------------
+# Fixtures
+# ---------------------------------------------------------------------------
+
+TIMESCALE = 1000
+DURATION  = 100     # trex default sample duration
+SIZE      = 10      # bytes per sample
+
+
+def u32(*v):
+    return struct.pack('>%dI' % len(v), *v)
+
+
+def u64(*v):
+    return struct.pack('>%dQ' % len(v), *v)
+
+
+def box(fourcc, *payload):
+    data = b''.join(payload)
+    return struct.pack('>I', 8 + len(data)) + fourcc.encode() + data
+
+
+def full(fourcc, version, flags, *payload):
+    return box(fourcc, u32((version << 24) | flags), *payload)
+
+
+def ftyp(fourcc='ftyp'):
+    return box(fourcc, b'iso6', u32(0), b'iso6')
+
+
+def trak(track_id, handler='vide', stbl=None):
+    tkhd = full('tkhd', 0, 7, u32(0, 0, track_id, 0, 0), bytes(60))
+    mdhd = full('mdhd', 0, 0, u32(0, 0, TIMESCALE, 0), bytes(4))
+    hdlr = full('hdlr', 0, 0, u32(0), handler.encode(), bytes(12), b'v\0')
+    mhd  = full('vmhd', 0, 1, bytes(8)) if handler == 'vide' else full('smhd', 0, 0, bytes(4))
+    if stbl is None:
+        stbl = box('stbl', full('stsd', 0, 0, u32(0)), full('stts', 0, 0, u32(0)),
+                   full('stsc', 0, 0, u32(0)), full('stsz', 0, 0, u32(0, 0)),
+                   full('stco', 0, 0, u32(0)))
+    return box('trak', tkhd, box('mdia', mdhd, hdlr, box('minf', mhd, stbl)))
+
+
+def moov(fragmented=True, stbl=None, audio=False):
+    """Video track 1, and audio track 2 before it if audio"""
+    mvhd  = full('mvhd', 0, 0, u32(0, 0, TIMESCALE, 0), bytes(80))
+    boxes = [mvhd, trak(1, 'vide', stbl)]
+    if audio:
+        boxes.insert(1, trak(2, 'soun'))
+    if fragmented:
+        trex = [full('trex', 0, 0, u32(t, 1, DURATION, 0, 0x10000)) for t in (1, 2)[:1 + audio]]
+        boxes.append(box('mvex', *trex))
+    return box('moov', *boxes)
+
+
+def fragment(seq, time, samples):
+    """A moof with one traf relying on the trex defaults, and its mdat"""
+    def moof(data_offset):
+        trun = full('trun', 0, 0x201, u32(samples, data_offset), *[u32(SIZE)] * samples)
+        traf = box('traf', full('tfhd', 0, 0x20000, u32(1)), full('tfdt', 1, 0, u64(time)), trun)
+        return box('moof', full('mfhd', 0, 0, u32(seq)), traf)
+
+    m = moof(0)
+    m = moof(len(m) + 8)
+    return m + box('mdat', bytes(samples * SIZE))
+
+
+def fragments(count, samples=10):
+    return [fragment(i + 1, i * samples * DURATION, samples) for i in range(count)]
+
+
+def sidx(frags, samples=10):
+    refs = b''.join(u32(len(f), samples * DURATION, 0x90000000) for f in frags)
+    return full('sidx', 0, 0, u32(1, TIMESCALE, 0, 0), struct.pack('>HH', 0, len(frags)), refs)
+
+
+def mfra(frag_offsets, samples=10, tracks=(1,)):
+    entries = b''.join(u64(i * samples * DURATION, o) + bytes([1, 1, 1])
+                       for i, o in enumerate(frag_offsets))
+    tfras = b''.join(full('tfra', 1, 0, u32(t, 0, len(frag_offsets)), entries) for t in tracks)
+    return box('mfra', tfras, full('mfro', 0, 0, u32(8 + len(tfras) + 16)))
+
+
+def init_segment():
+    return ftyp() + moov()
+
+
+def on_demand(count=5, audio=False):
+    """Single file with moov, sidx, fragments and mfra"""
+    frags = fragments(count)
+    head = ftyp() + moov(audio=audio) + sidx(frags)
+    offsets = []
+    offset = len(head)
+    for f in frags:
+        offsets.append(offset)
+        offset += len(f)
+    return head + b''.join(frags) + mfra(offsets, tracks=(2, 1) if audio else (1,))
+
+
+def media_segment(count=5):
+    """DASH media segment without a moov"""
+    frags = fragments(count)
+    head = ftyp('styp') + sidx(frags)
+    offsets = []
+    offset = len(head)
+    for f in frags:
+        offsets.append(offset)
+        offset += len(f)
+    return head + b''.join(frags) + mfra(offsets)
+
+
+# ---------------------------------------------------------------------------
+# Tests
+# ---------------------------------------------------------------------------
+
+MP4TREE = None
+TMP     = None
+
+
+def fixture(name, data):
+    path = os.path.join(TMP, name)
+    with open(path, 'wb') as f:
+        f.write(data)
+    return path
+
+
+def run(*args, stdin=None):
+    return subprocess.run([MP4TREE] + list(args), input=stdin, capture_output=True,
+                          timeout=30)
+
+
+def check(cond, what):
+    if not cond:
+        raise AssertionError(what)
+
+
+def test_subsegment_initseg():
+    init = fixture('init.mp4', init_segment())
+    seg  = fixture('seg.m4s', media_segment())
+    r = run('-n', '2', '-i', init, seg)
+    out = r.stdout.decode()
+    check(r.returncode == 0, 'exit status %d: %s' % (r.returncode, r.stderr.decode()))
+    check('Subsegment 2 at offset' in out, 'subsegment not printed')
+    check(out.count('Type: moof') == 1, 'not a single moof')
+    check('Type: moov' not in out, 'init segment printed')
+
+
+def test_at_initseg():
+    init = fixture('init.mp4', init_segment())
+    seg  = fixture('seg.m4s', media_segment())
+    r = run('-a', '0.5', '-i', init, seg)
+    out = r.stdout.decode()
+    check(r.returncode == 0, 'exit status %d: %s' % (r.returncode, r.stderr.decode()))
+    check('Track 1 entry 1 at offset' in out, 'fragment not printed')
+    check(out.count('Type: moof') == 1, 'not a single moof')
+    check('Type: moov' not in out, 'init segment printed')
+
+
+def test_subsegment_without_moov():
+    seg = fixture('seg.m4s', media_segment())
+    r = run('-n', '3', seg)
+    check(r.returncode == 0, 'exit status %d: %s' % (r.returncode, r.stderr.decode()))
+    check('Subsegment 3 at offset' in r.stdout.decode(), 'subsegment not printed')
+    check(r.stderr == b'', 'errors printed: %s' % r.stderr.decode())
+
+
+def test_stdin_huge_largesize():
+    data = u32(1) + b'free' + u64(0xF000000000000000) + bytes(16)
+    r = run('-', stdin=data)
+    check(r.returncode != 0, 'accepted a box larger than memory')
+    check(b'too large' in r.stderr, 'no error printed: %s' % r.stderr.decode())
+
+
+def test_stream_wrapping_largesize():
+    data = ftyp() + u32(1) + b'free' + u64(0xFFFFFFFFFFFFFFF0) + bytes(8) + box('skip')
+    f = fixture('wrap.mp4', data)
+    for args in (['-S'], ['-S', '-f', 'ftyp']):
+        r = run(*args, f)
+        check(r.returncode == 0, 'exit status %d: %s' % (r.returncode, r.stderr.decode()))
+        check(b'Type: skip' not in r.stdout, 'box after a truncated box printed')
+
+
+def test_batch_json_array():
+    init = fixture('init.mp4', init_segment())
+    seg  = fixture('seg.m4s', media_segment())
+    od   = fixture('od.mp4', on_demand())
+    r = run('-b', '-F', 'json', '-i', init, seg, od)
+    check(r.returncode == 0, 'exit status %d: %s' % (r.returncode, r.stderr.decode()))
+    docs = json.loads(r.stdout.decode())
+    check([d['file'] for d in docs] == [init, seg, od], 'wrong documents %s' % [d['file'] for d in docs])
+
+
+def test_timeline_format_rejected():
+    seg = fixture('seg.m4s', media_segment())
+    r = run('-T', '-F', 'json', seg)
+    check(r.returncode != 0 and b'only prints text' in r.stderr, 'timeline accepted --format=json')
+
+
+def test_subsegment_jobs():
+    f = fixture('ondemand.mp4', on_demand())
+    r = run('-j', '2', '-n', '2', f)
+    out = r.stdout.decode()
+    check(r.returncode == 0, 'exit status %d: %s' % (r.returncode, r.stderr.decode()))
+    check(out == run('-n', '2', f).stdout.decode(), 'differs from the run without --jobs')
+    check(out.count('Type: moof') == 1, 'not a single moof')
+
+
+def test_at_jobs():
+    f = fixture('ondemand.mp4', on_demand())
+    r = run('-j', '2', '-a', '0.5', f)
+    out = r.stdout.decode()
+    check(r.returncode == 0, 'exit status %d: %s' % (r.returncode, r.stderr.decode()))
+    check(out == run('-a', '0.5', f).stdout.decode(), 'differs from the run without --jobs')
+    check(out.count('Type: moof') == 1, 'not a single moof')
+
+
+def test_samples_initseg():
+    init = fixture('init.mp4', init_segment())
+    seg  = fixture('seg.m4s', media_segment())
+    r = run('-l', '-i', init, seg)
+    check(r.returncode == 0, 'exit status %d: %s' % (r.returncode, r.stderr.decode()))
+    rows = [l.split() for l in r.stdout.decode().splitlines()[1:]]
+    check(len(rows) == 50, '%d samples listed' % len(rows))
+    check(rows[1][4] == str(DURATION), 'trex duration not applied: %s' % rows[1])
+    check(rows[1][-1] == '0x00010000', 'trex flags not applied: %s' % rows[1])
+
+
+def test_samples_json():
+    f = fixture('od.mp4', on_demand(2))
+    r = run('-l', '-F', 'json', f)
+    check(r.returncode == 0, 'exit status %d: %s' % (r.returncode, r.stderr.decode()))
+    doc = json.loads(r.stdout.decode())
+    rows = doc['boxes'][0]['rows']
+    check(doc['boxes'][0]['table'] == 'Samples', 'no Samples table')
+    check(len(rows) == 20, '%d samples listed' % len(rows))
+    check(rows[11][:2] == [1, 12] and rows[11][4] == 11 * DURATION, 'wrong row %s' % rows[11])
+
+
+def test_samples_stbl_without_tables():
+    f = fixture('notables.mp4', ftyp() + moov(False, box('stbl', full('stsd', 0, 0, u32(0)))))
+    r = run('-l', f)
+    check(r.returncode == 0, 'exit status %d: %s' % (r.returncode, r.stderr.decode()))
+    check(r.stderr.decode().count('track 1 has no samples listed') == 1,
+          'skipped trak not reported once: %s' % r.stderr.decode())
+
+
+def test_es_json_nal_objects():
+    sps = bytes([0x67, 0x42, 0xc0, 0x28, 0xda, 0x01, 0xe0, 0x08, 0x9f, 0x95])
+    pps = bytes([0x68, 0xce, 0x3c, 0x80])
+    f = fixture('es.264', b'\0\0\0\1' + sps + b'\0\0\0\1' + pps + b'\0\0\1\x65\x88\x84\x00\x10')
+    r = run('-F', 'json', f)
+    check(r.returncode == 0, 'exit status %d: %s' % (r.returncode, r.stderr.decode()))
+    nals = json.loads(r.stdout.decode())['boxes']
+    check([(n['type'], n['offset'], n['size']) for n in nals] ==
+          [('H264', 4, 10), ('H264', 18, 4), ('H264', 25, 5)], 'wrong NAL units %s' % nals)
+    names = [c['name'] for c in nals[0]['children']]
+    check(len(names) == len(set(names)), 'fields repeated in one NAL unit: %s' % names)
+
+
+def test_timeline_unknown_duration():
+    seg = fixture('seg.m4s', media_segment())
+    r = run('-T', seg)
+    out = r.stdout.decode()
+    check(r.returncode != 0, 'unchecked timeline reported as continuous')
+    check(' gap of ' not in out, 'false gap reported')
+    check('sample durations unknown' in out, 'unknown duration not reported')
+
+    init = fixture('init.mp4', init_segment())
+    r = run('-T', '-i', init, seg)
+    check(r.returncode == 0, 'exit status %d: %s' % (r.returncode, r.stdout.decode()))
+    check('Timeline is continuous' in r.stdout.decode(), 'not continuous with trex')
+
+
+def test_binread_short_record():
+    # A box start record cut down to its 8 byte header
+    stream = b'MP4TBIN\0' + struct.pack('<II', 1, 0) + struct.pack('<IHH', 8, 2, 0)
+    f = fixture('short.bin', stream)
+    r = subprocess.run([MP4TREE + '-read', f], capture_output=True, timeout=30)
+    check(r.returncode == 1, 'exit status %d' % r.returncode)
+    check(b'Corrupt record at offset 16' in r.stderr, 'short record not reported')
+
+
+def test_at_track():
+    f = fixture('av.mp4', on_demand(audio=True))
+    r = run('-a', '0.5', f)
+    check(r.returncode == 0, 'exit status %d: %s' % (r.returncode, r.stderr.decode()))
+    check('Track 1 entry 1 at offset' in r.stdout.decode(), 'video tfra not used')
+
+    r = run('-a', '0.5', '-k', '2', f)
+    check(r.returncode == 0, 'exit status %d: %s' % (r.returncode, r.stderr.decode()))
+    check('Track 2 entry 1 at offset' in r.stdout.decode(), 'tfra of --track not used')
+
+    r = run('-a', '0.5', '-k', '3', f)
+    check(r.returncode != 0, 'missing track accepted')
+    check(b'No tfra for track 3' in r.stderr, 'missing track not reported')
+
+
+def test_mdat_many_truns():
+    # 80 truns of one sample, each holding a 6 byte SEI NAL unit
+    count = 80
+    nal   = u32(6) + bytes([0x06, 5, 1, 0xff, 0x80, 0])
+
+    def moof(data_offset):
+        truns = [full('trun', 0, 0x201, u32(1, data_offset + i * len(nal)), u32(len(nal)))
+                 for i in range(count)]
+        traf = box('traf', full('tfhd', 0, 0x20000, u32(1)), full('tfdt', 1, 0, u64(0)), *truns)
+        return box('moof', full('mfhd', 0, 0, u32(1)), traf)
+
+    m = moof(0)
+    m = moof(len(m) + 8)
+    f = fixture('runs.mp4', init_segment() + m + box('mdat', nal * count))
+    r = run(f)
+    check(r.returncode == 0, 'exit status %d: %s' % (r.returncode, r.stderr.decode()))
+    nals = r.stdout.decode().count('Type: H264 NAL')
+    check(nals == count, '%d of %d NAL units printed' % (nals, count))
+
+
+def test_many_tracks_warning():
+    traks = [trak(i + 1) for i in range(17)]
+    f = fixture('tracks.mp4', ftyp() + box('moov', full('mvhd', 0, 0, u32(0, 0, TIMESCALE, 0), bytes(80)), *traks))
+    r = run(f)
+    check(r.returncode == 0, 'exit status %d: %s' % (r.returncode, r.stderr.decode()))
+    check(b'More than 16 tracks' in r.stderr, 'evicted track not reported')
+
+
+TESTS = [v for k, v in sorted(globals().items()) if k.startswith('test_')]
+
+
+def main():
+    global MP4TREE, TMP
+
+    MP4TREE = os.path.abspath(sys.argv[1] if len(sys.argv) > 1 else './mp4tree')
+    failed  = 0
+
+    with tempfile.TemporaryDirectory() as TMP:
+        for test in TESTS:
+            try:
+                test()
+                print('PASS %s' % test.__name__)
+            except (AssertionError, subprocess.TimeoutExpired) as e:
+                print('FAIL %s: %s' % (test.__name__, e))
+                failed += 1
+
+    print('%d of %d tests failed' % (failed, len(TESTS)))
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,336 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "timeline.h"
+#include "track.h"
+#include "process.h"
+#include "output.h"
+#include "common.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+/* Timeline of one track so far */
+typedef struct
+{
+    uint32_t track_id;
+    bool     started;         /* A traf of the track has been seen */
+    uint64_t first;           /* Decode time of its first sample */
+    uint64_t next;            /* Decode time the next traf should start at */
+    bool     unknown;         /* The last traf had samples of unknown duration */
+    uint64_t unknown_fragments;
+    uint64_t fragments;
+    uint64_t samples;
+    uint64_t gaps;
+    uint64_t overlaps;
+} timeline_track_t;
+
+typedef struct
+{
+    int              num_tracks;
+    timeline_track_t tracks[MP4TREE_TRACKS_MAX];
+    uint64_t         discontinuities;
+    uint64_t         unknown_fragments;
+} timeline_t;
+
+
+static timeline_track_t *
+timeline_track(timeline_t * tl, uint32_t track_id)
+{
+    timeline_track_t * t;
+    int                i;
+
+    for (i = 0; i < tl->num_tracks; i++)
+    {
+        if (tl->tracks[i].track_id == track_id)
+            return &tl->tracks[i];
+    }
+
+    if (tl->num_tracks == MP4TREE_TRACKS_MAX)
+        return NULL;
+
+    t = &tl->tracks[tl->num_tracks++];
+    memset(t, 0, sizeof(*t));
+    t->track_id = track_id;
+    return t;
+}
+
+
+/* Record track IDs, timescales and trex defaults from the boxes of a moov */
+static void
+timeline_moov(const uint8_t * p, const uint8_t * end)
+{
+    const uint8_t * type;
+    const uint8_t * payload;
+    const uint8_t * next;
+
+    for (; (next = box_next(p, end, &type, &payload)) != NULL; p = next)
+    {
+        size_t len = next - payload;
+
+        if (memcmp(type, "trak", 4) == 0 || memcmp(type, "mdia", 4) == 0 ||
+            memcmp(type, "mvex", 4) == 0)
+        {
+            timeline_moov(payload, next);
+        }
+        else if (memcmp(type, "tkhd", 4) == 0)
+        {
+            /* track_ID follows the creation and modification times */
+            if (len >= 24 && payload[0] == 1)
+                mp4tree_track_select(get_u32(payload + 20));
+            else if (len >= 16)
+                mp4tree_track_select(get_u32(payload + 12));
+        }
+        else if (memcmp(type, "mdhd", 4) == 0)
+        {
+            mp4tree_track_mdhd(payload, len);
+        }
+        else if (memcmp(type, "trex", 4) == 0)
+        {
+            mp4tree_track_trex(payload, len);
+        }
+    }
+}
+
+
+static void
+timeline_discontinuity(
+    timeline_t *            tl,
+    timeline_track_t *      t,
+    const mp4tree_track_t * track,
+    const char *            filename,
+    uint64_t                moof_offset,
+    uint64_t                tfdt)
+{
+    bool     gap  = tfdt > t->next;
+    uint64_t diff = gap ? tfdt - t->next : t->next - tfdt;
+    char     seconds[32] = "";
+
+    if (track->timescale != 0)
+        snprintf(seconds, sizeof(seconds), " (%.3f s)", (double)diff / track->timescale);
+
+    out_printf("%s: track %u %s of %"PRIu64"%s in moof at offset %"PRIu64
+               ", base media decode time %"PRIu64", expected %"PRIu64"\n",
+               filename, t->track_id, gap ? "gap" : "overlap", diff, seconds,
+               moof_offset, tfdt, t->next);
+
+    if (gap)
+        t->gaps++;
+    else
+        t->overlaps++;
+    tl->discontinuities++;
+}
+
+
+/* Check the decode time of a traf and move the timeline of its track on */
+static void
+timeline_traf(
+    timeline_t *    tl,
+    const char *    filename,
+    uint64_t        moof_offset,
+    const uint8_t * p,
+    const uint8_t * end)
+{
+    const mp4tree_track_t * track    = NULL;
+    timeline_track_t *      t;
+    const uint8_t *         type;
+    const uint8_t *         payload;
+    const uint8_t *         next;
+    mp4tree_trun_t          trun;
+    bool                    has_tfdt = false;
+    uint64_t                tfdt     = 0;
+    uint64_t                duration = 0;
+    uint64_t                samples  = 0;
+    bool                    unknown  = false;
+
+    for (; (next = box_next(p, end, &type, &payload)) != NULL; p = next)
+    {
+        size_t len = next - payload;
+
+        if (memcmp(type, "tfhd", 4) == 0 && len >= 8)
+        {
+            mp4tree_track_tfhd(payload, len);
+            track = mp4tree_track_current();
+        }
+        else if (memcmp(type, "tfdt", 4) == 0 && len >= 8)
+        {
+            has_tfdt = true;
+            tfdt     = payload[0] == 1 && len >= 12 ? get_u64(payload + 4) : get_u32(payload + 4);
+        }
+        else if (memcmp(type, "trun", 4) == 0 && track != NULL)
+        {
+            mp4tree_track_trun(payload, len, &trun);
+            duration += trun.duration;
+            samples  += trun.samples;
+            unknown  |= trun.unknown_duration;
+        }
+    }
+
+    if (track == NULL || (t = timeline_track(tl, track->track_id)) == NULL)
+        return;
+
+    /* Without a tfdt a traf starts where the one before it ended */
+    if (!has_tfdt)
+        tfdt = t->next;
+    else if (t->started && !t->unknown && tfdt != t->next)
+        timeline_discontinuity(tl, t, track, filename, moof_offset, tfdt);
+
+    /*
+     * Without a trex or tfhd default duration the end of the traf is not
+     * known, the next one is not checked against it
+     */
+    if (unknown)
+    {
+        out_printf("%s: track %u sample durations unknown in moof at offset %"PRIu64
+                   ", no trex or tfhd default duration\n",
+                   filename, t->track_id, moof_offset);
+        t->unknown_fragments++;
+        tl->unknown_fragments++;
+    }
+    t->unknown = unknown;
+
+    if (!t->started)
+    {
+        t->started = true;
+        t->first   = tfdt;
+    }
+
+    t->next = tfdt + duration;
+    t->fragments++;
+    t->samples += samples;
+}
+
+
+static void
+timeline_moof(
+    timeline_t *    tl,
+    const char *    filename,
+    uint64_t        moof_offset,
+    const uint8_t * p,
+    const uint8_t * end)
+{
+    const uint8_t * type;
+    const uint8_t * payload;
+    const uint8_t * next;
+
+    mp4tree_track_moof(moof_offset);
+
+    for (; (next = box_next(p, end, &type, &payload)) != NULL; p = next)
+    {
+        if (memcmp(type, "traf", 4) == 0)
+            timeline_traf(tl, filename, moof_offset, payload, next);
+    }
+}
+
+
+static int
+timeline_file(timeline_t * tl, const char * filename)
+{
+    mp4tree_input_t input = {0};
+    const uint8_t * p;
+    const uint8_t * end;
+    const uint8_t * type;
+    const uint8_t * payload;
+    const uint8_t * next;
+
+    if (mp4tree_input_open(filename, &input) < 0)
+    {
+        fprintf(stderr, "Error reading %s\n", filename);
+        return -1;
+    }
+
+    /* Only the boxes of moov and moof are read, the media data is skipped */
+    if (input.mapped)
+        madvise(input.buf, input.len, MADV_RANDOM);
+
+    p   = input.buf;
+    end = input.buf + input.len;
+
+    for (; (next = box_next(p, end, &type, &payload)) != NULL; p = next)
+    {
+        if (memcmp(type, "moov", 4) == 0)
+            timeline_moov(payload, next);
+        else if (memcmp(type, "moof", 4) == 0)
+            timeline_moof(tl, filename, p - input.buf, payload, next);
+    }
+
+    if (p != end)
+        out_printf("%s: incomplete box at offset %zu, rest of file skipped\n",
+                   filename, (size_t)(p - input.buf));
+
+    mp4tree_input_close(&input);
+    return 0;
+}
+
+
+static void
+timeline_summary_print(const timeline_t * tl)
+{
+    int i;
+
+    for (i = 0; i < tl->num_tracks; i++)
+    {
+        const timeline_track_t * t     = &tl->tracks[i];
+        const mp4tree_track_t *  track = mp4tree_track_find(t->track_id);
+        char                     seconds[32] = "";
+
+        if (track != NULL && track->timescale != 0)
+            snprintf(seconds, sizeof(seconds), " (%.3f s)",
+                     (double)(t->next - t->first) / track->timescale);
+
+        out_printf("Track %u: %"PRIu64" fragments, %"PRIu64" samples, decode time %"PRIu64
+                   " to %"PRIu64"%s, %"PRIu64" gaps, %"PRIu64" overlaps",
+                   t->track_id, t->fragments, t->samples, t->first, t->next, seconds,
+                   t->gaps, t->overlaps);
+        if (t->unknown_fragments != 0)
+            out_printf(", %"PRIu64" fragments of unknown duration", t->unknown_fragments);
+        out_printf("\n");
+    }
+
+    if (tl->discontinuities == 0 && tl->unknown_fragments != 0)
+        out_printf("Timeline could not be checked, %"PRIu64" fragments of unknown duration\n",
+                   tl->unknown_fragments);
+    else if (tl->discontinuities == 0)
+        out_printf("Timeline is continuous\n");
+    else
+        out_printf("Timeline has %"PRIu64" discontinuities\n", tl->discontinuities);
+}
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+int
+mp4tree_timeline_check(const char * initseg, char ** files, int num_files)
+{
+    timeline_t tl     = {0};
+    int        status = EXIT_SUCCESS;
+    int        next   = 0;
+    char *     filename;
+
+    if (initseg != NULL && timeline_file(&tl, initseg) < 0)
+        return EXIT_FAILURE;
+
+    while ((filename = mp4tree_filename_next(files, num_files, &next)) != NULL)
+    {
+        if (timeline_file(&tl, filename) < 0)
+            status = EXIT_FAILURE;
+        free(filename);
+    }
+
+    timeline_summary_print(&tl);
+
+    return tl.discontinuities == 0 && tl.unknown_fragments == 0 ? status : EXIT_FAILURE;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              Timeline check                                *
+ ******************************************************************************
+ *
+ * Checks that the fragments of an ordered list of segments follow each other
+ * without gaps or overlaps: the baseMediaDecodeTime in the tfdt of every traf
+ * must be that of the traf before it for the same track plus the durations
+ * of its samples. Durations are summed from the truns with the tfhd and trex
+ * defaults applied, only the boxes of moov and moof are read.
+ */
+
+
+/*
+ * Check num_files files, or the files named on the lines of stdin if files
+ * is NULL, in that order. The trex defaults and timescales are taken from
+ * initseg if not NULL, and from any moov in the files. Discontinuities are
+ * printed per track followed by a summary of every track, as are trafs whose
+ * duration is unknown for lack of a default sample duration. Returns
+ * EXIT_SUCCESS if all files could be read and the timeline is continuous.
+ */
+int
+mp4tree_timeline_check(const char * initseg, char ** files, int num_files);
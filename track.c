@@ -0,0 +1,473 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+
+#include "track.h"
+#include "common.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+/* Per thread like the rest of the parser state */
+static _Thread_local mp4tree_tracks_t tracks;
+
+/* Runs of the last moof, not part of the state as they end with its mdat */
+static _Thread_local mp4tree_track_run_t * runs;
+static _Thread_local int                   num_runs;
+static _Thread_local int                   max_runs;
+
+static _Thread_local bool                  evict_warned;
+
+
+static mp4tree_track_t *
+track_add(uint32_t track_id)
+{
+    mp4tree_track_t * track;
+    int               i;
+
+    if (tracks.num_tracks < MP4TREE_TRACKS_MAX)
+    {
+        i = tracks.num_tracks++;
+    }
+    else
+    {
+        i = tracks.oldest;
+        tracks.oldest = (tracks.oldest + 1) % MP4TREE_TRACKS_MAX;
+
+        if (!evict_warned)
+        {
+            fprintf(stderr, "More than %d tracks, the timescale and defaults of track %u "
+                    "are forgotten for track %u\n", MP4TREE_TRACKS_MAX,
+                    tracks.tracks[i].track_id, track_id);
+            evict_warned = true;
+        }
+    }
+
+    track = &tracks.tracks[i];
+    memset(track, 0, sizeof(*track));
+    track->track_id = track_id;
+
+    tracks.current = i;
+    return track;
+}
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+mp4tree_track_t *
+mp4tree_track_select(uint32_t track_id)
+{
+    int i;
+
+    for (i = 0; i < tracks.num_tracks; i++)
+    {
+        if (tracks.tracks[i].track_id == track_id)
+        {
+            tracks.current = i;
+            return &tracks.tracks[i];
+        }
+    }
+
+    return track_add(track_id);
+}
+
+
+mp4tree_track_t *
+mp4tree_track_current(void)
+{
+    if (tracks.current < tracks.num_tracks)
+        return &tracks.tracks[tracks.current];
+
+    return mp4tree_track_select(0);
+}
+
+
+mp4tree_track_t *
+mp4tree_track_find(uint32_t track_id)
+{
+    int i;
+
+    for (i = 0; i < tracks.num_tracks; i++)
+    {
+        if (tracks.tracks[i].track_id == track_id)
+            return &tracks.tracks[i];
+    }
+
+    return NULL;
+}
+
+
+mp4tree_track_printer_t
+mp4tree_track_mdat_printer(void)
+{
+    int i;
+
+    /* Without truns, e.g. in a progressive file, all data goes to one printer */
+    if (tracks.current < tracks.num_tracks &&
+        tracks.tracks[tracks.current].mdat_printer != NULL)
+        return tracks.tracks[tracks.current].mdat_printer;
+
+    for (i = 0; i < tracks.num_tracks; i++)
+    {
+        if (tracks.tracks[i].mdat_printer != NULL)
+            return tracks.tracks[i].mdat_printer;
+    }
+
+    return NULL;
+}
+
+
+void
+mp4tree_track_mdhd(const uint8_t * p, size_t len)
+{
+    /* The timescale follows the creation and modification times */
+    if (len >= 24 && p[0] == 1)
+        mp4tree_track_current()->timescale = get_u32(p + 20);
+    else if (len >= 16 && p[0] == 0)
+        mp4tree_track_current()->timescale = get_u32(p + 12);
+}
+
+
+void
+mp4tree_track_trex(const uint8_t * p, size_t len)
+{
+    mp4tree_track_t * track;
+    mp4tree_trex_t    trex;
+    int               current = tracks.current;
+
+    if (!mp4tree_trex_parse(p, len, &trex))
+        return;
+
+    /* mvex comes after the traks, it does not select anything */
+    track = mp4tree_track_find(trex.track_id);
+    if (track == NULL)
+    {
+        track = track_add(trex.track_id);
+        tracks.current = current;
+    }
+
+    track->has_trex = true;
+    track->trex     = trex;
+}
+
+
+void
+mp4tree_track_moof(uint64_t offset)
+{
+    mp4tree_frag_moof(&tracks.frag, offset);
+    num_runs = 0;
+}
+
+
+void
+mp4tree_track_tfhd(const uint8_t * p, size_t len)
+{
+    mp4tree_track_t * track;
+
+    if (len < 8)
+        return;
+
+    track = mp4tree_track_select(mp4tree_tfhd_track_id(p, len));
+    mp4tree_frag_tfhd(&tracks.frag, p, len, track->has_trex ? &track->trex : NULL);
+}
+
+
+void
+mp4tree_track_trun(const uint8_t * p, size_t len, mp4tree_trun_t * trun)
+{
+    const mp4tree_track_t * track = mp4tree_track_current();
+
+    mp4tree_frag_trun(&tracks.frag, p, len, trun);
+
+    if (trun->size == 0)
+        return;
+
+    if (num_runs == max_runs)
+    {
+        int                   max  = max_runs ? 2 * max_runs : MP4TREE_TRACK_RUNS_MIN;
+        mp4tree_track_run_t * grow = realloc(runs, max * sizeof(*runs));
+
+        if (grow == NULL)
+        {
+            fprintf(stderr, "Out of memory for the truns of the moof at offset %"PRIu64
+                    ", the rest of its sample data is not printed per track\n",
+                    tracks.frag.moof_offset);
+            return;
+        }
+        runs     = grow;
+        max_runs = max;
+    }
+
+    runs[num_runs].track_id = track->track_id;
+    runs[num_runs].offset   = trun->offset;
+    runs[num_runs].size     = trun->size;
+    num_runs++;
+}
+
+
+int
+mp4tree_track_runs(const mp4tree_track_run_t ** track_runs)
+{
+    *track_runs = runs;
+    return num_runs;
+}
+
+
+void
+mp4tree_track_release(void)
+{
+    free(runs);
+    runs     = NULL;
+    num_runs = 0;
+    max_runs = 0;
+}
+
+
+bool
+mp4tree_trex_parse(const uint8_t * p, size_t len, mp4tree_trex_t * trex)
+{
+    /*
+     * aligned(8) class TrackExtendsBox extends FullBox('trex', 0, 0) {
+     *     unsigned int(32) track_ID;
+     *     unsigned int(32) default_sample_description_index;
+     *     unsigned int(32) default_sample_duration;
+     *     unsigned int(32) default_sample_size;
+     *     unsigned int(32) default_sample_flags;
+     * }
+     */
+    if (len < 24)
+        return false;
+
+    trex->track_id                         = get_u32(p + 4);
+    trex->default_sample_description_index = get_u32(p + 8);
+    trex->default_sample_duration          = get_u32(p + 12);
+    trex->default_sample_size              = get_u32(p + 16);
+    trex->default_sample_flags             = get_u32(p + 20);
+    return true;
+}
+
+
+void
+mp4tree_frag_moof(mp4tree_frag_t * frag, uint64_t offset)
+{
+    memset(frag, 0, sizeof(*frag));
+    frag->moof_offset = offset;
+    frag->first_traf  = true;
+    frag->data_end    = offset;
+}
+
+
+uint32_t
+mp4tree_tfhd_track_id(const uint8_t * p, size_t len)
+{
+    return len >= 8 ? get_u32(p + 4) : 0;
+}
+
+
+void
+mp4tree_frag_tfhd(
+    mp4tree_frag_t *       frag,
+    const uint8_t *        p,
+    size_t                 len,
+    const mp4tree_trex_t * trex)
+{
+    const uint8_t * end = p + len;
+    uint32_t        flags;
+
+    if (len < 8)
+        return;
+
+    flags = get_u24(p + 1);
+    frag->track_id = get_u32(p + 4);
+    p += 8;
+
+    frag->has_default_duration = trex != NULL;
+    frag->default_duration     = trex ? trex->default_sample_duration : 0;
+    frag->default_size         = trex ? trex->default_sample_size : 0;
+    frag->default_flags        = trex ? trex->default_sample_flags : 0;
+
+    /*
+     * Without an explicit base the data of the first traf starts at the moof,
+     * and the data of the others after that of the traf before them
+     */
+    if (flags & 0x020000)
+        frag->base = frag->moof_offset;
+    else
+        frag->base = frag->first_traf ? frag->moof_offset : frag->data_end;
+    frag->first_traf = false;
+
+    if ((flags & 0x01) && end - p >= 8)
+    {
+        frag->base = get_u64(p);
+        p += 8;
+    }
+    if ((flags & 0x02) && end - p >= 4)
+        p += 4;
+    if ((flags & 0x08) && end - p >= 4)
+    {
+        frag->default_duration     = get_u32(p);
+        frag->has_default_duration = true;
+        p += 4;
+    }
+    if ((flags & 0x10) && end - p >= 4)
+    {
+        frag->default_size = get_u32(p);
+        p += 4;
+    }
+    if ((flags & 0x20) && end - p >= 4)
+        frag->default_flags = get_u32(p);
+
+    frag->data_end = frag->base;
+}
+
+
+bool
+mp4tree_frag_trun(
+    mp4tree_frag_t * frag,
+    const uint8_t *  p,
+    size_t           len,
+    mp4tree_trun_t * trun)
+{
+    const uint8_t * end = p + len;
+    uint32_t        i;
+    bool            complete;
+
+    memset(trun, 0, sizeof(*trun));
+    trun->default_duration = frag->default_duration;
+    trun->default_size     = frag->default_size;
+    trun->default_flags    = frag->default_flags;
+    trun->offset           = frag->data_end;
+
+    if (len < 8)
+        return false;
+
+    trun->version = p[0];
+    trun->flags   = get_u24(p + 1);
+    trun->samples = get_u32(p + 4);
+    p += 8;
+
+    /* Without a data offset the data follows that of the trun before */
+    if (trun->flags & 0x01)
+    {
+        if (end - p < 4)
+        {
+            trun->samples = 0;
+            return false;
+        }
+        trun->has_data_offset = true;
+        trun->data_offset     = (int32_t)get_u32(p);
+        trun->offset          = frag->base + trun->data_offset;
+        p += 4;
+    }
+
+    if (trun->flags & 0x04)
+    {
+        if (end - p < 4)
+        {
+            trun->samples = 0;
+            return false;
+        }
+        trun->has_first_flags = true;
+        trun->first_flags     = get_u32(p);
+        p += 4;
+    }
+
+    /* Each sample has a 4 byte field for each of the flags 0x100 to 0x800 */
+    trun->stride  = 4 * __builtin_popcount(trun->flags & 0xf00);
+    trun->entries = p;
+    complete      = trun->stride == 0 ||
+                    (uint64_t)trun->samples * trun->stride <= (uint64_t)(end - p);
+
+    if (!complete)
+        trun->samples = (end - p) / trun->stride;
+
+    trun->unknown_duration = trun->samples > 0 && !(trun->flags & 0x100) &&
+                             !frag->has_default_duration;
+
+    if (!(trun->flags & 0x300))
+    {
+        trun->duration = (uint64_t)trun->samples * trun->default_duration;
+        trun->size     = (uint64_t)trun->samples * trun->default_size;
+    }
+    else
+    {
+        for (i = 0; i < trun->samples; i++)
+        {
+            mp4tree_trun_sample_t sample;
+
+            mp4tree_trun_sample(trun, i, &sample);
+            trun->duration += sample.duration;
+            trun->size     += sample.size;
+        }
+    }
+
+    frag->data_end = trun->offset + trun->size;
+    return complete;
+}
+
+
+void
+mp4tree_trun_sample(
+    const mp4tree_trun_t *  trun,
+    uint32_t                i,
+    mp4tree_trun_sample_t * sample)
+{
+    const uint8_t * p = trun->entries + (size_t)i * trun->stride;
+
+    sample->duration   = trun->default_duration;
+    sample->size       = trun->default_size;
+    sample->flags      = trun->default_flags;
+    sample->cts_offset = 0;
+
+    if (trun->flags & 0x100)
+    {
+        sample->duration = get_u32(p);
+        p += 4;
+    }
+    if (trun->flags & 0x200)
+    {
+        sample->size = get_u32(p);
+        p += 4;
+    }
+    if (trun->flags & 0x400)
+    {
+        sample->flags = get_u32(p);
+        p += 4;
+    }
+    if (trun->flags & 0x800)
+        sample->cts_offset = trun->version == 0 ? (int64_t)get_u32(p) : (int64_t)(int32_t)get_u32(p);
+
+    if (i == 0 && trun->has_first_flags)
+        sample->flags = trun->first_flags;
+}
+
+
+void
+mp4tree_track_state_get(mp4tree_tracks_t * state)
+{
+    *state = tracks;
+}
+
+
+void
+mp4tree_track_state_set(const mp4tree_tracks_t * state)
+{
+    tracks = *state;
+}
+
+
+void
+mp4tree_track_reset(void)
+{
+    memset(&tracks, 0, sizeof(tracks));
+    num_runs     = 0;
+    evict_warned = false;
+}
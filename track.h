@@ -0,0 +1,225 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              Track registry                                *
+ ******************************************************************************
+ *
+ * What the boxes of a track say about the rest of the file, keyed by
+ * track_ID: the timescale from mdhd, the sample entry from stsd, encryption
+ * defaults from tenc and fragment defaults from trex. tkhd selects the track
+ * of a trak and tfhd the track of a traf, so boxes printed after them use
+ * the right entry.
+ *
+ * The truns of a moof are also recorded as runs of sample data in the input,
+ * so the mdat after it can be printed track by track. The runs only last
+ * from a moof to its mdat and are kept per thread outside the registry, in
+ * an array that grows with the number of truns.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/* Tracks in the registry, further tracks replace the oldest with a warning */
+#define MP4TREE_TRACKS_MAX 16
+
+/* Runs of sample data allocated at first, doubled as needed */
+#define MP4TREE_TRACK_RUNS_MIN 64
+
+/* Same as mp4tree_parse_func, which mp4tree.h defines after including this */
+typedef void (*mp4tree_track_printer_t)(const uint8_t * p, size_t len, int depth);
+
+/* Fragment defaults of a track from its trex */
+typedef struct mp4tree_trex_struct
+{
+    uint32_t track_id;
+    uint32_t default_sample_description_index;
+    uint32_t default_sample_duration;
+    uint32_t default_sample_size;
+    uint32_t default_sample_flags;
+} mp4tree_trex_t;
+
+typedef struct mp4tree_track_struct
+{
+    uint32_t                track_id;
+    uint8_t                 format[4];    /* Type of the first sample entry in stsd */
+    uint32_t                timescale;    /* From mdhd, 0 if not known */
+    bool                    video;        /* Has a vmhd */
+
+    /* Sample data printer for the codec in stsd, NULL if not known */
+    mp4tree_track_printer_t mdat_printer;
+
+    /* tenc */
+    int                     per_sample_iv_size;
+    int                     constant_iv_size;
+
+    bool                    has_trex;
+    mp4tree_trex_t          trex;
+} mp4tree_track_t;
+
+/* Sample data of one trun */
+typedef struct mp4tree_track_run_struct
+{
+    uint32_t track_id;
+    uint64_t offset;                 /* In the input, see out_offset() */
+    uint64_t size;
+} mp4tree_track_run_t;
+
+/* A moof and its current traf, see mp4tree_frag_tfhd() */
+typedef struct mp4tree_frag_struct
+{
+    uint64_t moof_offset;
+    bool     first_traf;
+    uint64_t data_end;               /* End of the sample data of the last trun */
+    uint64_t base;                   /* Base data offset of the traf */
+    uint32_t track_id;
+    bool     has_default_duration;   /* From trex or tfhd */
+    uint32_t default_duration;
+    uint32_t default_size;
+    uint32_t default_flags;
+} mp4tree_frag_t;
+
+/* A trun with the defaults of its traf applied */
+typedef struct mp4tree_trun_struct
+{
+    uint8_t         version;
+    uint32_t        flags;
+    uint32_t        samples;         /* Sample entries present in the box */
+    bool            has_data_offset;
+    int32_t         data_offset;
+    bool            has_first_flags;
+    uint32_t        first_flags;
+    const uint8_t * entries;         /* Sample entries, stride bytes each */
+    uint32_t        stride;
+    uint32_t        default_duration;
+    uint32_t        default_size;
+    uint32_t        default_flags;
+    uint64_t        offset;          /* Of the sample data, by the traf rules */
+    uint64_t        duration;        /* Sum of the sample durations */
+    uint64_t        size;            /* Sum of the sample sizes */
+    bool            unknown_duration; /* Samples without a duration or a default */
+} mp4tree_trun_t;
+
+/* One sample of a trun */
+typedef struct mp4tree_trun_sample_struct
+{
+    uint32_t duration;
+    uint32_t size;
+    uint32_t flags;
+    int64_t  cts_offset;
+} mp4tree_trun_sample_t;
+
+/* The registry, part of the parser state, see mp4tree_state_get() */
+typedef struct mp4tree_tracks_struct
+{
+    int                 num_tracks;
+    int                 current;     /* Track of the trak or traf being printed, if < num_tracks */
+    int                 oldest;
+    mp4tree_track_t     tracks[MP4TREE_TRACKS_MAX];
+
+    /* The moof being printed */
+    mp4tree_frag_t      frag;
+} mp4tree_tracks_t;
+
+
+/* Select the track of a trak or traf, adding it if it is new */
+mp4tree_track_t *
+mp4tree_track_select(uint32_t track_id);
+
+/* The selected track, track 0 if none has been selected */
+mp4tree_track_t *
+mp4tree_track_current(void);
+
+/* Look up a track without selecting it, NULL if not known */
+mp4tree_track_t *
+mp4tree_track_find(uint32_t track_id);
+
+/* The printer for sample data not described by a trun, NULL if none */
+mp4tree_track_printer_t
+mp4tree_track_mdat_printer(void);
+
+/* Record the timescale of the current track from an mdhd payload */
+void
+mp4tree_track_mdhd(const uint8_t * p, size_t len);
+
+/* Record the payload of a trex box */
+void
+mp4tree_track_trex(const uint8_t * p, size_t len);
+
+/* A moof starts at offset in the input, forgetting the runs of the last one */
+void
+mp4tree_track_moof(uint64_t offset);
+
+/* Select the track of a traf from its tfhd payload and set up its defaults */
+void
+mp4tree_track_tfhd(const uint8_t * p, size_t len);
+
+/*
+ * Record the sample data of a trun payload in the current traf. The trun is
+ * returned in trun with the defaults of the traf applied.
+ */
+void
+mp4tree_track_trun(const uint8_t * p, size_t len, mp4tree_trun_t * trun);
+
+/* Runs of sample data of the last moof, returns their number */
+int
+mp4tree_track_runs(const mp4tree_track_run_t ** runs);
+
+/* Free the runs of the calling thread, e.g. before it exits */
+void
+mp4tree_track_release(void);
+
+/*
+ * Fragment decoding, shared by the registry and by readers with their own
+ * state such as the sample iterator. The base data offset rules of the
+ * tfhd are applied by mp4tree_frag_tfhd() and mp4tree_frag_trun().
+ */
+
+/* Parse a trex payload, false if it is too short */
+bool
+mp4tree_trex_parse(const uint8_t * p, size_t len, mp4tree_trex_t * trex);
+
+/* A moof starts at offset in the input */
+void
+mp4tree_frag_moof(mp4tree_frag_t * frag, uint64_t offset);
+
+/* track_ID of a tfhd payload, 0 if it is too short */
+uint32_t
+mp4tree_tfhd_track_id(const uint8_t * p, size_t len);
+
+/*
+ * Start the traf of a tfhd payload, with the defaults of trex for those the
+ * tfhd does not override. trex is NULL if the track has none.
+ */
+void
+mp4tree_frag_tfhd(mp4tree_frag_t * frag, const uint8_t * p, size_t len,
+                  const mp4tree_trex_t * trex);
+
+/*
+ * Parse a trun payload of the current traf, summing the sample durations
+ * and sizes with the defaults of the traf applied, and move the end of the
+ * sample data of the traf past it. Returns false if the box is too short
+ * for its sample table, which is then parsed as far as it goes.
+ */
+bool
+mp4tree_frag_trun(mp4tree_frag_t * frag, const uint8_t * p, size_t len,
+                  mp4tree_trun_t * trun);
+
+/* Sample i, i < samples, of a trun parsed by mp4tree_frag_trun() */
+void
+mp4tree_trun_sample(const mp4tree_trun_t * trun, uint32_t i,
+                    mp4tree_trun_sample_t * sample);
+
+/* Copy the tracks and fragment defaults of this thread to state */
+void
+mp4tree_track_state_get(mp4tree_tracks_t * state);
+
+/* Make state, from mp4tree_track_state_get(), those of this thread */
+void
+mp4tree_track_state_set(const mp4tree_tracks_t * state);
+
+/* Forget every track and the runs of the last moof, as before any box */
+void
+mp4tree_track_reset(void);
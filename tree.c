@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "tree.h"
+#include "common.h"
+#include "output.h"
+
+
+/*
+ ******************************************************************************
+ *                            Internals                                       *
+ ******************************************************************************
+ */
+
+/* Parse the boxes in [p, end) as children of parent, returns the list */
+static mp4tree_box_t *
+mp4tree_tree_parse_boxes(
+    mp4tree_tree_t * tree,
+    mp4tree_box_t *  parent,
+    const uint8_t *  p,
+    const uint8_t *  end,
+    int              depth,
+    bool *           failed)
+{
+    mp4tree_box_t *  first = NULL;
+    mp4tree_box_t ** link  = &first;
+
+    while (p + 8 <= end)
+    {
+        uint64_t        box_len     = get_u32(p);
+        uint8_t         box_hdr_len = 8;
+        mp4tree_box_t * box;
+
+        if (box_len == 1)
+        {
+            if (p + 16 > end)
+                break;
+            box_len     = get_u64(p + 8);
+            box_hdr_len = 16;
+        }
+        else if (box_len == 0)
+        {
+            box_len = end - p;
+        }
+
+        if (box_len < box_hdr_len)
+            break;
+
+        box = arena_alloc(&tree->arena, sizeof(*box));
+        if (box == NULL)
+        {
+            *failed = true;
+            break;
+        }
+
+        memcpy(box->type, p + 4, 4);
+        box->hdr_len  = box_hdr_len;
+        box->complete = box_len <= (uint64_t)(end - p);
+        box->depth    = depth;
+        box->offset   = p - tree->buf;
+        box->size     = box_len;
+        box->data     = p + box_hdr_len;
+        box->func     = mp4tree_box_printer_get(box->type);
+        box->parent   = parent;
+
+        if (box->complete && box->func == mp4tree_print)
+        {
+            box->children = mp4tree_tree_parse_boxes(tree, box, box->data,
+                                                     p + box_len, depth + 1,
+                                                     failed);
+        }
+
+        tree->num_boxes++;
+        *link = box;
+        link  = &box->next;
+
+        if (!box->complete || *failed)
+            break;
+
+        p += box_len;
+    }
+
+    return first;
+}
+
+
+static void
+mp4tree_tree_render_boxes(const mp4tree_box_t * box)
+{
+    for ( ; box != NULL; box = box->next)
+    {
+        /* A filtered box hides its children as well */
+        if (mp4tree_match_filter(box->type))
+        {
+            /* The node holds a copy of the type, not a pointer into buf */
+            out_set_origin(box->type, box->offset + 4);
+            mp4tree_box_print(box->type, box->size, box->depth);
+
+            if (box->complete)
+            {
+                if (box->func == mp4tree_print)
+                {
+                    mp4tree_tree_render_boxes(box->children);
+                }
+                else
+                {
+                    out_set_origin(box->data, box->offset + box->hdr_len);
+                    box->func(box->data, box->size - box->hdr_len, box->depth + 1);
+                }
+            }
+
+            out_box_end(box->type, box->depth);
+        }
+
+        if (box->depth == 0)
+            out_box_done();
+    }
+}
+
+
+/*
+ ******************************************************************************
+ *                            Public interface                                *
+ ******************************************************************************
+ */
+
+mp4tree_tree_t *
+mp4tree_tree_create(const uint8_t * buf, size_t len)
+{
+    mp4tree_tree_t * tree = calloc(1, sizeof(*tree));
+
+    if (tree == NULL)
+        return NULL;
+
+    arena_init(&tree->arena, 0);
+    tree->buf = buf;
+    tree->len = len;
+
+    return tree;
+}
+
+
+mp4tree_tree_t *
+mp4tree_tree_parse(const uint8_t * buf, size_t len)
+{
+    mp4tree_tree_t * tree   = mp4tree_tree_create(buf, len);
+    bool             failed = false;
+
+    if (tree == NULL)
+        return NULL;
+
+    tree->boxes = mp4tree_tree_parse_boxes(tree, NULL, buf, buf + len, 0, &failed);
+
+    if (failed)
+    {
+        mp4tree_tree_free(tree);
+        return NULL;
+    }
+
+    return tree;
+}
+
+
+void
+mp4tree_tree_render(const mp4tree_tree_t * tree)
+{
+    mp4tree_tree_render_boxes(tree->boxes);
+}
+
+
+const mp4tree_box_t *
+mp4tree_tree_find(const mp4tree_box_t * first, const char * type)
+{
+    for ( ; first != NULL; first = first->next)
+    {
+        if (memcmp(first->type, type, 4) == 0)
+            return first;
+    }
+
+    return NULL;
+}
+
+
+void
+mp4tree_tree_free(mp4tree_tree_t * tree)
+{
+    if (tree == NULL)
+        return;
+
+    arena_free(&tree->arena);
+    free(tree);
+}
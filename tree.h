@@ -0,0 +1,66 @@
+#pragma once
+
+/*
+ ******************************************************************************
+ *                              Box tree                                      *
+ ******************************************************************************
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "arena.h"
+#include "mp4tree.h"
+
+
+typedef struct mp4tree_box_struct mp4tree_box_t;
+
+struct mp4tree_box_struct
+{
+    uint8_t            type[4];
+    uint8_t            hdr_len;   /* 8, or 16 for large size boxes */
+    bool               complete;  /* Whole box is inside the buffer */
+    int                depth;
+    uint64_t           offset;    /* Offset of the box header in the buffer */
+    uint64_t           size;      /* Box size including the header */
+    const uint8_t *    data;      /* Payload, not copied */
+    mp4tree_parse_func func;      /* Payload printer */
+    mp4tree_box_t *    parent;
+    mp4tree_box_t *    children;
+    mp4tree_box_t *    next;
+};
+
+typedef struct mp4tree_tree_struct
+{
+    arena_t         arena;
+    const uint8_t * buf;
+    size_t          len;
+    mp4tree_box_t * boxes;      /* First top-level box */
+    size_t          num_boxes;
+} mp4tree_tree_t;
+
+
+/* Create a tree without boxes over buf, for building it from elsewhere */
+mp4tree_tree_t *
+mp4tree_tree_create(const uint8_t * buf, size_t len);
+
+/*
+ * Parse the box structure of buf into a tree. Containers are descended,
+ * other payloads are referenced in place and decoded when rendered.
+ * buf must outlive the tree. Returns NULL on allocation failure.
+ */
+mp4tree_tree_t *
+mp4tree_tree_parse(const uint8_t * buf, size_t len);
+
+/* Print a parsed tree, producing the same output as mp4tree_print() */
+void
+mp4tree_tree_render(const mp4tree_tree_t * tree);
+
+/* Find the first box of a type in a list of siblings */
+const mp4tree_box_t *
+mp4tree_tree_find(const mp4tree_box_t * first, const char * type);
+
+/* Free the tree and all its boxes */
+void
+mp4tree_tree_free(mp4tree_tree_t * tree);